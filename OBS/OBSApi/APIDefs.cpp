@@ -160,6 +160,8 @@ AudioSource* OBSGetMicAudioSource()         {return API->GetMicAudioSource();}
 void OBSGetCurDesktopVolumeStats(float *rms, float *max, float *peak)   {API->GetCurDesktopVolumeStats(rms, max, peak);}
 void OBSGetCurMicVolumeStats(float *rms, float *max, float *peak)       {API->GetCurMicVolumeStats(rms, max, peak);}
 
+bool OBSGetAudioSourceLevels(AudioSource *source, AudioLevels &levels)  {return API->GetAudioSourceLevels(source, levels);}
+
 void OBSAddSettingsPane(SettingsPane *pane)     {API->AddSettingsPane(pane);}
 void OBSRemoveSettingsPane(SettingsPane *pane)  {API->RemoveSettingsPane(pane);}
 
@@ -37,6 +37,14 @@ enum StreamInfoPriority
     StreamInfoPriority_Critical,
 };
 
+//levels of one 10ms buffer of an audio source as it was mixed, after its volume.  linear, 1.0 is full scale
+struct AudioLevels
+{
+    float rms;
+    float peak;         //highest sample
+    float truePeak;     //highest point of the signal, between samples too, estimated by oversampling 4x
+};
+
 //-------------------------------------------------------------------
 // API interface, plugins should not ever use, use C funcs below
 
@@ -197,6 +205,8 @@ public:
     virtual bool SetSceneCollection(CTSTR lpCollection, CTSTR lpScene) = 0;
     virtual CTSTR GetSceneCollectionName() const = 0;
     virtual void GetSceneCollectionNames(StringList &list) const = 0;
+
+    virtual bool GetAudioSourceLevels(AudioSource *source, AudioLevels &levels) const=0;
 };
 
 BASE_EXPORT extern APIInterface *API;
@@ -324,6 +334,9 @@ BASE_EXPORT AudioSource* OBSGetMicAudioSource();
 BASE_EXPORT void OBSGetCurDesktopVolumeStats(float *rms, float *max, float *peak);
 BASE_EXPORT void OBSGetCurMicVolumeStats(float *rms, float *max, float *peak);
 
+//levels of the desktop, mic or an aux source in the last buffer mixed.  returns false if the source isn't being mixed
+BASE_EXPORT bool OBSGetAudioSourceLevels(AudioSource *source, AudioLevels &levels);
+
 BASE_EXPORT void OBSAddSettingsPane(SettingsPane *pane);
 BASE_EXPORT void OBSRemoveSettingsPane(SettingsPane *pane);
 
@@ -0,0 +1,414 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#include "AudioDownmix.h"
+#include <emmintrin.h>
+#include <string.h>
+
+
+static const float dbMinus3 = 0.7071067811865476f;
+static const float dbMinus6 = 0.5f;
+
+// According to ITU-R  BS.775-1 recommendation, the downmix from a 3/2 source to stereo
+// is the following:
+// L = FL + k0*C + k1*RL
+// R = FR + k0*C + k1*RR
+// FL = front left
+// FR = front right
+// C  = center
+// RL = rear left
+// RR = rear right
+// k0 = centerMix   = dbMinus3 = 0.7071067811865476 [for k0 we can use dbMinus6 = 0.5 too, probably it's better]
+// k1 = surroundMix = dbMinus3 = 0.7071067811865476
+
+// The output (L,R) can be out of (-1,1) domain so we attenuate it [ attn5dot1 = 1/(1 + centerMix + surroundMix) ]
+// Note: this method of downmixing is far from "perfect" (pretty sure it's not the correct way) but the resulting downmix is "okayish", at least no more bleeding ears.
+// (maybe have a look at http://forum.doom9.org/archive/index.php/t-148228.html too [ 5.1 -> stereo ] the approach seems almost the same [but different coefficients])
+
+// http://acousticsfreq.com/blog/wp-content/uploads/2012/01/ITU-R-BS775-1.pdf
+// http://ir.lib.nctu.edu.tw/bitstream/987654321/22934/1/030104001.pdf
+
+//not entirely sure if these are the correct coefficients for downmixing,
+//I'm fairly new to the whole multi speaker thing
+const float downmixSurroundMix  = dbMinus3;
+const float downmixCenterMix    = dbMinus6;
+const float downmixSurroundMix4 = dbMinus6;
+
+const float downmixAttn5dot1 = 1.0f / (1.0f + downmixCenterMix + downmixSurroundMix);
+const float downmixAttn4dotX = 1.0f / (1.0f + downmixSurroundMix4);
+
+//-----------------------------------------------------------------------------
+// input formats.  Load4 converts four samples and Load1 one, to the integer value as a float; Scale() is what
+// takes that to -1..1, and it's applied along with the volume.
+
+struct FormatInt8
+{
+    enum {sampleSize = 1, bFloat = false};
+
+    static inline float Scale() {return 1.0f/127.0f;}
+
+    static inline __m128 Load4(const unsigned char *in)
+    {
+        int val;
+        memcpy(&val, in, 4);
+
+        //put each byte at the top of its int, then shift it back down with the sign
+        __m128i samples = _mm_cvtsi32_si128(val);
+        samples = _mm_unpacklo_epi8(samples, samples);
+        samples = _mm_unpacklo_epi16(samples, samples);
+        return _mm_cvtepi32_ps(_mm_srai_epi32(samples, 24));
+    }
+
+    static inline float Load1(const unsigned char *in) {return float(*(const signed char*)in);}
+};
+
+struct FormatInt16
+{
+    enum {sampleSize = 2, bFloat = false};
+
+    static inline float Scale() {return 1.0f/32767.0f;}
+
+    static inline __m128 Load4(const unsigned char *in)
+    {
+        __m128i samples = _mm_loadl_epi64((const __m128i*)in);
+        samples = _mm_unpacklo_epi16(samples, samples);
+        return _mm_cvtepi32_ps(_mm_srai_epi32(samples, 16));
+    }
+
+    static inline float Load1(const unsigned char *in)
+    {
+        short val;
+        memcpy(&val, in, 2);
+        return float(val);
+    }
+};
+
+struct FormatInt24
+{
+    enum {sampleSize = 3, bFloat = false};
+
+    static inline float Scale() {return 1.0f/8388607.0f;}
+
+    static inline int Read(const unsigned char *in)
+    {
+        return int((unsigned int)in[0]<<8 | (unsigned int)in[1]<<16 | (unsigned int)in[2]<<24) >> 8;
+    }
+
+    static inline __m128 Load4(const unsigned char *in)
+    {
+        return _mm_cvtepi32_ps(_mm_setr_epi32(Read(in), Read(in+3), Read(in+6), Read(in+9)));
+    }
+
+    static inline float Load1(const unsigned char *in) {return float(Read(in));}
+};
+
+struct FormatInt32
+{
+    enum {sampleSize = 4, bFloat = false};
+
+    static inline float Scale() {return 1.0f/2147483647.0f;}
+
+    static inline __m128 Load4(const unsigned char *in)
+    {
+        return _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)in));
+    }
+
+    static inline float Load1(const unsigned char *in)
+    {
+        int val;
+        memcpy(&val, in, 4);
+        return float(val);
+    }
+};
+
+struct FormatFloat
+{
+    enum {sampleSize = 4, bFloat = true};
+
+    static inline float Scale() {return 1.0f;}
+
+    static inline __m128 Load4(const unsigned char *in) {return _mm_loadu_ps((const float*)in);}
+
+    static inline float Load1(const unsigned char *in)
+    {
+        float val;
+        memcpy(&val, in, 4);
+        return val;
+    }
+};
+
+//-----------------------------------------------------------------------------
+// speaker layouts.  Mix takes four frames of float samples and writes them as four stereo frames, scaled by the
+// coefficients Coefficients() set up for the gain.  two frames make one output vector: [L0 R0 L1 R1].
+
+//channels c and c+1 of two frames
+template<unsigned int channels> inline __m128 TwoFramePair(const float *in, unsigned int c)
+{
+    __m128 val = _mm_loadl_pi(_mm_setzero_ps(), (const __m64*)(in+c));
+    return _mm_loadh_pi(val, (const __m64*)(in+channels+c));
+}
+
+//channel c of two frames, going to both left and right
+template<unsigned int channels> inline __m128 TwoFrameBoth(const float *in, unsigned int c)
+{
+    __m128 val = _mm_unpacklo_ps(_mm_load_ss(in+c), _mm_load_ss(in+channels+c));
+    return _mm_unpacklo_ps(val, val);
+}
+
+struct LayoutMono
+{
+    enum {channels = 1};
+
+    static inline void Coefficients(float gain, __m128 *k) {k[0] = _mm_set1_ps(gain);}
+
+    static inline void Mix(const float *in, const __m128 *k, float *out)
+    {
+        __m128 val = _mm_loadu_ps(in);
+        _mm_storeu_ps(out,   _mm_mul_ps(_mm_unpacklo_ps(val, val), k[0]));
+        _mm_storeu_ps(out+4, _mm_mul_ps(_mm_unpackhi_ps(val, val), k[0]));
+    }
+};
+
+struct LayoutStereo
+{
+    enum {channels = 2};
+
+    static inline void Coefficients(float gain, __m128 *k) {k[0] = _mm_set1_ps(gain);}
+
+    static inline void Mix(const float *in, const __m128 *k, float *out)
+    {
+        _mm_storeu_ps(out,   _mm_mul_ps(_mm_loadu_ps(in),   k[0]));
+        _mm_storeu_ps(out+4, _mm_mul_ps(_mm_loadu_ps(in+4), k[0]));
+    }
+};
+
+//  front left and right, plus optionally a center channel and one or two more left/right pairs (rear and side),
+//each with its own coefficient in k[0] to k[3].  anything else in the frame (LFE, front left/right of center,
+//back center) is dropped.  negative channel numbers mean the layout doesn't have that channel.
+template<unsigned int numChannels, int center, int rear, int side> struct LayoutSurround
+{
+    enum {channels = numChannels};
+
+    static inline __m128 MixTwoFrames(const float *in, const __m128 *k)
+    {
+        __m128 out = _mm_mul_ps(TwoFramePair<channels>(in, 0), k[0]);
+        if(center >= 0)
+            out = _mm_add_ps(out, _mm_mul_ps(TwoFrameBoth<channels>(in, center), k[1]));
+        if(rear >= 0)
+            out = _mm_add_ps(out, _mm_mul_ps(TwoFramePair<channels>(in, rear), k[2]));
+        if(side >= 0)
+            out = _mm_add_ps(out, _mm_mul_ps(TwoFramePair<channels>(in, side), k[3]));
+        return out;
+    }
+
+    static inline void Mix(const float *in, const __m128 *k, float *out)
+    {
+        _mm_storeu_ps(out,   MixTwoFrames(in, k));
+        _mm_storeu_ps(out+4, MixTwoFrames(in+channels*2, k));
+    }
+};
+
+//drops LFE
+struct Layout2Point1 : LayoutSurround<3, -1, -1, -1>
+{
+    static inline void Coefficients(float gain, __m128 *k) {k[0] = _mm_set1_ps(gain);}
+};
+
+//drops center and LFE
+struct Layout3Point1 : LayoutSurround<4, -1, -1, -1>
+{
+    static inline void Coefficients(float gain, __m128 *k) {k[0] = _mm_set1_ps(gain);}
+};
+
+// When in doubt, use only left and right :) Seriously.
+// THIS NEEDS TO BE PROPERLY IMPLEMENTED!
+struct LayoutBasicSurround : LayoutSurround<4, -1, -1, -1>
+{
+    static inline void Coefficients(float gain, __m128 *k) {k[0] = _mm_set1_ps(gain);}
+};
+
+//left and right plus rear left and right, same idea as the 5.1 downmix
+struct LayoutQuad : LayoutSurround<4, -1, 2, -1>
+{
+    static inline void Coefficients(float gain, __m128 *k)
+    {
+        k[0] = _mm_set1_ps(gain*downmixAttn4dotX);
+        k[2] = _mm_set1_ps(gain*downmixSurroundMix4*downmixAttn4dotX);
+    }
+};
+
+//quad with LFE at 2, which is dropped
+struct Layout4Point1 : LayoutSurround<5, -1, 3, -1>
+{
+    static inline void Coefficients(float gain, __m128 *k) {LayoutQuad::Coefficients(gain, k);}
+};
+
+// Both 5.1 speakers configs share the same format, the difference is in rear speakers position
+// See: http://msdn.microsoft.com/en-us/library/windows/hardware/ff537083(v=vs.85).aspx
+// Probably for KSAUDIO_SPEAKER_5POINT1_SURROUND we will need a different coefficient for rear left/right
+struct Layout5Point1 : LayoutSurround<6, 2, 4, -1>
+{
+    static inline void Coefficients(float gain, __m128 *k)
+    {
+        k[0] = _mm_set1_ps(gain*downmixAttn5dot1);
+        k[1] = _mm_set1_ps(gain*downmixCenterMix*downmixAttn5dot1);
+        k[2] = _mm_set1_ps(gain*downmixSurroundMix*downmixAttn5dot1);
+    }
+};
+
+// According to http://msdn.microsoft.com/en-us/library/windows/hardware/ff537083(v=vs.85).aspx
+// KSAUDIO_SPEAKER_7POINT1 is obsolete and no longer supported in Windows Vista and later versions of Windows
+// Not sure what to do about it, meh , drop front left of center/front right of center -> 5.1 -> stereo;
+struct Layout7Point1 : LayoutSurround<8, 2, 4, -1>
+{
+    static inline void Coefficients(float gain, __m128 *k) {Layout5Point1::Coefficients(gain, k);}
+};
+
+//the rear and side pairs are averaged into the 5.1 surround pair, then it's downmixed as 5.1
+struct Layout7Point1Surround : LayoutSurround<8, 2, 4, 6>
+{
+    static inline void Coefficients(float gain, __m128 *k)
+    {
+        Layout5Point1::Coefficients(gain, k);
+        k[2] = k[3] = _mm_set1_ps(gain*0.5f*downmixSurroundMix*downmixAttn5dot1);
+    }
+};
+
+//-----------------------------------------------------------------------------
+
+template<typename Format, typename Layout> void Downmix(const void *input, float *output, unsigned int numFrames, float volume)
+{
+    const unsigned int channels = Layout::channels;
+    const unsigned char *in = (const unsigned char*)input;
+
+    __m128 k[4];
+    Layout::Coefficients(volume*Format::Scale(), k);
+
+    //four frames converted to float
+    __m128 frames[channels];
+
+    unsigned int alignedFrames = numFrames & 0xFFFFFFFC;
+    for(unsigned int i=0; i<alignedFrames; i += 4)
+    {
+        const unsigned char *frameIn = in + i*channels*Format::sampleSize;
+
+        if(Format::bFloat)
+            Layout::Mix((const float*)frameIn, k, output+i*2);
+        else
+        {
+            for(unsigned int c=0; c<channels; c++)
+                frames[c] = Format::Load4(frameIn + c*4*Format::sampleSize);
+
+            Layout::Mix((const float*)frames, k, output+i*2);
+        }
+    }
+
+    //the last few frames are padded out to four with silence
+    unsigned int numLeft = numFrames-alignedFrames;
+    if(numLeft)
+    {
+        const unsigned char *frameIn = in + alignedFrames*channels*Format::sampleSize;
+        float *tail = (float*)frames;
+
+        for(unsigned int i=0; i<numLeft*channels; i++)
+            tail[i] = Format::Load1(frameIn + i*Format::sampleSize);
+        for(unsigned int i=numLeft*channels; i<4*channels; i++)
+            tail[i] = 0.0f;
+
+        __m128 out[2];
+        Layout::Mix(tail, k, (float*)out);
+        memcpy(output+alignedFrames*2, out, numLeft*2*sizeof(float));
+    }
+}
+
+template<typename Format> void DownmixFrontPair(const void *input, float *output, unsigned int numFrames, unsigned int channels, float volume)
+{
+    const unsigned char *in = (const unsigned char*)input;
+    const unsigned int frameSize = channels*Format::sampleSize;
+    const float gain = volume*Format::Scale();
+
+    for(unsigned int i=0; i<numFrames; i++)
+    {
+        const unsigned char *frameIn = in + i*frameSize;
+        output[i*2]   = Format::Load1(frameIn)*gain;
+        output[i*2+1] = Format::Load1(frameIn+Format::sampleSize)*gain;
+    }
+}
+
+#define DOWNMIX_LAYOUTS(format) \
+    {                                                   \
+        &Downmix<format, LayoutMono>,                   \
+        &Downmix<format, LayoutStereo>,                 \
+        &Downmix<format, LayoutQuad>,                   \
+        &Downmix<format, Layout2Point1>,                \
+        &Downmix<format, Layout3Point1>,                \
+        &Downmix<format, Layout4Point1>,                \
+        &Downmix<format, LayoutBasicSurround>,          \
+        &Downmix<format, Layout5Point1>,                \
+        &Downmix<format, Layout7Point1>,                \
+        &Downmix<format, Layout7Point1Surround>,        \
+    }
+
+static const DownmixProc downmixProcs[DOWNMIX_NUM_FORMATS][DOWNMIX_NUM_LAYOUTS] =
+{
+    DOWNMIX_LAYOUTS(FormatInt8),
+    DOWNMIX_LAYOUTS(FormatInt16),
+    DOWNMIX_LAYOUTS(FormatInt24),
+    DOWNMIX_LAYOUTS(FormatInt32),
+    DOWNMIX_LAYOUTS(FormatFloat),
+};
+
+static const unsigned int downmixChannels[DOWNMIX_NUM_LAYOUTS] = {1, 2, 4, 3, 4, 5, 4, 6, 8, 8};
+
+static const char *downmixLayoutNames[DOWNMIX_NUM_LAYOUTS] =
+{
+    "mono", "stereo", "quad", "2.1", "3.1", "4.1", "surround", "5.1", "7.1", "7.1 surround"
+};
+
+DownmixProc GetDownmixProc(DownmixFormat format, DownmixLayout layout)
+{
+    if(format >= DOWNMIX_NUM_FORMATS || layout >= DOWNMIX_NUM_LAYOUTS)
+        return 0;
+
+    return downmixProcs[format][layout];
+}
+
+static const FrontPairProc frontPairProcs[DOWNMIX_NUM_FORMATS] =
+{
+    &DownmixFrontPair<FormatInt8>,
+    &DownmixFrontPair<FormatInt16>,
+    &DownmixFrontPair<FormatInt24>,
+    &DownmixFrontPair<FormatInt32>,
+    &DownmixFrontPair<FormatFloat>,
+};
+
+FrontPairProc GetFrontPairProc(DownmixFormat format)
+{
+    return format < DOWNMIX_NUM_FORMATS ? frontPairProcs[format] : 0;
+}
+
+unsigned int GetDownmixChannels(DownmixLayout layout)
+{
+    return layout < DOWNMIX_NUM_LAYOUTS ? downmixChannels[layout] : 0;
+}
+
+const char* GetDownmixLayoutName(DownmixLayout layout)
+{
+    return layout < DOWNMIX_NUM_LAYOUTS ? downmixLayoutNames[layout] : "unknown";
+}
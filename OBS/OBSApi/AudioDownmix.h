@@ -0,0 +1,74 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#pragma once
+
+//  Turns a packet of captured audio into stereo float at the given volume in one pass: the samples are converted
+//to float, mixed down (or up) to stereo and scaled together, four frames at a time with SSE2.  there's a kernel for
+//every input format and speaker layout AudioSource handles.  nothing in here depends on windows, so the tools can
+//build it too.
+
+enum DownmixFormat
+{
+    DOWNMIX_INT8,
+    DOWNMIX_INT16,
+    DOWNMIX_INT24,
+    DOWNMIX_INT32,
+    DOWNMIX_FLOAT,
+
+    DOWNMIX_NUM_FORMATS
+};
+
+enum DownmixLayout
+{
+    DOWNMIX_MONO,
+    DOWNMIX_STEREO,
+    DOWNMIX_QUAD,
+    DOWNMIX_2POINT1,
+    DOWNMIX_3POINT1,
+    DOWNMIX_4POINT1,
+    DOWNMIX_SURROUND,
+    DOWNMIX_5POINT1,
+    DOWNMIX_7POINT1,
+    DOWNMIX_7POINT1_SURROUND,
+
+    DOWNMIX_NUM_LAYOUTS
+};
+
+//input is numFrames interleaved frames in the kernel's format and layout, output gets numFrames*2 floats
+typedef void (*DownmixProc)(const void *input, float *output, unsigned int numFrames, float volume);
+
+DownmixProc GetDownmixProc(DownmixFormat format, DownmixLayout layout);
+
+//for frames with a channel count or mask none of the layouts match: keeps front left and right (the first two
+//channels, as every KSAUDIO_SPEAKER_* mask has them) and drops the rest.  slower than the layout kernels.
+typedef void (*FrontPairProc)(const void *input, float *output, unsigned int numFrames, unsigned int channels, float volume);
+
+FrontPairProc GetFrontPairProc(DownmixFormat format);
+
+unsigned int GetDownmixChannels(DownmixLayout layout);
+const char* GetDownmixLayoutName(DownmixLayout layout);
+
+//how much of the center and surround channels goes into left and right, and the attenuation that keeps the sum
+//in range.  used by the kernels, and by anything that wants to check them.
+extern const float downmixCenterMix;
+extern const float downmixSurroundMix;
+extern const float downmixSurroundMix4;
+extern const float downmixAttn5dot1;
+extern const float downmixAttn4dotX;
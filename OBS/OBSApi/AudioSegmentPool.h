@@ -0,0 +1,134 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#pragma once
+
+//  segments are recycled instead of being freed and allocated again every 10ms.  plugins and filters still
+//create and delete segments with new/delete, so a pooled segment is an ordinary AudioSegment whose sample
+//buffer is kept while it's queued and after it's been used, and only grown when a packet needs more.
+//
+//  the pool is zeroed by its owner rather than constructed.  nothing in here depends on windows, so the tools can
+//build it too; AudioSegment, ReAllocate, mcpy and zero have to be declared before it's included, as OBSApi.h does.
+
+const UINT segmentPoolSize = 32;
+
+struct PooledSegment
+{
+    AudioSegment *segment;
+    float        *storage;
+    UINT         capacity;      //floats storage holds
+    bool         bInUse;
+};
+
+struct AudioSegmentPool
+{
+    PooledSegment slots[segmentPoolSize];
+    UINT      numQueuedSegments;
+    UINT      numSegmentAllocs;
+
+    AudioSegment* GetSegment(float *data, UINT numFloats, QWORD timestamp)
+    {
+        numQueuedSegments++;
+
+        PooledSegment *emptySlot = NULL;
+        for(UINT i=0; i<segmentPoolSize; i++)
+        {
+            PooledSegment &slot = slots[i];
+            if(!slot.segment)
+            {
+                if(!emptySlot)
+                    emptySlot = &slot;
+            }
+            else if(!slot.bInUse)
+            {
+                //detach the buffer so the list doesn't free it, grow it if it has to, and hand it back at the new size
+                float *array;
+                UINT num;
+                slot.segment->audioData.TransferTo(array, num);
+                if(numFloats > slot.capacity)
+                {
+                    slot.storage = (float*)ReAllocate(slot.storage, numFloats*sizeof(float));
+                    slot.capacity = numFloats;
+                    numSegmentAllocs++;
+                }
+                slot.segment->audioData.TransferFrom(slot.storage, numFloats);
+                mcpy(slot.storage, data, numFloats*sizeof(float));
+
+                slot.segment->timestamp = timestamp;
+                slot.bInUse = true;
+                return slot.segment;
+            }
+        }
+
+        AudioSegment *segment = new AudioSegment(data, numFloats, timestamp);
+        numSegmentAllocs += 2;
+
+        if(emptySlot)
+        {
+            emptySlot->segment  = segment;
+            emptySlot->storage  = segment->audioData.Array();
+            emptySlot->capacity = numFloats;
+            emptySlot->bInUse   = true;
+        }
+
+        return segment;
+    }
+
+    void RecycleSegment(AudioSegment *segment)
+    {
+        for(UINT i=0; i<segmentPoolSize; i++)
+        {
+            PooledSegment &slot = slots[i];
+            if(slot.segment == segment && slot.bInUse)
+            {
+                //a filter may have swapped the buffer for its own or resized it, and List::SetSize reallocates to
+                //the exact size even when the buffer doesn't move, so only what the list holds now can be counted on
+                slot.storage  = segment->audioData.Array();
+                slot.capacity = segment->audioData.Num();
+                slot.bInUse = false;
+                return;
+            }
+        }
+
+        delete segment;
+    }
+
+    //a filter dropped or replaced the segment, and may have deleted it
+    void ForgetSegment(AudioSegment *segment)
+    {
+        for(UINT i=0; i<segmentPoolSize; i++)
+        {
+            if(slots[i].segment == segment && slots[i].bInUse)
+            {
+                zero(&slots[i], sizeof(PooledSegment));
+                return;
+            }
+        }
+    }
+
+    //the queued segments have to have been recycled first
+    void FreeSegments()
+    {
+        for(UINT i=0; i<segmentPoolSize; i++)
+        {
+            delete slots[i].segment;
+            slots[i].segment = NULL;
+        }
+    }
+};
@@ -20,49 +20,107 @@
 #include "OBSApi.h"
 #include <Audioclient.h>
 #include "../libsamplerate/samplerate.h"
+#include "AudioDownmix.h"
+#include "AudioSegmentPool.h"
 
 #define KSAUDIO_SPEAKER_4POINT1     (KSAUDIO_SPEAKER_QUAD|SPEAKER_LOW_FREQUENCY)
 #define KSAUDIO_SPEAKER_3POINT1     (KSAUDIO_SPEAKER_STEREO|SPEAKER_FRONT_CENTER|SPEAKER_LOW_FREQUENCY)
 #define KSAUDIO_SPEAKER_2POINT1     (KSAUDIO_SPEAKER_STEREO|SPEAKER_LOW_FREQUENCY)
 
 
-void MultiplyAudioBuffer(float *buffer, int totalFloats, float mulVal)
+/* astoundingly disgusting hack to get more variables into the class without breaking API */
+struct NotAResampler
 {
-    float sum = 0.0f;
-    int totalFloatsStore = totalFloats;
+    SRC_STATE *resampler;
+    QWORD     jumpRange;
+
+    AudioSegmentPool segmentPool;
 
-    if((UPARAM(buffer) & 0xF) == 0)
+    //audioSegments is the storage of a ring of the queued segments, oldest first.  its size is the ring's
+    //capacity (a power of two), and these are where the ring starts and how many segments are in it.  the
+    //segments are in timestamp order unless a burst added one out of order and SortAudio hasn't run since.
+    UINT      firstSegment;
+    UINT      segmentCount;
+    bool      bSegmentsUnsorted;
+
+    //converts, mixes to stereo and applies the volume, for the input format and speaker layout.  when no layout
+    //matches, frontPair takes front left/right out of frames of inputChannels instead, and when the format isn't
+    //supported both are NULL and the source outputs silence.
+    DownmixProc downmix;
+    FrontPairProc frontPair;
+
+    inline AudioSegment*& QueuedSegment(List<AudioSegment*> &ring, UINT i)
     {
-        UINT alignedFloats = totalFloats & 0xFFFFFFFC;
-        __m128 sseMulVal = _mm_set_ps1(mulVal);
+        return ring[(firstSegment+i) & (ring.Num()-1)];
+    }
 
-        for(UINT i=0; i<alignedFloats; i += 4)
-        {
-            __m128 sseScaledVals = _mm_mul_ps(_mm_load_ps(buffer+i), sseMulVal);
-            _mm_store_ps(buffer+i, sseScaledVals);
-        }
+    void PushSegment(List<AudioSegment*> &ring, AudioSegment *segment);
+    AudioSegment* PopSegment(List<AudioSegment*> &ring);
+    UINT CountSegmentsBefore(List<AudioSegment*> &ring, QWORD timestamp);
+};
+
+#define MoreVariables static_cast<NotAResampler*>(resampler)
 
-        buffer      += alignedFloats;
-        totalFloats -= alignedFloats;
+void NotAResampler::PushSegment(List<AudioSegment*> &ring, AudioSegment *segment)
+{
+    if(segmentCount == ring.Num())
+    {
+        //full, so unwrap it into a ring twice the size
+        List<AudioSegment*> newRing;
+        newRing.SetSize(MAX(ring.Num()*2, 16));
+        for(UINT i=0; i<segmentCount; i++)
+            newRing[i] = QueuedSegment(ring, i);
+
+        ring.TransferFrom(newRing);
+        firstSegment = 0;
     }
 
-    for(int i=0; i<totalFloats; i++)
-        buffer[i] *= mulVal;
+    if(segmentCount && segment->timestamp < QueuedSegment(ring, segmentCount-1)->timestamp)
+        bSegmentsUnsorted = true;
+
+    QueuedSegment(ring, segmentCount++) = segment;
 }
 
-/* astoundingly disgusting hack to get more variables into the class without breaking API */
-struct NotAResampler
+AudioSegment* NotAResampler::PopSegment(List<AudioSegment*> &ring)
 {
-    SRC_STATE *resampler;
-    QWORD     jumpRange;
-};
+    AudioSegment *segment = QueuedSegment(ring, 0);
+    firstSegment = (firstSegment+1) & (ring.Num()-1);
 
-#define MoreVariables static_cast<NotAResampler*>(resampler)
+    if(!--segmentCount)
+        bSegmentsUnsorted = false;
+
+    return segment;
+}
+
+//number of segments at the front of the queue that are older than timestamp
+UINT NotAResampler::CountSegmentsBefore(List<AudioSegment*> &ring, QWORD timestamp)
+{
+    if(bSegmentsUnsorted)
+    {
+        UINT count = 0;
+        while(count < segmentCount && QueuedSegment(ring, count)->timestamp < timestamp)
+            count++;
+        return count;
+    }
+
+    UINT low = 0, high = segmentCount;
+    while(low < high)
+    {
+        UINT mid = (low+high)/2;
+        if(QueuedSegment(ring, mid)->timestamp < timestamp)
+            low = mid+1;
+        else
+            high = mid;
+    }
+
+    return low;
+}
 
 AudioSource::AudioSource()
 {
     sourceVolume = 1.0f;
     resampler = (void*)new NotAResampler;
+    zero(resampler, sizeof(NotAResampler));
     MoreVariables->jumpRange = 70;
 }
 
@@ -71,24 +129,15 @@ AudioSource::~AudioSource()
     if(bResample)
         src_delete(MoreVariables->resampler);
 
-    for(UINT i=0; i<audioSegments.Num(); i++)
-        delete audioSegments[i];
+    while(MoreVariables->segmentCount)
+        MoreVariables->segmentPool.RecycleSegment(MoreVariables->PopSegment(audioSegments));
+
+    MoreVariables->segmentPool.FreeSegments();
 
     delete (NotAResampler*)resampler;
 }
 
 
-union TripleToLong
-{
-    LONG val;
-    struct 
-    {
-        WORD wVal;
-        BYTE tripleVal;
-        BYTE lastByte;
-    };
-};
-
 void AudioSource::InitAudioData(bool bFloat, UINT channels, UINT samplesPerSec, UINT bitsPerSample, UINT blockSize, DWORD channelMask)
 {
     this->bFloat = bFloat;
@@ -172,32 +221,68 @@ void AudioSource::InitAudioData(bool bFloat, UINT channels, UINT samplesPerSec,
                 case 6: inputChannelMask = KSAUDIO_SPEAKER_5POINT1; break;
                 case 8: inputChannelMask = KSAUDIO_SPEAKER_7POINT1; break;
                 default:
-                    CrashError(TEXT("Unknown speaker setup, no downmixer available."));
+                    AppWarning(TEXT("AudioSource::InitAudioData: No downmixer for %u channels, only front left and right will be used"), inputChannels);
             }
         }
     }
-}
 
+    //-------------------------------------------------------------------------
 
-const float dbMinus3    = 0.7071067811865476f;
-const float dbMinus6    = 0.5f;
-const float dbMinus9    = 0.3535533905932738f;
+    MoreVariables->downmix = NULL;
+    MoreVariables->frontPair = NULL;
 
-//not entirely sure if these are the correct coefficients for downmixing,
-//I'm fairly new to the whole multi speaker thing
-const float surroundMix = dbMinus3;
-const float centerMix   = dbMinus6;
-const float lowFreqMix  = dbMinus3;
+    DownmixFormat format = DOWNMIX_FLOAT;
+    if(!bFloat)
+    {
+        switch(inputBitsPerSample)
+        {
+            case 8:  format = DOWNMIX_INT8;  break;
+            case 16: format = DOWNMIX_INT16; break;
+            case 24: format = DOWNMIX_INT24; break;
+            case 32: format = DOWNMIX_INT32; break;
+            default:
+                AppWarning(TEXT("AudioSource::InitAudioData: %u bit audio isn't supported, the source will be silent"), inputBitsPerSample);
+                return;
+        }
+    }
 
-const float surroundMix4 = dbMinus6;
+    DownmixLayout layout = DOWNMIX_STEREO;
+    if(inputChannels == 1)
+        layout = DOWNMIX_MONO;
+    else if(inputChannels > 2)
+    {
+        layout = DOWNMIX_NUM_LAYOUTS;
+        switch(inputChannelMask)
+        {
+            case KSAUDIO_SPEAKER_QUAD:              layout = DOWNMIX_QUAD;              break;
+            case KSAUDIO_SPEAKER_2POINT1:           layout = DOWNMIX_2POINT1;           break;
+            case KSAUDIO_SPEAKER_3POINT1:           layout = DOWNMIX_3POINT1;           break;
+            case KSAUDIO_SPEAKER_4POINT1:           layout = DOWNMIX_4POINT1;           break;
+            case KSAUDIO_SPEAKER_SURROUND:          layout = DOWNMIX_SURROUND;          break;
+            case KSAUDIO_SPEAKER_5POINT1:
+            case KSAUDIO_SPEAKER_5POINT1_SURROUND:  layout = DOWNMIX_5POINT1;           break;
+            case KSAUDIO_SPEAKER_7POINT1:           layout = DOWNMIX_7POINT1;           break;
+            case KSAUDIO_SPEAKER_7POINT1_SURROUND:  layout = DOWNMIX_7POINT1_SURROUND;  break;
+        }
+    }
+
+    //a mask that doesn't match the channel count would have the layout's kernel read frames with the wrong stride
+    if(layout != DOWNMIX_NUM_LAYOUTS && GetDownmixChannels(layout) != inputChannels)
+    {
+        AppWarning(TEXT("AudioSource::InitAudioData: Speaker setup 0x%lX doesn't have %u channels, only front left and right will be used"), inputChannelMask, inputChannels);
+        layout = DOWNMIX_NUM_LAYOUTS;
+    }
+
+    if(layout == DOWNMIX_NUM_LAYOUTS)
+        MoreVariables->frontPair = GetFrontPairProc(format);
+    else
+        MoreVariables->downmix = GetDownmixProc(format, layout);
+}
 
-const float attn5dot1 = 1.0f / (1.0f + centerMix + surroundMix);
-const float attn4dotX = 1.0f / (1.0f + surroundMix4);
 
-void AudioSource::AddAudioSegment(AudioSegment *newSegment, float curVolume)
+void AudioSource::AddAudioSegment(AudioSegment *newSegment)
 {
-    if (newSegment)
-        MultiplyAudioBuffer(newSegment->audioData.Array(), newSegment->audioData.Num(), curVolume*sourceVolume);
+    AudioSegment *pooledSegment = newSegment;
 
     for (UINT i=0; i<audioFilters.Num(); i++)
     {
@@ -205,8 +290,11 @@ void AudioSource::AddAudioSegment(AudioSegment *newSegment, float curVolume)
             newSegment = audioFilters[i]->Process(newSegment);
     }
 
+    if (newSegment != pooledSegment)
+        MoreVariables->segmentPool.ForgetSegment(pooledSegment);
+
     if (newSegment)
-        audioSegments << newSegment;
+        MoreVariables->PushSegment(audioSegments, newSegment);
 }
 
 //  Used to sort sort audio in case from back->front in case of burst (this shouldn't be
@@ -214,15 +302,16 @@ void AudioSource::AddAudioSegment(AudioSegment *newSegment, float curVolume)
 void AudioSource::SortAudio(QWORD timestamp)
 {
     QWORD jumpAmount = 0;
+    UINT numSegments = MoreVariables->segmentCount;
 
-    if (audioSegments.Num() <= 1)
+    if (numSegments <= 1)
         return;
 
-    lastUsedTimestamp = lastSentTimestamp = audioSegments.Last()->timestamp = timestamp;
+    lastUsedTimestamp = lastSentTimestamp = MoreVariables->QueuedSegment(audioSegments, numSegments-1)->timestamp = timestamp;
 
-    for (UINT i = audioSegments.Num()-1; i > 0; i--)
+    for (UINT i = numSegments-1; i > 0; i--)
     {
-        AudioSegment *segment = audioSegments[i-1];
+        AudioSegment *segment = MoreVariables->QueuedSegment(audioSegments, i-1);
         UINT frames = segment->audioData.Num()/2;
         double totalTime = double(frames)/double(OBSGetSampleRateHz())*1000.0;
         QWORD newTime = timestamp - QWORD(totalTime);
@@ -239,6 +328,9 @@ void AudioSource::SortAudio(QWORD timestamp)
         timestamp = segment->timestamp;
     }
 
+    //every segment now ends no later than the next one starts
+    MoreVariables->bSegmentsUnsorted = false;
+
     //if (jumpAmount && sstri(GetDeviceName(), L"avermedia") != NULL)
     //    Log(L"sorted, lastUsedTimestamp is now %llu", lastUsedTimestamp);
 
@@ -263,340 +355,20 @@ UINT AudioSource::QueryAudio2(float curVolume, bool bCanBurstHack)
     if(GetNextBuffer((void**)&buffer, &numAudioFrames, &newTimestamp))
     {
         //------------------------------------------------------------
-        // convert to float
-
-        float *captureBuffer;
-
-        if(!bFloat)
-        {
-            UINT totalSamples = numAudioFrames*inputChannels;
-            if(convertBuffer.Num() < totalSamples)
-                convertBuffer.SetSize(totalSamples);
-
-            if(inputBitsPerSample == 8)
-            {
-                float *tempConvert = convertBuffer.Array();
-                char *tempSByte = (char*)buffer;
-
-                while(totalSamples--)
-                {
-                    *(tempConvert++) = float(*(tempSByte++))/127.0f;
-                }
-            }
-            else if(inputBitsPerSample == 16)
-            {
-                float *tempConvert = convertBuffer.Array();
-                short *tempShort = (short*)buffer;
-
-                while(totalSamples--)
-                {
-                    *(tempConvert++) = float(*(tempShort++))/32767.0f;
-                }
-            }
-            else if(inputBitsPerSample == 24)
-            {
-                float *tempConvert = convertBuffer.Array();
-                BYTE *tempTriple = (BYTE*)buffer;
-                TripleToLong valOut;
-
-                while(totalSamples--)
-                {
-                    TripleToLong &valIn  = (TripleToLong&)tempTriple;
-
-                    valOut.wVal = valIn.wVal;
-                    valOut.tripleVal = valIn.tripleVal;
-                    if(valOut.tripleVal > 0x7F)
-                        valOut.lastByte = 0xFF;
-
-                    *(tempConvert++) = float(double(valOut.val)/8388607.0);
-                    tempTriple += 3;
-                }
-            }
-            else if(inputBitsPerSample == 32)
-            {
-                float *tempConvert = convertBuffer.Array();
-                long *tempShort = (long*)buffer;
-
-                while(totalSamples--)
-                {
-                    *(tempConvert++) = float(double(*(tempShort++))/2147483647.0);
-                }
-            }
-
-            captureBuffer = convertBuffer.Array();
-        }
-        else
-            captureBuffer = (float*)buffer;
-
-        //------------------------------------------------------------
-        // channel upmix/downmix
+        // convert to float, up/downmix to stereo and apply the volume, all in one pass.
+        // sourceVolume is applied twice, as it always has been (once by the caller and again per segment)
 
         if(tempBuffer.Num() < numAudioFrames*2)
             tempBuffer.SetSize(numAudioFrames*2);
 
         float *dataOutputBuffer = tempBuffer.Array();
-        float *tempOut = dataOutputBuffer;
-
-        if(inputChannels == 1)
-        {
-            UINT  numFloats   = numAudioFrames;
-            float *inputTemp  = (float*)captureBuffer;
-            float *outputTemp = dataOutputBuffer;
-
-            if((UPARAM(inputTemp) & 0xF) == 0 && (UPARAM(outputTemp) & 0xF) == 0)
-            {
-                UINT alignedFloats = numFloats & 0xFFFFFFFC;
-                for(UINT i=0; i<alignedFloats; i += 4)
-                {
-                    __m128 inVal   = _mm_load_ps(inputTemp+i);
-
-                    __m128 outVal1 = _mm_unpacklo_ps(inVal, inVal);
-                    __m128 outVal2 = _mm_unpackhi_ps(inVal, inVal);
-
-                    _mm_store_ps(outputTemp+(i*2),   outVal1);
-                    _mm_store_ps(outputTemp+(i*2)+4, outVal2);
-                }
-
-                numFloats  -= alignedFloats;
-                inputTemp  += alignedFloats;
-                outputTemp += alignedFloats*2;
-            }
-
-            while(numFloats--)
-            {
-                float inputVal = *inputTemp;
-                *(outputTemp++) = inputVal;
-                *(outputTemp++) = inputVal;
-
-                inputTemp++;
-            }
-        }
-        else if(inputChannels == 2) //straight up copy
-        {
-            memcpy(dataOutputBuffer, captureBuffer, numAudioFrames*2*sizeof(float));
-        }
+        float volume = curVolume*sourceVolume*sourceVolume;
+        if(MoreVariables->downmix)
+            MoreVariables->downmix(buffer, dataOutputBuffer, numAudioFrames, volume);
+        else if(MoreVariables->frontPair)
+            MoreVariables->frontPair(buffer, dataOutputBuffer, numAudioFrames, inputChannels, volume);
         else
-        {
-            //todo: downmix optimization, also support for other speaker configurations than ones I can merely "think" of.  ugh.
-            float *inputTemp  = (float*)captureBuffer;
-            float *outputTemp = dataOutputBuffer;
-
-            if(inputChannelMask == KSAUDIO_SPEAKER_QUAD)
-            {
-                UINT numFloats = numAudioFrames*4;
-                float *endTemp = inputTemp+numFloats;
-
-                while(inputTemp < endTemp)
-                {
-                    float left      = inputTemp[0];
-                    float right     = inputTemp[1];
-                    float rearLeft  = inputTemp[2]*surroundMix4;
-                    float rearRight = inputTemp[3]*surroundMix4;
-
-                    // When in doubt, use only left and right .... and rear left and rear right :) 
-                    // Same idea as with 5.1 downmix
-
-                    *(outputTemp++) = (left  + rearLeft)  * attn4dotX;
-                    *(outputTemp++) = (right + rearRight) * attn4dotX;
-
-                    inputTemp  += 4;
-                }
-            }
-            else if(inputChannelMask == KSAUDIO_SPEAKER_2POINT1)
-            {
-                UINT numFloats = numAudioFrames*3;
-                float *endTemp = inputTemp+numFloats;
-
-                while(inputTemp < endTemp)
-                {
-                    float left      = inputTemp[0];
-                    float right     = inputTemp[1];
-                   
-                    // Drop LFE since we don't need it
-                    //float lfe       = inputTemp[2]*lowFreqMix;
-
-                    *(outputTemp++) = left;
-                    *(outputTemp++) = right;
-
-                    inputTemp  += 3;
-                }
-            }
-            else if(inputChannelMask == KSAUDIO_SPEAKER_3POINT1)
-            {
-                UINT numFloats = numAudioFrames*4;
-                float *endTemp = inputTemp+numFloats;
-
-                while(inputTemp < endTemp)
-                {
-                    float left          = inputTemp[0];
-                    float right         = inputTemp[1];
-                    float frontCenter   = inputTemp[2];
-                    float lowFreq       = inputTemp[3];
-
-                    *(outputTemp++) = left;
-                    *(outputTemp++) = right;
-
-                    inputTemp  += 4;
-                }
-            }
-            else if(inputChannelMask == KSAUDIO_SPEAKER_4POINT1)
-            {
-                UINT numFloats = numAudioFrames*5;
-                float *endTemp = inputTemp+numFloats;
-
-                while(inputTemp < endTemp)
-                {
-                    float left      = inputTemp[0];
-                    float right     = inputTemp[1];
-
-                    // Skip LFE , we don't really need it.
-                    //float lfe       = inputTemp[2];
-
-                    float rearLeft  = inputTemp[3]*surroundMix4;
-                    float rearRight = inputTemp[4]*surroundMix4;
-
-                    // Same idea as with 5.1 downmix
-
-                    *(outputTemp++) = (left  + rearLeft)  * attn4dotX;
-                    *(outputTemp++) = (right + rearRight) * attn4dotX;
-
-                    inputTemp  += 5;
-                }
-            }
-            else if(inputChannelMask == KSAUDIO_SPEAKER_SURROUND)
-            {
-                UINT numFloats = numAudioFrames*4;
-                float *endTemp = inputTemp+numFloats;
-
-                while(inputTemp < endTemp)
-                {
-                    float left      = inputTemp[0];
-                    float right     = inputTemp[1];
-                    float frontCenter    = inputTemp[2];
-                    float rearCenter     = inputTemp[3];
-                    
-                    // When in doubt, use only left and right :) Seriously.
-                    // THIS NEEDS TO BE PROPERLY IMPLEMENTED!
-
-                    *(outputTemp++) = left;
-                    *(outputTemp++) = right;
-
-                    inputTemp  += 4;
-                }
-            }
-            // Both speakers configs share the same format, the difference is in rear speakers position 
-            // See: http://msdn.microsoft.com/en-us/library/windows/hardware/ff537083(v=vs.85).aspx
-            // Probably for KSAUDIO_SPEAKER_5POINT1_SURROUND we will need a different coefficient for rear left/right
-            else if(inputChannelMask == KSAUDIO_SPEAKER_5POINT1 || inputChannelMask == KSAUDIO_SPEAKER_5POINT1_SURROUND)
-            {
-                UINT numFloats = numAudioFrames*6;
-                float *endTemp = inputTemp+numFloats;
-
-                while(inputTemp < endTemp)
-                {
-                    float left      = inputTemp[0];
-                    float right     = inputTemp[1];
-                    float center    = inputTemp[2]*centerMix;
-                    
-                    //We don't need LFE channel so skip it (see below)
-                    //float lowFreq   = inputTemp[3]*lowFreqMix;
-                    
-                    float rearLeft  = inputTemp[4]*surroundMix;
-                    float rearRight = inputTemp[5]*surroundMix;
-                    
-                    // According to ITU-R  BS.775-1 recommendation, the downmix from a 3/2 source to stereo
-                    // is the following:
-                    // L = FL + k0*C + k1*RL
-                    // R = FR + k0*C + k1*RR
-                    // FL = front left
-                    // FR = front right
-                    // C  = center
-                    // RL = rear left
-                    // RR = rear right
-                    // k0 = centerMix   = dbMinus3 = 0.7071067811865476 [for k0 we can use dbMinus6 = 0.5 too, probably it's better]
-                    // k1 = surroundMix = dbMinus3 = 0.7071067811865476
-
-                    // The output (L,R) can be out of (-1,1) domain so we attenuate it [ attn5dot1 = 1/(1 + centerMix + surroundMix) ]
-                    // Note: this method of downmixing is far from "perfect" (pretty sure it's not the correct way) but the resulting downmix is "okayish", at least no more bleeding ears.
-                    // (maybe have a look at http://forum.doom9.org/archive/index.php/t-148228.html too [ 5.1 -> stereo ] the approach seems almost the same [but different coefficients])
-
-                    
-                    // http://acousticsfreq.com/blog/wp-content/uploads/2012/01/ITU-R-BS775-1.pdf
-                    // http://ir.lib.nctu.edu.tw/bitstream/987654321/22934/1/030104001.pdf
-
-                    *(outputTemp++) = (left  + center  + rearLeft) * attn5dot1;
-                    *(outputTemp++) = (right + center  + rearRight) * attn5dot1;
-
-                    inputTemp  += 6;
-                }
-            }
-
-            // According to http://msdn.microsoft.com/en-us/library/windows/hardware/ff537083(v=vs.85).aspx
-            // KSAUDIO_SPEAKER_7POINT1 is obsolete and no longer supported in Windows Vista and later versions of Windows
-            // Not sure what to do about it, meh , drop front left of center/front right of center -> 5.1 -> stereo; 
-
-            else if(inputChannelMask == KSAUDIO_SPEAKER_7POINT1)
-            {
-                UINT numFloats = numAudioFrames*8;
-                float *endTemp = inputTemp+numFloats;
-
-                while(inputTemp < endTemp)
-                {
-                    float left          = inputTemp[0];
-                    float right         = inputTemp[1];
-                    
-                    float center        = inputTemp[2] * centerMix;
-                    
-                    // Drop LFE since we don't need it
-                    //float lowFreq       = inputTemp[3]*lowFreqMix;
-                    
-                    float rearLeft      = inputTemp[4] * surroundMix;
-                    float rearRight     = inputTemp[5] * surroundMix;
-
-                    // Drop SPEAKER_FRONT_LEFT_OF_CENTER , SPEAKER_FRONT_RIGHT_OF_CENTER
-                    //float centerLeft    = inputTemp[6];
-                    //float centerRight   = inputTemp[7];
-                    
-                    // Downmix from 5.1 to stereo
-                    *(outputTemp++) = (left  + center  + rearLeft)  * attn5dot1;
-                    *(outputTemp++) = (right + center  + rearRight) * attn5dot1;
-
-                    inputTemp  += 8;
-                }
-            }
-
-            // Downmix to 5.1 (easy stuff) then downmix to stereo as done in KSAUDIO_SPEAKER_5POINT1
-            else if(inputChannelMask == KSAUDIO_SPEAKER_7POINT1_SURROUND)
-            {
-                UINT numFloats = numAudioFrames*8;
-                float *endTemp = inputTemp+numFloats;
-
-                while(inputTemp < endTemp)
-                {
-                    float left      = inputTemp[0];
-                    float right     = inputTemp[1];
-                    float center    = inputTemp[2] * centerMix;
-
-                    // Skip LFE we don't need it
-                    //float lowFreq   = inputTemp[3]*lowFreqMix;
-
-                    float rearLeft  = inputTemp[4];
-                    float rearRight = inputTemp[5];
-                    float sideLeft  = inputTemp[6];
-                    float sideRight = inputTemp[7];
-
-                    // combine the rear/side channels first , baaam! 5.1
-                    rearLeft  = (rearLeft  + sideLeft)  * 0.5f;
-                    rearRight = (rearRight + sideRight) * 0.5f;
-
-                    // downmix to stereo as in 5.1 case
-                    *(outputTemp++) = (left  + center + rearLeft  * surroundMix) * attn5dot1;
-                    *(outputTemp++) = (right + center + rearRight * surroundMix) * attn5dot1;
-
-                    inputTemp  += 8;
-                }
-            }
-        }
+            zero(dataOutputBuffer, numAudioFrames*2*sizeof(float));
 
         ReleaseBuffer();
 
@@ -673,8 +445,8 @@ UINT AudioSource::QueryAudio2(float curVolume, bool bCanBurstHack)
         bool overshotAudio = (lastUsedTimestamp < lastSentTimestamp+10);
         if (bCanBurstHack || !overshotAudio)
         {
-            AudioSegment *newSegment = new AudioSegment(newBuffer, numAudioFrames*2, lastUsedTimestamp);
-            AddAudioSegment(newSegment, curVolume*sourceVolume);
+            AudioSegment *newSegment = MoreVariables->segmentPool.GetSegment(newBuffer, numAudioFrames*2, lastUsedTimestamp);
+            AddAudioSegment(newSegment);
             lastSentTimestamp = lastUsedTimestamp;
         }
 
@@ -688,9 +460,9 @@ UINT AudioSource::QueryAudio2(float curVolume, bool bCanBurstHack)
 
 bool AudioSource::GetEarliestTimestamp(QWORD &timestamp)
 {
-    if(audioSegments.Num())
+    if(MoreVariables->segmentCount)
     {
-        timestamp = audioSegments[0]->timestamp;
+        timestamp = MoreVariables->QueuedSegment(audioSegments, 0)->timestamp;
         return true;
     }
 
@@ -699,9 +471,9 @@ bool AudioSource::GetEarliestTimestamp(QWORD &timestamp)
 
 bool AudioSource::GetLatestTimestamp(QWORD &timestamp)
 {
-    if(audioSegments.Num())
+    if(MoreVariables->segmentCount)
     {
-        timestamp = audioSegments.Last()->timestamp;
+        timestamp = MoreVariables->QueuedSegment(audioSegments, MoreVariables->segmentCount-1)->timestamp;
         return true;
     }
 
@@ -712,65 +484,47 @@ bool AudioSource::GetBuffer(float **buffer, QWORD targetTimestamp)
 {
     bool bSuccess = false;
     bool bDeleted = false;
-    outputBuffer.Clear();
 
-    bool bReportedOnce = false;
+    //the output buffer keeps its size, and the segment's samples are copied so the segment can be reused
+    UINT outputFloats = OBSGetSampleRateHz()/100*2;
+    outputBuffer.SetSize(outputFloats);
 
-    while(audioSegments.Num())
+    //drop the segments that are already too old to be mixed
+    UINT numStale = MoreVariables->CountSegmentsBefore(audioSegments, targetTimestamp);
+    if(numStale)
     {
-        if(audioSegments[0]->timestamp < targetTimestamp)
-        {
-            QWORD diff = targetTimestamp-audioSegments[0]->timestamp;
-            //OSDebugOut(TEXT("Off by %llu\n"), targetTimestamp-audioSegments[0]->timestamp);
-            if (!bReportedOnce) {
-                Log(TEXT("Audio timestamp for device '%s' was behind target timestamp by %llu"),
-                        GetDeviceName(), diff);
-
-                bReportedOnce = true;
-            }
+        QWORD diff = targetTimestamp-MoreVariables->QueuedSegment(audioSegments, 0)->timestamp;
+        Log(TEXT("Audio timestamp for device '%s' was behind target timestamp by %llu"),
+                GetDeviceName(), diff);
 
-            /*if (!bReportedOnce && diff > 150) {
-                for (UINT i = 0; i < audioSegments.Num(); i++)
-                    Log(L"    %llu", audioSegments[i]->timestamp);
+        while(numStale--)
+            MoreVariables->segmentPool.RecycleSegment(MoreVariables->PopSegment(audioSegments));
 
-                bReportedOnce = true;
-            }*/
-
-            /*OSDebugOut(L"targetTimestamp: %llu\n", targetTimestamp);
-            for (UINT i = 0; i < audioSegments.Num(); i++)
-            {
-                OSDebugOut(L"%llu\n", audioSegments[i]->timestamp);
-            }*/
-
-            delete audioSegments[0];
-            audioSegments.Remove(0);
-
-            bDeleted = true;
-        }
-        else
-            break;
+        bDeleted = true;
     }
 
-    if(audioSegments.Num())
+    if(MoreVariables->segmentCount)
     {
         bool bUseSegment = false;
 
-        AudioSegment *segment = audioSegments[0];
+        AudioSegment *segment = MoreVariables->QueuedSegment(audioSegments, 0);
 
         QWORD difference = (segment->timestamp-targetTimestamp);
         if(bDeleted || difference <= 11)
         {
             //Log(TEXT("segment.timestamp: %llu, targetTimestamp: %llu"), segment.timestamp, targetTimestamp);
-            outputBuffer.TransferFrom(segment->audioData);
+            UINT numFloats = MIN(segment->audioData.Num(), outputFloats);
+            mcpy(outputBuffer.Array(), segment->audioData.Array(), numFloats*sizeof(float));
+            zero(outputBuffer.Array()+numFloats, (outputFloats-numFloats)*sizeof(float));
 
-            delete segment;
-            audioSegments.Remove(0);
+            MoreVariables->segmentPool.RecycleSegment(MoreVariables->PopSegment(audioSegments));
 
             bSuccess = true;
         }
     }
 
-    outputBuffer.SetSize(OBSGetSampleRateHz()/100*2);
+    if(!bSuccess)
+        zero(outputBuffer.Array(), outputFloats*sizeof(float));
 
     *buffer = outputBuffer.Array();
 
@@ -781,9 +535,9 @@ bool AudioSource::GetNewestFrame(float **buffer)
 {
     if(buffer)
     {
-        if(audioSegments.Num())
+        if(MoreVariables->segmentCount)
         {
-            List<float> &data = audioSegments.Last()->audioData;
+            List<float> &data = MoreVariables->QueuedSegment(audioSegments, MoreVariables->segmentCount-1)->audioData;
             *buffer = data.Array();
             return true;
         }
@@ -792,10 +546,17 @@ bool AudioSource::GetNewestFrame(float **buffer)
     return false;
 }
 
+void AudioSource::GetSegmentAllocations(UINT &numSegments, UINT &numAllocs) const
+{
+    numSegments = MoreVariables->segmentPool.numQueuedSegments;
+    numAllocs = MoreVariables->segmentPool.numSegmentAllocs;
+}
+
 QWORD AudioSource::GetBufferedTime()
 {
-    if(audioSegments.Num())
-        return audioSegments.Last()->timestamp - audioSegments[0]->timestamp;
+    UINT numSegments = MoreVariables->segmentCount;
+    if(numSegments)
+        return MoreVariables->QueuedSegment(audioSegments, numSegments-1)->timestamp - MoreVariables->QueuedSegment(audioSegments, 0)->timestamp;
 
     return 0;
 }
@@ -55,7 +55,7 @@ class BASE_EXPORT AudioSource
 
     //-----------------------------------------
 
-    List<AudioSegment*> audioSegments;
+    List<AudioSegment*> audioSegments;     //storage of a ring buffer, indexed through NotAResampler in AudioSource.cpp
 
     QWORD lastUsedTimestamp;
     QWORD lastSentTimestamp;
@@ -68,7 +68,7 @@ class BASE_EXPORT AudioSource
     //-----------------------------------------
 
     List<float> outputBuffer;
-    List<float> convertBuffer;
+    List<float> convertBuffer;             //unused since the downmix kernels convert as they go
     List<float> tempBuffer;
     List<float> tempResampleBuffer;
 
@@ -87,7 +87,7 @@ class BASE_EXPORT AudioSource
 
     //-----------------------------------------
 
-    void AddAudioSegment(AudioSegment *segment, float curVolume);
+    void AddAudioSegment(AudioSegment *segment);
 
 protected:
 
@@ -123,6 +123,10 @@ public:
     UINT GetChannelCount() const;
     UINT GetSamplesPerSec() const;
 
+    //segments queued since the source was created, and the allocations made for them.  once the segment pool
+    //is warmed up, the allocation count stops going up.
+    void GetSegmentAllocations(UINT &numSegments, UINT &numAllocs) const;
+
     int  GetTimeOffset() const;
     void SetTimeOffset(int newOffset);
 
@@ -639,16 +639,18 @@ public:
 
     virtual void GetCurDesktopVolumeStats(float *rms, float *max, float *peak) const
     {
-        *rms = App->desktopMag;
-        *max = App->desktopMax;
-        *peak = App->desktopPeak;
+        AudioMeterSnapshot levels = App->meterSnapshot.Read();
+        *rms = levels.desktopMag;
+        *max = levels.desktopMax;
+        *peak = levels.desktopPeak;
     }
 
     virtual void GetCurMicVolumeStats(float *rms, float *max, float *peak) const
     {
-        *rms = App->micMag;
-        *max = App->micMax;
-        *peak = App->micPeak;
+        AudioMeterSnapshot levels = App->meterSnapshot.Read();
+        *rms = levels.micMag;
+        *max = levels.micMax;
+        *peak = levels.micPeak;
     }
 
     virtual void AddSettingsPane(SettingsPane *pane)    {App->AddSettingsPane(pane);}
@@ -679,6 +681,8 @@ public:
     }
     virtual CTSTR GetSceneCollectionName() const { return App->GetCurrentSceneCollection(); }
     virtual void GetSceneCollectionNames(StringList &list) const { return App->GetSceneCollection(list); }
+
+    virtual bool GetAudioSourceLevels(AudioSource *source, AudioLevels &levels) const {return App->GetAudioSourceLevels(source, levels);}
 };
 
 APIInterface* CreateOBSApiInterface()
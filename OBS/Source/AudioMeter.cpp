@@ -0,0 +1,241 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#include "Main.h"
+
+
+//  4x oversampling filter for the true peak: the three points between two samples, each interpolated from the 8
+//samples around them (hann windowed sinc, normalized).  tap k is applied to the sample k frames back, so the points
+//come out 4 frames late, which doesn't matter for a peak.
+static const float truePeakTaps[3][8] =
+{
+    {-0.00057572f, 0.01815831f, -0.07673042f, 0.27437424f, 0.89023010f, -0.13982489f, 0.04019477f, -0.00582639f},
+    {-0.00345092f, 0.03918042f, -0.14626240f, 0.61053290f, 0.61053290f, -0.14626240f, 0.03918042f, -0.00345092f},
+    {-0.00582639f, 0.04019477f, -0.13982489f, 0.89023010f, 0.27437424f, -0.07673042f, 0.01815831f, -0.00057572f},
+};
+
+void AudioMeter::Reset()
+{
+    zero(history, sizeof(history));
+    zero(&levels, sizeof(levels));
+    highestTruePeak = 0.0f;
+}
+
+//  One meter's running state through a buffer.  the samples go in four floats (two frames) at a time, and the last
+//four vectors are kept so the true peak filter doesn't have to reload what it's just seen.
+class MeterPass
+{
+    AudioMeter &meter;
+
+    __m128 prev1, prev2, prev3, prev4;
+    __m128 sumSquares, peak, truePeak;
+    __m128 absMask;
+
+    static inline __m128 Taps(__m128 x0, __m128 x1, __m128 x2, __m128 x3, __m128 x4, __m128 x5, __m128 x6, __m128 x7, const float *taps)
+    {
+        __m128 sum = _mm_mul_ps(x0, _mm_set1_ps(taps[0]));
+        sum = _mm_add_ps(sum, _mm_mul_ps(x1, _mm_set1_ps(taps[1])));
+        sum = _mm_add_ps(sum, _mm_mul_ps(x2, _mm_set1_ps(taps[2])));
+        sum = _mm_add_ps(sum, _mm_mul_ps(x3, _mm_set1_ps(taps[3])));
+        sum = _mm_add_ps(sum, _mm_mul_ps(x4, _mm_set1_ps(taps[4])));
+        sum = _mm_add_ps(sum, _mm_mul_ps(x5, _mm_set1_ps(taps[5])));
+        sum = _mm_add_ps(sum, _mm_mul_ps(x6, _mm_set1_ps(taps[6])));
+        sum = _mm_add_ps(sum, _mm_mul_ps(x7, _mm_set1_ps(taps[7])));
+        return sum;
+    }
+
+    static inline float HorizontalSum(__m128 val)
+    {
+        val = _mm_add_ps(val, _mm_movehl_ps(val, val));
+        val = _mm_add_ss(val, _mm_shuffle_ps(val, val, _MM_SHUFFLE(1, 1, 1, 1)));
+        return _mm_cvtss_f32(val);
+    }
+
+    static inline float HorizontalMax(__m128 val)
+    {
+        val = _mm_max_ps(val, _mm_movehl_ps(val, val));
+        val = _mm_max_ss(val, _mm_shuffle_ps(val, val, _MM_SHUFFLE(1, 1, 1, 1)));
+        return _mm_cvtss_f32(val);
+    }
+
+public:
+    inline MeterPass(AudioMeter &meter) : meter(meter)
+    {
+        prev4 = _mm_loadu_ps(meter.history);
+        prev3 = _mm_loadu_ps(meter.history+4);
+        prev2 = _mm_loadu_ps(meter.history+8);
+        prev1 = _mm_loadu_ps(meter.history+12);
+
+        sumSquares = peak = truePeak = _mm_setzero_ps();
+        absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    }
+
+    inline void Add(__m128 val)
+    {
+        sumSquares = _mm_add_ps(sumSquares, _mm_mul_ps(val, val));
+        peak = _mm_max_ps(peak, _mm_and_ps(val, absMask));
+
+        //the frames 1, 3, 5 and 7 back straddle two vectors
+        __m128 back1 = _mm_shuffle_ps(prev1, val,   _MM_SHUFFLE(1, 0, 3, 2));
+        __m128 back3 = _mm_shuffle_ps(prev2, prev1, _MM_SHUFFLE(1, 0, 3, 2));
+        __m128 back5 = _mm_shuffle_ps(prev3, prev2, _MM_SHUFFLE(1, 0, 3, 2));
+        __m128 back7 = _mm_shuffle_ps(prev4, prev3, _MM_SHUFFLE(1, 0, 3, 2));
+
+        for(int phase=0; phase<3; phase++)
+        {
+            __m128 point = Taps(val, back1, prev1, back3, prev2, back5, prev3, back7, truePeakTaps[phase]);
+            truePeak = _mm_max_ps(truePeak, _mm_and_ps(point, absMask));
+        }
+
+        prev4 = prev3;
+        prev3 = prev2;
+        prev2 = prev1;
+        prev1 = val;
+    }
+
+    //tail is whatever was left over after the last whole vector, which is whole frames
+    void Finish(const float *tail, UINT numTailFloats, UINT totalFloats)
+    {
+        float frames[16+4];
+        _mm_storeu_ps(frames,    prev4);
+        _mm_storeu_ps(frames+4,  prev3);
+        _mm_storeu_ps(frames+8,  prev2);
+        _mm_storeu_ps(frames+12, prev1);
+
+        float sum = HorizontalSum(sumSquares);
+        float samplePeak = HorizontalMax(peak);
+        float pointPeak = HorizontalMax(truePeak);
+
+        for(UINT i=0; i<numTailFloats; i++)
+        {
+            float val = tail[i];
+            frames[16+i] = val;
+
+            sum += val*val;
+            samplePeak = max(samplePeak, fabsf(val));
+
+            for(int phase=0; phase<3; phase++)
+            {
+                float point = 0.0f;
+                for(int k=0; k<8; k++)
+                    point += frames[16+i-k*2]*truePeakTaps[phase][k];
+                pointPeak = max(pointPeak, fabsf(point));
+            }
+        }
+
+        mcpy(meter.history, frames+numTailFloats, sizeof(meter.history));
+
+        AudioLevels &levels = meter.levels;
+        levels.rms      = totalFloats ? sqrtf(sum/totalFloats) : 0.0f;
+        levels.peak     = samplePeak;
+        levels.truePeak = max(samplePeak, pointPeak);
+
+        meter.highestTruePeak = max(meter.highestTruePeak, levels.truePeak);
+    }
+};
+
+void AudioMeter::Measure(const float *buffer, UINT totalFloats)
+{
+    MeterPass pass(*this);
+
+    UINT alignedFloats = totalFloats & 0xFFFFFFFC;
+    for(UINT i=0; i<alignedFloats; i += 4)
+        pass.Add(_mm_loadu_ps(buffer+i));
+
+    pass.Finish(buffer+alignedFloats, totalFloats-alignedFloats, totalFloats);
+}
+
+template<bool bForceMono, bool bMeasureDest> static void MixAndMeasure(float *dest, float *src, UINT totalFloats, AudioMeter &srcMeter, AudioMeter *destMeter)
+{
+    MeterPass srcPass(srcMeter);
+    MeterPass destPass(bMeasureDest ? *destMeter : srcMeter);
+
+    __m128 maxVal = _mm_set_ps1(1.0f);
+    __m128 minVal = _mm_set_ps1(-1.0f);
+    __m128 halfVal = _mm_set_ps1(0.5f);
+
+    UINT alignedFloats = totalFloats & 0xFFFFFFFC;
+    for(UINT i=0; i<alignedFloats; i += 4)
+    {
+        __m128 srcVal = _mm_loadu_ps(src+i);
+        __m128 destVal = _mm_loadu_ps(dest+i);
+
+        if(bForceMono)
+        {
+            __m128 shufVal = _mm_shuffle_ps(srcVal, srcVal, _MM_SHUFFLE(2, 3, 0, 1));
+            srcVal = _mm_mul_ps(_mm_add_ps(srcVal, shufVal), halfVal);
+            _mm_storeu_ps(src+i, srcVal);
+        }
+
+        srcPass.Add(srcVal);
+        if(bMeasureDest)
+            destPass.Add(destVal);
+
+        __m128 mix = _mm_add_ps(destVal, srcVal);
+        mix = _mm_min_ps(mix, maxVal);
+        mix = _mm_max_ps(mix, minVal);
+        _mm_storeu_ps(dest+i, mix);
+    }
+
+    //leftover frames, measured before they're mixed
+    UINT numTailFloats = totalFloats-alignedFloats;
+    float *srcTail = src+alignedFloats, *destTail = dest+alignedFloats;
+    float destBefore[4];
+
+    if(bForceMono)
+    {
+        for(UINT i=0; i+1<numTailFloats; i += 2)
+        {
+            srcTail[i] = (srcTail[i]+srcTail[i+1])*0.5f;
+            srcTail[i+1] = srcTail[i];
+        }
+    }
+
+    mcpy(destBefore, destTail, numTailFloats*sizeof(float));
+
+    for(UINT i=0; i<numTailFloats; i++)
+    {
+        float val = destTail[i]+srcTail[i];
+        if(val < -1.0f)     val = -1.0f;
+        else if(val > 1.0f) val = 1.0f;
+        destTail[i] = val;
+    }
+
+    srcPass.Finish(srcTail, numTailFloats, totalFloats);
+    if(bMeasureDest)
+        destPass.Finish(destBefore, numTailFloats, totalFloats);
+}
+
+void MixAudioMetered(float *dest, float *src, UINT totalFloats, bool bForceMono, AudioMeter &srcMeter, AudioMeter *destMeter)
+{
+    if(bForceMono)
+    {
+        if(destMeter)
+            MixAndMeasure<true, true>(dest, src, totalFloats, srcMeter, destMeter);
+        else
+            MixAndMeasure<true, false>(dest, src, totalFloats, srcMeter, destMeter);
+    }
+    else
+    {
+        if(destMeter)
+            MixAndMeasure<false, true>(dest, src, totalFloats, srcMeter, destMeter);
+        else
+            MixAndMeasure<false, false>(dest, src, totalFloats, srcMeter, destMeter);
+    }
+}
@@ -0,0 +1,82 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#pragma once
+
+//  Measures a stream of buffers.  the true peak filter looks back across buffers, so each stream needs its own
+//meter.  while a buffer is measured everything stays in SSE registers, and it's only reduced to numbers at the end.
+class AudioMeter
+{
+    friend class MeterPass;
+
+    float history[16];      //the last 8 frames measured, for the true peak filter
+    AudioLevels levels;
+    float highestTruePeak;
+
+public:
+    AudioMeter() {Reset();}
+
+    void Reset();
+
+    //levels of the last buffer, and the highest true peak since the meter was reset
+    inline const AudioLevels& GetLevels() const {return levels;}
+    inline float GetHighestTruePeak() const     {return highestTruePeak;}
+
+    void Measure(const float *buffer, UINT totalFloats);
+};
+
+//  Mixes src into dest like MixAudio, measuring src with srcMeter in the same pass.  if destMeter is set, it
+//measures dest as it was before src was added.
+void MixAudioMetered(float *dest, float *src, UINT totalFloats, bool bForceMono, AudioMeter &srcMeter, AudioMeter *destMeter=NULL);
+
+//  Lets one thread publish a value that others read without locking.  the writer makes the sequence number odd
+//while it writes, and readers copy the value again if it was odd or changed while they were copying.
+template<typename T> class SnapshotPublisher
+{
+    volatile LONG sequence;
+    T value;
+
+public:
+    SnapshotPublisher() : sequence(0) {zero(&value, sizeof(T));}
+
+    void Publish(const T &newValue)
+    {
+        InterlockedIncrement(&sequence);
+        value = newValue;
+        InterlockedIncrement(&sequence);
+    }
+
+    T Read() const
+    {
+        T copy;
+        LONG before, after;
+
+        //x86 doesn't reorder loads with other loads, so only the compiler has to be kept from it
+        do
+        {
+            before = sequence;
+            _ReadWriteBarrier();
+            copy = value;
+            _ReadWriteBarrier();
+            after = sequence;
+        } while((before & 1) || before != after);
+
+        return copy;
+    }
+};
@@ -0,0 +1,194 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#pragma once
+
+#include <vector>
+
+//  The aux sources and the mic are queried in parallel.  each source is a task, and the calling thread and the
+//workers take tasks in turn until there are none left, so a slow source doesn't hold up the others.  every source
+//still only fills its own buffers, and they're mixed on the mixer thread in the same order as always.
+//
+//  nothing in here depends on windows or on the rest of OBS, so the tools can build it too.  Source is anything with
+//AudioSource's QueryAudio2, GetLatestTimestamp and SortAudio (and NoAudioAvailable has to be declared, as
+//AudioSource.h does).  Platform supplies the rest:
+//
+//  Event                                                   auto-reset event
+//  Event CreateSignal(), DestroySignal(e), Signal(e), Wait(e), WaitAll(events, num)
+//  Thread                                                  thread handle
+//  Thread StartThread(proc, param), JoinThread(thread)     proc is void (*)(void*)
+//  long Increment(volatile long *value)                    atomic, returns the new value
+
+template<typename Source> struct AudioQueryTask
+{
+    Source *source;
+    float volume;
+    bool bDrain;        //query until there's nothing left, then sort
+    bool bGotAudio;
+};
+
+template<typename Source, typename Platform> class AudioQueryPool
+{
+    typedef typename Platform::Event Event;
+    typedef typename Platform::Thread Thread;
+
+    struct Worker
+    {
+        AudioQueryPool *pool;
+        Thread thread;
+        Event signalQuery, signalComplete;
+    };
+
+    std::vector<AudioQueryTask<Source> > tasks;
+    volatile long nextTask;
+    bool bKillThreads;
+
+    std::vector<Worker> workers;
+    std::vector<Event> completeEvents;
+
+    static void RunTask(AudioQueryTask<Source> &task)
+    {
+        if (task.bDrain) {
+            while (task.source->QueryAudio2(task.volume, true) != NoAudioAvailable)
+                task.bGotAudio = true;
+
+            unsigned long long timestamp;
+            if (task.source->GetLatestTimestamp(timestamp))
+                task.source->SortAudio(timestamp);
+        } else {
+            task.bGotAudio = (task.source->QueryAudio2(task.volume, true) != NoAudioAvailable);
+        }
+    }
+
+    void RunTasks()
+    {
+        long id;
+        while ((id = Platform::Increment(&nextTask)-1) < (long)tasks.size())
+            RunTask(tasks[id]);
+    }
+
+    static void WorkerThread(void *param)
+    {
+        Worker *worker = (Worker*)param;
+
+        while (true) {
+            Platform::Wait(worker->signalQuery);
+            if (worker->pool->bKillThreads)
+                break;
+
+            worker->pool->RunTasks();
+            Platform::Signal(worker->signalComplete);
+        }
+    }
+
+public:
+    AudioQueryPool() : nextTask(0), bKillThreads(false) {}
+    ~AudioQueryPool() {Stop();}
+
+    //starts up to numWorkers threads, and returns how many did
+    unsigned int Start(unsigned int numWorkers)
+    {
+        bKillThreads = false;
+
+        //reserved so the workers' addresses don't change while they start
+        workers.reserve(numWorkers);
+
+        for (unsigned int i=0; i<numWorkers; i++) {
+            Worker worker;
+            worker.pool = this;
+            worker.signalQuery    = Platform::CreateSignal();
+            worker.signalComplete = Platform::CreateSignal();
+            workers.push_back(worker);
+
+            Worker &added = workers.back();
+            added.thread = Platform::StartThread(&WorkerThread, &added);
+
+            if (!added.thread) {
+                Platform::DestroySignal(added.signalQuery);
+                Platform::DestroySignal(added.signalComplete);
+                workers.pop_back();
+                break;
+            }
+
+            completeEvents.push_back(added.signalComplete);
+        }
+
+        return (unsigned int)workers.size();
+    }
+
+    void Stop()
+    {
+        bKillThreads = true;
+
+        for (size_t i=0; i<workers.size(); i++) {
+            Platform::Signal(workers[i].signalQuery);
+            Platform::JoinThread(workers[i].thread);
+            Platform::DestroySignal(workers[i].signalQuery);
+            Platform::DestroySignal(workers[i].signalComplete);
+        }
+
+        workers.clear();
+        completeEvents.clear();
+    }
+
+    inline unsigned int NumWorkers() const {return (unsigned int)workers.size();}
+
+    //the tasks can only be changed while Run isn't
+    inline void ClearTasks() {tasks.clear();}
+
+    void AddTask(Source *source, float volume, bool bDrain)
+    {
+        AudioQueryTask<Source> task;
+        task.source = source;
+        task.volume = volume;
+        task.bDrain = bDrain;
+        task.bGotAudio = false;
+        tasks.push_back(task);
+    }
+
+    inline const AudioQueryTask<Source>& GetTask(unsigned int i) const {return tasks[i];}
+
+    //runs every task once, and returns whether any of the sources had audio
+    bool Run()
+    {
+        //the calling thread takes tasks too, so only wake as many workers as there are other tasks
+        unsigned int numTasks = (unsigned int)tasks.size();
+        unsigned int numWorkers = numTasks ? numTasks-1 : 0;
+        if (numWorkers > workers.size())
+            numWorkers = (unsigned int)workers.size();
+
+        nextTask = 0;
+
+        for (unsigned int i=0; i<numWorkers; i++)
+            Platform::Signal(workers[i].signalQuery);
+
+        RunTasks();
+
+        if (numWorkers)
+            Platform::WaitAll(&completeEvents[0], numWorkers);
+
+        bool bGotSomeAudio = false;
+        for (unsigned int i=0; i<numTasks; i++) {
+            if (tasks[i].bGotAudio)
+                bGotSomeAudio = true;
+        }
+
+        return bGotSomeAudio;
+    }
+};
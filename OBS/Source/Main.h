@@ -120,6 +120,7 @@ void WINAPI ProcessEvents();
 #include "../resource.h"
 #include "VolumeControl.h"
 #include "VolumeMeter.h"
+#include "AudioMeter.h"
 #include "OBS.h"
 #include "WindowStuff.h"
 #include "CodeTokenizer.h"
@@ -132,6 +132,7 @@ OBS::OBS()
 
     hSceneMutex = OSCreateMutex();
     hAuxAudioMutex = OSCreateMutex();
+    audioQueryPool = NULL;
     hVideoEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
 
     monitors.Clear();
@@ -1632,8 +1633,26 @@ void OBS::ReloadIniSettings()
 
 void OBS::UpdateAudioMeters()
 {
-    SetVolumeMeterValue(GetDlgItem(hwndMain, ID_DESKTOPVOLUMEMETER), desktopMag, desktopMax, desktopPeak);
-    SetVolumeMeterValue(GetDlgItem(hwndMain, ID_MICVOLUMEMETER), micMag, micMax, micPeak);
+    AudioMeterSnapshot levels = meterSnapshot.Read();
+
+    SetVolumeMeterValue(GetDlgItem(hwndMain, ID_DESKTOPVOLUMEMETER), levels.desktopMag, levels.desktopMax, levels.desktopPeak);
+    SetVolumeMeterValue(GetDlgItem(hwndMain, ID_MICVOLUMEMETER), levels.micMag, levels.micMax, levels.micPeak);
+}
+
+bool OBS::GetAudioSourceLevels(AudioSource *source, AudioLevels &levels) const
+{
+    AudioMeterSnapshot snapshot = meterSnapshot.Read();
+
+    for(UINT i=0; i<snapshot.numSources; i++)
+    {
+        if(snapshot.sources[i].source == source)
+        {
+            levels = snapshot.sources[i].levels;
+            return true;
+        }
+    }
+
+    return false;
 }
 
 HICON OBS::GetIcon(HINSTANCE hInst, int resource)
@@ -442,6 +442,27 @@ enum
 
 //----------------------------
 
+#define MAX_METERED_AUDIO_SOURCES 32
+
+struct MeteredAudioSource
+{
+    AudioSource *source;
+    AudioLevels levels;
+};
+
+//what the desktop and mic meters show, in dB, and the levels of each source that was mixed (desktop, mic, then the
+//aux sources).  the audio thread publishes it every 10ms through meterSnapshot
+struct AudioMeterSnapshot
+{
+    float desktopMag, desktopMax, desktopPeak;
+    float micMag, micMax, micPeak;
+
+    UINT numSources;
+    MeteredAudioSource sources[MAX_METERED_AUDIO_SOURCES];
+};
+
+//----------------------------
+
 enum ColorPrimaries
 {
     ColorPrimaries_BT709 = 1,
@@ -601,6 +622,9 @@ enum PreviewDrawType {
 void ResetWASAPIAudioDevice(AudioSource *source);
 
 struct FrameProcessInfo;
+template<typename Source, typename Platform> class AudioQueryPool;
+struct Win32AudioQueryPlatform;
+typedef AudioQueryPool<AudioSource, Win32AudioQueryPlatform> OBSAudioQueryPool;
 
 enum class SceneCollectionAction {
     Add,
@@ -895,14 +919,13 @@ private:
     QWORD   latestAudioTime;
 
     float   desktopVol, micVol, curMicVol, curDesktopVol;
-    float   desktopPeak, micPeak;
-    float   desktopMax, micMax;
-    float   desktopMag, micMag;
+    SnapshotPublisher<AudioMeterSnapshot> meterSnapshot;
     List<FrameAudio> pendingAudioFrames;
     bool    bForceMicMono;
     float   desktopBoost, micBoost;
 
     HANDLE hAuxAudioMutex;
+    OBSAudioQueryPool *audioQueryPool;
 
     //---------------------------------------------------
     // hotkey stuff
@@ -933,6 +956,7 @@ private:
     bool bRecordFromReplayBufferHotkeyDown;
 
     static DWORD STDCALL MainAudioThread(LPVOID lpUnused);
+    bool QueryAudioSources(bool bDrain);
     bool QueryAudioBuffers(bool bQueriedDesktopDebugParam);
     bool QueryNewAudio();
     void EncodeAudioSegment(float *buffer, UINT numFrames, QWORD timestamp);
@@ -1054,6 +1078,7 @@ private:
     static void STDCALL MuteDesktopHotkey(DWORD hotkey, UPARAM param, bool bDown);
 
     void UpdateAudioMeters();
+    bool GetAudioSourceLevels(AudioSource *source, AudioLevels &levels) const;
 
     static void GetNewSceneName(String &strScene);
     static void GetNewSourceName(String &strSource);
@@ -18,6 +18,7 @@
 
 
 #include "Main.h"
+#include "AudioQueryPool.h"
 #include <time.h>
 #include <Avrt.h>
 
@@ -831,6 +832,9 @@ retryHookTestV2:
     hSoundDataMutex = OSCreateMutex();
     hSoundThread = OSCreateThread((XTHREAD)OBS::MainAudioThread, NULL);
 
+    //the meters are redrawn from the audio thread's latest levels every 50ms
+    SetTimer(hwndMain, ID_MICVOLUMEMETER, 50, NULL);
+
     //-------------------------------------------------------------
 
     //if (!useInputDevices)
@@ -914,6 +918,17 @@ retryHookTestV2:
     ConfigureStreamButtons();
 }
 
+static void LogSegmentAllocations(AudioSource *source)
+{
+    if(!source)
+        return;
+
+    UINT numSegments, numAllocs;
+    source->GetSegmentAllocations(numSegments, numAllocs);
+    CTSTR name = source->GetDeviceName2();
+    Log(TEXT("Audio source '%s': %u segments queued, %u allocations"), name ? name : TEXT(""), numSegments, numAllocs);
+}
+
 void OBS::Stop(bool overrideKeepRecording, bool stopReplayBuffer)
 {
     if((!bStreaming && !bRecording && !bRunning && !bRecordingReplayBuffer) && (!bTestStream)) return;
@@ -1014,6 +1029,9 @@ void OBS::Stop(bool overrideKeepRecording, bool stopReplayBuffer)
     //hRequestAudioEvent = NULL;
     hSoundDataMutex = NULL;
 
+    KillTimer(hwndMain, ID_MICVOLUMEMETER);
+    UpdateAudioMeters();
+
     //-------------------------------------------------------------
 
     StopBlankSoundPlayback();
@@ -1042,6 +1060,13 @@ void OBS::Stop(bool overrideKeepRecording, bool stopReplayBuffer)
     if (bRecording) StopRecording(true);
     if (bRecordingReplayBuffer) StopReplayBuffer(true);
 
+    //-------------------------------------------------------------
+
+    LogSegmentAllocations(desktopAudio);
+    LogSegmentAllocations(micAudio);
+    for(UINT i=0; i<auxAudioSources.Num(); i++)
+        LogSegmentAllocations(auxAudioSources[i]);
+
     delete micAudio;
     micAudio = NULL;
 
@@ -1193,66 +1218,89 @@ DWORD STDCALL OBS::MainAudioThread(LPVOID lpUnused)
 
 #define INVALID_LL 0xFFFFFFFFFFFFFFFFLL
 
-inline void CalculateVolumeLevels(float *buffer, int totalFloats, float mulVal, float &RMS, float &MAX)
+inline float toDB(float RMS)
 {
-    float sum = 0.0f;
-    int totalFloatsStore = totalFloats;
+    float db = 20.0f * log10(RMS);
+    if(!_finite(db))
+        return VOL_MIN;
+    return db;
+}
 
-    float Max = 0.0f;
+//the win32 side of AudioQueryPool.  the workers run at "Pro Audio" priority like the mixer thread
+struct Win32AudioQueryPlatform
+{
+    typedef HANDLE Event;
+    typedef HANDLE Thread;
+
+    static inline Event CreateSignal()                          {return CreateEvent(NULL, FALSE, FALSE, NULL);}
+    static inline void DestroySignal(Event e)                   {CloseHandle(e);}
+    static inline void Signal(Event e)                          {SetEvent(e);}
+    static inline void Wait(Event e)                            {WaitForSingleObject(e, INFINITE);}
+    static inline void WaitAll(Event *events, unsigned int num) {WaitForMultipleObjects(num, events, TRUE, INFINITE);}
+    static inline long Increment(volatile long *value)          {return InterlockedIncrement(value);}
 
-    if((UPARAM(buffer) & 0xF) == 0)
+    struct ThreadStart
     {
-        UINT alignedFloats = totalFloats & 0xFFFFFFFC;
-        __m128 sseMulVal = _mm_set_ps1(mulVal);
+        void (*proc)(void*);
+        void *param;
+    };
 
-        for(UINT i=0; i<alignedFloats; i += 4)
-        {
-            __m128 sseScaledVals = _mm_mul_ps(_mm_load_ps(buffer+i), sseMulVal);
-
-            /*compute squares and add them to the sum*/
-            __m128 sseSquares = _mm_mul_ps(sseScaledVals, sseScaledVals);
-            sum += sseSquares.m128_f32[0] + sseSquares.m128_f32[1] + sseSquares.m128_f32[2] + sseSquares.m128_f32[3];
-
-            /* 
-                sse maximum of squared floats 
-                concept from: http://stackoverflow.com/questions/9795529/how-to-find-the-horizontal-maximum-in-a-256-bit-avx-vector
-            */
-            __m128 sseSquaresP = _mm_shuffle_ps(sseSquares, sseSquares, _MM_SHUFFLE(1, 0, 3, 2));
-            __m128 halfmax = _mm_max_ps(sseSquares, sseSquaresP);
-            __m128 halfmaxP = _mm_shuffle_ps(halfmax, halfmax, _MM_SHUFFLE(0,1,2,3));
-            __m128 maxs = _mm_max_ps(halfmax, halfmaxP);
-
-            Max = max(Max, maxs.m128_f32[0]);
-        }
+    static DWORD STDCALL ThreadProc(ThreadStart *start)
+    {
+        ThreadStart info = *start;
+        delete start;
+
+        CoInitialize(0);
+
+        DWORD taskID = 0;
+        HANDLE hTask = AvSetMmThreadCharacteristics(TEXT("Pro Audio"), &taskID);
 
-        buffer      += alignedFloats;
-        totalFloats -= alignedFloats;
+        info.proc(info.param);
+
+        AvRevertMmThreadCharacteristics(hTask);
+        CoUninitialize();
+        return 0;
     }
 
-    for(int i=0; i<totalFloats; i++)
+    static Thread StartThread(void (*proc)(void*), void *param)
     {
-        float val = buffer[i] * mulVal;
-        float pow2Val = val * val;
-        sum += pow2Val;
-        Max = max(Max, pow2Val);
+        ThreadStart *start = new ThreadStart;
+        start->proc = proc;
+        start->param = param;
+
+        HANDLE hThread = OSCreateThread((XTHREAD)ThreadProc, start);
+        if (!hThread)
+            delete start;
+
+        return hThread;
     }
 
-    RMS = sqrt(sum / totalFloatsStore);
-    MAX = sqrt(Max);
-}
+    static inline void JoinThread(Thread thread) {OSTerminateThread(thread, 10000);}
+};
 
-inline float toDB(float RMS)
+bool OBS::QueryAudioSources(bool bDrain)
 {
-    float db = 20.0f * log10(RMS);
-    if(!_finite(db))
-        return VOL_MIN;
-    return db;
+    OBSAudioQueryPool *pool = audioQueryPool;
+
+    OSEnterMutex(hAuxAudioMutex);
+
+    pool->ClearTasks();
+
+    for (UINT i=0; i<auxAudioSources.Num(); i++)
+        pool->AddTask(auxAudioSources[i], auxAudioSources[i]->GetVolume(), bDrain);
+
+    if (micAudio)
+        pool->AddTask(micAudio, curMicVol, bDrain);
+
+    bool bGotSomeAudio = pool->Run();
+
+    OSLeaveMutex(hAuxAudioMutex);
+
+    return bGotSomeAudio;
 }
 
 bool OBS::QueryAudioBuffers(bool bQueriedDesktopDebugParam)
 {
-    bool bGotSomeAudio = false;
-
     if (!latestAudioTime) {
         desktopAudio->GetEarliestTimestamp(latestAudioTime); //will always return true
     } else {
@@ -1266,22 +1314,7 @@ bool OBS::QueryAudioBuffers(bool bQueriedDesktopDebugParam)
 
     bufferedAudioTimes << latestAudioTime;
 
-    OSEnterMutex(hAuxAudioMutex);
-    for(UINT i=0; i<auxAudioSources.Num(); i++)
-    {
-        if (auxAudioSources[i]->QueryAudio2(auxAudioSources[i]->GetVolume(), true) != NoAudioAvailable)
-            bGotSomeAudio = true;
-    }
-
-    OSLeaveMutex(hAuxAudioMutex);
-
-    if(micAudio != NULL)
-    {
-        if (micAudio->QueryAudio2(curMicVol, true) != NoAudioAvailable)
-            bGotSomeAudio = true;
-    }
-
-    return bGotSomeAudio;
+    return QueryAudioSources(false);
 }
 
 bool OBS::QueryNewAudio()
@@ -1325,38 +1358,8 @@ bool OBS::QueryNewAudio()
     /* wait until buffers are completely filled before accounting for burst */
     if (!bAudioBufferFilled)
     {
-        QWORD timestamp;
-        int burst = 0;
-
         // No more desktop data, drain auxilary/mic buffers until they're dry to prevent burst data
-        OSEnterMutex(hAuxAudioMutex);
-        for(UINT i=0; i<auxAudioSources.Num(); i++)
-        {
-            while (auxAudioSources[i]->QueryAudio2(auxAudioSources[i]->GetVolume(), true) != NoAudioAvailable)
-                burst++;
-
-            if (auxAudioSources[i]->GetLatestTimestamp(timestamp))
-                auxAudioSources[i]->SortAudio(timestamp);
-
-            /*if (burst > 10)
-                Log(L"Burst happened for %s", auxAudioSources[i]->GetDeviceName2());*/
-        }
-
-        OSLeaveMutex(hAuxAudioMutex);
-
-        burst = 0;
-
-        if (micAudio)
-        {
-            while (micAudio->QueryAudio2(curMicVol, true) != NoAudioAvailable)
-                burst++;
-
-            /*if (burst > 10)
-                Log(L"Burst happened for %s", micAudio->GetDeviceName2());*/
-
-            if (micAudio->GetLatestTimestamp(timestamp))
-                micAudio->SortAudio(timestamp);
-        }
+        QueryAudioSources(true);
     }
 
     return bAudioBufferFilled;
@@ -1377,6 +1380,49 @@ void OBS::EncodeAudioSegment(float *buffer, UINT numFrames, QWORD timestamp)
     }
 }
 
+//an aux source's meter.  the true peak filter looks back across buffers, so the meter has to stay with its source
+struct AuxAudioMeter
+{
+    AudioSource *source;
+    AudioMeter meter;
+};
+
+//  Finds the meter of the i-th aux source.  the meters are kept in the same order as the sources, so it's normally
+//at i; when a source was added, removed or moved, its meter is moved to i, or a new one is put there.
+static AudioMeter& GetAuxAudioMeter(List<AuxAudioMeter> &auxMeters, UINT i, AudioSource *source)
+{
+    if (i >= auxMeters.Num() || auxMeters[i].source != source) {
+        UINT found = INVALID;
+        for (UINT j=i+1; j<auxMeters.Num(); j++) {
+            if (auxMeters[j].source == source) {
+                found = j;
+                break;
+            }
+        }
+
+        if (found != INVALID) {
+            AuxAudioMeter meter = auxMeters[found];
+            auxMeters.Remove(found);
+            auxMeters.Insert(i, meter);
+        } else {
+            AuxAudioMeter meter;
+            meter.source = source;
+            auxMeters.Insert(i, meter);
+        }
+    }
+
+    return auxMeters[i].meter;
+}
+
+static void AddMeteredSource(AudioMeterSnapshot &snapshot, AudioSource *source, const AudioLevels &levels)
+{
+    if (snapshot.numSources < MAX_METERED_AUDIO_SOURCES) {
+        snapshot.sources[snapshot.numSources].source = source;
+        snapshot.sources[snapshot.numSources].levels = levels;
+        snapshot.numSources++;
+    }
+}
+
 void OBS::MainAudioLoop()
 {
     const unsigned int audioSamplesPerSec = App->GetSampleRateHz();
@@ -1389,19 +1435,36 @@ void OBS::MainAudioLoop()
 
     bPushToTalkOn = false;
 
-    micMax = desktopMax = VOL_MIN;
-    micPeak = desktopPeak = VOL_MIN;
+    float desktopMag, desktopMax, desktopPeak;
+    float micMag, micMax, micPeak;
+    desktopMag = desktopMax = desktopPeak = VOL_MIN;
+    micMag = micMax = micPeak = VOL_MIN;
 
-    UINT audioFramesSinceMeterUpdate = 0;
     UINT audioFramesSinceMicMaxUpdate = 0;
     UINT audioFramesSinceDesktopMaxUpdate = 0;
 
-    List<float> mixBuffer, levelsBuffer;
+    //every source is measured as it's mixed, and the desktop meter measures desktop and aux audio mixed together
+    AudioMeter desktopMeter, micMeter, desktopMixMeter;
+    List<AuxAudioMeter> auxMeters;
+
+    //silent levels, for sources that had nothing to mix
+    AudioLevels noLevels = {0.0f, 0.0f, 0.0f};
+    AudioMeterSnapshot snapshot;
+    zero(&snapshot, sizeof(snapshot));
+
+    List<float> mixBuffer;
     mixBuffer.SetSize(audioSampleSize*2);
-    levelsBuffer.SetSize(audioSampleSize*2);
 
     latestAudioTime = 0;
 
+    //---------------------------------------------
+    // workers that query the aux sources and the mic alongside this thread
+
+    OBSAudioQueryPool queryPool;
+    queryPool.Start(bUseMultithreadedOptimizations ? MIN(MAX(OSGetTotalCores()-1, 0), 3) : 0);
+
+    audioQueryPool = &queryPool;
+
     //---------------------------------------------
     // the audio loop of doom
 
@@ -1430,64 +1493,76 @@ void OBS::MainAudioLoop()
             QWORD timestamp = bufferedAudioTimes[0];
             bufferedAudioTimes.Remove(0);
 
-            zero(mixBuffer.Array(),    audioSampleSize*2*sizeof(float));
-            zero(levelsBuffer.Array(), audioSampleSize*2*sizeof(float));
-
-            //----------------------------------------------------------------------------
-            // get latest sample for calculating the volume levels
-
-            float *latestDesktopBuffer = NULL, *latestMicBuffer = NULL;
+            zero(mixBuffer.Array(), audioSampleSize*2*sizeof(float));
 
             desktopAudio->GetBuffer(&desktopBuffer, timestamp);
-            desktopAudio->GetNewestFrame(&latestDesktopBuffer);
 
-            if (micAudio != NULL) {
+            if (micAudio != NULL)
                 micAudio->GetBuffer(&micBuffer, timestamp);
-                micAudio->GetNewestFrame(&latestMicBuffer);
-            }
 
             //----------------------------------------------------------------------------
             // mix desktop samples
 
             if (desktopBuffer)
-                MixAudio(mixBuffer.Array(), desktopBuffer, audioSampleSize*2, false);
+                MixAudioMetered(mixBuffer.Array(), desktopBuffer, audioSampleSize*2, false, desktopMeter);
 
-            if (latestDesktopBuffer)
-                MixAudio(levelsBuffer.Array(), latestDesktopBuffer, audioSampleSize*2, false);
+            snapshot.numSources = 0;
+            AddMeteredSource(snapshot, desktopAudio, desktopBuffer ? desktopMeter.GetLevels() : noLevels);
 
             //----------------------------------------------------------------------------
-            // get latest aux volume level samples and mix
+            // mix output aux sound samples with the desktop
 
             OSEnterMutex(hAuxAudioMutex);
 
-            for (UINT i=0; i<auxAudioSources.Num(); i++) {
-                float *latestAuxBuffer;
-
-                if(auxAudioSources[i]->GetNewestFrame(&latestAuxBuffer))
-                    MixAudio(levelsBuffer.Array(), latestAuxBuffer, audioSampleSize*2, false);
-            }
-
-            //----------------------------------------------------------------------------
-            // mix output aux sound samples with the desktop
+            //the mic goes before the aux sources in the snapshot, its levels are filled in once it's mixed
+            UINT micSnapshotIndex = snapshot.numSources;
+            if (micAudio != NULL)
+                AddMeteredSource(snapshot, micAudio, noLevels);
 
             for (UINT i=0; i<auxAudioSources.Num(); i++) {
+                AudioSource *auxSource = auxAudioSources[i];
+                AudioMeter &auxMeter = GetAuxAudioMeter(auxMeters, i, auxSource);
                 float *auxBuffer;
 
-                if(auxAudioSources[i]->GetBuffer(&auxBuffer, timestamp))
-                    MixAudio(mixBuffer.Array(), auxBuffer, audioSampleSize*2, false);
+                if(auxSource->GetBuffer(&auxBuffer, timestamp)) {
+                    MixAudioMetered(mixBuffer.Array(), auxBuffer, audioSampleSize*2, false, auxMeter);
+                    AddMeteredSource(snapshot, auxSource, auxMeter.GetLevels());
+                } else {
+                    AddMeteredSource(snapshot, auxSource, noLevels);
+                }
             }
 
+            //meters of sources that were removed
+            if (auxMeters.Num() > auxAudioSources.Num())
+                auxMeters.SetSize(auxAudioSources.Num());
+
             OSLeaveMutex(hAuxAudioMutex);
 
             //----------------------------------------------------------------------------
-            // multiply samples by volume and compute RMS and max of samples
-            // Use 1.0f instead of curDesktopVol, since aux audio sources already have their volume set, and shouldn't be boosted anyway.
+            // mix mic and desktop sound, measuring the desktop mix on the way
+            // also, it's perfectly fine to just mix into the returned buffer
+
+            bool bMicMixed = bMicEnabled && micBuffer;
+            if (bMicMixed)
+                MixAudioMetered(mixBuffer.Array(), micBuffer, audioSampleSize*2, bForceMicMono, micMeter, &desktopMixMeter);
+            else
+                desktopMixMeter.Measure(mixBuffer.Array(), audioSampleSize*2);
+
+            EncodeAudioSegment(mixBuffer.Array(), audioSampleSize, timestamp);
+
+            //----------------------------------------------------------------------------
+            // RMS and max of what was mixed.  the mic's volume is already applied to its samples.
+
+            AudioLevels desktopLevels = desktopMixMeter.GetLevels();
+            AudioLevels micLevels = noLevels;
+            if (bMicMixed)
+                micLevels = micMeter.GetLevels();
+
+            if (micSnapshotIndex < snapshot.numSources && snapshot.sources[micSnapshotIndex].source == micAudio)
+                snapshot.sources[micSnapshotIndex].levels = micLevels;
 
-            float desktopRMS = 0, micRMS = 0, desktopMx = 0, micMx = 0;
-            if (latestDesktopBuffer)
-                CalculateVolumeLevels(levelsBuffer.Array(), audioSampleSize*2, 1.0f, desktopRMS, desktopMx);
-            if (bMicEnabled && latestMicBuffer)
-                CalculateVolumeLevels(latestMicBuffer, audioSampleSize*2, curMicVol, micRMS, micMx);
+            float desktopRMS = desktopLevels.rms, micRMS = micLevels.rms;
+            float desktopMx = desktopLevels.peak, micMx = micLevels.peak;
 
             //----------------------------------------------------------------------------
             // convert RMS and Max of samples to dB 
@@ -1538,22 +1613,15 @@ void OBS::MainAudioLoop()
             micMag = rmsAlpha * micRMS + micMag * (1.0f - rmsAlpha);
 
             //----------------------------------------------------------------------------
-            // update the meter about every 50ms
-
-            audioFramesSinceMeterUpdate += audioSampleSize;
-            if (audioFramesSinceMeterUpdate >= (audioSampleSize*5)) {
-                PostMessage(hwndMain, WM_COMMAND, MAKEWPARAM(ID_MICVOLUMEMETER, VOLN_METERED), 0);
-                audioFramesSinceMeterUpdate = 0;
-            }
-
-            //----------------------------------------------------------------------------
-            // mix mic and desktop sound
-            // also, it's perfectly fine to just mix into the returned buffer
-
-            if (bMicEnabled && micBuffer)
-                MixAudio(mixBuffer.Array(), micBuffer, audioSampleSize*2, bForceMicMono);
-
-            EncodeAudioSegment(mixBuffer.Array(), audioSampleSize, timestamp);
+            // hand the levels to the UI, which redraws the meters on its own timer
+
+            snapshot.desktopMag  = desktopMag;
+            snapshot.desktopMax  = desktopMax;
+            snapshot.desktopPeak = desktopPeak;
+            snapshot.micMag      = micMag;
+            snapshot.micMax      = micMax;
+            snapshot.micPeak     = micPeak;
+            meterSnapshot.Publish(snapshot);
         }
         else
         {
@@ -1566,14 +1634,28 @@ void OBS::MainAudioLoop()
             bRecievedFirstAudioFrame = true;
     }
 
-    desktopMag = desktopMax = desktopPeak = VOL_MIN;
-    micMag = micMax = micPeak = VOL_MIN;
+    snapshot.desktopMag = snapshot.desktopMax = snapshot.desktopPeak = VOL_MIN;
+    snapshot.micMag = snapshot.micMax = snapshot.micPeak = VOL_MIN;
+    snapshot.numSources = 0;
+    meterSnapshot.Publish(snapshot);
 
-    PostMessage(hwndMain, WM_COMMAND, MAKEWPARAM(ID_MICVOLUMEMETER, VOLN_METERED), 0);
+    Log(TEXT("Highest true peaks: desktop mix %.1f dBTP, desktop %.1f dBTP, mic %.1f dBTP"),
+        toDB(desktopMixMeter.GetHighestTruePeak()), toDB(desktopMeter.GetHighestTruePeak()), toDB(micMeter.GetHighestTruePeak()));
+
+    OSEnterMutex(hAuxAudioMutex);
+    for (UINT i=0; i<auxAudioSources.Num(); i++) {
+        CTSTR name = auxAudioSources[i]->GetDeviceName2();
+        Log(TEXT("    %s: %.1f dBTP"), name ? name : TEXT("aux"), toDB(GetAuxAudioMeter(auxMeters, i, auxAudioSources[i]).GetHighestTruePeak()));
+    }
+    OSLeaveMutex(hAuxAudioMutex);
 
     for (UINT i=0; i<pendingAudioFrames.Num(); i++)
         pendingAudioFrames[i].audioData.Clear();
 
+    queryPool.Stop();
+
+    audioQueryPool = NULL;
+
     AvRevertMmThreadCharacteristics(hTask);
 }
 
@@ -3739,13 +3739,6 @@ LRESULT CALLBACK OBS::OBSProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lPa
                         }
                     }
                     break;
-                case ID_DESKTOPVOLUMEMETER:
-                case ID_MICVOLUMEMETER:
-                    if(HIWORD(wParam) == VOLN_METERED)
-                    {
-                        App->UpdateAudioMeters();
-                    }
-                    break;
                 case ID_SCENEEDITOR:
                     if(HIWORD(wParam) == BN_CLICKED)
                         App->bEditMode = !App->bEditMode;
@@ -4444,6 +4437,11 @@ LRESULT CALLBACK OBS::OBSProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lPa
             App->SetStatusBarData();
             break;
 
+        case WM_TIMER:
+            if(wParam == ID_MICVOLUMEMETER)
+                App->UpdateAudioMeters();
+            break;
+
         case OBS_CONFIGURE_STREAM_BUTTONS:
             App->ConfigureStreamButtons();
             break;
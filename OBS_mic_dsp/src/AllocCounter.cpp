@@ -0,0 +1,61 @@
+#include "AllocCounter.h"
+#include <stdlib.h>
+#include <new>
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+static THREAD_LOCAL unsigned int s_threadAllocs = 0;
+
+unsigned int ThreadAllocations(void)
+{
+    return s_threadAllocs;
+}
+
+void *operator new(size_t size)
+{
+    s_threadAllocs++;
+    void *p = malloc(size ? size : 1);
+    if(!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) throw()
+{
+    s_threadAllocs++;
+    return malloc(size ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) throw()
+{
+    return operator new(size, std::nothrow);
+}
+
+void operator delete(void *p) throw()
+{
+    free(p);
+}
+
+void operator delete[](void *p) throw()
+{
+    free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) throw()
+{
+    free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) throw()
+{
+    free(p);
+}
@@ -0,0 +1,9 @@
+#ifndef INCLUDED_AllocCounter_H
+#define INCLUDED_AllocCounter_H
+
+// Number of times the calling thread has allocated through operator new, so the capture path can show that it stops
+// allocating once it's warmed up. AllocCounter.cpp replaces the global operator new to count them, which only affects
+// the module it's linked into; what Speex, the DMO or OBS allocate isn't seen.
+unsigned int ThreadAllocations(void);
+
+#endif
@@ -0,0 +1,553 @@
+#include "DSPChain.h"
+#include "DSPKernels.h"
+#include <math.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+DSPChain::DSPChain()
+    : _sampleRate(0),
+    _segmentSize(0),
+    _sliceSize(0),
+    _floatChain(false),
+    _numDropped(0),
+    _stateMem(nullptr),
+    _stateMemSize(0),
+    _stateMemLocked(false),
+    _speexState(nullptr),
+    _silenceSkip(false),
+    _skipping(false),
+    _hangoverSegments(0),
+    _silentSegments(0),
+    _sinceRefresh(0),
+    _skippedSegments(0),
+    _comfortGain(1),
+    _limit(false),
+    _echoState(nullptr),
+    _farEndUnderruns(0),
+    _segment(nullptr),
+    _sliceOffset(0),
+    _upsample(false)
+{
+}
+
+DSPChain::~DSPChain()
+{
+    FreeSpeexStates();
+}
+
+// Allocates the block for the Speex states and tries to lock it. Failing to lock it isn't an error; the states then
+// just live in ordinary memory.
+bool DSPChain::AllocStateMemory(size_t size)
+{
+#ifdef _WIN32
+    _stateMem = VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if(!_stateMem)
+        return false;
+    _stateMemLocked = VirtualLock(_stateMem, size) != 0;
+#else
+    _stateMem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(_stateMem == MAP_FAILED)
+    {
+        _stateMem = nullptr;
+        return false;
+    }
+    _stateMemLocked = mlock(_stateMem, size) == 0;
+#endif
+    _stateMemSize = size;
+    return true;
+}
+
+void DSPChain::FreeSpeexStates(void)
+{
+    if(_speexState)
+    {
+        speex_preprocess_state_destroy(_speexState);
+        _speexState = nullptr;
+    }
+    if(_echoState)
+    {
+        speex_echo_state_destroy(_echoState);
+        _echoState = nullptr;
+    }
+
+    // Freeing the block unlocks it too
+    if(_stateMem)
+    {
+#ifdef _WIN32
+        VirtualFree(_stateMem, 0, MEM_RELEASE);
+#else
+        munmap(_stateMem, _stateMemSize);
+#endif
+        _stateMem = nullptr;
+    }
+    _stateMemSize = 0;
+    _stateMemLocked = false;
+}
+
+bool DSPChain::Init(const DSPChainConfig &config)
+{
+    FreeSpeexStates();
+
+    _sampleRate = config.sampleRate;
+    _segmentSize = config.sampleRate * config.frameMS / 1000;
+    _sliceSize = config.sampleRate * k_SliceMS / 1000;
+    _floatChain = config.floatChain;
+    _numDropped = 0;
+    _farEndUnderruns = 0;
+    _segment = nullptr;
+    _sliceOffset = 0;
+    _captureProfile.Reset();
+    _outputProfile.Reset();
+
+    if(_segmentSize == 0 || _segmentSize % _sliceSize != 0 || config.bufferedSegments == 0)
+        return false;
+
+    unsigned int capacity = _segmentSize * config.bufferedSegments;
+
+    // Speex sizes its FFTs from the frame. The echo canceller's filter is rounded up to whole frames.
+    unsigned int filterLength = (_sampleRate * config.echoFilterMS / 1000 + _segmentSize - 1) / _segmentSize *
+        _segmentSize;
+    size_t echoSize = 0, speexSize = 0;
+    if(config.echoFilterMS)
+        speex_echo_state_init_mem(_segmentSize, filterLength, 1, 1, nullptr, &echoSize);
+    if(config.noiseSuppression)
+        speex_preprocess_state_init_mem(_segmentSize, _sampleRate, nullptr, &speexSize);
+    if(echoSize + speexSize != 0 && !AllocStateMemory(echoSize + speexSize))
+        return false;
+
+    if(config.echoFilterMS)
+    {
+        _echoState = speex_echo_state_init_mem(_segmentSize, filterLength, 1, 1, _stateMem, &echoSize);
+        if(!_echoState || !_farEnd.Init(capacity, _segmentSize))
+            return false;
+
+        spx_int32_t rate = _sampleRate;
+        speex_echo_ctl(_echoState, SPEEX_ECHO_SET_SAMPLING_RATE, &rate);
+        _farSilence.assign(_segmentSize, 0);
+        if(_floatChain)
+            _floatFarEnd.resize(_segmentSize);
+    }
+
+    if(config.noiseSuppression)
+    {
+        _speexState = speex_preprocess_state_init_mem(_segmentSize, _sampleRate, (char *) _stateMem + echoSize,
+            &speexSize);
+        if(_speexState)
+        {
+            spx_int32_t noiseSuppress = config.noiseSuppressDB;
+            speex_preprocess_ctl(_speexState, SPEEX_PREPROCESS_SET_NOISE_SUPPRESS, &noiseSuppress);
+
+            // Lets the preprocessor suppress the echo the canceller leaves behind
+            if(_echoState)
+                speex_preprocess_ctl(_speexState, SPEEX_PREPROCESS_SET_ECHO_STATE, _echoState);
+
+            // The VAD doesn't change the output, it only reports its decision. Its default thresholds call most
+            // steady background noise speech.
+            if(config.silenceSkip)
+            {
+                spx_int32_t vad = 1;
+                spx_int32_t probStart = k_VADProbStart;
+                spx_int32_t probContinue = k_VADProbContinue;
+                speex_preprocess_ctl(_speexState, SPEEX_PREPROCESS_SET_VAD, &vad);
+                speex_preprocess_ctl(_speexState, SPEEX_PREPROCESS_SET_PROB_START, &probStart);
+                speex_preprocess_ctl(_speexState, SPEEX_PREPROCESS_SET_PROB_CONTINUE, &probContinue);
+            }
+        }
+    }
+
+    _silenceSkip = config.silenceSkip && _speexState;
+    _skipping = false;
+    _silentSegments = 0;
+    _sinceRefresh = 0;
+    _skippedSegments = 0;
+    _hangoverSegments = (k_HangoverMS + config.frameMS - 1) / config.frameMS;
+    // Until it's measured, assume silence comes out of the preprocessor attenuated by the full amount
+    _comfortGain = powf(10.0f, config.noiseSuppressDB / 20.0f);
+    _silenceDetector.Init(_sampleRate, _segmentSize);
+    if(_silenceSkip && !_floatChain)
+        _estimateBuf.resize(_segmentSize);
+
+    // The float chain limits whole segments at OBS's scale; the int16 chain limits whatever Write() gets, in 16-bit
+    // scale, before it's converted back
+    _limit = false;
+    if(config.limiterMS)
+    {
+        float ceiling = powf(10.0f, config.limiterCeilingDB / 20.0f) * (_floatChain ? 1.0f : 32767.0f);
+        if(!_limiter.Init(_sampleRate, config.limiterMS, ceiling, _floatChain ? _segmentSize : capacity))
+            return false;
+        _limit = true;
+    }
+
+    if(!_captureTimes.Init(config.bufferedSegments, 1))
+        return false;
+    if(_floatChain)
+    {
+        _convertBuf.resize(capacity);
+        if(!_floatInput.Init(capacity, _segmentSize) || !_floatOutput.Init(capacity, _segmentSize))
+            return false;
+    }
+    else
+    {
+        if(_limit)
+            _convertBuf.resize(capacity);
+        if(!_input.Init(capacity, _segmentSize) || !_output.Init(capacity, _segmentSize))
+            return false;
+    }
+
+    // Deliver audio at the consumer's rate directly if we can get there with a fixed integer ratio. The output is
+    // still mono; any channel duplication happens after this, so only one channel gets upsampled.
+    _upsample = config.outputRate > _sampleRate && config.outputRate % _sampleRate == 0 &&
+        _upsampler.Init(config.outputRate / _sampleRate, _sliceSize);
+
+    return true;
+}
+
+unsigned int DSPChain::OutputRate(void) const
+{
+    return _upsample ? _sampleRate * _upsampler.Factor() : _sampleRate;
+}
+
+double DSPChain::LatencyMS(void) const
+{
+    double ms = 1000.0 * LimiterLatency() / _sampleRate;
+    if(_upsample)
+        ms += 1000.0 * _upsampler.Latency() / OutputRate();
+    return ms;
+}
+
+unsigned int DSPChain::OutputSliceFrames(void) const
+{
+    return _upsample ? _sliceSize * _upsampler.Factor() : _sliceSize;
+}
+
+/// Capture side ///
+
+void DSPChain::Write(int16_t *samples, unsigned int count, float gain, bool mute)
+{
+    if(mute || gain == 0)
+    {
+        if(_floatChain)
+            _numDropped += count - _floatInput.Write(nullptr, count);
+        else
+        {
+            // What's still in the limiter's delay line is dropped, like the rest of the muted audio
+            if(_limit)
+                _limiter.Reset();
+            _numDropped += count - _input.Write(nullptr, count);
+        }
+    }
+    else if(_floatChain)
+        StoreSamples(_floatInput, samples, count, gain);
+    else
+        StoreSamples(_input, samples, count, gain);
+}
+
+void DSPChain::WriteFarEnd(const int16_t *samples, unsigned int count)
+{
+    if(!_echoState)
+        return;
+
+    // Keep the newest far-end audio. The capture side is the only consumer, so it's safe to consume here.
+    unsigned int free = _farEnd.Free();
+    if(count > free)
+        _farEnd.Consume(count - free);
+    _farEnd.Write(samples, count);
+}
+
+void DSPChain::StoreSamples(RingBuffer<int16_t> &ring, int16_t *data, unsigned int count, float gain)
+{
+    if(_limit)
+    {
+        // The gain is applied in float so the limiter sees the peaks that ApplyGainInt16() would clip. Unity gain
+        // goes through it too, to keep the delay constant. Reads longer than the conversion buffer go through it in
+        // pieces.
+        for(unsigned int done = 0; done < count;)
+        {
+            unsigned int run = count - done;
+            if(run > _convertBuf.size())
+                run = (unsigned int) _convertBuf.size();
+            {
+                StageTimer timer(_captureProfile, Stage_Gain);
+                ConvertInt16ToFloat(data + done, &_convertBuf[0], run, gain);
+            }
+            StageTimer timer(_captureProfile, Stage_Limiter);
+            _limiter.Process(&_convertBuf[0], run);
+            ConvertFloatToInt16(&_convertBuf[0], data + done, run);
+            done += run;
+        }
+    }
+    else if(gain != 1)
+    {
+        StageTimer timer(_captureProfile, Stage_Gain);
+        ApplyGainInt16(data, count, gain);
+    }
+
+    // Copy new samples into audio buffer
+    _numDropped += count - ring.Write(data, count);
+}
+
+void DSPChain::StoreSamples(RingBuffer<float> &ring, int16_t *data, unsigned int count, float gain)
+{
+    // Convert and apply gain in one pass. Samples stay in 16-bit scale, which is what Speex expects, and aren't
+    // clipped here so boosted peaks survive until the end of the chain. Reads longer than the conversion buffer go
+    // through it in pieces.
+    for(unsigned int done = 0; done < count;)
+    {
+        unsigned int run = count - done;
+        if(run > _convertBuf.size())
+            run = (unsigned int) _convertBuf.size();
+        {
+            StageTimer timer(_captureProfile, Stage_Gain);
+            ConvertInt16ToFloat(data + done, &_convertBuf[0], run, gain);
+        }
+        _numDropped += run - ring.Write(&_convertBuf[0], run);
+        done += run;
+    }
+}
+
+void DSPChain::CancelEcho(int16_t *segment)
+{
+    StageTimer timer(_captureProfile, Stage_Echo);
+
+    // With no far-end audio there's nothing to cancel, but the canceller still has to see the frame to stay in step
+    const int16_t *farEnd = _farEnd.Peek(_segmentSize);
+    if(farEnd)
+    {
+        speex_echo_cancellation(_echoState, segment, farEnd, segment);
+        _farEnd.Consume(_segmentSize);
+    }
+    else
+    {
+        speex_echo_cancellation(_echoState, segment, &_farSilence[0], segment);
+        _farEndUnderruns++;
+    }
+}
+
+void DSPChain::CancelEcho(float *segment)
+{
+    StageTimer timer(_captureProfile, Stage_Echo);
+
+    const int16_t *farEnd = _farEnd.Peek(_segmentSize);
+    if(farEnd)
+    {
+        ConvertInt16ToFloat(farEnd, &_floatFarEnd[0], _segmentSize, 1.0f);
+        _farEnd.Consume(_segmentSize);
+    }
+    else
+    {
+        ConvertInt16ToFloat(&_farSilence[0], &_floatFarEnd[0], _segmentSize, 1.0f);
+        _farEndUnderruns++;
+    }
+
+    // The mic samples go in unrounded and unclipped, and come out the same way
+    speex_echo_cancellation_float(_echoState, segment, &_floatFarEnd[0], segment);
+}
+
+bool DSPChain::RunPreprocessor(int16_t *segment)
+{
+    return speex_preprocess_run(_speexState, segment) != 0;
+}
+
+bool DSPChain::RunPreprocessor(float *segment)
+{
+    return speex_preprocess_run_float(_speexState, segment) != 0;
+}
+
+void DSPChain::UpdateEstimates(int16_t *segment)
+{
+    ConvertInt16ToFloat(segment, &_estimateBuf[0], _segmentSize, 1.0f);
+    speex_preprocess_estimate_update_float(_speexState, &_estimateBuf[0], _comfortGain);
+}
+
+void DSPChain::UpdateEstimates(float *segment)
+{
+    speex_preprocess_estimate_update_float(_speexState, segment, _comfortGain);
+}
+
+static void ScaleSegment(int16_t *segment, unsigned int count, float gain)
+{
+    ApplyGainInt16(segment, count, gain);
+}
+
+static void ScaleSegment(float *segment, unsigned int count, float gain)
+{
+    ScaleFloat(segment, count, gain);
+}
+
+template<typename T>
+void DSPChain::Preprocess(T *segment)
+{
+    if(!_silenceSkip)
+    {
+        RunPreprocessor(segment);
+        return;
+    }
+
+    bool quiet = _silenceDetector.IsSilent(segment);
+    if(quiet && _skipping && ++_sinceRefresh < k_RefreshSegments)
+    {
+        // Near enough what the preprocessor would have made of it
+        UpdateEstimates(segment);
+        ScaleSegment(segment, _segmentSize, _comfortGain);
+        _skippedSegments++;
+        return;
+    }
+    _sinceRefresh = 0;
+
+    float inEnergy = _silenceDetector.Energy();
+    bool speech = RunPreprocessor(segment);
+    if(!quiet || speech)
+    {
+        _silentSegments = 0;
+        _skipping = false;
+        return;
+    }
+
+    // Both stages call it silence, so this is how much the preprocessor attenuates the noise
+    float outEnergy = SilenceDetector::MeanSquare(segment, _segmentSize);
+    if(inEnergy > 0)
+    {
+        float gain = sqrtf(outEnergy / inEnergy);
+        _comfortGain += 0.1f * ((gain < 1 ? gain : 1) - _comfortGain);
+    }
+    if(++_silentSegments >= _hangoverSegments)
+        _skipping = true;
+}
+
+void DSPChain::ProcessSegment(int16_t *segment)
+{
+    if(_echoState)
+        CancelEcho(segment);
+
+    // Apply Speex noise removal if enabled
+    if(_speexState)
+    {
+        StageTimer timer(_captureProfile, Stage_Speex);
+        Preprocess(segment);
+    }
+}
+
+void DSPChain::ProcessSegment(float *segment)
+{
+    if(_echoState)
+        CancelEcho(segment);
+
+    {
+        StageTimer timer(_captureProfile, Stage_Speex);
+
+        // Apply Speex noise removal if enabled
+        if(_speexState)
+        {
+            Preprocess(segment);
+        }
+
+        // Scale to the -1..1 range OBS uses for float input
+        ScaleFloat(segment, _segmentSize, 1.0f / 32767.0f);
+    }
+
+    // This is the first place anything clips, when OBS mixes the audio
+    if(_limit)
+    {
+        StageTimer timer(_captureProfile, Stage_Limiter);
+        _limiter.Process(segment, _segmentSize);
+    }
+}
+
+unsigned int DSPChain::ProcessSegments(unsigned long long captureTime)
+{
+    if(_floatChain)
+        return ProcessSegments(_floatInput, _floatOutput, captureTime);
+    else
+        return ProcessSegments(_input, _output, captureTime);
+}
+
+template<typename T>
+unsigned int DSPChain::ProcessSegments(RingBuffer<T> &input, RingBuffer<T> &output, unsigned long long captureTime)
+{
+    // Segments are processed in place in the input queue, then passed on whole so the output side always stays
+    // aligned
+    unsigned int numQueued = 0;
+    T *segment;
+    while((segment = input.Peek(_segmentSize)) != nullptr)
+    {
+        ProcessSegment(segment);
+
+        // The capture time goes in first so it's there by the time the output side sees the segment. Both queues hold
+        // the same number of segments and are consumed together.
+        if(output.Free() >= _segmentSize)
+        {
+            StageTimer timer(_captureProfile, Stage_Handoff);
+            _captureTimes.Write(&captureTime, 1);
+            output.Write(segment, _segmentSize);
+            numQueued++;
+        }
+        else
+            _numDropped += _segmentSize;
+
+        input.Consume(_segmentSize);
+    }
+    return numQueued;
+}
+
+/// Output side ///
+
+const void *DSPChain::NextSlice(bool *newSegment, unsigned long long *captureTime)
+{
+    if(_floatChain)
+        return NextSlice(_floatOutput, newSegment, captureTime);
+    else
+        return NextSlice(_output, newSegment, captureTime);
+}
+
+template<typename T>
+const void *DSPChain::NextSlice(RingBuffer<T> &output, bool *newSegment, unsigned long long *captureTime)
+{
+    *newSegment = false;
+    if(!_segment)
+    {
+        // The segment stays in the output queue until its last slice is released, so the pointer remains valid
+        _segment = output.Peek(_segmentSize);
+        if(!_segment)
+            return nullptr;
+        *newSegment = true;
+    }
+    if(captureTime)
+    {
+        unsigned long long *time = _captureTimes.Peek(1);
+        *captureTime = time ? *time : 0;
+    }
+
+    const T *slice = (const T *) _segment + _sliceOffset;
+    if(!_upsample)
+        return slice;
+
+    StageTimer timer(_outputProfile, Stage_Upsample);
+    float *in = _upsampler.InputBuffer();
+    if(_floatChain)
+        memcpy(in, slice, _sliceSize * sizeof(float));
+    else
+        ConvertInt16ToFloat((const int16_t *) slice, in, _sliceSize, 1.0f / 32767.0f);
+    return _upsampler.Process(_sliceSize);
+}
+
+void DSPChain::ReleaseSlice(void)
+{
+    StageTimer timer(_outputProfile, Stage_Handoff);
+
+    _sliceOffset += _sliceSize;
+    if(_sliceOffset < _segmentSize)
+        return;
+
+    if(_floatChain)
+        _floatOutput.Consume(_segmentSize);
+    else
+        _output.Consume(_segmentSize);
+    _captureTimes.Consume(1);
+    _segment = nullptr;
+    _sliceOffset = 0;
+}
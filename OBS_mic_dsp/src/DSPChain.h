@@ -0,0 +1,207 @@
+#ifndef INCLUDED_DSPChain_H
+#define INCLUDED_DSPChain_H
+
+#include <stdint.h>
+#include <vector>
+#include "RingBuffer.h"
+#include "PolyphaseUpsampler.h"
+#include "StageProfiler.h"
+#include "SilenceDetector.h"
+#include "Limiter.h"
+#include "../../speex/include/speex/speex_preprocess.h"
+#include "../../speex/include/speex/speex_echo.h"
+
+struct DSPChainConfig
+{
+    unsigned int sampleRate;        // Rate of the captured samples, and of processing
+    unsigned int frameMS;           // Length of a segment (Speex frame), 10 or 20
+    unsigned int outputRate;        // Rate the consumer runs at; output is upsampled to it if it's a whole multiple
+    unsigned int bufferedSegments;  // Capacity of the input and output queues
+    bool floatChain;                // Process in float instead of int16
+    bool noiseSuppression;          // Run the Speex preprocessor
+    int noiseSuppressDB;            // Maximum Speex noise attenuation
+    unsigned int echoFilterMS;      // Length of the echo canceller's filter, or 0 for no echo cancellation
+    bool silenceSkip;               // Skip the preprocessor on silent segments (only with noiseSuppression)
+    unsigned int limiterMS;         // Look-ahead of the limiter that replaces clipping, or 0 to clip
+    float limiterCeilingDB;         // Highest true peak the limiter lets through, in dBFS
+
+    DSPChainConfig()
+        : sampleRate(16000),
+        frameMS(10),
+        outputRate(16000),
+        bufferedSegments(8),
+        floatChain(false),
+        noiseSuppression(true),
+        noiseSuppressDB(-30),
+        echoFilterMS(0),
+        silenceSkip(false),
+        limiterMS(0),
+        limiterCeilingDB(-1.0f)
+    {
+    }
+};
+
+// The mic processing chain, independent of where the audio comes from or goes to: gain and muting, cutting into
+// segments, Speex echo cancellation and preprocessing, and handing the result over in 10 ms slices at the consumer's
+// rate. The voice capture DMO source and the Speex echo method drive it in OBS, and the replay tool drives it from WAV
+// files.
+//
+// The capture side (Write and ProcessSegments) and the output side (NextSlice and ReleaseSlice) may run on different
+// threads, one each. Processed segments pass between them through a lock-free queue.
+class DSPChain
+{
+public:
+    DSPChain();
+    ~DSPChain();
+
+    DSPChain(const DSPChain &) = delete;
+    DSPChain &operator=(const DSPChain &) = delete;
+
+    // Sets up the chain. Not thread safe.
+    bool Init(const DSPChainConfig &config);
+
+    unsigned int SampleRate(void) const { return _sampleRate; }
+    unsigned int SegmentSize(void) const { return _segmentSize; }
+    bool NoiseSuppression(void) const { return _speexState != nullptr; }
+    bool EchoCancellation(void) const { return _echoState != nullptr; }
+
+    // Delay the limiter and upsampler add, which timestamps handed to OBS should be moved back by, in ms. The limiter
+    // delays the audio by LimiterLatency() samples at SampleRate().
+    double LatencyMS(void) const;
+    bool Limiting(void) const { return _limit; }
+    unsigned int LimiterLatency(void) const { return _limit ? _limiter.Latency() : 0; }
+
+    // Size of the block holding the Speex states, and whether it's locked in memory
+    size_t StateMemory(void) const { return _stateMemSize; }
+    bool StateMemoryLocked(void) const { return _stateMemLocked; }
+
+    // Format of the slices NextSlice() returns: mono, float in -1..1 or int16, OutputSliceFrames() frames at
+    // OutputRate()
+    bool OutputIsFloat(void) const { return _floatChain || _upsample; }
+    unsigned int OutputRate(void) const;
+    unsigned int OutputSliceFrames(void) const;
+    bool Upsampling(void) const { return _upsample; }
+    unsigned int UpsamplerLatency(void) const { return _upsampler.Latency(); }
+
+    // Samples lost because a queue was full, and segments that had no far-end audio to cancel against. Read them once
+    // both sides have stopped.
+    unsigned int Dropped(void) const { return _numDropped; }
+    unsigned int FarEndUnderruns(void) const { return _farEndUnderruns; }
+
+    // Segments that skipped the preprocessor as silence, and the lowest gain the limiter applied. Read them once the
+    // capture side has stopped.
+    unsigned int SkippedSegments(void) const { return _skippedSegments; }
+    float LimiterLowestGain(void) const { return _limiter.LowestGain(); }
+
+    /// Capture side ///
+
+    // Queues `count` captured samples with `gain` applied, or silence in their place if `mute` is set. int16 samples
+    // are amplified in place.
+    void Write(int16_t *samples, unsigned int count, float gain, bool mute);
+
+    // Queues `count` samples of the far-end (loudspeaker) signal for the echo canceller. Far-end audio should arrive no
+    // later than the mic audio it's echoed in; the oldest is discarded if it gets more than the queue's length ahead.
+    void WriteFarEnd(const int16_t *samples, unsigned int count);
+
+    // Processes every whole segment written so far and passes it to the output side, tagged with `captureTime`.
+    // Returns the number of segments passed on; any that don't fit are dropped.
+    unsigned int ProcessSegments(unsigned long long captureTime = 0);
+
+    StageProfiler &CaptureProfile(void) { return _captureProfile; }
+
+    /// Output side ///
+
+    // Returns the next slice of processed audio, or null if there is none yet. `newSegment` is set if the slice is the
+    // first one of a segment, and `captureTime` is set to the time the segment was tagged with. The slice stays valid
+    // until ReleaseSlice().
+    const void *NextSlice(bool *newSegment, unsigned long long *captureTime = nullptr);
+    void ReleaseSlice(void);
+
+    StageProfiler &OutputProfile(void) { return _outputProfile; }
+
+private:
+    // Written once for both sample types, like the rest of the chain
+    template<typename T> unsigned int ProcessSegments(RingBuffer<T> &input, RingBuffer<T> &output,
+        unsigned long long captureTime);
+    template<typename T> const void *NextSlice(RingBuffer<T> &output, bool *newSegment, unsigned long long *captureTime);
+    void StoreSamples(RingBuffer<int16_t> &ring, int16_t *data, unsigned int count, float gain);
+    void StoreSamples(RingBuffer<float> &ring, int16_t *data, unsigned int count, float gain);
+    void ProcessSegment(int16_t *segment);
+    void ProcessSegment(float *segment);
+    void CancelEcho(int16_t *segment);
+    void CancelEcho(float *segment);
+    template<typename T> void Preprocess(T *segment);
+    bool RunPreprocessor(int16_t *segment);
+    bool RunPreprocessor(float *segment);
+    void UpdateEstimates(int16_t *segment);
+    void UpdateEstimates(float *segment);
+    bool AllocStateMemory(size_t size);
+    void FreeSpeexStates(void);
+
+    unsigned int _sampleRate;
+    unsigned int _segmentSize;
+    unsigned int _sliceSize;
+    bool _floatChain;
+    unsigned int _numDropped;
+
+    // Both Speex states are placed in one block, so their arrays sit next to each other, and the block is locked in
+    // memory if the OS allows it
+    void *_stateMem;
+    size_t _stateMemSize;
+    bool _stateMemLocked;
+
+    SpeexPreprocessState *_speexState;
+
+    // Silence skipping. The detector is the first stage and the Speex VAD the second; once both have called a run of
+    // segments silent, further silent segments are scaled by the preprocessor's measured noise attenuation instead of
+    // going through it. They still update its noise estimate and overlap, so the first segment it processes after a
+    // skip isn't working from stale state, and every k_RefreshSegments-th one still goes through so the VAD keeps up.
+    SilenceDetector _silenceDetector;
+    bool _silenceSkip;
+    bool _skipping;
+    unsigned int _hangoverSegments;
+    unsigned int _silentSegments;
+    unsigned int _sinceRefresh;
+    unsigned int _skippedSegments;
+    float _comfortGain;
+    std::vector<float> _estimateBuf;
+
+    // The limiter runs where the chain would otherwise clip: on the gain in the int16 chain, and at the end of the
+    // float chain, on the -1..1 samples OBS clips
+    LookaheadLimiter _limiter;
+    bool _limit;
+
+    // Echo canceller. It works in place on either sample type; the far end is queued as int16 and converted for the
+    // float chain.
+    SpeexEchoState *_echoState;
+    RingBuffer<int16_t> _farEnd;
+    std::vector<int16_t> _farSilence;
+    std::vector<float> _floatFarEnd;
+    unsigned int _farEndUnderruns;
+
+    // Captured samples waiting to make up a segment, and processed segments waiting for the output side
+    RingBuffer<int16_t> _input;
+    RingBuffer<int16_t> _output;
+    RingBuffer<float> _floatInput;
+    RingBuffer<float> _floatOutput;
+    RingBuffer<unsigned long long> _captureTimes;
+    std::vector<float> _convertBuf;
+
+    // Output side: the segment being sliced, if any
+    const void *_segment;
+    unsigned int _sliceOffset;
+
+    PolyphaseUpsampler _upsampler;
+    bool _upsample;
+
+    StageProfiler _captureProfile;
+    StageProfiler _outputProfile;
+
+    static const unsigned int k_SliceMS = 10;
+    static const unsigned int k_HangoverMS = 300;
+    static const unsigned int k_RefreshSegments = 4;
+    static const int k_VADProbStart = 80;
+    static const int k_VADProbContinue = 65;
+};
+
+#endif
@@ -0,0 +1,556 @@
+#include "DSPKernels.h"
+
+#if defined _M_IX86 || defined _M_X64 || defined __i386__ || defined __x86_64__
+#define DSP_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+/// CPU feature detection ///
+
+#ifdef DSP_X86
+static bool CPUHasAVX2(void)
+{
+#ifdef _MSC_VER
+    int regs[4];
+    __cpuid(regs, 0);
+    if(regs[0] < 7)
+        return false;
+
+    // The OS has to save the YMM registers too, not just the CPU supporting AVX
+    __cpuid(regs, 1);
+    bool osxsave = (regs[2] & (1 << 27)) != 0;
+    bool avx = (regs[2] & (1 << 28)) != 0;
+    if(!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+        return false;
+
+    __cpuidex(regs, 7, 0);
+    return (regs[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif
+
+/// ApplyGainInt16 ///
+
+static void ApplyGainInt16_Scalar(int16_t *samples, unsigned int count, float gain)
+{
+    for(unsigned int i = 0; i < count; i++)
+    {
+        long sample = samples[i];
+        sample *= gain;
+        if(sample > 32767)
+            sample = 32767;
+        else if(sample < -32767)
+            sample = -32767;
+        samples[i] = (int16_t) sample;
+    }
+}
+
+#ifdef DSP_X86
+// Clipping happens in the float domain before truncation, which gives the same result as clipping the truncated
+// integer, and keeps huge products from wrapping in the conversion.
+static void ApplyGainInt16_SSE2(int16_t *samples, unsigned int count, float gain)
+{
+    const __m128 g = _mm_set1_ps(gain);
+    const __m128 maxVal = _mm_set1_ps(32767.0f);
+    const __m128 minVal = _mm_set1_ps(-32767.0f);
+
+    unsigned int i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        __m128i s = _mm_loadu_si128((const __m128i *) (samples + i));
+        __m128i sign = _mm_srai_epi16(s, 15);
+        __m128 lo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(s, sign));
+        __m128 hi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(s, sign));
+        lo = _mm_max_ps(_mm_min_ps(_mm_mul_ps(lo, g), maxVal), minVal);
+        hi = _mm_max_ps(_mm_min_ps(_mm_mul_ps(hi, g), maxVal), minVal);
+        __m128i out = _mm_packs_epi32(_mm_cvttps_epi32(lo), _mm_cvttps_epi32(hi));
+        _mm_storeu_si128((__m128i *) (samples + i), out);
+    }
+
+    ApplyGainInt16_Scalar(samples + i, count - i, gain);
+}
+
+TARGET_AVX2 static void ApplyGainInt16_AVX2(int16_t *samples, unsigned int count, float gain)
+{
+    const __m256 g = _mm256_set1_ps(gain);
+    const __m256 maxVal = _mm256_set1_ps(32767.0f);
+    const __m256 minVal = _mm256_set1_ps(-32767.0f);
+
+    unsigned int i = 0;
+    for(; i + 16 <= count; i += 16)
+    {
+        __m128i s0 = _mm_loadu_si128((const __m128i *) (samples + i));
+        __m128i s1 = _mm_loadu_si128((const __m128i *) (samples + i + 8));
+        __m256 f0 = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(s0));
+        __m256 f1 = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(s1));
+        f0 = _mm256_max_ps(_mm256_min_ps(_mm256_mul_ps(f0, g), maxVal), minVal);
+        f1 = _mm256_max_ps(_mm256_min_ps(_mm256_mul_ps(f1, g), maxVal), minVal);
+
+        // The pack works within 128-bit lanes, so put the 64-bit blocks back in order afterwards
+        __m256i out = _mm256_packs_epi32(_mm256_cvttps_epi32(f0), _mm256_cvttps_epi32(f1));
+        out = _mm256_permute4x64_epi64(out, 0xD8);
+        _mm256_storeu_si256((__m256i *) (samples + i), out);
+    }
+    _mm256_zeroupper();
+
+    ApplyGainInt16_SSE2(samples + i, count - i, gain);
+}
+#endif
+
+/// ConvertInt16ToFloat ///
+
+static void ConvertInt16ToFloat_Scalar(const int16_t *in, float *out, unsigned int count, float scale)
+{
+    for(unsigned int i = 0; i < count; i++)
+        out[i] = (float) in[i] * scale;
+}
+
+#ifdef DSP_X86
+static void ConvertInt16ToFloat_SSE2(const int16_t *in, float *out, unsigned int count, float scale)
+{
+    const __m128 s = _mm_set1_ps(scale);
+
+    unsigned int i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *) (in + i));
+        __m128i sign = _mm_srai_epi16(x, 15);
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(x, sign)), s));
+        _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(x, sign)), s));
+    }
+
+    ConvertInt16ToFloat_Scalar(in + i, out + i, count - i, scale);
+}
+
+TARGET_AVX2 static void ConvertInt16ToFloat_AVX2(const int16_t *in, float *out, unsigned int count, float scale)
+{
+    const __m256 s = _mm256_set1_ps(scale);
+
+    unsigned int i = 0;
+    for(; i + 16 <= count; i += 16)
+    {
+        __m256i x0 = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) (in + i)));
+        __m256i x1 = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) (in + i + 8)));
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(x0), s));
+        _mm256_storeu_ps(out + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(x1), s));
+    }
+    _mm256_zeroupper();
+
+    ConvertInt16ToFloat_SSE2(in + i, out + i, count - i, scale);
+}
+#endif
+
+/// ConvertFloatToInt16 ///
+
+static void ConvertFloatToInt16_Scalar(const float *in, int16_t *out, unsigned int count)
+{
+    for(unsigned int i = 0; i < count; i++)
+    {
+        float sample = in[i];
+        if(sample > 32767.0f)
+            sample = 32767.0f;
+        else if(sample < -32767.0f)
+            sample = -32767.0f;
+        out[i] = (int16_t) sample;
+    }
+}
+
+#ifdef DSP_X86
+static void ConvertFloatToInt16_SSE2(const float *in, int16_t *out, unsigned int count)
+{
+    const __m128 maxVal = _mm_set1_ps(32767.0f);
+    const __m128 minVal = _mm_set1_ps(-32767.0f);
+
+    unsigned int i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        __m128 lo = _mm_max_ps(_mm_min_ps(_mm_loadu_ps(in + i), maxVal), minVal);
+        __m128 hi = _mm_max_ps(_mm_min_ps(_mm_loadu_ps(in + i + 4), maxVal), minVal);
+        __m128i s = _mm_packs_epi32(_mm_cvttps_epi32(lo), _mm_cvttps_epi32(hi));
+        _mm_storeu_si128((__m128i *) (out + i), s);
+    }
+
+    ConvertFloatToInt16_Scalar(in + i, out + i, count - i);
+}
+
+TARGET_AVX2 static void ConvertFloatToInt16_AVX2(const float *in, int16_t *out, unsigned int count)
+{
+    const __m256 maxVal = _mm256_set1_ps(32767.0f);
+    const __m256 minVal = _mm256_set1_ps(-32767.0f);
+
+    unsigned int i = 0;
+    for(; i + 16 <= count; i += 16)
+    {
+        __m256 f0 = _mm256_max_ps(_mm256_min_ps(_mm256_loadu_ps(in + i), maxVal), minVal);
+        __m256 f1 = _mm256_max_ps(_mm256_min_ps(_mm256_loadu_ps(in + i + 8), maxVal), minVal);
+        __m256i s = _mm256_packs_epi32(_mm256_cvttps_epi32(f0), _mm256_cvttps_epi32(f1));
+        s = _mm256_permute4x64_epi64(s, 0xD8);
+        _mm256_storeu_si256((__m256i *) (out + i), s);
+    }
+    _mm256_zeroupper();
+
+    ConvertFloatToInt16_SSE2(in + i, out + i, count - i);
+}
+#endif
+
+/// ScaleFloat ///
+
+static void ScaleFloat_Scalar(float *samples, unsigned int count, float scale)
+{
+    for(unsigned int i = 0; i < count; i++)
+        samples[i] *= scale;
+}
+
+#ifdef DSP_X86
+static void ScaleFloat_SSE2(float *samples, unsigned int count, float scale)
+{
+    const __m128 s = _mm_set1_ps(scale);
+
+    unsigned int i = 0;
+    for(; i + 4 <= count; i += 4)
+        _mm_storeu_ps(samples + i, _mm_mul_ps(_mm_loadu_ps(samples + i), s));
+
+    ScaleFloat_Scalar(samples + i, count - i, scale);
+}
+
+TARGET_AVX2 static void ScaleFloat_AVX2(float *samples, unsigned int count, float scale)
+{
+    const __m256 s = _mm256_set1_ps(scale);
+
+    unsigned int i = 0;
+    for(; i + 8 <= count; i += 8)
+        _mm256_storeu_ps(samples + i, _mm256_mul_ps(_mm256_loadu_ps(samples + i), s));
+    _mm256_zeroupper();
+
+    ScaleFloat_SSE2(samples + i, count - i, scale);
+}
+#endif
+
+/// MultiplyFloat ///
+
+static void MultiplyFloat_Scalar(const float *in, const float *gains, float *out, unsigned int count)
+{
+    for(unsigned int i = 0; i < count; i++)
+        out[i] = in[i] * gains[i];
+}
+
+#ifdef DSP_X86
+static void MultiplyFloat_SSE2(const float *in, const float *gains, float *out, unsigned int count)
+{
+    unsigned int i = 0;
+    for(; i + 4 <= count; i += 4)
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(in + i), _mm_loadu_ps(gains + i)));
+
+    MultiplyFloat_Scalar(in + i, gains + i, out + i, count - i);
+}
+
+TARGET_AVX2 static void MultiplyFloat_AVX2(const float *in, const float *gains, float *out, unsigned int count)
+{
+    unsigned int i = 0;
+    for(; i + 8 <= count; i += 8)
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_loadu_ps(in + i), _mm256_loadu_ps(gains + i)));
+    _mm256_zeroupper();
+
+    MultiplyFloat_SSE2(in + i, gains + i, out + i, count - i);
+}
+#endif
+
+/// UpsampleFloat ///
+
+static void UpsampleFloat_Scalar(const float *in, float *out, unsigned int count, const float *coefs, unsigned int factor,
+    unsigned int taps)
+{
+    for(unsigned int k = 0; k < count; k++)
+    {
+        const float *x = in + k - (taps - 1);
+        for(unsigned int p = 0; p < factor; p++)
+        {
+            const float *c = coefs + p * taps;
+            float acc = 0;
+            for(unsigned int i = 0; i < taps; i++)
+                acc += c[i] * x[i];
+            out[k * factor + p] = acc;
+        }
+    }
+}
+
+#ifdef DSP_X86
+// Vectorized across consecutive input positions rather than across taps, so there are no horizontal sums; each phase
+// produces every `factor`th output sample, which is scattered into place afterwards.
+static void UpsampleFloat_SSE2(const float *in, float *out, unsigned int count, const float *coefs, unsigned int factor,
+    unsigned int taps)
+{
+    unsigned int k = 0;
+    for(; k + 4 <= count; k += 4)
+    {
+        const float *x = in + k - (taps - 1);
+        for(unsigned int p = 0; p < factor; p++)
+        {
+            const float *c = coefs + p * taps;
+            __m128 acc = _mm_setzero_ps();
+            for(unsigned int i = 0; i < taps; i++)
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(c[i]), _mm_loadu_ps(x + i)));
+
+            float lanes[4];
+            _mm_storeu_ps(lanes, acc);
+            float *o = out + k * factor + p;
+            o[0] = lanes[0];
+            o[factor] = lanes[1];
+            o[factor * 2] = lanes[2];
+            o[factor * 3] = lanes[3];
+        }
+    }
+
+    UpsampleFloat_Scalar(in + k, out + k * factor, count - k, coefs, factor, taps);
+}
+
+TARGET_AVX2 static void UpsampleFloat_AVX2(const float *in, float *out, unsigned int count, const float *coefs,
+    unsigned int factor, unsigned int taps)
+{
+    unsigned int k = 0;
+    for(; k + 8 <= count; k += 8)
+    {
+        const float *x = in + k - (taps - 1);
+        for(unsigned int p = 0; p < factor; p++)
+        {
+            const float *c = coefs + p * taps;
+            __m256 acc = _mm256_setzero_ps();
+            for(unsigned int i = 0; i < taps; i++)
+                acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(c[i]), _mm256_loadu_ps(x + i)));
+
+            float lanes[8];
+            _mm256_storeu_ps(lanes, acc);
+            float *o = out + k * factor + p;
+            for(unsigned int j = 0; j < 8; j++)
+                o[j * factor] = lanes[j];
+        }
+    }
+    _mm256_zeroupper();
+
+    UpsampleFloat_SSE2(in + k, out + k * factor, count - k, coefs, factor, taps);
+}
+#endif
+
+/// TruePeakFloat ///
+
+static void TruePeakFloat_Scalar(const float *in, float *peaks, unsigned int count, const float *coefs,
+    unsigned int factor, unsigned int taps)
+{
+    for(unsigned int k = 0; k < count; k++)
+    {
+        const float *x = in + k - (taps - 1);
+        float peak = 0;
+        for(unsigned int p = 0; p < factor; p++)
+        {
+            const float *c = coefs + p * taps;
+            float acc = 0;
+            for(unsigned int i = 0; i < taps; i++)
+                acc += c[i] * x[i];
+            float magnitude = acc < 0 ? -acc : acc;
+            if(magnitude > peak)
+                peak = magnitude;
+        }
+        peaks[k] = peak;
+    }
+}
+
+#ifdef DSP_X86
+// Like UpsampleFloat, vectorized across consecutive input positions, so the maximum over the phases is taken lane by
+// lane and the peaks are stored in order. Phases are filtered in pairs, which shares the input loads and keeps two
+// independent sums going.
+static void TruePeakFloat_SSE2(const float *in, float *peaks, unsigned int count, const float *coefs,
+    unsigned int factor, unsigned int taps)
+{
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+
+    unsigned int k = 0;
+    for(; k + 4 <= count && factor % 2 == 0; k += 4)
+    {
+        const float *x = in + k - (taps - 1);
+        __m128 peak = _mm_setzero_ps();
+        for(unsigned int p = 0; p < factor; p += 2)
+        {
+            const float *c0 = coefs + p * taps;
+            const float *c1 = c0 + taps;
+            __m128 acc0 = _mm_setzero_ps();
+            __m128 acc1 = _mm_setzero_ps();
+            for(unsigned int i = 0; i < taps; i++)
+            {
+                __m128 xi = _mm_loadu_ps(x + i);
+                acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_set1_ps(c0[i]), xi));
+                acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_set1_ps(c1[i]), xi));
+            }
+            peak = _mm_max_ps(peak, _mm_max_ps(_mm_andnot_ps(signMask, acc0), _mm_andnot_ps(signMask, acc1)));
+        }
+        _mm_storeu_ps(peaks + k, peak);
+    }
+
+    TruePeakFloat_Scalar(in + k, peaks + k, count - k, coefs, factor, taps);
+}
+
+TARGET_AVX2 static void TruePeakFloat_AVX2(const float *in, float *peaks, unsigned int count, const float *coefs,
+    unsigned int factor, unsigned int taps)
+{
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+
+    unsigned int k = 0;
+    for(; k + 8 <= count && factor % 2 == 0; k += 8)
+    {
+        const float *x = in + k - (taps - 1);
+        __m256 peak = _mm256_setzero_ps();
+        for(unsigned int p = 0; p < factor; p += 2)
+        {
+            const float *c0 = coefs + p * taps;
+            const float *c1 = c0 + taps;
+            __m256 acc0 = _mm256_setzero_ps();
+            __m256 acc1 = _mm256_setzero_ps();
+            for(unsigned int i = 0; i < taps; i++)
+            {
+                __m256 xi = _mm256_loadu_ps(x + i);
+                acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_set1_ps(c0[i]), xi));
+                acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_set1_ps(c1[i]), xi));
+            }
+            peak = _mm256_max_ps(peak, _mm256_max_ps(_mm256_andnot_ps(signMask, acc0),
+                _mm256_andnot_ps(signMask, acc1)));
+        }
+        _mm256_storeu_ps(peaks + k, peak);
+    }
+    _mm256_zeroupper();
+
+    TruePeakFloat_SSE2(in + k, peaks + k, count - k, coefs, factor, taps);
+}
+#endif
+
+/// Dispatch ///
+
+typedef void (*ConvertInt16ToFloatFunc)(const int16_t *in, float *out, unsigned int count, float scale);
+typedef void (*ConvertFloatToInt16Func)(const float *in, int16_t *out, unsigned int count);
+typedef void (*ScaleFloatFunc)(float *samples, unsigned int count, float scale);
+typedef void (*MultiplyFloatFunc)(const float *in, const float *gains, float *out, unsigned int count);
+typedef void (*UpsampleFloatFunc)(const float *in, float *out, unsigned int count, const float *coefs,
+    unsigned int factor, unsigned int taps);
+typedef void (*TruePeakFloatFunc)(const float *in, float *peaks, unsigned int count, const float *coefs,
+    unsigned int factor, unsigned int taps);
+
+struct DSPKernels
+{
+    const char *arch;
+    ApplyGainInt16Func applyGainInt16;
+    ConvertInt16ToFloatFunc convertInt16ToFloat;
+    ConvertFloatToInt16Func convertFloatToInt16;
+    ScaleFloatFunc scaleFloat;
+    MultiplyFloatFunc multiplyFloat;
+    UpsampleFloatFunc upsampleFloat;
+    TruePeakFloatFunc truePeakFloat;
+
+    DSPKernels()
+    {
+#ifdef DSP_X86
+        if(CPUHasAVX2())
+        {
+            arch = "AVX2";
+            applyGainInt16 = ApplyGainInt16_AVX2;
+            convertInt16ToFloat = ConvertInt16ToFloat_AVX2;
+            convertFloatToInt16 = ConvertFloatToInt16_AVX2;
+            scaleFloat = ScaleFloat_AVX2;
+            multiplyFloat = MultiplyFloat_AVX2;
+            upsampleFloat = UpsampleFloat_AVX2;
+            truePeakFloat = TruePeakFloat_AVX2;
+            return;
+        }
+#if defined _M_X64 || defined __x86_64__ || defined __SSE2__ || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+        // SSE2 is part of the baseline on every target we build for
+        arch = "SSE2";
+        applyGainInt16 = ApplyGainInt16_SSE2;
+        convertInt16ToFloat = ConvertInt16ToFloat_SSE2;
+        convertFloatToInt16 = ConvertFloatToInt16_SSE2;
+        scaleFloat = ScaleFloat_SSE2;
+        multiplyFloat = MultiplyFloat_SSE2;
+        upsampleFloat = UpsampleFloat_SSE2;
+        truePeakFloat = TruePeakFloat_SSE2;
+        return;
+#endif
+#endif
+        arch = "scalar";
+        applyGainInt16 = ApplyGainInt16_Scalar;
+        convertInt16ToFloat = ConvertInt16ToFloat_Scalar;
+        convertFloatToInt16 = ConvertFloatToInt16_Scalar;
+        scaleFloat = ScaleFloat_Scalar;
+        multiplyFloat = MultiplyFloat_Scalar;
+        upsampleFloat = UpsampleFloat_Scalar;
+        truePeakFloat = TruePeakFloat_Scalar;
+    }
+};
+
+static const DSPKernels g_kernels;
+
+void ApplyGainInt16(int16_t *samples, unsigned int count, float gain)
+{
+    g_kernels.applyGainInt16(samples, count, gain);
+}
+
+void ConvertInt16ToFloat(const int16_t *in, float *out, unsigned int count, float scale)
+{
+    g_kernels.convertInt16ToFloat(in, out, count, scale);
+}
+
+void ConvertFloatToInt16(const float *in, int16_t *out, unsigned int count)
+{
+    g_kernels.convertFloatToInt16(in, out, count);
+}
+
+void ScaleFloat(float *samples, unsigned int count, float scale)
+{
+    g_kernels.scaleFloat(samples, count, scale);
+}
+
+void MultiplyFloat(const float *in, const float *gains, float *out, unsigned int count)
+{
+    g_kernels.multiplyFloat(in, gains, out, count);
+}
+
+void UpsampleFloat(const float *in, float *out, unsigned int count, const float *coefs, unsigned int factor,
+    unsigned int taps)
+{
+    g_kernels.upsampleFloat(in, out, count, coefs, factor, taps);
+}
+
+void TruePeakFloat(const float *in, float *peaks, unsigned int count, const float *coefs, unsigned int factor,
+    unsigned int taps)
+{
+    g_kernels.truePeakFloat(in, peaks, count, coefs, factor, taps);
+}
+
+const char *GetDSPKernelsArch(void)
+{
+    return g_kernels.arch;
+}
+
+ApplyGainInt16Func GetApplyGainInt16(DSPKernelsArch arch)
+{
+    switch(arch)
+    {
+    case DSP_ARCH_SCALAR:
+        return ApplyGainInt16_Scalar;
+#ifdef DSP_X86
+#if defined _M_X64 || defined __x86_64__ || defined __SSE2__ || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+    case DSP_ARCH_SSE2:
+        return ApplyGainInt16_SSE2;
+#endif
+    case DSP_ARCH_AVX2:
+        return CPUHasAVX2() ? ApplyGainInt16_AVX2 : nullptr;
+#endif
+    default:
+        return nullptr;
+    }
+}
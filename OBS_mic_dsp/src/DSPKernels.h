@@ -0,0 +1,55 @@
+#ifndef INCLUDED_DSPKernels_H
+#define INCLUDED_DSPKernels_H
+
+#include <stdint.h>
+
+// Sample processing kernels shared by the capture paths. Each has a scalar version and, where it pays off, SSE2 and
+// AVX2 versions that are picked once at runtime based on what the CPU supports.
+
+// Multiplies int16 samples by `gain` in place, truncating toward zero and clipping to [-32767, 32767]. All versions
+// produce exactly the same output as the scalar loop.
+void ApplyGainInt16(int16_t *samples, unsigned int count, float gain);
+
+// Converts int16 samples to float and multiplies them by `scale`, without clipping. `in` and `out` may not overlap.
+void ConvertInt16ToFloat(const int16_t *in, float *out, unsigned int count, float scale);
+
+// Converts float samples in 16-bit scale to int16, truncating toward zero and clipping to [-32767, 32767] like
+// ApplyGainInt16(). All versions produce exactly the same output as the scalar loop.
+void ConvertFloatToInt16(const float *in, int16_t *out, unsigned int count);
+
+// Multiplies float samples by `scale` in place.
+void ScaleFloat(float *samples, unsigned int count, float scale);
+
+// Multiplies each sample of `in` by the matching entry of `gains`, writing to `out`, which may be `in`.
+void MultiplyFloat(const float *in, const float *gains, float *out, unsigned int count);
+
+// Interpolates `count` samples by an integer `factor` with a polyphase FIR filter, writing `count * factor` samples to
+// `out`. `in` must be preceded by `taps - 1` samples of history. `coefs` holds `factor` phases of `taps` coefficients
+// each, in reverse order: output sample `k * factor + p` is the dot product of `coefs + p * taps` with
+// `in[k - taps + 1]..in[k]`.
+void UpsampleFloat(const float *in, float *out, unsigned int count, const float *coefs, unsigned int factor,
+    unsigned int taps);
+
+// Largest magnitude of the signal upsampled by `factor` between input samples `k - 1` and `k`, for each of `count`
+// samples, i.e. a true-peak estimate per sample. `in` and `coefs` are laid out as for UpsampleFloat(), and the peaks
+// are delayed by the filter's delay like its output is.
+void TruePeakFloat(const float *in, float *peaks, unsigned int count, const float *coefs, unsigned int factor,
+    unsigned int taps);
+
+// Name of the instruction set the kernels were dispatched to ("AVX2", "SSE2" or "scalar"), for logging.
+const char *GetDSPKernelsArch(void);
+
+// Each instruction set's version of ApplyGainInt16(), for tests and benchmarks. Returns null for one the build or the
+// CPU doesn't support.
+enum DSPKernelsArch
+{
+    DSP_ARCH_SCALAR,
+    DSP_ARCH_SSE2,
+    DSP_ARCH_AVX2,
+    DSP_NUM_ARCHS
+};
+
+typedef void (*ApplyGainInt16Func)(int16_t *samples, unsigned int count, float gain);
+ApplyGainInt16Func GetApplyGainInt16(DSPKernelsArch arch);
+
+#endif
@@ -0,0 +1,80 @@
+#include "LatencyStats.h"
+#include <math.h>
+
+const double LatencyHistogram::k_BinMS = 0.5;
+
+LatencyHistogram::LatencyHistogram(double minMS, double maxMS)
+    : _rangeMin(minMS),
+    _bins((size_t) ceil((maxMS - minMS) / k_BinMS)),
+    _count(0),
+    _sum(0),
+    _sumSq(0),
+    _min(0),
+    _max(0)
+{
+}
+
+void LatencyHistogram::Add(double ms)
+{
+    double pos = (ms - _rangeMin) / k_BinMS;
+    size_t bin;
+    if(pos < 0)
+        bin = 0;
+    else if(pos >= _bins.size())
+        bin = _bins.size() - 1;
+    else
+        bin = (size_t) pos;
+    _bins[bin]++;
+
+    if(_count == 0 || ms < _min)
+        _min = ms;
+    if(_count == 0 || ms > _max)
+        _max = ms;
+    _count++;
+    _sum += ms;
+    _sumSq += ms * ms;
+}
+
+void LatencyHistogram::Reset(void)
+{
+    _bins.assign(_bins.size(), 0);
+    _count = 0;
+    _sum = 0;
+    _sumSq = 0;
+    _min = 0;
+    _max = 0;
+}
+
+double LatencyHistogram::Percentile(double fraction) const
+{
+    // Center of the bin the requested fraction of values falls in, clamped to the values actually seen
+    unsigned int target = (unsigned int) ceil(fraction * _count);
+    unsigned int seen = 0;
+    for(size_t bin = 0; bin < _bins.size(); bin++)
+    {
+        seen += _bins[bin];
+        if(seen >= target)
+        {
+            double ms = _rangeMin + (bin + 0.5) * k_BinMS;
+            return ms < _min ? _min : ms > _max ? _max : ms;
+        }
+    }
+    return _max;
+}
+
+LatencySummary LatencyHistogram::Summarize(void) const
+{
+    LatencySummary s = {};
+    s.count = _count;
+    if(_count == 0)
+        return s;
+
+    s.minMS = _min;
+    s.maxMS = _max;
+    s.meanMS = _sum / _count;
+    double variance = _sumSq / _count - s.meanMS * s.meanMS;
+    s.jitterMS = variance > 0 ? sqrt(variance) : 0;
+    s.p50MS = Percentile(0.5);
+    s.p99MS = Percentile(0.99);
+    return s;
+}
@@ -0,0 +1,61 @@
+#ifndef INCLUDED_LatencyStats_H
+#define INCLUDED_LatencyStats_H
+
+#include <vector>
+
+// Summary of one latency histogram. All times are in milliseconds; jitter is the standard deviation.
+struct LatencySummary
+{
+    unsigned int count;
+    double minMS;
+    double maxMS;
+    double meanMS;
+    double jitterMS;
+    double p50MS;
+    double p99MS;
+};
+
+// Latency of each stage of the mic pipeline, as returned by the GetMicDSPLatencyStats() export. Counts are since the
+// stream started.
+struct DSPLatencyStats
+{
+    // Age of a processed segment when it's handed to OBS, measured from the DMO read that completed it
+    LatencySummary dmoToSegment;
+
+    // Audio queued in OBS's AudioSource ahead of the buffer OBS's mixer is about to take, i.e. how long a segment
+    // waits between being handed over and being mixed
+    LatencySummary segmentToMix;
+
+    // AudioSource's smoothed timestamp minus the capture timestamp we supplied
+    LatencySummary timestampCorrection;
+
+    // Number of times AudioSource's timestamp didn't follow on 10 ms after the previous one (jumps and resorts)
+    unsigned int timestampResets;
+};
+
+// Fixed-resolution histogram over a range of milliseconds. Values outside the range are counted in the end bins, but
+// the exact minimum, maximum, mean and jitter are kept as well. Not thread safe.
+class LatencyHistogram
+{
+public:
+    LatencyHistogram(double minMS, double maxMS);
+
+    void Add(double ms);
+    void Reset(void);
+    LatencySummary Summarize(void) const;
+
+private:
+    double Percentile(double fraction) const;
+
+    static const double k_BinMS;
+
+    double _rangeMin;
+    std::vector<unsigned int> _bins;
+    unsigned int _count;
+    double _sum;
+    double _sumSq;
+    double _min;
+    double _max;
+};
+
+#endif
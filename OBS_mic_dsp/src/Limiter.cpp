@@ -0,0 +1,138 @@
+#include "Limiter.h"
+#include "DSPKernels.h"
+#include "PolyphaseUpsampler.h"
+#include <math.h>
+#include <string.h>
+
+// The true-peak detector's cutoff as a fraction of Nyquist. Overshoots between samples come from content close to
+// Nyquist, so it reaches all the way there. That also makes the phase that lands on each sample pass it through
+// exactly, so the detector never reads less than the sample peak.
+static const double k_DetectorCutoff = 1.0;
+
+// Time constant of the gain's recovery once the peaks have passed
+static const float k_ReleaseMS = 60.0f;
+
+LookaheadLimiter::LookaheadLimiter()
+    : _lookahead(1),
+    _maxFrames(0),
+    _history(0),
+    _ceiling(1),
+    _release(1),
+    _decay(0),
+    _minHead(0),
+    _minCount(0),
+    _position(0),
+    _gain(1),
+    _heldPos(0),
+    _heldSum(1),
+    _heldScale(1),
+    _lowestGain(1)
+{
+}
+
+bool LookaheadLimiter::Init(unsigned int sampleRate, unsigned int lookaheadMS, float ceiling, unsigned int maxFrames)
+{
+    _maxFrames = 0;
+    _lookahead = sampleRate * lookaheadMS / 1000;
+    if(_lookahead == 0 || maxFrames == 0 || !(ceiling > 0))
+    {
+        _lookahead = 1;
+        return false;
+    }
+
+    PolyphaseUpsampler::Design(_coefs, k_DetectorPhases, k_DetectorTaps, k_DetectorCutoff);
+    _ceiling = ceiling;
+    _decay = expf(-1000.0f / (k_ReleaseMS * sampleRate));
+    _release = 1.0f - _decay;
+
+    // The history has to cover both the detector's filter and the delay line
+    _history = Latency() > k_DetectorTaps - 1 ? Latency() : k_DetectorTaps - 1;
+    _input.resize(_history + maxFrames);
+    _gains.resize(maxFrames);
+    _minGains.resize(_lookahead);
+    _minEnds.resize(_lookahead);
+    _held.resize(_lookahead);
+    _heldScale = 1.0 / _lookahead;
+    _maxFrames = maxFrames;
+    _lowestGain = 1;
+    Reset();
+    return true;
+}
+
+void LookaheadLimiter::Reset(void)
+{
+    _input.assign(_input.size(), 0.0f);
+    _minHead = 0;
+    _minCount = 0;
+    _position = 0;
+    _gain = 1;
+    _held.assign(_held.size(), 1.0f);
+    _heldPos = 0;
+    _heldSum = _lookahead;
+}
+
+void LookaheadLimiter::Process(float *samples, unsigned int count)
+{
+    while(count > 0)
+    {
+        unsigned int block = count < _maxFrames ? count : _maxFrames;
+        ProcessBlock(samples, block);
+        samples += block;
+        count -= block;
+    }
+}
+
+void LookaheadLimiter::ProcessBlock(float *samples, unsigned int count)
+{
+    float *block = &_input[_history];
+    memcpy(block, samples, count * sizeof(float));
+    TruePeakFloat(block, &_gains[0], count, &_coefs[0], k_DetectorPhases, k_DetectorTaps);
+
+    for(unsigned int i = 0; i < count; i++)
+    {
+        float peak = _gains[i];
+        float needed = peak > _ceiling ? _ceiling / peak : 1.0f;
+
+        // Drop the gain that has left the window, if it's still queued. Gains at the back that aren't lower than
+        // this one can never be the minimum again.
+        if(_minCount > 0 && _minEnds[_minHead] == _position)
+        {
+            _minHead = _minHead + 1 < _lookahead ? _minHead + 1 : 0;
+            _minCount--;
+        }
+        unsigned int back = _minHead + _minCount;
+        if(back >= _lookahead)
+            back -= _lookahead;
+        while(_minCount > 0)
+        {
+            unsigned int last = back > 0 ? back - 1 : _lookahead - 1;
+            if(_minGains[last] < needed)
+                break;
+            back = last;
+            _minCount--;
+        }
+        _minGains[back] = needed;
+        _minEnds[back] = _position + _lookahead;
+        _minCount++;
+        _position++;
+
+        // Recover towards 1, but never above what the look-ahead window needs. Averaging that over the window ramps
+        // the gain down in time for the peak without ever going above what any sample in it needs.
+        float held = _minGains[_minHead];
+        float released = _gain * _decay + _release;
+        _gain = held < released ? held : released;
+        _heldSum += _gain - _held[_heldPos];
+        _held[_heldPos] = _gain;
+        _heldPos = _heldPos + 1 < _lookahead ? _heldPos + 1 : 0;
+
+        float gain = (float) (_heldSum * _heldScale);
+        _gains[i] = gain;
+        if(gain < _lowestGain)
+            _lowestGain = gain;
+    }
+
+    MultiplyFloat(block - Latency(), &_gains[0], samples, count);
+
+    // Keep the tail of this block as history for the next one
+    memmove(&_input[0], &_input[count], _history * sizeof(float));
+}
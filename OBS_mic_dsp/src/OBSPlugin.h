@@ -4,6 +4,9 @@
 #include "../../OBS/OBSApi/OBSApi.h"
 
 #define PLUGIN_VERSION_STRING "1.1"
+#define CONFIG_FILENAME TEXT("\\OBS_mic_dsp.ini")
+
+struct DSPLatencyStats;
 
 class OBSPlugin
 {
@@ -16,6 +19,7 @@ public:
     virtual void OnStartStream(void) {}
     virtual void OnStopStream(void) {}
     virtual void OnMicVolumeChanged(float level, bool muted, bool finalValue) {}
+    virtual bool GetLatencyStats(DSPLatencyStats &stats) { return false; }
 
     static OBSPlugin *g_instance;
     static HINSTANCE g_dllInstance;
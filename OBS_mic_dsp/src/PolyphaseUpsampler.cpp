@@ -0,0 +1,94 @@
+#include "PolyphaseUpsampler.h"
+#include "DSPKernels.h"
+#include <math.h>
+#include <string.h>
+
+// Stopband attenuation of the Kaiser window, roughly 70 dB
+static const double k_KaiserBeta = 7.0;
+
+// Cutoff as a fraction of the input Nyquist frequency, leaving room for the transition band below the first image.
+// Response is flat to about 6 kHz at 16 kHz input, which covers what the DMO's voice processing lets through.
+static const double k_Cutoff = 0.92;
+
+static const double k_Pi = 3.14159265358979323846;
+
+// Zeroth-order modified Bessel function of the first kind, for the Kaiser window
+static double BesselI0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for(int k = 1; k < 50; k++)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if(term < sum * 1e-12)
+            break;
+    }
+    return sum;
+}
+
+PolyphaseUpsampler::PolyphaseUpsampler()
+    : _factor(0),
+    _maxFrames(0)
+{
+}
+
+void PolyphaseUpsampler::Design(std::vector<float> &coefs, unsigned int factor, unsigned int taps, double cutoff)
+{
+    // Prototype filter at the output rate, centered on tap `center` so every phase lines up with whole output samples
+    unsigned int length = factor * taps;
+    double center = length / 2;
+    std::vector<double> proto(length);
+    for(unsigned int n = 0; n < length; n++)
+    {
+        double t = (n - center) / factor * cutoff;
+        double sinc = t == 0 ? 1.0 : sin(k_Pi * t) / (k_Pi * t);
+        double x = (n - center) / center;
+        double window = BesselI0(k_KaiserBeta * sqrt(1.0 - x * x)) / BesselI0(k_KaiserBeta);
+        proto[n] = cutoff * sinc * window;
+    }
+
+    // Split into phases, reversed for the kernel, and normalize each phase to unity gain at DC so there's no ripple
+    // at the output rate
+    coefs.resize(length);
+    for(unsigned int p = 0; p < factor; p++)
+    {
+        double sum = 0;
+        for(unsigned int j = 0; j < taps; j++)
+            sum += proto[p + j * factor];
+        for(unsigned int j = 0; j < taps; j++)
+            coefs[p * taps + (taps - 1 - j)] = (float) (proto[p + j * factor] / sum);
+    }
+}
+
+bool PolyphaseUpsampler::Init(unsigned int factor, unsigned int maxFrames)
+{
+    _factor = 0;
+    _maxFrames = 0;
+    if(factor < 2 || maxFrames == 0)
+        return false;
+
+    Design(_coefs, factor, k_Taps, k_Cutoff);
+    _input.assign(k_Taps - 1 + maxFrames, 0.0f);
+    _output.assign(maxFrames * factor, 0.0f);
+    _factor = factor;
+    _maxFrames = maxFrames;
+    return true;
+}
+
+void PolyphaseUpsampler::Reset(void)
+{
+    _input.assign(_input.size(), 0.0f);
+}
+
+const float *PolyphaseUpsampler::Process(unsigned int count)
+{
+    if(count > _maxFrames)
+        count = _maxFrames;
+
+    UpsampleFloat(InputBuffer(), &_output[0], count, &_coefs[0], _factor, k_Taps);
+
+    // Keep the tail of this block as history for the next one
+    memmove(&_input[0], &_input[count], (k_Taps - 1) * sizeof(float));
+    return &_output[0];
+}
@@ -0,0 +1,48 @@
+#ifndef INCLUDED_PolyphaseUpsampler_H
+#define INCLUDED_PolyphaseUpsampler_H
+
+#include <vector>
+
+// Mono upsampler for a fixed integer ratio, so the plugin can hand OBS audio at its own sample rate and skip the generic
+// libsamplerate converter in AudioSource.
+//
+// The filter is a Kaiser-windowed sinc split into `factor` phases of `k_Taps` coefficients each. It's symmetric around
+// a whole number of output samples, so it delays the signal by Latency() output samples without any phase distortion.
+class PolyphaseUpsampler
+{
+public:
+    PolyphaseUpsampler();
+
+    // Designs the filter and allocates buffers for blocks of up to `maxFrames` input samples. Not thread safe.
+    bool Init(unsigned int factor, unsigned int maxFrames);
+
+    // Clears the filter history.
+    void Reset(void);
+
+    unsigned int Factor(void) const { return _factor; }
+    unsigned int Latency(void) const { return _factor * k_Taps / 2; }
+
+    // Where the caller writes the next block of input samples, up to `maxFrames` of them.
+    float *InputBuffer(void) { return &_input[k_Taps - 1]; }
+
+    // Upsamples the `count` samples written to InputBuffer() and returns `count * Factor()` output samples. The result
+    // stays valid until the next call.
+    const float *Process(unsigned int count);
+
+    // Designs `factor` phases of `taps` coefficients each, laid out for UpsampleFloat(), with the cutoff given as a
+    // fraction of the input Nyquist frequency. The filter delays the signal by `taps / 2` input samples.
+    static void Design(std::vector<float> &coefs, unsigned int factor, unsigned int taps, double cutoff);
+
+private:
+    static const unsigned int k_Taps = 32;
+
+    unsigned int _factor;
+    unsigned int _maxFrames;
+    std::vector<float> _coefs;
+
+    // Filter history followed by the current input block
+    std::vector<float> _input;
+    std::vector<float> _output;
+};
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef INCLUDED_RingBuffer_H
+#define INCLUDED_RingBuffer_H
+
+#include <atomic>
+#include <string.h>
+
+// Fixed-capacity single-producer/single-consumer ring buffer of samples.
+//
+// The first `window` slots of the buffer are mirrored past its end, so any run of up to `window` samples can be read
+// as one contiguous array without copying, no matter where it wraps. Writes never reallocate or move existing data;
+// if the consumer falls behind, the samples that don't fit are dropped and Write() reports how many were stored.
+template<typename T>
+class RingBuffer
+{
+public:
+    RingBuffer()
+        : _data(nullptr),
+        _capacity(0),
+        _window(0),
+        _readPos(0),
+        _writePos(0)
+    {
+    }
+
+    ~RingBuffer()
+    {
+        delete[] _data;
+    }
+
+    RingBuffer(const RingBuffer &) = delete;
+    RingBuffer &operator=(const RingBuffer &) = delete;
+
+    // Allocates storage. Not thread safe, call before the producer and consumer start.
+    bool Init(unsigned int capacity, unsigned int window)
+    {
+        delete[] _data;
+        _data = nullptr;
+        _capacity = 0;
+        _window = 0;
+        _readPos = 0;
+        _writePos = 0;
+
+        if(window == 0 || window > capacity)
+            return false;
+
+        _data = new T[capacity + window];
+        if(!_data)
+            return false;
+        memset(_data, 0, (capacity + window) * sizeof(T));
+        _capacity = capacity;
+        _window = window;
+        return true;
+    }
+
+    // Discards all buffered samples. Not thread safe.
+    void Reset(void)
+    {
+        _readPos = 0;
+        _writePos = 0;
+    }
+
+    unsigned int Capacity(void) const { return _capacity; }
+
+    // Number of samples that can be read. Safe to call from either side.
+    unsigned int Available(void) const
+    {
+        return (unsigned int) (_writePos.load(std::memory_order_acquire) - _readPos.load(std::memory_order_acquire));
+    }
+
+    // Number of samples that can be written. Safe to call from either side.
+    unsigned int Free(void) const
+    {
+        return _capacity - Available();
+    }
+
+    /// Producer side ///
+
+    // Appends `count` samples, or zeros if `data` is null. Returns the number of samples actually stored.
+    unsigned int Write(const T *data, unsigned int count)
+    {
+        unsigned int freeSamples = _capacity - (unsigned int) (_writePos.load(std::memory_order_relaxed) -
+            _readPos.load(std::memory_order_acquire));
+        if(count > freeSamples)
+            count = freeSamples;
+
+        unsigned int pos = (unsigned int) (_writePos.load(std::memory_order_relaxed) % _capacity);
+        unsigned int done = 0;
+        while(done < count)
+        {
+            unsigned int run = count - done;
+            if(run > _capacity - pos)
+                run = _capacity - pos;
+
+            CopyOrZero(_data + pos, data ? data + done : nullptr, run);
+
+            // Keep the mirrored tail in sync with the head
+            if(pos < _window)
+            {
+                unsigned int mirror = run;
+                if(mirror > _window - pos)
+                    mirror = _window - pos;
+                CopyOrZero(_data + _capacity + pos, data ? data + done : nullptr, mirror);
+            }
+
+            done += run;
+            pos += run;
+            if(pos == _capacity)
+                pos = 0;
+        }
+
+        _writePos.fetch_add(count, std::memory_order_release);
+        return count;
+    }
+
+    /// Consumer side ///
+
+    // Returns a contiguous view of the next `count` samples, or null if fewer than that are buffered. `count` may not
+    // exceed the window size given to Init(). The caller may modify the samples in place before consuming them.
+    T *Peek(unsigned int count)
+    {
+        if(count > _window || Available() < count)
+            return nullptr;
+        return _data + (unsigned int) (_readPos.load(std::memory_order_relaxed) % _capacity);
+    }
+
+    // Drops `count` samples from the front of the buffer.
+    void Consume(unsigned int count)
+    {
+        unsigned int available = Available();
+        if(count > available)
+            count = available;
+        _readPos.fetch_add(count, std::memory_order_release);
+    }
+
+private:
+    static void CopyOrZero(T *dest, const T *src, unsigned int count)
+    {
+        if(src)
+            memcpy(dest, src, count * sizeof(T));
+        else
+            memset(dest, 0, count * sizeof(T));
+    }
+
+    T *_data;
+    unsigned int _capacity;
+    unsigned int _window;
+
+    // Free-running positions; the difference is the fill level and each is reduced modulo the capacity on use
+    std::atomic<unsigned long long> _readPos;
+    std::atomic<unsigned long long> _writePos;
+};
+
+#endif
@@ -0,0 +1,89 @@
+#include "SilenceDetector.h"
+#include <math.h>
+
+// A segment this far above the noise floor is speech...
+static const float k_SpeechRatio = 4.0f;
+
+// ...and so is one only this far above it that crosses zero more than k_ZCRPerSecond times a second. Noise crosses
+// zero often too, so the crossings alone don't count.
+static const float k_UnvoicedRatio = 2.0f;
+static const unsigned int k_ZCRPerSecond = 4000;
+
+// Anything quieter than about -80 dBFS is silent, and the noise floor doesn't go below -90 dBFS, so digital silence
+// doesn't make every bit of noise look like speech
+static const float k_SilentEnergy = 10.0f;
+static const float k_MinFloor = 1.0f;
+
+// How fast the noise floor creeps up while the signal stays above it, in dB per second. It follows the quietest
+// segments down immediately.
+static const float k_FloorRiseDB = 3.0f;
+
+SilenceDetector::SilenceDetector()
+    : _segmentSize(0),
+    _zcrThreshold(0),
+    _floorRise(1),
+    _floor(0),
+    _energy(0)
+{
+}
+
+void SilenceDetector::Init(unsigned int sampleRate, unsigned int segmentSize)
+{
+    _segmentSize = segmentSize;
+    _zcrThreshold = (unsigned int) ((unsigned long long) k_ZCRPerSecond * segmentSize / sampleRate);
+    _floorRise = powf(10.0f, k_FloorRiseDB / 10.0f * segmentSize / sampleRate);
+    _floor = 0;
+    _energy = 0;
+}
+
+float SilenceDetector::MeanSquare(const int16_t *samples, unsigned int count)
+{
+    float sum = 0;
+    for(unsigned int i = 0; i < count; i++)
+        sum += (float) samples[i] * samples[i];
+    return count ? sum / count : 0;
+}
+
+float SilenceDetector::MeanSquare(const float *samples, unsigned int count)
+{
+    float sum = 0;
+    for(unsigned int i = 0; i < count; i++)
+        sum += samples[i] * samples[i];
+    return count ? sum / count : 0;
+}
+
+template<typename T>
+bool SilenceDetector::Classify(const T *samples)
+{
+    _energy = MeanSquare(samples, _segmentSize);
+    unsigned int crossings = 0;
+    for(unsigned int i = 1; i < _segmentSize; i++)
+        crossings += (samples[i - 1] < 0) != (samples[i] < 0);
+
+    // The first segment only sets the floor
+    bool first = _floor == 0;
+    float floor = first ? _energy : _floor;
+    if(_energy < floor)
+        floor = _energy;
+    else
+        floor *= _floorRise;
+    _floor = floor < k_MinFloor ? k_MinFloor : floor;
+
+    if(first)
+        return false;
+    if(_energy < k_SilentEnergy)
+        return true;
+    if(_energy > k_SpeechRatio * _floor)
+        return false;
+    return !(crossings > _zcrThreshold && _energy > k_UnvoicedRatio * _floor);
+}
+
+bool SilenceDetector::IsSilent(const int16_t *samples)
+{
+    return Classify(samples);
+}
+
+bool SilenceDetector::IsSilent(const float *samples)
+{
+    return Classify(samples);
+}
@@ -0,0 +1,40 @@
+#ifndef INCLUDED_SilenceDetector_H
+#define INCLUDED_SilenceDetector_H
+
+#include <stdint.h>
+
+// Cheap first-stage voice activity detector. A segment is silent if its energy is close to the tracked noise floor,
+// unless it crosses zero often enough to be a quiet unvoiced sound like "s" or "f". It's meant to err towards speech;
+// the Speex VAD makes the final call.
+//
+// Samples are in 16-bit scale, whichever type they're stored as.
+class SilenceDetector
+{
+public:
+    SilenceDetector();
+
+    // Forgets the noise floor. Not thread safe.
+    void Init(unsigned int sampleRate, unsigned int segmentSize);
+
+    // Classifies a segment and updates the noise floor from it
+    bool IsSilent(const int16_t *samples);
+    bool IsSilent(const float *samples);
+
+    // Mean square of the last segment classified, and the noise floor
+    float Energy(void) const { return _energy; }
+    float NoiseFloor(void) const { return _floor; }
+
+    static float MeanSquare(const int16_t *samples, unsigned int count);
+    static float MeanSquare(const float *samples, unsigned int count);
+
+private:
+    template<typename T> bool Classify(const T *samples);
+
+    unsigned int _segmentSize;
+    unsigned int _zcrThreshold;
+    float _floorRise;
+    float _floor;
+    float _energy;
+};
+
+#endif
@@ -0,0 +1,95 @@
+#include "StageProfiler.h"
+#include <string.h>
+
+StageProfiler::StageProfiler()
+{
+    Reset();
+}
+
+void StageProfiler::Reset(void)
+{
+    memset(_stages, 0, sizeof(_stages));
+}
+
+unsigned int StageProfiler::BinIndex(unsigned long long cycles)
+{
+    if(cycles < k_SubBins)
+        return (unsigned int) cycles;
+
+    unsigned int exp = 0;
+    while((cycles >> exp) >= 2 * k_SubBins)
+        exp++;
+
+    // `exp + 1` octaves above the linear range, plus the position within that octave
+    return (exp + 1) * k_SubBins + (unsigned int) ((cycles >> exp) - k_SubBins);
+}
+
+unsigned long long StageProfiler::BinValue(unsigned int bin)
+{
+    if(bin < k_SubBins)
+        return bin;
+
+    unsigned int exp = bin / k_SubBins - 1;
+    unsigned long long lower = (unsigned long long) (k_SubBins + bin % k_SubBins) << exp;
+    return lower + ((1ull << exp) >> 1);
+}
+
+void StageProfiler::Add(ProfileStage stage, unsigned long long cycles)
+{
+    Stage &s = _stages[stage];
+    if(s.count == 0 || cycles < s.min)
+        s.min = cycles;
+    if(cycles > s.max)
+        s.max = cycles;
+    s.count++;
+    s.sum += cycles;
+
+    unsigned int bin = BinIndex(cycles);
+    if(bin >= k_NumBins)
+        bin = k_NumBins - 1;
+    s.bins[bin]++;
+}
+
+StageSummary StageProfiler::Summarize(ProfileStage stage) const
+{
+    const Stage &s = _stages[stage];
+    StageSummary summary = {};
+    summary.count = s.count;
+    if(s.count == 0)
+        return summary;
+
+    summary.minCycles = s.min;
+    summary.maxCycles = s.max;
+    summary.avgCycles = s.sum / s.count;
+
+    // Middle of the bin the 99th percentile falls in, clamped to what was actually seen
+    unsigned int target = s.count - s.count / 100;
+    unsigned int seen = 0;
+    summary.p99Cycles = s.max;
+    for(unsigned int bin = 0; bin < k_NumBins; bin++)
+    {
+        seen += s.bins[bin];
+        if(seen >= target)
+        {
+            unsigned long long value = BinValue(bin);
+            summary.p99Cycles = value < s.min ? s.min : value > s.max ? s.max : value;
+            break;
+        }
+    }
+    return summary;
+}
+
+const char *StageProfiler::StageName(ProfileStage stage)
+{
+    switch(stage)
+    {
+    case Stage_ProcessOutput:   return "DMO ProcessOutput";
+    case Stage_Gain:            return "Gain";
+    case Stage_Echo:            return "Speex echo cancel";
+    case Stage_Speex:           return "Speex preprocess";
+    case Stage_Limiter:         return "Limiter";
+    case Stage_Upsample:        return "Upsample";
+    case Stage_Handoff:         return "Ring handoff";
+    default:                    return "?";
+    }
+}
@@ -0,0 +1,102 @@
+#ifndef INCLUDED_StageProfiler_H
+#define INCLUDED_StageProfiler_H
+
+#if defined _MSC_VER
+#include <intrin.h>
+#elif defined __i386__ || defined __x86_64__
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+// Always-on cycle counting for the stages of the capture path, cheap enough to leave enabled on every stream: a stage
+// costs two timestamp reads and a few adds. Each StageProfiler has a single writer thread and is only read once that
+// thread has stopped using it, so there is no locking or atomics on the hot path.
+
+enum ProfileStage
+{
+    Stage_ProcessOutput,    // IMediaObject::ProcessOutput
+    Stage_Gain,             // Volume gain and sample conversion
+    Stage_Echo,             // Speex echo canceller
+    Stage_Speex,            // Speex preprocessor
+    Stage_Limiter,          // Look-ahead limiter
+    Stage_Upsample,         // Upsampling to OBS's rate
+    Stage_Handoff,          // Moving finished segments through the audio buffer
+    Stage_Count
+};
+
+inline unsigned long long ReadCycleCounter(void)
+{
+#if defined _MSC_VER || defined __i386__ || defined __x86_64__
+    return __rdtsc();
+#else
+    return (unsigned long long) std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+struct StageSummary
+{
+    unsigned int count;
+    unsigned long long minCycles;
+    unsigned long long avgCycles;
+    unsigned long long p99Cycles;
+    unsigned long long maxCycles;
+};
+
+class StageProfiler
+{
+public:
+    StageProfiler();
+
+    void Add(ProfileStage stage, unsigned long long cycles);
+    void Reset(void);
+    StageSummary Summarize(ProfileStage stage) const;
+
+    static const char *StageName(ProfileStage stage);
+
+private:
+    // Eight bins per power of two, so percentiles are accurate to within about 12%
+    static const unsigned int k_SubBins = 8;
+    static const unsigned int k_NumBins = 64 * k_SubBins;
+
+    struct Stage
+    {
+        unsigned int count;
+        unsigned long long sum;
+        unsigned long long min;
+        unsigned long long max;
+        unsigned int bins[k_NumBins];
+    };
+
+    static unsigned int BinIndex(unsigned long long cycles);
+    static unsigned long long BinValue(unsigned int bin);
+
+    Stage _stages[Stage_Count];
+};
+
+// Adds the cycles spent in the enclosing scope to a stage
+class StageTimer
+{
+public:
+    StageTimer(StageProfiler &profiler, ProfileStage stage)
+        : _profiler(profiler),
+        _stage(stage),
+        _start(ReadCycleCounter())
+    {
+    }
+
+    ~StageTimer()
+    {
+        _profiler.Add(_stage, ReadCycleCounter() - _start);
+    }
+
+private:
+    StageTimer(const StageTimer &) = delete;
+    StageTimer &operator=(const StageTimer &) = delete;
+
+    StageProfiler &_profiler;
+    ProfileStage _stage;
+    unsigned long long _start;
+};
+
+#endif
@@ -1,5 +1,7 @@
 #include "OBSPlugin.h"
 #include "win_voicecapturedmo.h"
+#include "speexecho.h"
+#include "LatencyStats.h"
 
 OBSPlugin *OBSPlugin::g_instance = nullptr;
 HINSTANCE OBSPlugin::g_dllInstance = nullptr;
@@ -9,7 +11,16 @@ extern "C" __declspec(dllexport) bool LoadPlugin(void)
     if(OBSPlugin::g_instance)
         return false;
 
-    OBSPlugin::g_instance = new WinVoiceCaptureDMOMethod();
+    // The capture method is picked once, when OBS loads the plugin
+    String method;
+    ConfigFile pluginCfg;
+    if(pluginCfg.Open(OBSGetPluginDataPath() + CONFIG_FILENAME))
+        method = pluginCfg.GetString(TEXT("Capture"), TEXT("Method"), TEXT("DMO"));
+
+    if(method.IsValid() && scmpi(method.Array(), TEXT("Speex")) == 0)
+        OBSPlugin::g_instance = new SpeexEchoMethod();
+    else
+        OBSPlugin::g_instance = new WinVoiceCaptureDMOMethod();
     return true;
 }
 
@@ -37,6 +48,14 @@ extern "C" __declspec(dllexport) void OnMicVolumeChanged(float level, bool muted
         OBSPlugin::g_instance->OnMicVolumeChanged(level, muted, finalValue);
 }
 
+// Fills in latency statistics for the processed mic audio. Returns false if the plugin isn't supplying audio right now.
+extern "C" __declspec(dllexport) bool GetMicDSPLatencyStats(DSPLatencyStats *stats)
+{
+    if(OBSPlugin::g_instance && stats)
+        return OBSPlugin::g_instance->GetLatencyStats(*stats);
+    return false;
+}
+
 extern "C" __declspec(dllexport) CTSTR GetPluginName(void)
 {
     return TEXT("Microphone DSP plugin");
@@ -0,0 +1,234 @@
+#include "speexecho.h"
+#include "DSPKernels.h"
+
+#define LOG_NAME TEXT("OBS_mic_dsp (SpeexEchoMethod)")
+
+// OBS segments are interleaved stereo floats in -1..1; Speex works on mono 16-bit samples
+static void DownmixToInt16(const float *in, int16_t *out, unsigned int numFrames)
+{
+    for(unsigned int i = 0; i < numFrames; i++)
+    {
+        float s = (in[i * 2] + in[i * 2 + 1]) * (0.5f * 32767.0f);
+        out[i] = (int16_t) (s >= 32767.0f ? 32767 : s <= -32768.0f ? -32768 : (int) (s + (s < 0 ? -0.5f : 0.5f)));
+    }
+}
+
+/// SpeexEchoMethod::DesktopTapFilter and MicEchoFilter implementation ///
+
+AudioSegment *SpeexEchoMethod::DesktopTapFilter::Process(AudioSegment *segment)
+{
+    _owner->ProcessFarEnd(segment);
+    return segment;
+}
+
+AudioSegment *SpeexEchoMethod::MicEchoFilter::Process(AudioSegment *segment)
+{
+    _owner->ProcessMic(segment);
+    return segment;
+}
+
+/// SpeexEchoMethod implementation ///
+
+SpeexEchoMethod::SpeexEchoMethod()
+    : _desktopFilter(nullptr),
+    _micFilter(nullptr),
+    _numUnderruns(0),
+    _profileStartCycles(0),
+    _profileStartTime(0)
+{
+}
+
+SpeexEchoMethod::~SpeexEchoMethod()
+{
+    OnStopStream();
+}
+
+bool SpeexEchoMethod::Initialize(void)
+{
+    // Get plugin settings. Everything runs at OBS's rate, so nothing has to be resampled on the way in or out.
+    DSPChainConfig chainCfg;
+    chainCfg.sampleRate = OBSGetSampleRateHz();
+    chainCfg.outputRate = chainCfg.sampleRate;
+    chainCfg.frameMS = k_DefaultFrameMS;
+    chainCfg.bufferedSegments = k_BufferedSegments;
+    chainCfg.echoFilterMS = k_DefaultFilterMS;
+    ConfigFile pluginCfg;
+    if(pluginCfg.Open(OBSGetPluginDataPath() + CONFIG_FILENAME))
+    {
+        chainCfg.floatChain = pluginCfg.GetInt(TEXT("Processing"), TEXT("FloatChain"), 0) != 0;
+        chainCfg.silenceSkip = pluginCfg.GetInt(TEXT("Processing"), TEXT("SilenceSkip"), 0) != 0;
+
+        int frameSetting = pluginCfg.GetInt(TEXT("Processing"), TEXT("FrameMS"), k_DefaultFrameMS);
+        if(frameSetting == 10 || frameSetting == 20)
+            chainCfg.frameMS = frameSetting;
+        else
+            Log(TEXT("%s: Unsupported FrameMS %d, using %u ms."), LOG_NAME, frameSetting, k_DefaultFrameMS);
+
+        int filterSetting = pluginCfg.GetInt(TEXT("Echo"), TEXT("FilterMS"), k_DefaultFilterMS);
+        if(filterSetting >= (int) chainCfg.frameMS && filterSetting <= (int) k_MaxFilterMS)
+            chainCfg.echoFilterMS = filterSetting;
+        else
+            Log(TEXT("%s: Unsupported FilterMS %d, using %u ms."), LOG_NAME, filterSetting, k_DefaultFilterMS);
+    }
+
+    if(!_chain.Init(chainCfg))
+    {
+        Log(TEXT("%s: Failed to set up the echo canceller for %u Hz audio in %u ms frames."), LOG_NAME,
+            chainCfg.sampleRate, chainCfg.frameMS);
+        return false;
+    }
+    if(!_chain.NoiseSuppression())
+        Log(TEXT("%s: Warning! Failed to create Speex preprocessor state for post-gain noise removal."), LOG_NAME);
+
+    // Room for a whole 10 ms OBS segment, give or take a frame from its resampler
+    unsigned int sliceFrames = _chain.OutputSliceFrames();
+    _monoBuf.SetSize(sliceFrames * 2);
+    _sliceBuf.SetSize(sliceFrames);
+    if(!_outputBuf.Init(sliceFrames * k_BufferedSegments, sliceFrames * 2))
+        return false;
+    _numUnderruns = 0;
+
+    Log(TEXT("%s: Cancelling echo of desktop audio at %u Hz in %u ms frames with a %u ms filter."), LOG_NAME,
+        chainCfg.sampleRate, chainCfg.frameMS, chainCfg.echoFilterMS);
+    Log(TEXT("%s: Using %S sample processing kernels."), LOG_NAME, GetDSPKernelsArch());
+    if(chainCfg.floatChain)
+        Log(TEXT("%s: Processing microphone audio in floating point."), LOG_NAME);
+    if(chainCfg.silenceSkip && _chain.NoiseSuppression())
+        Log(TEXT("%s: Skipping noise suppression on silent segments."), LOG_NAME);
+
+    _profileStartCycles = ReadCycleCounter();
+    _profileStartTime = OSGetTimeMicroseconds();
+    return true;
+}
+
+void SpeexEchoMethod::ProcessFarEnd(AudioSegment *segment)
+{
+    unsigned int numFrames = segment->audioData.Num() / 2;
+    if(numFrames > _monoBuf.Num())
+        numFrames = _monoBuf.Num();
+
+    DownmixToInt16(segment->audioData.Array(), _monoBuf.Array(), numFrames);
+    _chain.WriteFarEnd(_monoBuf.Array(), numFrames);
+}
+
+void SpeexEchoMethod::ProcessMic(AudioSegment *segment)
+{
+    unsigned int numFrames = segment->audioData.Num() / 2;
+    if(numFrames > _monoBuf.Num())
+        numFrames = _monoBuf.Num();
+
+    // OBS has already applied the mic volume and push-to-talk muting
+    DownmixToInt16(segment->audioData.Array(), _monoBuf.Array(), numFrames);
+    _chain.Write(_monoBuf.Array(), numFrames, 1, false);
+    _chain.ProcessSegments();
+
+    // Collect whatever the chain has finished
+    bool newSegment;
+    const void *slice;
+    unsigned int sliceFrames = _chain.OutputSliceFrames();
+    while((slice = _chain.NextSlice(&newSegment)) != nullptr)
+    {
+        float *out = _sliceBuf.Array();
+        if(_chain.OutputIsFloat())
+            memcpy(out, slice, sliceFrames * sizeof(float));
+        else
+            ConvertInt16ToFloat((const int16_t *) slice, out, sliceFrames, 1.0f / 32767.0f);
+        _chain.ReleaseSlice();
+        _outputBuf.Write(out, sliceFrames);
+    }
+
+    // Write it back over the mic audio on both channels. Until the first frame is done, which is only ever short with
+    // 20 ms frames, the difference is filled with silence.
+    unsigned int available = _outputBuf.Available();
+    unsigned int numOut = numFrames < available ? numFrames : available;
+    const float *processed = _outputBuf.Peek(numOut);
+    float *data = segment->audioData.Array();
+    for(unsigned int i = 0; i < numFrames; i++)
+    {
+        float s = i < numOut ? processed[i] : 0.0f;
+        data[i * 2] = s;
+        data[i * 2 + 1] = s;
+    }
+    _outputBuf.Consume(numOut);
+    if(numOut < numFrames)
+        _numUnderruns++;
+}
+
+void SpeexEchoMethod::LogStageProfile(void)
+{
+    if(!_profileStartTime)
+        return;
+
+    // Calibrate the cycle counter against wall time over the whole stream
+    QWORD elapsed = OSGetTimeMicroseconds() - _profileStartTime;
+    double cyclesPerMicro = elapsed ? double(ReadCycleCounter() - _profileStartCycles) / elapsed : 0;
+    _profileStartTime = 0;
+
+    bool titled = false;
+    for(int stage = 0; stage < Stage_Count; stage++)
+    {
+        StageSummary s = _chain.CaptureProfile().Summarize((ProfileStage) stage);
+        if(s.count == 0)
+            continue;
+        if(!titled)
+        {
+            Log(TEXT("%s: CPU cycles per call processing mic audio:"), LOG_NAME);
+            titled = true;
+        }
+        Log(TEXT("%s:   %-18S min %9llu  avg %9llu  p99 %9llu  max %9llu  (avg %.1f us, %u calls)"),
+            LOG_NAME, StageProfiler::StageName((ProfileStage) stage), s.minCycles, s.avgCycles, s.p99Cycles,
+            s.maxCycles, cyclesPerMicro > 0 ? s.avgCycles / cyclesPerMicro : 0.0, s.count);
+    }
+}
+
+void SpeexEchoMethod::OnStartStream(void)
+{
+    OnStopStream();
+
+    AudioSource *desktop = OBSGetDesktopAudioSource();
+    AudioSource *mic = OBSGetMicAudioSource();
+    if(!mic)
+    {
+        Log(TEXT("%s: Microphone input disabled in OBS settings."), LOG_NAME);
+        return;
+    }
+    if(!desktop || !Initialize())
+    {
+        Log(TEXT("%s: Echo canceller initialization failed. Mic processing is NOT active."), LOG_NAME);
+        return;
+    }
+
+    _desktopFilter = new DesktopTapFilter(this);
+    _micFilter = new MicEchoFilter(this);
+    desktop->AddAudioFilter(_desktopFilter);
+    mic->AddAudioFilter(_micFilter);
+    Log(TEXT("%s: Processing microphone audio in place with desktop audio as the echo reference."), LOG_NAME);
+}
+
+void SpeexEchoMethod::OnStopStream(void)
+{
+    if(_desktopFilter)
+    {
+        if(OBSGetDesktopAudioSource())
+            OBSGetDesktopAudioSource()->RemoveAudioFilter(_desktopFilter);
+        delete _desktopFilter;
+        _desktopFilter = nullptr;
+    }
+    if(_micFilter)
+    {
+        if(OBSGetMicAudioSource())
+            OBSGetMicAudioSource()->RemoveAudioFilter(_micFilter);
+        delete _micFilter;
+        _micFilter = nullptr;
+
+        LogStageProfile();
+        if(_chain.FarEndUnderruns())
+            Log(TEXT("%s: %u frames had no desktop audio to cancel against."), LOG_NAME, _chain.FarEndUnderruns());
+        if(_chain.SkippedSegments())
+            Log(TEXT("%s: %u silent segments skipped noise suppression."), LOG_NAME, _chain.SkippedSegments());
+        if(_chain.Dropped())
+            Log(TEXT("%s: Dropped %u samples because the audio buffer was full."), LOG_NAME, _chain.Dropped());
+        if(_numUnderruns > 1)
+            Log(TEXT("%s: %u mic segments were padded with silence."), LOG_NAME, _numUnderruns);
+    }
+}
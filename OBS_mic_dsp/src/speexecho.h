@@ -0,0 +1,67 @@
+#ifndef INCLUDED_speexecho_H
+#define INCLUDED_speexecho_H
+
+#include "OBSPlugin.h"
+#include "DSPChain.h"
+
+// Echo cancellation in-process with Speex's MDF canceller instead of the voice capture DMO. OBS's own desktop audio is
+// the far-end reference and OBS's mic source is the near end, so the sample rate, frame size and filter length are all
+// ours to choose and nothing is buffered where we can't see it.
+class SpeexEchoMethod : public OBSPlugin
+{
+public:
+    SpeexEchoMethod();
+    ~SpeexEchoMethod();
+
+    void OnStartStream(void);
+    void OnStopStream(void);
+
+private:
+    // Copies desktop audio into the far-end queue and passes it on untouched
+    class DesktopTapFilter : public AudioFilter
+    {
+    public:
+        DesktopTapFilter(SpeexEchoMethod *owner) : _owner(owner) {}
+        AudioSegment *Process(AudioSegment *segment);
+
+    private:
+        SpeexEchoMethod *_owner;
+    };
+
+    // Replaces the mic audio with the processed version
+    class MicEchoFilter : public AudioFilter
+    {
+    public:
+        MicEchoFilter(SpeexEchoMethod *owner) : _owner(owner) {}
+        AudioSegment *Process(AudioSegment *segment);
+
+    private:
+        SpeexEchoMethod *_owner;
+    };
+
+    bool Initialize(void);
+    void ProcessFarEnd(AudioSegment *segment);
+    void ProcessMic(AudioSegment *segment);
+    void LogStageProfile(void);
+
+    // Both filters run on OBS's audio thread, desktop audio first, so the chain needs no locking here
+    DSPChain _chain;
+    DesktopTapFilter *_desktopFilter;
+    MicEchoFilter *_micFilter;
+
+    // Mono 16-bit copy of the incoming segment, and processed audio waiting to be written back into mic segments
+    List<int16_t> _monoBuf;
+    List<float> _sliceBuf;
+    RingBuffer<float> _outputBuf;
+    unsigned int _numUnderruns;
+
+    unsigned long long _profileStartCycles;
+    QWORD _profileStartTime;
+
+    static const unsigned int k_DefaultFrameMS = 10;
+    static const unsigned int k_DefaultFilterMS = 200;
+    static const unsigned int k_MaxFilterMS = 1000;
+    static const unsigned int k_BufferedSegments = 8;
+};
+
+#endif
@@ -1,4 +1,6 @@
 #include "win_voicecapturedmo.h"
+#include "DSPKernels.h"
+#include "AllocCounter.h"
 #include <tchar.h>
 #include <wmcodecdsp.h>
 #include <propsys.h>
@@ -6,8 +8,8 @@
 #include <mmreg.h>
 #include <mmdeviceapi.h>
 #include <functiondiscoverykeys_devpkey.h>
-#include "../../speex/include/speex/speex_types.h"
-#include "../../speex/include/speex/speex_preprocess.h"
+#include <avrt.h>
+#include <math.h>
 
 #define LOG_NAME TEXT("OBS_mic_dsp (WinVoiceCaptureDMOMethod)")
 #define DEVICE_NAME TEXT("Voice Capture DMO")
@@ -25,30 +27,68 @@ AudioSegment *WinVoiceCaptureDMOMethod::MicDiscardFilter::Process(AudioSegment *
 
 WinVoiceCaptureDMOMethod::VoiceCaptureDMOSource::VoiceCaptureDMOSource()
     : _dmo(nullptr),
-    _numSamples(0),
+    _dmoBuf(nullptr),
     _skipNextRead(false),
+    _pumpThread(nullptr),
+    _pumpStopEvent(nullptr),
     _micVolume(0),
     _micBoost(0),
+    _statsMutex(nullptr),
+    _dmoLatency(0, 500),
+    _mixLatency(0, 1000),
+    _timestampCorrection(-500, 500),
+    _timestampResets(0),
+    _lastReadTime(0),
+    _sliceTimestamp(0),
+    _chainLatency(0),
+    _lastAssignedTimestamp(0),
+    _statsLogInterval(0),
+    _nextStatsLog(0),
+    _profileStartCycles(0),
+    _profileStartTime(0),
+    _numAllocs(0),
+    _numSegments(0),
+    _numWarmupAllocs(0),
     _usePushToTalk(false),
     _pttHotkeyID(0), _pttHotkey2ID(0),
     _pttKeysDown(0),
     _pttDelay(0),
-    _pttDelayExpires(0),
-    _speexState(nullptr)
+    _pttDelayExpires(0)
 {
+    _statsMutex = OSCreateMutex();
 }
 
 WinVoiceCaptureDMOMethod::VoiceCaptureDMOSource::~VoiceCaptureDMOSource()
 {
+    // The pump thread uses the DMO, so it has to go first
+    StopPump();
+
+    LogStageProfile();
+
+    if(_numSegments > k_WarmupSegments)
+    {
+        Log(TEXT("%s: Capture path made %u allocations during warm-up and %u over the following %u segments."),
+            LOG_NAME, _numWarmupAllocs, _numAllocs - _numWarmupAllocs, _numSegments - k_WarmupSegments);
+    }
+    if(_chain.SkippedSegments())
+        Log(TEXT("%s: %u silent segments skipped noise suppression."), LOG_NAME, _chain.SkippedSegments());
+    if(_chain.Limiting() && _chain.LimiterLowestGain() < 1)
+        Log(TEXT("%s: The limiter reduced the gain by up to %.1f dB."), LOG_NAME, -20 * log10(_chain.LimiterLowestGain()));
+    if(_chain.Dropped())
+        Log(TEXT("%s: Dropped %u samples because the audio buffer was full."), LOG_NAME, _chain.Dropped());
+    if(_statsMutex)
+    {
+        LogLatencyStats();
+        OSCloseMutex(_statsMutex);
+    }
+
+    SafeRelease(_dmoBuf);
     SafeRelease(_dmo);
 
     if(_pttHotkeyID)
         OBSDeleteHotkey(_pttHotkeyID);
     if(_pttHotkey2ID)
         OBSDeleteHotkey(_pttHotkey2ID);
-
-    if(_speexState)
-        speex_preprocess_state_destroy(_speexState);
 }
 
 static HRESULT SetVtI4Property(IPropertyStore *ps, REFPROPERTYKEY key, LONG value)
@@ -62,6 +102,34 @@ static HRESULT SetVtI4Property(IPropertyStore *ps, REFPROPERTYKEY key, LONG valu
     return hr;
 }
 
+static HRESULT SetOutputFormat(IMediaObject *dmo, unsigned int sampleRate)
+{
+    DMO_MEDIA_TYPE mt;
+    mt.majortype = MEDIATYPE_Audio;
+    mt.subtype = MEDIASUBTYPE_PCM;
+    mt.lSampleSize = 0;
+    mt.bFixedSizeSamples = TRUE;
+    mt.bTemporalCompression = FALSE;
+    mt.formattype = FORMAT_WaveFormatEx;
+
+    HRESULT hr = MoInitMediaType(&mt, sizeof(WAVEFORMATEX));
+    if(SUCCEEDED(hr))
+    {
+        WAVEFORMATEX *wav = (WAVEFORMATEX *) mt.pbFormat;
+        wav->wFormatTag = WAVE_FORMAT_PCM;
+        wav->nChannels = 1;
+        wav->nSamplesPerSec = sampleRate;
+        wav->nAvgBytesPerSec = sampleRate * 2;
+        wav->nBlockAlign = 2;
+        wav->wBitsPerSample = 16;
+        wav->cbSize = 0;
+
+        hr = dmo->SetOutputType(0, &mt, 0);
+        MoFreeMediaType(&mt);
+    }
+    return hr;
+}
+
 static HRESULT SetBoolProperty(IPropertyStore *ps, REFPROPERTYKEY key, bool value)
 {
     PROPVARIANT pv;
@@ -214,6 +282,41 @@ bool WinVoiceCaptureDMOMethod::VoiceCaptureDMOSource::Initialize(void)
         // Only call once!
         return false;
 
+    // Get plugin settings
+    bool usePumpThread = false;
+    int statsLogInterval = k_DefaultStatsLogInterval;
+    DSPChainConfig chainCfg;
+    chainCfg.sampleRate = k_DefaultSampleRate;
+    chainCfg.frameMS = k_DefaultFrameMS;
+    chainCfg.bufferedSegments = k_BufferedSegments;
+    ConfigFile pluginCfg;
+    if(pluginCfg.Open(OBSGetPluginDataPath() + CONFIG_FILENAME))
+    {
+        usePumpThread = pluginCfg.GetInt(TEXT("Capture"), TEXT("PumpThread"), 0) != 0;
+        chainCfg.floatChain = pluginCfg.GetInt(TEXT("Processing"), TEXT("FloatChain"), 0) != 0;
+        chainCfg.silenceSkip = pluginCfg.GetInt(TEXT("Processing"), TEXT("SilenceSkip"), 0) != 0;
+        statsLogInterval = pluginCfg.GetInt(TEXT("Stats"), TEXT("LogInterval"), k_DefaultStatsLogInterval);
+
+        int sampleRate = pluginCfg.GetInt(TEXT("Processing"), TEXT("SampleRate"), k_DefaultSampleRate);
+        if(sampleRate == 8000 || sampleRate == 16000 || sampleRate == 24000 || sampleRate == 32000 || sampleRate == 48000)
+            chainCfg.sampleRate = sampleRate;
+        else
+            Log(TEXT("%s: Unsupported SampleRate %d, using %u Hz."), LOG_NAME, sampleRate, k_DefaultSampleRate);
+
+        int frameSetting = pluginCfg.GetInt(TEXT("Processing"), TEXT("FrameMS"), k_DefaultFrameMS);
+        if(frameSetting == 10 || frameSetting == 20)
+            chainCfg.frameMS = frameSetting;
+        else
+            Log(TEXT("%s: Unsupported FrameMS %d, using %u ms."), LOG_NAME, frameSetting, k_DefaultFrameMS);
+
+        int limiterSetting = pluginCfg.GetInt(TEXT("Limiter"), TEXT("LookaheadMS"), 0);
+        if(limiterSetting >= 0 && limiterSetting <= (int) k_MaxLimiterMS)
+            chainCfg.limiterMS = limiterSetting;
+        else
+            Log(TEXT("%s: Unsupported limiter LookaheadMS %d, clipping instead."), LOG_NAME, limiterSetting);
+        chainCfg.limiterCeilingDB = pluginCfg.GetFloat(TEXT("Limiter"), TEXT("CeilingDB"), chainCfg.limiterCeilingDB);
+    }
+
     // Get OBS settings
     String micDeviceId;
     String playbackDeviceId;
@@ -226,12 +329,6 @@ bool WinVoiceCaptureDMOMethod::VoiceCaptureDMOSource::Initialize(void)
     _pttKeysDown = 0;
     _pttDelayExpires = 0;
 
-    if(_speexState)
-    {
-        speex_preprocess_state_destroy(_speexState);
-        _speexState = nullptr;
-    }
-
     ConfigFile cfg;
     String cfgName;
     cfgName << OBSGetAppDataPath() << TEXT("\\global.ini");
@@ -286,21 +383,7 @@ bool WinVoiceCaptureDMOMethod::VoiceCaptureDMOSource::Initialize(void)
 
     LogEndpointInfo(micDeviceIdx, eCapture);
     LogEndpointInfo(playbackDeviceIdx, eRender);
-
-    // Initialize Speex preprocessor for post-gain noise removal if mic boost is used
-    //if(_micBoost > 1)
-    {
-        //Log(TEXT("%s: Mic boost > 1, enabling post-gain noise removal."), LOG_NAME);
-
-        _speexState = speex_preprocess_state_init(k_SegmentSize, k_SampleRate);
-        if(_speexState)
-        {
-            spx_int32_t noiseSuppress = -30;
-            speex_preprocess_ctl(_speexState, SPEEX_PREPROCESS_SET_NOISE_SUPPRESS, &noiseSuppress);
-        }
-        else
-            Log(TEXT("%s: Warning! Failed to create Speex preprocessor state for post-gain noise removal."), LOG_NAME);
-    }
+    Log(TEXT("%s: Using %S sample processing kernels."), LOG_NAME, GetDSPKernelsArch());
 
     TRACE(CoCreateInstance(__uuidof(CWMAudioAEC), nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&_dmo)));
 
@@ -339,45 +422,96 @@ bool WinVoiceCaptureDMOMethod::VoiceCaptureDMOSource::Initialize(void)
 
     if(SUCCEEDED(hr))
     {
-        // Set output media type
-        DMO_MEDIA_TYPE mt;
-        mt.majortype = MEDIATYPE_Audio;
-        mt.subtype = MEDIASUBTYPE_PCM;
-        mt.lSampleSize = 0;
-        mt.bFixedSizeSamples = TRUE;
-        mt.bTemporalCompression = FALSE;
-        mt.formattype = FORMAT_WaveFormatEx;
-
-        TRACE(MoInitMediaType(&mt, sizeof(WAVEFORMATEX)));
-        if(SUCCEEDED(hr))
+        // Set output media type. The DMO doesn't take every rate we offer, so fall back to the default if it refuses.
+        TRACE(SetOutputFormat(_dmo, chainCfg.sampleRate));
+        if(FAILED(hr) && chainCfg.sampleRate != k_DefaultSampleRate)
         {
-            WAVEFORMATEX *wav = (WAVEFORMATEX *) mt.pbFormat;
-            wav->wFormatTag = WAVE_FORMAT_PCM;
-            wav->nChannels = 1;
-            wav->nSamplesPerSec = k_SampleRate;
-            wav->nAvgBytesPerSec = k_SampleRate * 2;
-            wav->nBlockAlign = 2;
-            wav->wBitsPerSample = 16;
-            wav->cbSize = 0;
-
-            TRACE(_dmo->SetOutputType(0, &mt, 0));
-            MoFreeMediaType(&mt);
+            Log(TEXT("%s: The DMO doesn't support %u Hz output, using %u Hz instead."), LOG_NAME, chainCfg.sampleRate, k_DefaultSampleRate);
+            chainCfg.sampleRate = k_DefaultSampleRate;
+            TRACE(SetOutputFormat(_dmo, chainCfg.sampleRate));
         }
     }
 
+    // The chain upsamples to OBS's rate when it can
+    chainCfg.outputRate = OBSGetSampleRateHz();
+
+    // The chain's buffers and the DMO output buffer are the capture path's warm-up allocations
+    unsigned int allocs = ThreadAllocations();
+    _numAllocs = 0;
+
+    // Speex preprocessor for post-gain noise removal. Its FFT is sized from the frame.
+    if(SUCCEEDED(hr) && !_chain.Init(chainCfg))
+    {
+        traceCall = TEXT("DSPChain::Init(chainCfg)");
+        hr = E_OUTOFMEMORY;
+    }
+    if(SUCCEEDED(hr) && !_chain.NoiseSuppression())
+        Log(TEXT("%s: Warning! Failed to create Speex preprocessor state for post-gain noise removal."), LOG_NAME);
+
     if(SUCCEEDED(hr))
         TRACE(_dmo->AllocateStreamingResources());
 
+    // The output buffer is reused for every ProcessOutput call so that the capture path doesn't allocate
+    if(SUCCEEDED(hr))
+        TRACE(CMediaBuffer::Create(_chain.SegmentSize() * 2, &_dmoBuf));
+    CountAllocations(allocs);
+
     if(SUCCEEDED(hr))
     {
-        InitAudioData(false, 1, k_SampleRate, 16, 2, 0);
-        _audioBuf.Clear();
-        _numSamples = 0;
+        if(_chain.OutputIsFloat())
+            InitAudioData(true, 1, _chain.OutputRate(), 32, 4, 0);
+        else
+            InitAudioData(false, 1, _chain.OutputRate(), 16, 2, 0);
+
+        if(_chain.Upsampling())
+        {
+            Log(TEXT("%s: Upsampling to %u Hz in the plugin (%u samples of filter latency)."), LOG_NAME,
+                _chain.OutputRate(), _chain.UpsamplerLatency());
+        }
+        Log(TEXT("%s: Processing microphone audio at %u Hz in %u ms segments."), LOG_NAME, chainCfg.sampleRate, chainCfg.frameMS);
+        if(chainCfg.floatChain)
+            Log(TEXT("%s: Processing microphone audio in floating point."), LOG_NAME);
+        if(chainCfg.silenceSkip && _chain.NoiseSuppression())
+            Log(TEXT("%s: Skipping noise suppression on silent segments."), LOG_NAME);
+        if(_chain.Limiting())
+        {
+            Log(TEXT("%s: Limiting peaks to %.1f dBFS with %u ms of look-ahead (%u samples of latency)."), LOG_NAME,
+                chainCfg.limiterCeilingDB, chainCfg.limiterMS, _chain.LimiterLatency());
+        }
+
+        // The audio handed to OBS is this much older than the time it's stamped with otherwise
+        _chainLatency = (QWORD) (_chain.LatencyMS() + 0.5);
         _skipNextRead = false;
+
+        OSEnterMutex(_statsMutex);
+        _dmoLatency.Reset();
+        _mixLatency.Reset();
+        _timestampCorrection.Reset();
+        _timestampResets = 0;
+        OSLeaveMutex(_statsMutex);
+        _lastReadTime = 0;
+        _sliceTimestamp = 0;
+        _lastAssignedTimestamp = 0;
+        _statsLogInterval = statsLogInterval > 0 ? statsLogInterval * 1000 : 0;
+        _nextStatsLog = OSGetTime() + _statsLogInterval;
+
+        _profileStartCycles = ReadCycleCounter();
+        _profileStartTime = OSGetTimeMicroseconds();
+        _numSegments = 0;
+        _numWarmupAllocs = 0;
+
+        if(usePumpThread)
+        {
+            if(StartPump())
+                Log(TEXT("%s: Draining the DMO on a separate pump thread."), LOG_NAME);
+            else
+                Log(TEXT("%s: Warning! Failed to start the DMO pump thread, reading from the DMO on the audio thread instead."), LOG_NAME);
+        }
         return true;
     }
     else
     {
+        SafeRelease(_dmoBuf);
         SafeRelease(_dmo);
         Log(TEXT("%s: Initialization of VoiceCaptureDMOSource failed on %s with hr = 0x%lX"), LOG_NAME, traceCall, (unsigned long) hr);
         return false;
@@ -408,108 +542,287 @@ CTSTR WinVoiceCaptureDMOMethod::VoiceCaptureDMOSource::GetDeviceName(void) const
     return DEVICE_NAME;
 }
 
-bool WinVoiceCaptureDMOMethod::VoiceCaptureDMOSource::GetNextBuffer(void **buffer, UINT *numFrames, QWORD *timestamp)
+HRESULT WinVoiceCaptureDMOMethod::VoiceCaptureDMOSource::ReadDMO(bool *moreData)
+{
+    // Fill the pooled buffer from the DMO
+    _dmoBuf->SetLength(0);
+
+    DMO_OUTPUT_DATA_BUFFER dodb;
+    DWORD status;
+    dodb.pBuffer = _dmoBuf;
+    HRESULT hr;
+    {
+        StageTimer timer(_chain.CaptureProfile(), Stage_ProcessOutput);
+        hr = _dmo->ProcessOutput(0, 1, &dodb, &status);
+    }
+    if(SUCCEEDED(hr))
+    {
+        BYTE *data;
+        DWORD len;
+        _dmoBuf->GetBufferAndLength(&data, &len);
+        _lastReadTime = OSGetTimeMicroseconds();
+
+        // Push-to-talk audio muting and volume level
+        bool pttMute = _usePushToTalk && _pttKeysDown == 0 && OBSGetTotalStreamTime() >= _pttDelayExpires;
+        _chain.Write((int16_t *) data, len / 2, _micVolume * _micBoost, pttMute);
+
+        *moreData = (dodb.dwStatus & DMO_OUTPUT_DATA_BUFFERF_INCOMPLETE) != 0;
+    }
+    else
+        *moreData = false;
+
+    return hr;
+}
+
+void WinVoiceCaptureDMOMethod::VoiceCaptureDMOSource::PumpDMO(void)
 {
-    while(_numSamples < k_SegmentSize)
+    unsigned int allocs = ThreadAllocations();
+
+    // Drain everything the DMO has, cutting it into finished segments as we go so the chain's input never fills
+    bool moreData = true;
+    while(moreData)
     {
+        if(FAILED(ReadDMO(&moreData)))
+            break;
+
+        // Each finished segment carries the time of the read that completed it across to the audio thread
+        _chain.ProcessSegments(_lastReadTime);
+    }
+
+    CountAllocations(allocs);
+}
+
+DWORD STDCALL WinVoiceCaptureDMOMethod::VoiceCaptureDMOSource::PumpThread(LPVOID param)
+{
+    VoiceCaptureDMOSource *me = (VoiceCaptureDMOSource *) param;
+
+    CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    DWORD taskID = 0;
+    HANDLE hTask = AvSetMmThreadCharacteristics(TEXT("Pro Audio"), &taskID);
+
+    while(WaitForSingleObject(me->_pumpStopEvent, k_PumpIntervalMS) == WAIT_TIMEOUT)
+        me->PumpDMO();
+
+    if(hTask)
+        AvRevertMmThreadCharacteristics(hTask);
+    CoUninitialize();
+    return 0;
+}
+
+bool WinVoiceCaptureDMOMethod::VoiceCaptureDMOSource::StartPump(void)
+{
+    _pumpStopEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    if(!_pumpStopEvent)
+        return false;
+
+    _pumpThread = OSCreateThread((XTHREAD) PumpThread, this);
+    if(!_pumpThread)
+    {
+        CloseHandle(_pumpStopEvent);
+        _pumpStopEvent = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+void WinVoiceCaptureDMOMethod::VoiceCaptureDMOSource::StopPump(void)
+{
+    if(_pumpThread)
+    {
+        SetEvent(_pumpStopEvent);
+        OSWaitForThread(_pumpThread, nullptr);
+        OSCloseThread(_pumpThread);
+        _pumpThread = nullptr;
+    }
+    if(_pumpStopEvent)
+    {
+        CloseHandle(_pumpStopEvent);
+        _pumpStopEvent = nullptr;
+    }
+}
+
+bool WinVoiceCaptureDMOMethod::VoiceCaptureDMOSource::ReadSegment(void)
+{
+    for(;;)
+    {
+        if(_chain.ProcessSegments(_lastReadTime) > 0)
+            return true;
+
         // This is horrible.
         // When I completed the bulk of this plugin and got initialization to pass, I wasn't expecting it to lock up the
         // audio thread and crash OBS on stop stream. It turns out that you _cannot_ always return true from this function
         // or you will get OBS stuck in an infinite loop. OBS will call this repeatedly until it returns false to drain
         // data from the input sources, so it's expected that we return false after reading out all available data.
         // Unfortunately DMOs don't seem to have an asynchronous mode or anything useful, so this hack will have to do.
+        // (The pump thread capture mode avoids all this.)
         if(_skipNextRead)
         {
             _skipNextRead = false;
             return false;
         }
 
-        // Fill a buffer from the DMO
-        IMediaBuffer *buf;
-        HRESULT hr = CMediaBuffer::Create(k_SegmentSize * 2, &buf);
-        if(FAILED(hr))
+        bool moreData;
+        if(FAILED(ReadDMO(&moreData)))
         {
             return false;
         }
 
-        DMO_OUTPUT_DATA_BUFFER dodb;
-        DWORD status;
-        dodb.pBuffer = buf;
-        hr = _dmo->ProcessOutput(0, 1, &dodb, &status);
-        if(SUCCEEDED(hr))
-        {
-            BYTE *data;
-            DWORD len;
-            buf->GetBufferAndLength(&data, &len);
-            unsigned int newSamples = len / 2;
-            unsigned int newNumSamples = _numSamples + newSamples;
-
-            // Expand audio buffer to accomodate new samples if necessary
-            if(newNumSamples > _audioBuf.Num())
-                _audioBuf.SetSize(newNumSamples);
-
-            // Push-to-talk audio muting and volume level
-            bool pttMute = _usePushToTalk && _pttKeysDown == 0 && OBSGetTotalStreamTime() >= _pttDelayExpires;
-            float micGain = _micVolume * _micBoost;
-            if(pttMute || micGain == 0)
-            {
-                memset(_audioBuf.Array() + _numSamples, 0, newSamples * 2);
-            }
-            else
-            {
-                if(micGain != 1)
-                {
-                    for(unsigned int i = 0; i < newSamples; i++)
-                    {
-                        long sample = ((int16_t *) data)[i];
-                        sample *= micGain;
-                        if(sample > 32767)
-                            sample = 32767;
-                        else if(sample < -32767)
-                            sample = -32767;
-                        ((int16_t *) data)[i] = sample;
-                    }
-                }
-
-                // Copy new samples into audio buffer
-                mcpy(_audioBuf.Array() + _numSamples, data, newSamples * 2);
-            }
-            
-            _numSamples = newNumSamples;
-
-            // If the next call to ProcessOutput would block, force the next read to be skipped and return false
-            if(!(dodb.dwStatus & DMO_OUTPUT_DATA_BUFFERF_INCOMPLETE))
-                _skipNextRead = true;
-        }
+        // If the next call to ProcessOutput would block, force the next read to be skipped and return false
+        if(!moreData)
+            _skipNextRead = true;
+    }
+}
 
-        buf->Release();
+bool WinVoiceCaptureDMOMethod::VoiceCaptureDMOSource::GetNextBuffer(void **buffer, UINT *numFrames, QWORD *timestamp)
+{
+    unsigned int allocs = ThreadAllocations();
 
-        if(FAILED(hr))
+    // AudioSource has filed the previous slice by now, so see what timestamp it ended up with. If the slice was
+    // thrown away as overshot, the newest timestamp won't have changed.
+    if(_sliceTimestamp)
+    {
+        QWORD assigned;
+        if(GetLatestTimestamp(assigned) && assigned != _lastAssignedTimestamp)
         {
-            return false;
+            OSEnterMutex(_statsMutex);
+            _timestampCorrection.Add((double) (long long) (assigned - _sliceTimestamp));
+            if(_lastAssignedTimestamp && assigned != _lastAssignedTimestamp + k_SliceMS)
+                _timestampResets++;
+            OSLeaveMutex(_statsMutex);
+            _lastAssignedTimestamp = assigned;
         }
+        _sliceTimestamp = 0;
     }
 
-    // Apply Speex noise removal if enabled
-    if(_speexState)
+    // In pump mode the pump thread has already done all the processing, and returning false when it hasn't finished
+    // another segment is exactly what OBS expects. Otherwise read the DMO until a segment is ready.
+    bool newSegment;
+    unsigned long long readTime;
+    const void *slice = _chain.NextSlice(&newSegment, &readTime);
+    if(!slice && !_pumpThread && ReadSegment())
+        slice = _chain.NextSlice(&newSegment, &readTime);
+    CountAllocations(allocs);
+    if(!slice)
+        return false;
+
+    if(newSegment && readTime)
     {
-        speex_preprocess_run(_speexState, _audioBuf.Array());
+        double age = (OSGetTimeMicroseconds() - readTime) / 1000.0;
+        OSEnterMutex(_statsMutex);
+        _dmoLatency.Add(age);
+        OSLeaveMutex(_statsMutex);
     }
 
-    *buffer = _audioBuf.Array();
-    *numFrames = k_SegmentSize;
-    *timestamp = OBSGetAudioTime();  // TODO: Is this right? Maybe look at Get/SetTimeOffset()
+    *buffer = (void *) slice;
+    *numFrames = _chain.OutputSliceFrames();
+    *timestamp = OBSGetAudioTime() - _chainLatency;  // TODO: Is this right? Maybe look at Get/SetTimeOffset()
+    _sliceTimestamp = *timestamp;
+
+    if(++_numSegments == k_WarmupSegments)
+        _numWarmupAllocs = _numAllocs;
 
     return true;
 }
 
 void WinVoiceCaptureDMOMethod::VoiceCaptureDMOSource::ReleaseBuffer(void)
 {
-    // Delete one segment-sized chunk from the beginning of the audio buffer
-    if(_numSamples >= k_SegmentSize)
+    unsigned int allocs = ThreadAllocations();
+    _chain.ReleaseSlice();
+    CountAllocations(allocs);
+}
+
+// Adds what this thread has allocated since it read ThreadAllocations(). The pump thread and the audio thread both
+// count, but after warm-up there should be nothing to add.
+void WinVoiceCaptureDMOMethod::VoiceCaptureDMOSource::CountAllocations(unsigned int since)
+{
+    unsigned int allocs = ThreadAllocations() - since;
+    if(allocs)
+        InterlockedExchangeAdd(&_numAllocs, (LONG) allocs);
+}
+
+bool WinVoiceCaptureDMOMethod::VoiceCaptureDMOSource::GetBuffer(float **buffer, QWORD targetTimestamp)
+{
+    // Everything queued up to and including the newest segment will be mixed before audio captured now is
+    QWORD newest;
+    if(GetLatestTimestamp(newest) && newest >= targetTimestamp)
+    {
+        OSEnterMutex(_statsMutex);
+        _mixLatency.Add((double) (newest - targetTimestamp + k_SliceMS));
+        OSLeaveMutex(_statsMutex);
+    }
+
+    bool rv = AudioSource::GetBuffer(buffer, targetTimestamp);
+
+    if(_statsLogInterval && (int) (OSGetTime() - _nextStatsLog) >= 0)
     {
-        mcpy(_audioBuf.Array(), _audioBuf.Array() + k_SegmentSize, (_numSamples - k_SegmentSize) * 2);
-        _numSamples -= k_SegmentSize;
+        LogLatencyStats();
+        _nextStatsLog += _statsLogInterval;
+    }
+
+    return rv;
+}
+
+void WinVoiceCaptureDMOMethod::VoiceCaptureDMOSource::GetLatencyStats(DSPLatencyStats &stats)
+{
+    OSEnterMutex(_statsMutex);
+    stats.dmoToSegment = _dmoLatency.Summarize();
+    stats.segmentToMix = _mixLatency.Summarize();
+    stats.timestampCorrection = _timestampCorrection.Summarize();
+    stats.timestampResets = _timestampResets;
+    OSLeaveMutex(_statsMutex);
+}
+
+static void LogLatencySummary(CTSTR stage, const LatencySummary &s)
+{
+    if(s.count == 0)
+        return;
+    Log(TEXT("%s:   %-22s min %7.1f  avg %7.1f  p50 %7.1f  p99 %7.1f  max %7.1f  jitter %6.1f ms (%u samples)"),
+        LOG_NAME, stage, s.minMS, s.meanMS, s.p50MS, s.p99MS, s.maxMS, s.jitterMS, s.count);
+}
+
+void WinVoiceCaptureDMOMethod::VoiceCaptureDMOSource::LogLatencyStats(void)
+{
+    DSPLatencyStats stats;
+    GetLatencyStats(stats);
+    if(stats.dmoToSegment.count == 0)
+        return;
+
+    Log(TEXT("%s: Latency since the stream started:"), LOG_NAME);
+    LogLatencySummary(TEXT("DMO to segment"), stats.dmoToSegment);
+    LogLatencySummary(TEXT("Segment to mix"), stats.segmentToMix);
+    LogLatencySummary(TEXT("Timestamp correction"), stats.timestampCorrection);
+    Log(TEXT("%s:   %u timestamp resets"), LOG_NAME, stats.timestampResets);
+}
+
+void WinVoiceCaptureDMOMethod::VoiceCaptureDMOSource::LogStageProfile(void)
+{
+    if(!_profileStartTime)
+        return;
+
+    // Calibrate the cycle counter against wall time over the whole stream
+    QWORD elapsed = OSGetTimeMicroseconds() - _profileStartTime;
+    double cyclesPerMicro = elapsed ? double(ReadCycleCounter() - _profileStartCycles) / elapsed : 0;
+
+    const StageProfiler *profiles[] = {&_chain.CaptureProfile(), &_chain.OutputProfile()};
+    CTSTR titles[] = {TEXT("reading and processing DMO audio"), TEXT("handing audio to OBS")};
+    for(int i = 0; i < 2; i++)
+    {
+        bool titled = false;
+        for(int stage = 0; stage < Stage_Count; stage++)
+        {
+            StageSummary s = profiles[i]->Summarize((ProfileStage) stage);
+            if(s.count == 0)
+                continue;
+            if(!titled)
+            {
+                Log(TEXT("%s: CPU cycles per call %s:"), LOG_NAME, titles[i]);
+                titled = true;
+            }
+            Log(TEXT("%s:   %-18S min %9llu  avg %9llu  p99 %9llu  max %9llu  (avg %.1f us, %u calls)"),
+                LOG_NAME, StageProfiler::StageName((ProfileStage) stage), s.minCycles, s.avgCycles, s.p99Cycles,
+                s.maxCycles, cyclesPerMicro > 0 ? s.avgCycles / cyclesPerMicro : 0.0, s.count);
+        }
     }
 }
 
@@ -586,4 +899,12 @@ void WinVoiceCaptureDMOMethod::OnMicVolumeChanged(float level, bool muted, bool
 {
     if(_auxSource)
         _auxSource->SetMicVolume(level);
+}
+
+bool WinVoiceCaptureDMOMethod::GetLatencyStats(DSPLatencyStats &stats)
+{
+    if(!_auxSource)
+        return false;
+    _auxSource->GetLatencyStats(stats);
+    return true;
 }
\ No newline at end of file
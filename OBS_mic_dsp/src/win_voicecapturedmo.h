@@ -2,8 +2,9 @@
 #define INCLUDED_win_voicecapturedmo_H
 
 #include "OBSPlugin.h"
+#include "DSPChain.h"
+#include "LatencyStats.h"
 #include <dmo.h>
-#include "../../speex/include/speex/speex_preprocess.h"
 
 class WinVoiceCaptureDMOMethod : public OBSPlugin
 {
@@ -14,6 +15,7 @@ public:
     void OnStartStream(void);
     void OnStopStream(void);
     void OnMicVolumeChanged(float level, bool muted, bool finalValue);
+    bool GetLatencyStats(DSPLatencyStats &stats);
 
 private:
     // Audio filter to discard real mic's audio data
@@ -32,6 +34,10 @@ private:
 
         bool Initialize(void);
         void SetMicVolume(float micVolume);
+        void GetLatencyStats(DSPLatencyStats &stats);
+
+        // Overridden only to measure how long audio waits in AudioSource before it's mixed
+        bool GetBuffer(float **buffer, QWORD targetTimestamp);
 
     protected:
         CTSTR GetDeviceName(void) const;
@@ -39,13 +45,56 @@ private:
         void ReleaseBuffer(void);
 
     private:
+        HRESULT ReadDMO(bool *moreData);
+        bool ReadSegment(void);
+
         IMediaObject *_dmo;
-        List<int16_t> _audioBuf;
-        unsigned int _numSamples;
+        IMediaBuffer *_dmoBuf;
         bool _skipNextRead;
+
+        // Everything between the DMO and OBS: gain, Speex, slicing and upsampling
+        DSPChain _chain;
+
+        // Optional thread that drains the DMO off the OBS audio thread. When it's running, it owns the DMO and the
+        // capture side of the chain, and GetNextBuffer only takes finished segments from the chain.
+        static DWORD STDCALL PumpThread(LPVOID param);
+        void PumpDMO(void);
+        bool StartPump(void);
+        void StopPump(void);
+        HANDLE _pumpThread;
+        HANDLE _pumpStopEvent;
+
         float _micVolume;
         float _micBoost;
 
+        // Latency instrumentation. The histograms are written from the audio thread and may be read from anywhere, so
+        // they're guarded by _statsMutex. _lastReadTime belongs to whichever thread reads the DMO; the chain carries
+        // it along with each segment that read completed.
+        void LogLatencyStats(void);
+        HANDLE _statsMutex;
+        LatencyHistogram _dmoLatency;
+        LatencyHistogram _mixLatency;
+        LatencyHistogram _timestampCorrection;
+        unsigned int _timestampResets;
+        QWORD _lastReadTime;
+        QWORD _sliceTimestamp;
+        QWORD _chainLatency;
+        QWORD _lastAssignedTimestamp;
+        DWORD _statsLogInterval;
+        DWORD _nextStatsLog;
+
+        // Always-on CPU profile of the capture path, logged when the stream stops. The chain's capture profile belongs to
+        // whichever thread drains the DMO and its output profile to OBS's audio thread, so each has a single writer.
+        void LogStageProfile(void);
+        unsigned long long _profileStartCycles;
+        QWORD _profileStartTime;
+
+        // Heap allocations made on the capture path, for verifying that the steady state allocates nothing
+        void CountAllocations(unsigned int since);
+        volatile LONG _numAllocs;
+        unsigned int _numSegments;
+        unsigned int _numWarmupAllocs;
+
         // Push-to-talk hotkey support
         static void STDCALL PushToTalkHotkeyCB(DWORD hotkey, UPARAM param, bool keyDown);
         bool _usePushToTalk;
@@ -54,11 +103,14 @@ private:
         int _pttDelay;
         UINT _pttDelayExpires;
 
-        // Speex preprocessor state for post-gain noise removal
-        SpeexPreprocessState *_speexState;
-
-        static const int k_SampleRate = 16000;
-        static const int k_SegmentSize = k_SampleRate / 100;
+        static const unsigned int k_DefaultSampleRate = 16000;
+        static const unsigned int k_DefaultFrameMS = 10;
+        static const unsigned int k_SliceMS = 10;
+        static const int k_DefaultStatsLogInterval = 300;
+        static const unsigned int k_MaxLimiterMS = 5;
+        static const unsigned int k_WarmupSegments = 100;
+        static const int k_BufferedSegments = 8;
+        static const int k_PumpIntervalMS = 5;
 
 #include "CMediaBuffer.h"
     };
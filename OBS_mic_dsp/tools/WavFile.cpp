@@ -0,0 +1,188 @@
+#include "WavFile.h"
+#include <string.h>
+#include <math.h>
+
+// WAVE files are little-endian, as is every machine the plugin runs on
+static bool ReadU32(FILE *f, uint32_t &value)
+{
+    unsigned char b[4];
+    if(fread(b, 1, 4, f) != 4)
+        return false;
+    value = b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t) b[3] << 24);
+    return true;
+}
+
+static void WriteU32(FILE *f, uint32_t value)
+{
+    unsigned char b[4] = {(unsigned char) value, (unsigned char) (value >> 8), (unsigned char) (value >> 16),
+        (unsigned char) (value >> 24)};
+    fwrite(b, 1, 4, f);
+}
+
+static void WriteU16(FILE *f, uint16_t value)
+{
+    unsigned char b[2] = {(unsigned char) value, (unsigned char) (value >> 8)};
+    fwrite(b, 1, 2, f);
+}
+
+bool ReadWav(const std::string &path, WavData &wav, std::string &error)
+{
+    FILE *f = fopen(path.c_str(), "rb");
+    if(!f)
+    {
+        error = "can't open " + path;
+        return false;
+    }
+
+    char id[4];
+    uint32_t size;
+    bool haveFormat = false;
+    unsigned int formatTag = 0, bits = 0;
+    wav.sampleRate = 0;
+    wav.channels = 0;
+    wav.samples.clear();
+
+    if(fread(id, 1, 4, f) != 4 || memcmp(id, "RIFF", 4) != 0 || !ReadU32(f, size) || fread(id, 1, 4, f) != 4 ||
+        memcmp(id, "WAVE", 4) != 0)
+    {
+        error = path + " is not a WAVE file";
+        fclose(f);
+        return false;
+    }
+
+    while(fread(id, 1, 4, f) == 4 && ReadU32(f, size))
+    {
+        if(memcmp(id, "fmt ", 4) == 0 && size >= 16)
+        {
+            unsigned char fmt[16];
+            if(fread(fmt, 1, 16, f) != 16)
+                break;
+            formatTag = fmt[0] | (fmt[1] << 8);
+            wav.channels = fmt[2] | (fmt[3] << 8);
+            wav.sampleRate = fmt[4] | (fmt[5] << 8) | (fmt[6] << 16) | ((uint32_t) fmt[7] << 24);
+            bits = fmt[14] | (fmt[15] << 8);
+
+            // WAVE_FORMAT_EXTENSIBLE keeps the real format tag in the first two bytes of the subformat GUID
+            if(formatTag == 0xFFFE && size >= 26)
+            {
+                unsigned char ext[10];
+                if(fread(ext, 1, 10, f) != 10)
+                    break;
+                formatTag = ext[8] | (ext[9] << 8);
+                size -= 10;
+            }
+            fseek(f, (size - 16 + 1) & ~1u, SEEK_CUR);
+            haveFormat = true;
+        }
+        else if(memcmp(id, "data", 4) == 0 && haveFormat)
+        {
+            bool isPCM16 = formatTag == 1 && bits == 16;
+            bool isFloat = formatTag == 3 && bits == 32;
+            if((!isPCM16 && !isFloat) || wav.channels == 0)
+            {
+                error = path + ": only 16-bit PCM and 32-bit float WAVE files are supported";
+                fclose(f);
+                return false;
+            }
+
+            std::vector<unsigned char> data(size);
+            size = (uint32_t) fread(data.data(), 1, size, f);
+            unsigned int frameBytes = wav.channels * bits / 8;
+            unsigned int numFrames = size / frameBytes;
+            wav.samples.resize(numFrames);
+
+            // Downmix by averaging the channels, then round to 16 bits like the DMO's output
+            for(unsigned int i = 0; i < numFrames; i++)
+            {
+                const unsigned char *frame = &data[i * frameBytes];
+                float sum = 0;
+                for(unsigned int ch = 0; ch < wav.channels; ch++)
+                {
+                    if(isPCM16)
+                        sum += (int16_t) (frame[ch * 2] | (frame[ch * 2 + 1] << 8));
+                    else
+                    {
+                        float value;
+                        memcpy(&value, frame + ch * 4, 4);
+                        sum += value * 32767.0f;
+                    }
+                }
+                float mono = floorf(sum / wav.channels + 0.5f);
+                wav.samples[i] = (int16_t) (mono > 32767 ? 32767 : mono < -32768 ? -32768 : mono);
+            }
+            fclose(f);
+            return true;
+        }
+        else
+            fseek(f, (size + 1) & ~1u, SEEK_CUR);
+    }
+
+    error = path + " has no audio data";
+    fclose(f);
+    return false;
+}
+
+WavWriter::WavWriter()
+    : _file(nullptr),
+    _isFloat(false),
+    _sampleRate(0),
+    _dataBytes(0)
+{
+}
+
+WavWriter::~WavWriter()
+{
+    Close();
+}
+
+bool WavWriter::Open(const std::string &path, unsigned int sampleRate, bool isFloat)
+{
+    Close();
+    _file = fopen(path.c_str(), "wb");
+    if(!_file)
+        return false;
+
+    _isFloat = isFloat;
+    _sampleRate = sampleRate;
+    _dataBytes = 0;
+
+    // Sizes are filled in by Close()
+    unsigned int sampleBytes = isFloat ? 4 : 2;
+    fwrite("RIFF", 1, 4, _file);
+    WriteU32(_file, 0);
+    fwrite("WAVEfmt ", 1, 8, _file);
+    WriteU32(_file, 16);
+    WriteU16(_file, isFloat ? 3 : 1);
+    WriteU16(_file, 1);
+    WriteU32(_file, sampleRate);
+    WriteU32(_file, sampleRate * sampleBytes);
+    WriteU16(_file, (uint16_t) sampleBytes);
+    WriteU16(_file, (uint16_t) (sampleBytes * 8));
+    fwrite("data", 1, 4, _file);
+    WriteU32(_file, 0);
+    return !ferror(_file);
+}
+
+void WavWriter::Write(const void *samples, unsigned int count)
+{
+    if(!_file)
+        return;
+    size_t bytes = count * (size_t) (_isFloat ? 4 : 2);
+    _dataBytes += fwrite(samples, 1, bytes, _file);
+}
+
+bool WavWriter::Close(void)
+{
+    if(!_file)
+        return true;
+
+    fseek(_file, 4, SEEK_SET);
+    WriteU32(_file, (uint32_t) (36 + _dataBytes));
+    fseek(_file, 40, SEEK_SET);
+    WriteU32(_file, (uint32_t) _dataBytes);
+
+    bool ok = !ferror(_file);
+    ok = fclose(_file) == 0 && ok;
+    _file = nullptr;
+    return ok;
+}
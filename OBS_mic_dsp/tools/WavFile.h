@@ -0,0 +1,44 @@
+#ifndef INCLUDED_WavFile_H
+#define INCLUDED_WavFile_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// Minimal RIFF WAVE reading and writing for the replay tool. Reads 16-bit PCM and 32-bit float files; multichannel
+// input is downmixed to mono, since the mic path is mono.
+struct WavData
+{
+    unsigned int sampleRate;
+    unsigned int channels;      // Of the file; samples are always mono
+    std::vector<int16_t> samples;
+};
+
+// Returns false and sets `error` if the file can't be read or isn't a format we handle.
+bool ReadWav(const std::string &path, WavData &wav, std::string &error);
+
+// Writes mono samples as 16-bit PCM or 32-bit float, the two formats the chain produces.
+class WavWriter
+{
+public:
+    WavWriter();
+    ~WavWriter();
+
+    WavWriter(const WavWriter &) = delete;
+    WavWriter &operator=(const WavWriter &) = delete;
+
+    bool Open(const std::string &path, unsigned int sampleRate, bool isFloat);
+    void Write(const void *samples, unsigned int count);
+
+    // Fills in the header sizes. Called by the destructor if needed.
+    bool Close(void);
+
+private:
+    FILE *_file;
+    bool _isFloat;
+    unsigned int _sampleRate;
+    unsigned long long _dataBytes;
+};
+
+#endif
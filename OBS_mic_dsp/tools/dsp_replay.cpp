@@ -0,0 +1,317 @@
+// Replays a recorded mic WAV file through the plugin's DSP chain, so changes to the chain can be checked for output and
+// timing without OBS, Windows or a live mic. The input is fed in 10 ms reads like the voice capture DMO delivers, and
+// the output is collected exactly as OBS would receive it.
+
+#include "../src/AllocCounter.h"
+#include "../src/DSPChain.h"
+#include "../src/DSPKernels.h"
+#include "WavFile.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Like the plugin's warm-up before it counts the capture path's steady state
+static const unsigned int k_WarmupReads = 100;
+
+static void PrintUsage(void)
+{
+    fprintf(stderr,
+        "Usage: dsp_replay MIC.wav -o OUT.wav [options]\n"
+        "\n"
+        "  -o, --output FILE       Processed audio, mono, as OBS would receive it\n"
+        "  --far FILE              Far-end (desktop audio) reference at the mic's sample rate, for echo cancellation\n"
+        "  --echo-ms N             Echo canceller filter length (default 200 with --far)\n"
+        "  --timing FILE           Per-frame processing times as CSV\n"
+        "  --frame-ms N            Segment length, 10 or 20 (default 10)\n"
+        "  --output-rate HZ        Consumer's rate; upsamples if it's a whole multiple (default: mic rate)\n"
+        "  --float                 Use the floating point chain\n"
+        "  --gain X                Mic volume times boost (default 1)\n"
+        "  --mute START:END        Mute between two times in seconds, like push-to-talk\n"
+        "  --no-denoise            Skip the Speex preprocessor\n"
+        "  --silence-skip          Skip the Speex preprocessor on silent segments\n"
+        "  --limiter MS            Limit peaks with this much look-ahead, 1 to 5 ms, instead of clipping them\n"
+        "  --ceiling DB            Highest true peak the limiter lets through (default -1 dBFS)\n"
+        "  --repeat N              Process the input N times, for steadier timing (default 1)\n"
+        "  --check-allocs          Fail if the chain allocates after the first %u reads\n", k_WarmupReads);
+}
+
+struct FrameTiming
+{
+    double captureUS;
+    double outputUS;
+};
+
+int main(int argc, char **argv)
+{
+    std::string micPath, farPath, outPath, timingPath;
+    DSPChainConfig config;
+    unsigned int outputRate = 0;
+    float gain = 1;
+    double muteStart = -1, muteEnd = -1;
+    int repeat = 1;
+    int echoMS = -1;
+    bool checkAllocs = false;
+
+    config.frameMS = 10;
+    for(int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if((arg == "-o" || arg == "--output") && hasValue)
+            outPath = argv[++i];
+        else if(arg == "--far" && hasValue)
+            farPath = argv[++i];
+        else if(arg == "--timing" && hasValue)
+            timingPath = argv[++i];
+        else if(arg == "--frame-ms" && hasValue)
+            config.frameMS = (unsigned int) atoi(argv[++i]);
+        else if(arg == "--output-rate" && hasValue)
+            outputRate = (unsigned int) atoi(argv[++i]);
+        else if(arg == "--float")
+            config.floatChain = true;
+        else if(arg == "--gain" && hasValue)
+            gain = (float) atof(argv[++i]);
+        else if(arg == "--mute" && hasValue)
+        {
+            if(sscanf(argv[++i], "%lf:%lf", &muteStart, &muteEnd) != 2)
+            {
+                PrintUsage();
+                return 2;
+            }
+        }
+        else if(arg == "--echo-ms" && hasValue)
+            echoMS = atoi(argv[++i]);
+        else if(arg == "--no-denoise")
+            config.noiseSuppression = false;
+        else if(arg == "--silence-skip")
+            config.silenceSkip = true;
+        else if(arg == "--limiter" && hasValue)
+            config.limiterMS = (unsigned int) atoi(argv[++i]);
+        else if(arg == "--ceiling" && hasValue)
+            config.limiterCeilingDB = (float) atof(argv[++i]);
+        else if(arg == "--repeat" && hasValue)
+            repeat = std::max(1, atoi(argv[++i]));
+        else if(arg == "--check-allocs")
+            checkAllocs = true;
+        else if(arg[0] != '-' && micPath.empty())
+            micPath = arg;
+        else
+        {
+            PrintUsage();
+            return 2;
+        }
+    }
+    if(micPath.empty() || outPath.empty() || (config.frameMS != 10 && config.frameMS != 20) || config.limiterMS > 5)
+    {
+        PrintUsage();
+        return 2;
+    }
+
+    WavData mic;
+    std::string error;
+    if(!ReadWav(micPath, mic, error))
+    {
+        fprintf(stderr, "dsp_replay: %s\n", error.c_str());
+        return 1;
+    }
+
+    WavData far;
+    if(!farPath.empty())
+    {
+        if(!ReadWav(farPath, far, error))
+        {
+            fprintf(stderr, "dsp_replay: %s\n", error.c_str());
+            return 1;
+        }
+        if(far.sampleRate != mic.sampleRate)
+        {
+            fprintf(stderr, "dsp_replay: far-end rate %u Hz doesn't match the mic's %u Hz\n", far.sampleRate,
+                mic.sampleRate);
+            return 1;
+        }
+    }
+
+    // The chain runs at the rate the DMO was asked for, which is the recording's rate here. The queues only need to
+    // hold what one read produces, but match the plugin's depth anyway.
+    config.sampleRate = mic.sampleRate;
+    config.outputRate = outputRate ? outputRate : mic.sampleRate;
+    config.echoFilterMS = farPath.empty() ? 0 : echoMS >= 0 ? echoMS : 200;
+    DSPChain chain;
+    unsigned int initAllocs = ThreadAllocations();
+    if(mic.sampleRate % 100 != 0 || !chain.Init(config))
+    {
+        fprintf(stderr, "dsp_replay: can't process %u Hz audio in %u ms frames\n", mic.sampleRate, config.frameMS);
+        return 1;
+    }
+    if(config.outputRate != chain.OutputRate())
+    {
+        fprintf(stderr, "dsp_replay: %u Hz is not a whole multiple of %u Hz, output stays at %u Hz\n",
+            config.outputRate, mic.sampleRate, chain.OutputRate());
+    }
+
+    // Pad the recording to whole segments so the last one comes out
+    unsigned int readSize = mic.sampleRate / 100;
+    unsigned int segmentSize = chain.SegmentSize();
+    size_t numSamples = (mic.samples.size() + segmentSize - 1) / segmentSize * segmentSize;
+    mic.samples.resize(numSamples, 0);
+    if(!farPath.empty())
+        far.samples.resize(numSamples, 0);
+
+    size_t sampleBytes = chain.OutputIsFloat() ? sizeof(float) : sizeof(int16_t);
+    size_t sliceBytes = chain.OutputSliceFrames() * sampleBytes;
+    std::vector<unsigned char> output;
+    output.reserve(numSamples / readSize * sliceBytes + sliceBytes);
+
+    std::vector<FrameTiming> timings;
+    timings.reserve(numSamples / readSize * repeat);
+    std::vector<int16_t> readBuf(readSize);
+    typedef std::chrono::steady_clock Clock;
+    double totalUS = 0;
+
+    // Only what the chain allocates is counted, not the replay's own buffers
+    initAllocs = ThreadAllocations() - initAllocs;
+    unsigned int numReads = 0, warmupAllocs = 0, chainAllocs = 0;
+
+    for(int pass = 0; pass < repeat; pass++)
+    {
+        for(size_t pos = 0; pos < numSamples; pos += readSize)
+        {
+            // The chain amplifies int16 input in place, like it does the DMO's buffer
+            memcpy(readBuf.data(), &mic.samples[pos], readSize * sizeof(int16_t));
+            double seconds = (double) pos / mic.sampleRate;
+            bool mute = seconds >= muteStart && seconds < muteEnd;
+
+            // OBS hands over desktop audio before the mic audio it's echoed in
+            Clock::time_point start = Clock::now();
+            unsigned int allocs = ThreadAllocations();
+            if(!farPath.empty())
+                chain.WriteFarEnd(&far.samples[pos], readSize);
+            chain.Write(readBuf.data(), readSize, gain, mute);
+            chain.ProcessSegments();
+            Clock::time_point captured = Clock::now();
+            chainAllocs += ThreadAllocations() - allocs;
+
+            // Drain it all like OBS does. Only the first pass is kept, and copying it out isn't timed.
+            FrameTiming timing;
+            timing.outputUS = 0;
+            for(;;)
+            {
+                Clock::time_point sliceStart = Clock::now();
+                allocs = ThreadAllocations();
+                bool newSegment;
+                const void *slice = chain.NextSlice(&newSegment);
+                Clock::time_point sliceEnd = Clock::now();
+                timing.outputUS += std::chrono::duration<double, std::micro>(sliceEnd - sliceStart).count();
+                chainAllocs += ThreadAllocations() - allocs;
+                if(!slice)
+                    break;
+
+                if(pass == 0)
+                    output.insert(output.end(), (const unsigned char *) slice, (const unsigned char *) slice + sliceBytes);
+
+                Clock::time_point releaseStart = Clock::now();
+                allocs = ThreadAllocations();
+                chain.ReleaseSlice();
+                chainAllocs += ThreadAllocations() - allocs;
+                timing.outputUS += std::chrono::duration<double, std::micro>(Clock::now() - releaseStart).count();
+            }
+
+            timing.captureUS = std::chrono::duration<double, std::micro>(captured - start).count();
+            timings.push_back(timing);
+            totalUS += timing.captureUS + timing.outputUS;
+            if(++numReads == k_WarmupReads)
+                warmupAllocs = chainAllocs;
+        }
+    }
+
+    WavWriter writer;
+    if(!writer.Open(outPath, chain.OutputRate(), chain.OutputIsFloat()))
+    {
+        fprintf(stderr, "dsp_replay: can't write %s\n", outPath.c_str());
+        return 1;
+    }
+    writer.Write(output.data(), (unsigned int) (output.size() / sampleBytes));
+    if(!writer.Close())
+    {
+        fprintf(stderr, "dsp_replay: can't write %s\n", outPath.c_str());
+        return 1;
+    }
+
+    if(!timingPath.empty())
+    {
+        FILE *csv = fopen(timingPath.c_str(), "w");
+        if(!csv)
+        {
+            fprintf(stderr, "dsp_replay: can't write %s\n", timingPath.c_str());
+            return 1;
+        }
+        fprintf(csv, "frame,time_ms,capture_us,output_us,total_us\n");
+        for(size_t i = 0; i < timings.size(); i++)
+        {
+            fprintf(csv, "%u,%.1f,%.3f,%.3f,%.3f\n", (unsigned int) i, i * 10.0, timings[i].captureUS,
+                timings[i].outputUS, timings[i].captureUS + timings[i].outputUS);
+        }
+        fclose(csv);
+    }
+
+    // Summary
+    std::vector<double> totals(timings.size());
+    for(size_t i = 0; i < timings.size(); i++)
+        totals[i] = timings[i].captureUS + timings[i].outputUS;
+    std::sort(totals.begin(), totals.end());
+    double audioSeconds = (double) numSamples * repeat / mic.sampleRate;
+
+    printf("Input:    %s, %u Hz, %u channel(s), %.2f s\n", micPath.c_str(), mic.sampleRate, mic.channels,
+        (double) numSamples / mic.sampleRate);
+    if(!farPath.empty())
+    {
+        printf("Far end:  %s, %s\n", farPath.c_str(), chain.EchoCancellation() ? "echo cancelled" : "not used");
+    }
+    printf("Chain:    %u ms segments, %s, %s, %s kernels\n", config.frameMS, config.floatChain ? "float" : "int16",
+        chain.NoiseSuppression() ? "Speex" : "no Speex", GetDSPKernelsArch());
+    if(chain.EchoCancellation())
+        printf("Echo:     %u ms filter, %u frames without far-end audio\n", config.echoFilterMS, chain.FarEndUnderruns());
+    if(config.silenceSkip && chain.NoiseSuppression())
+        printf("Silence:  %u of %u segments skipped the preprocessor\n", chain.SkippedSegments(),
+            (unsigned int) (totals.size() * 10 / config.frameMS));
+    if(chain.Limiting())
+        printf("Limiter:  %u ms look-ahead, %u samples of latency, gain down to %.1f dB\n", config.limiterMS,
+            chain.LimiterLatency(), 20 * log10(chain.LimiterLowestGain()));
+    if(chain.StateMemory())
+        printf("State:    %.1f KB of Speex state, %s\n", chain.StateMemory() / 1024.0,
+            chain.StateMemoryLocked() ? "locked" : "not locked");
+    printf("Output:   %s, %u Hz %s\n", outPath.c_str(), chain.OutputRate(), chain.OutputIsFloat() ? "float" : "int16");
+    printf("Frames:   %u x 10 ms, avg %.2f us, p50 %.2f us, p99 %.2f us, max %.2f us\n", (unsigned int) totals.size(),
+        totalUS / totals.size(), totals[totals.size() / 2], totals[totals.size() - 1 - totals.size() / 100],
+        totals.back());
+    printf("Speed:    %.1fx realtime\n", totalUS > 0 ? audioSeconds * 1e6 / totalUS : 0.0);
+
+    const StageProfiler *profiles[] = {&chain.CaptureProfile(), &chain.OutputProfile()};
+    const char *titles[] = {"Capture side", "Output side"};
+    for(int i = 0; i < 2; i++)
+    {
+        printf("%s:\n", titles[i]);
+        for(int stage = 0; stage < Stage_Count; stage++)
+        {
+            StageSummary s = profiles[i]->Summarize((ProfileStage) stage);
+            if(s.count == 0)
+                continue;
+            printf("  %-18s min %9llu  avg %9llu  p99 %9llu  max %9llu cycles (%u calls)\n",
+                StageProfiler::StageName((ProfileStage) stage), s.minCycles, s.avgCycles, s.p99Cycles, s.maxCycles,
+                s.count);
+        }
+    }
+    if(chain.Dropped())
+        printf("Dropped:  %u samples\n", chain.Dropped());
+    if(numReads < k_WarmupReads)
+        warmupAllocs = chainAllocs;
+    printf("Allocs:   %u in Init, %u during the first %u reads, %u over the following %u\n", initAllocs, warmupAllocs,
+        std::min(numReads, k_WarmupReads), chainAllocs - warmupAllocs, numReads - std::min(numReads, k_WarmupReads));
+
+    return checkAllocs && chainAllocs != warmupAllocs ? 1 : 0;
+}
@@ -0,0 +1,427 @@
+// Checks and times the worker pool OBS queries its aux sources and the mic on (OBS/Source/AudioQueryPool.h, used by
+// OBS::QueryAudioSources in OBS/Source/OBSCapture.cpp). The pool is the one OBS builds, with std::thread standing in
+// for the win32 events and threads.
+//
+// "testaudiograph -c" runs the checks. Thousands of runs with random numbers of sources, workers and queued packets
+// check that every task runs exactly once, drains run until their source is empty and then sort it, and Run() reports
+// whether any source had audio. Then a few seconds of ticks of DSP sources, each a mic DSP chain followed by the kernel
+// QueryAudio2 uses to turn a packet into stereo float, check that the mix comes out bit for bit the same with and
+// without workers. Run without arguments, it also times a tick for 1 to 16 DSP sources, first with no workers and then
+// with the pool. "--workers n" sets the pool's size; by default it's what OBS would use, one less than the CPU's
+// threads and at most 3.
+
+#include "../src/DSPChain.h"
+#include "../../OBS/OBSApi/AudioDownmix.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// What AudioSource.h declares for QueryAudio2's result, which the pool compares against
+enum
+{
+    NoAudioAvailable,
+    AudioAvailable,
+};
+
+#include "../../OBS/Source/AudioQueryPool.h"
+
+static const unsigned int k_SampleRate = 48000;
+static const unsigned int k_TickFrames = k_SampleRate / 100;
+static const unsigned int k_MaxSources = 16;
+static const unsigned int k_MaxWorkers = 3;
+
+// The pool's platform on top of the standard library
+struct StdAudioQueryPlatform
+{
+    // Auto-reset, like the win32 events OBS uses
+    struct EventState
+    {
+        std::mutex lock;
+        std::condition_variable cond;
+        bool signaled = false;
+    };
+
+    typedef EventState *Event;
+    typedef std::thread *Thread;
+
+    static Event CreateSignal(void) { return new EventState; }
+    static void DestroySignal(Event e) { delete e; }
+
+    static void Signal(Event e)
+    {
+        {
+            std::lock_guard<std::mutex> lock(e->lock);
+            e->signaled = true;
+        }
+        e->cond.notify_one();
+    }
+
+    static void Wait(Event e)
+    {
+        std::unique_lock<std::mutex> lock(e->lock);
+        e->cond.wait(lock, [e] { return e->signaled; });
+        e->signaled = false;
+    }
+
+    static void WaitAll(Event *events, unsigned int num)
+    {
+        for(unsigned int i = 0; i < num; i++)
+            Wait(events[i]);
+    }
+
+    static long Increment(volatile long *value)
+    {
+#ifdef _MSC_VER
+        return _InterlockedIncrement(value);
+#else
+        return __atomic_add_fetch(value, 1, __ATOMIC_SEQ_CST);
+#endif
+    }
+
+    static Thread StartThread(void (*proc)(void *), void *param) { return new std::thread(proc, param); }
+
+    static void JoinThread(Thread thread)
+    {
+        thread->join();
+        delete thread;
+    }
+};
+
+static uint32_t s_seed = 1;
+static std::thread::id s_mainThread;
+
+static uint32_t RandomBits(void)
+{
+    s_seed = s_seed * 1664525 + 1013904223;
+    return s_seed;
+}
+
+// A source that only counts what the pool does to it. Each query takes one queued packet, if there is one, and gives
+// up the CPU, so the workers get to take tasks even where there's only one CPU thread.
+class CountingSource
+{
+public:
+    CountingSource() : _queued(0), _numQueries(0), _numPackets(0), _numSorts(0), _onWorker(false) {}
+
+    void Queue(unsigned int numPackets)
+    {
+        _queued = numPackets;
+        _numQueries = _numPackets = _numSorts = 0;
+        _onWorker = false;
+    }
+
+    unsigned int QueryAudio2(float volume, bool bCanBurst)
+    {
+        (void) volume;
+        (void) bCanBurst;
+        std::this_thread::yield();
+        _numQueries++;
+        _onWorker = std::this_thread::get_id() != s_mainThread;
+        if(!_queued)
+            return NoAudioAvailable;
+        _queued--;
+        _numPackets++;
+        return AudioAvailable;
+    }
+
+    bool GetLatestTimestamp(unsigned long long &timestamp)
+    {
+        timestamp = 0;
+        return true;
+    }
+
+    void SortAudio(unsigned long long timestamp)
+    {
+        (void) timestamp;
+        _numSorts++;
+    }
+
+    unsigned int NumQueries(void) const { return _numQueries; }
+    unsigned int NumPackets(void) const { return _numPackets; }
+    unsigned int NumSorts(void) const { return _numSorts; }
+    bool OnWorker(void) const { return _onWorker; }
+
+private:
+    unsigned int _queued;
+    unsigned int _numQueries;
+    unsigned int _numPackets;
+    unsigned int _numSorts;
+    bool _onWorker;
+};
+
+typedef AudioQueryPool<CountingSource, StdAudioQueryPlatform> CountingPool;
+
+// Random runs on pools of 0 to k_MaxWorkers workers
+static bool CheckTasks(void)
+{
+    const unsigned int numRuns = 20000;
+    std::unique_ptr<CountingPool> pools[k_MaxWorkers + 1];
+    for(unsigned int w = 0; w <= k_MaxWorkers; w++)
+    {
+        pools[w].reset(new CountingPool);
+        pools[w]->Start(w);
+    }
+
+    CountingSource sources[k_MaxSources];
+    unsigned int queued[k_MaxSources];
+    bool drain[k_MaxSources];
+    unsigned int wrongQueries = 0, wrongPackets = 0, wrongSorts = 0, wrongResults = 0, numOnWorkers = 0;
+    s_mainThread = std::this_thread::get_id();
+
+    for(unsigned int run = 0; run < numRuns; run++)
+    {
+        CountingPool &pool = *pools[RandomBits() % (k_MaxWorkers + 1)];
+        unsigned int numSources = RandomBits() % (k_MaxSources + 1);
+
+        pool.ClearTasks();
+        bool expectAudio = false;
+        for(unsigned int i = 0; i < numSources; i++)
+        {
+            queued[i] = RandomBits() % 4;
+            drain[i] = (RandomBits() & 0x100) != 0;
+            expectAudio |= queued[i] != 0;
+            sources[i].Queue(queued[i]);
+            pool.AddTask(&sources[i], 1.0f, drain[i]);
+        }
+
+        bool gotAudio = pool.Run();
+
+        for(unsigned int i = 0; i < numSources; i++)
+        {
+            // A drain queries until a query comes back empty; a plain query is made once
+            unsigned int queries = drain[i] ? queued[i] + 1 : 1;
+            unsigned int packets = drain[i] ? queued[i] : (queued[i] ? 1 : 0);
+            if(sources[i].NumQueries() != queries)
+                wrongQueries++;
+            if(sources[i].NumPackets() != packets)
+                wrongPackets++;
+            if(sources[i].NumSorts() != (drain[i] ? 1u : 0u))
+                wrongSorts++;
+            if(pool.GetTask(i).bGotAudio != (packets != 0))
+                wrongResults++;
+            if(sources[i].OnWorker())
+                numOnWorkers++;
+        }
+        if(gotAudio != expectAudio)
+            wrongResults++;
+    }
+
+    // If no task ever ran on a worker, the runs didn't check anything the workers do
+    bool ok = wrongQueries == 0 && wrongPackets == 0 && wrongSorts == 0 && wrongResults == 0 && numOnWorkers != 0;
+    printf("%u random runs, %u tasks on workers: %u wrong query counts, %u wrong packet counts, %u wrong sorts, "
+        "%u wrong results: %s\n", numRuns, numOnWorkers, wrongQueries, wrongPackets, wrongSorts, wrongResults,
+        ok ? "ok" : "FAILED");
+    return ok;
+}
+
+// A mic DSP chain and the downmix kernel. Each tick the capture queues one packet, and a query processes it.
+class DSPSource
+{
+public:
+    explicit DSPSource(unsigned int index)
+        : _pos(0),
+        _queued(0),
+        _readBuf(k_TickFrames),
+        _stereo(k_TickFrames * 2),
+        _downmix(GetDownmixProc(DOWNMIX_FLOAT, DOWNMIX_MONO))
+    {
+        DSPChainConfig config;
+        config.sampleRate = k_SampleRate;
+        config.outputRate = k_SampleRate;
+        config.floatChain = true;
+        _chain.Init(config);
+
+        // A second of a different tone in noise for each source
+        uint32_t seed = 1 + index;
+        _capture.resize(k_SampleRate);
+        for(unsigned int i = 0; i < k_SampleRate; i++)
+        {
+            seed = seed * 1664525 + 1013904223;
+            float noise = (int32_t) seed / 2147483648.0f;
+            float tone = sinf(2.0f * 3.14159265f * (220.0f + 55.0f * index) * i / k_SampleRate);
+            _capture[i] = (int16_t) (8000.0f * tone + 2000.0f * noise);
+        }
+    }
+
+    void Capture(void) { _queued++; }
+
+    unsigned int QueryAudio2(float volume, bool bCanBurst)
+    {
+        (void) bCanBurst;
+        if(!_queued)
+            return NoAudioAvailable;
+        _queued--;
+
+        memcpy(_readBuf.data(), &_capture[_pos], k_TickFrames * sizeof(int16_t));
+        _pos = (_pos + k_TickFrames) % _capture.size();
+
+        _chain.Write(_readBuf.data(), k_TickFrames, 1.0f, false);
+        _chain.ProcessSegments();
+
+        bool newSegment;
+        const void *slice = _chain.NextSlice(&newSegment);
+        if(slice)
+        {
+            _downmix(slice, _stereo.data(), k_TickFrames, volume);
+            _chain.ReleaseSlice();
+        }
+        else
+        {
+            memset(_stereo.data(), 0, _stereo.size() * sizeof(float));
+        }
+        return AudioAvailable;
+    }
+
+    bool GetLatestTimestamp(unsigned long long &timestamp)
+    {
+        (void) timestamp;
+        return false;
+    }
+
+    void SortAudio(unsigned long long timestamp) { (void) timestamp; }
+
+    const float *Stereo(void) const { return _stereo.data(); }
+
+private:
+    DSPChain _chain;
+    std::vector<int16_t> _capture;
+    size_t _pos;
+    unsigned int _queued;
+    std::vector<int16_t> _readBuf;
+    std::vector<float> _stereo;
+    DownmixProc _downmix;
+};
+
+typedef AudioQueryPool<DSPSource, StdAudioQueryPlatform> DSPPool;
+typedef std::vector<std::unique_ptr<DSPSource> > SourceList;
+
+static SourceList MakeSources(unsigned int numSources)
+{
+    SourceList sources;
+    for(unsigned int i = 0; i < numSources; i++)
+        sources.push_back(std::unique_ptr<DSPSource>(new DSPSource(i)));
+    return sources;
+}
+
+// One tick: a packet for every source, the query the way QueryAudioSources makes it, then the mix in source order
+static void RunTick(DSPPool &pool, SourceList &sources, float *mix)
+{
+    pool.ClearTasks();
+    for(size_t i = 0; i < sources.size(); i++)
+    {
+        sources[i]->Capture();
+        pool.AddTask(sources[i].get(), 0.5f + 0.05f * i, false);
+    }
+    pool.Run();
+
+    memset(mix, 0, k_TickFrames * 2 * sizeof(float));
+    for(size_t i = 0; i < sources.size(); i++)
+    {
+        const float *stereo = sources[i]->Stereo();
+        for(unsigned int j = 0; j < k_TickFrames * 2; j++)
+            mix[j] += stereo[j];
+    }
+}
+
+// The mix of a few seconds of ticks with workers has to match the one without
+static bool CheckMix(unsigned int numSources, unsigned int numWorkers)
+{
+    const unsigned int numTicks = 300;
+    SourceList serialSources = MakeSources(numSources), pooledSources = MakeSources(numSources);
+    DSPPool serialPool, pooledPool;
+    pooledPool.Start(numWorkers);
+    std::vector<float> serialMix(k_TickFrames * 2), pooledMix(k_TickFrames * 2);
+    unsigned int mismatches = 0;
+
+    for(unsigned int tick = 0; tick < numTicks; tick++)
+    {
+        RunTick(serialPool, serialSources, serialMix.data());
+        RunTick(pooledPool, pooledSources, pooledMix.data());
+        if(memcmp(serialMix.data(), pooledMix.data(), serialMix.size() * sizeof(float)) != 0)
+            mismatches++;
+    }
+
+    printf("%2u sources, %u workers: %u of %u ticks differ: %s\n", numSources, numWorkers, mismatches, numTicks,
+        mismatches ? "FAILED" : "ok");
+    return mismatches == 0;
+}
+
+// Best time for a tick over a few rounds, in us
+static double TimeTicks(unsigned int numSources, unsigned int numWorkers)
+{
+    SourceList sources = MakeSources(numSources);
+    DSPPool pool;
+    pool.Start(numWorkers);
+    std::vector<float> mix(k_TickFrames * 2);
+    typedef std::chrono::steady_clock Clock;
+    double best = 0;
+
+    // Let the preprocessors settle first
+    for(unsigned int i = 0; i < 50; i++)
+        RunTick(pool, sources, mix.data());
+
+    for(int round = 0; round < 5; round++)
+    {
+        const unsigned int numTicks = 100;
+        Clock::time_point start = Clock::now();
+        for(unsigned int i = 0; i < numTicks; i++)
+            RunTick(pool, sources, mix.data());
+        double us = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / numTicks;
+        if(round == 0 || us < best)
+            best = us;
+    }
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    bool checkOnly = false;
+    unsigned int cpuThreads = std::thread::hardware_concurrency();
+    unsigned int numWorkers = cpuThreads > 1 ? cpuThreads - 1 : 0;
+    if(numWorkers > k_MaxWorkers)
+        numWorkers = k_MaxWorkers;
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "-c") == 0)
+            checkOnly = true;
+        else if(strcmp(argv[i], "--workers") == 0 && i + 1 < argc)
+            numWorkers = (unsigned int) atoi(argv[++i]);
+        else
+        {
+            fprintf(stderr, "usage: testaudiograph [-c] [--workers n]\n");
+            return 1;
+        }
+    }
+
+    // The checks always use some workers, even where the CPU has one thread and OBS wouldn't
+    bool ok = CheckTasks();
+    ok &= CheckMix(1, k_MaxWorkers);
+    ok &= CheckMix(5, k_MaxWorkers);
+    ok &= CheckMix(k_MaxSources, k_MaxWorkers);
+
+    if(!checkOnly)
+    {
+        printf("\n%u CPU threads, %u workers. One 10 ms tick at %u Hz, us:\n", cpuThreads, numWorkers, k_SampleRate);
+        printf("sources    serial    pooled   speedup  %% of realtime (pooled)\n");
+        for(unsigned int n = 1; n <= k_MaxSources; n++)
+        {
+            double serial = TimeTicks(n, 0);
+            double pooled = TimeTicks(n, numWorkers);
+            printf("%7u%10.1f%10.1f%9.2fx%12.1f\n", n, serial, pooled, serial / pooled, pooled / 100.0);
+            fflush(stdout);
+        }
+    }
+    return ok ? 0 : 1;
+}
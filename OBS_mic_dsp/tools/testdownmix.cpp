@@ -0,0 +1,278 @@
+// Checks OBS's fused convert/downmix/volume kernels (OBS/OBSApi/AudioDownmix.cpp) against the three passes
+// AudioSource::QueryAudio2 used to make: convert every sample to float, mix the frames to stereo, then scale by the
+// volume. Run without arguments, it also times both for every input format and KSAUDIO_SPEAKER_* layout OBS handles,
+// on 10 ms packets at 48 kHz. "testdownmix -c" only does the checks. It also checks the front-pair kernels OBS falls
+// back to for channel counts none of the layouts have.
+
+#include "../../OBS/OBSApi/AudioDownmix.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+static const unsigned int k_PacketFrames = 480;
+
+// Largest difference allowed between the kernels and the reference, relative to full scale. The kernels fold the
+// sample scaling into the mix coefficients, so they round differently.
+static const float k_Tolerance = 1e-5f;
+
+static const char *const k_FormatNames[DOWNMIX_NUM_FORMATS] = {"int8", "int16", "int24", "int32", "float"};
+static const unsigned int k_SampleSizes[DOWNMIX_NUM_FORMATS] = {1, 2, 3, 4, 4};
+
+static uint32_t s_seed = 1;
+
+static uint32_t RandomBits(void)
+{
+    s_seed = s_seed * 1664525 + 1013904223;
+    return s_seed;
+}
+
+// Full-scale random samples in the given format
+static std::vector<unsigned char> MakeInput(DownmixFormat format, unsigned int numSamples)
+{
+    std::vector<unsigned char> input(numSamples * k_SampleSizes[format]);
+    for(unsigned int i = 0; i < numSamples; i++)
+    {
+        unsigned char *sample = &input[i * k_SampleSizes[format]];
+        if(format == DOWNMIX_FLOAT)
+        {
+            float val = (int32_t)RandomBits() / 2147483648.0f;
+            memcpy(sample, &val, 4);
+        }
+        else
+        {
+            uint32_t val = RandomBits();
+            memcpy(sample, &val, k_SampleSizes[format]);
+        }
+    }
+    return input;
+}
+
+// The old conversion pass, one sample at a time
+static void ReferenceConvert(DownmixFormat format, const unsigned char *in, float *out, unsigned int numSamples)
+{
+    for(unsigned int i = 0; i < numSamples; i++)
+    {
+        const unsigned char *sample = in + i * k_SampleSizes[format];
+        switch(format)
+        {
+        case DOWNMIX_INT8:
+            out[i] = float(*(const signed char *)sample) / 127.0f;
+            break;
+        case DOWNMIX_INT16:
+        {
+            int16_t val;
+            memcpy(&val, sample, 2);
+            out[i] = float(val) / 32767.0f;
+            break;
+        }
+        case DOWNMIX_INT24:
+        {
+            int32_t val = (int32_t)((uint32_t)sample[0] << 8 | (uint32_t)sample[1] << 16 | (uint32_t)sample[2] << 24) >> 8;
+            out[i] = float(double(val) / 8388607.0);
+            break;
+        }
+        case DOWNMIX_INT32:
+        {
+            int32_t val;
+            memcpy(&val, sample, 4);
+            out[i] = float(double(val) / 2147483647.0);
+            break;
+        }
+        default:
+            memcpy(&out[i], sample, 4);
+            break;
+        }
+    }
+}
+
+// The old mixing pass
+static void ReferenceMix(DownmixLayout layout, const float *in, float *out, unsigned int numFrames)
+{
+    const unsigned int channels = GetDownmixChannels(layout);
+    for(unsigned int i = 0; i < numFrames; i++, in += channels, out += 2)
+    {
+        switch(layout)
+        {
+        case DOWNMIX_MONO:
+            out[0] = out[1] = in[0];
+            break;
+        case DOWNMIX_QUAD:
+        case DOWNMIX_4POINT1:
+        {
+            unsigned int rear = layout == DOWNMIX_QUAD ? 2 : 3;
+            out[0] = (in[0] + in[rear] * downmixSurroundMix4) * downmixAttn4dotX;
+            out[1] = (in[1] + in[rear + 1] * downmixSurroundMix4) * downmixAttn4dotX;
+            break;
+        }
+        case DOWNMIX_5POINT1:
+        case DOWNMIX_7POINT1:
+        {
+            float center = in[2] * downmixCenterMix;
+            out[0] = (in[0] + center + in[4] * downmixSurroundMix) * downmixAttn5dot1;
+            out[1] = (in[1] + center + in[5] * downmixSurroundMix) * downmixAttn5dot1;
+            break;
+        }
+        case DOWNMIX_7POINT1_SURROUND:
+        {
+            float center = in[2] * downmixCenterMix;
+            float rearLeft = (in[4] + in[6]) * 0.5f;
+            float rearRight = (in[5] + in[7]) * 0.5f;
+            out[0] = (in[0] + center + rearLeft * downmixSurroundMix) * downmixAttn5dot1;
+            out[1] = (in[1] + center + rearRight * downmixSurroundMix) * downmixAttn5dot1;
+            break;
+        }
+        default:
+            // Stereo, 2.1, 3.1 and basic surround keep only front left and right
+            out[0] = in[0];
+            out[1] = in[1];
+            break;
+        }
+    }
+}
+
+static void ReferenceDownmix(DownmixFormat format, DownmixLayout layout, const unsigned char *in, float *out,
+    unsigned int numFrames, float volume, std::vector<float> &convertBuf)
+{
+    convertBuf.resize(numFrames * GetDownmixChannels(layout));
+    ReferenceConvert(format, in, &convertBuf[0], (unsigned int)convertBuf.size());
+    ReferenceMix(layout, &convertBuf[0], out, numFrames);
+    for(unsigned int i = 0; i < numFrames * 2; i++)
+        out[i] *= volume;
+}
+
+static bool Check(DownmixFormat format, DownmixLayout layout)
+{
+    const float volume = 0.8f;
+    std::vector<float> convertBuf;
+    bool failed = false;
+    float err = 0;
+
+    // Whole packets and ones that leave one to three frames for the kernel's tail
+    for(unsigned int numFrames = k_PacketFrames; numFrames < k_PacketFrames + 4; numFrames++)
+    {
+        std::vector<unsigned char> input = MakeInput(format, numFrames * GetDownmixChannels(layout));
+        std::vector<float> ref(numFrames * 2), out(numFrames * 2 + 1, -99.0f);
+
+        ReferenceDownmix(format, layout, &input[0], &ref[0], numFrames, volume, convertBuf);
+        GetDownmixProc(format, layout)(&input[0], &out[0], numFrames, volume);
+
+        for(unsigned int i = 0; i < numFrames * 2; i++)
+        {
+            float diff = fabsf(out[i] - ref[i]);
+            if(!(diff <= err))
+                err = diff;
+        }
+        failed |= out[numFrames * 2] != -99.0f;
+    }
+
+    failed |= !(err <= k_Tolerance);
+    printf("%-6s %-13s differs by up to %.3g: %s\n", k_FormatNames[format], GetDownmixLayoutName(layout), err,
+        failed ? "FAILED" : "ok");
+    return !failed;
+}
+
+// Front left and right out of frames of any channel count, against converting everything and keeping channels 0 and 1
+static bool CheckFrontPair(DownmixFormat format)
+{
+    const float volume = 0.8f;
+    std::vector<float> convertBuf;
+    bool failed = false;
+    float err = 0;
+
+    for(unsigned int channels = 2; channels <= 12; channels++)
+    {
+        unsigned int numFrames = k_PacketFrames + channels % 4;
+        std::vector<unsigned char> input = MakeInput(format, numFrames * channels);
+        std::vector<float> out(numFrames * 2 + 1, -99.0f);
+
+        convertBuf.resize(numFrames * channels);
+        ReferenceConvert(format, &input[0], &convertBuf[0], (unsigned int)convertBuf.size());
+        GetFrontPairProc(format)(&input[0], &out[0], numFrames, channels, volume);
+
+        for(unsigned int i = 0; i < numFrames * 2; i++)
+        {
+            float diff = fabsf(out[i] - convertBuf[(i / 2) * channels + i % 2] * volume);
+            if(!(diff <= err))
+                err = diff;
+        }
+        failed |= out[numFrames * 2] != -99.0f;
+    }
+
+    failed |= !(err <= k_Tolerance);
+    printf("%-6s %-13s differs by up to %.3g: %s\n", k_FormatNames[format], "front pair", err, failed ? "FAILED" : "ok");
+    return !failed;
+}
+
+// Best time over a few rounds for one packet, in ns
+template<typename F> static double TimePacket(F process)
+{
+    double best = 0;
+    for(int round = 0; round < 5; round++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::duration elapsed;
+        int runs = 0;
+        do
+        {
+            process();
+            runs++;
+            elapsed = std::chrono::steady_clock::now() - start;
+        } while(elapsed < std::chrono::milliseconds(20));
+
+        double ns = std::chrono::duration<double, std::nano>(elapsed).count() / runs;
+        if(round == 0 || ns < best)
+            best = ns;
+    }
+    return best;
+}
+
+static void Time(DownmixFormat format, DownmixLayout layout)
+{
+    std::vector<unsigned char> input = MakeInput(format, k_PacketFrames * GetDownmixChannels(layout));
+    std::vector<float> out(k_PacketFrames * 2), convertBuf;
+    DownmixProc proc = GetDownmixProc(format, layout);
+    volatile float sink;
+
+    double refNS = TimePacket([&]() {
+        ReferenceDownmix(format, layout, &input[0], &out[0], k_PacketFrames, 0.8f, convertBuf);
+        sink = out[0];
+    });
+    double fusedNS = TimePacket([&]() {
+        proc(&input[0], &out[0], k_PacketFrames, 0.8f);
+        sink = out[0];
+    });
+    (void)sink;
+
+    printf("%-6s %-13s %10.0f %10.0f %8.1fx\n", k_FormatNames[format], GetDownmixLayoutName(layout), refNS, fusedNS,
+        refNS / fusedNS);
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    bool checkOnly = argc > 1 && strcmp(argv[1], "-c") == 0;
+    bool ok = true;
+
+    printf("Fused kernels compared to separate convert, mix and volume passes:\n");
+    for(int format = 0; format < DOWNMIX_NUM_FORMATS; format++)
+    {
+        for(int layout = 0; layout < DOWNMIX_NUM_LAYOUTS; layout++)
+            ok &= Check((DownmixFormat)format, (DownmixLayout)layout);
+        ok &= CheckFrontPair((DownmixFormat)format);
+    }
+
+    if(!checkOnly)
+    {
+        printf("\n%u frame packet, ns:\nformat layout        3 passes      fused  speedup\n", k_PacketFrames);
+        for(int format = 0; format < DOWNMIX_NUM_FORMATS; format++)
+        {
+            for(int layout = 0; layout < DOWNMIX_NUM_LAYOUTS; layout++)
+                Time((DownmixFormat)format, (DownmixLayout)layout);
+        }
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,323 @@
+// Checks LookaheadLimiter (OBS_mic_dsp/src/Limiter.cpp), which the DSP chain uses in place of clipping boosted mic
+// audio. Boosted tones close to Nyquist and boosted noise have to come out with their true peak, measured by a much
+// finer interpolation than the limiter's own detector, at or below the ceiling. Audio that stays under the ceiling has to
+// come out exactly as it went in, Latency() samples later, since the plugin corrects its timestamps by that much. Feeding
+// Process() a buffer in blocks of any size has to give the same samples as one call for all of it, and Reset(), which
+// the int16 chain calls when it's muted, has to leave it as it was after Init(). Run without arguments, it also times
+// it on 10 ms segments. "testlimiter -c" only does the checks.
+
+#include "../src/Limiter.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+static const double k_Pi = 3.14159265358979323846;
+
+// -1 dBFS, the plugin's default
+static const float k_Ceiling = 0.89125094f;
+
+// How far over the ceiling the measured true peak may go. The limiter's detector only looks at 8 points between
+// samples, through a much shorter filter than the meter's; the worst case here is about 0.11 dB.
+static const double k_PeakToleranceDB = 0.15;
+
+static const unsigned int k_Rates[] = {16000, 48000};
+static const unsigned int k_LookaheadMS[] = {1, 3, 5};
+
+static uint32_t s_seed = 1;
+
+static uint32_t RandomBits(void)
+{
+    s_seed = s_seed * 1664525 + 1013904223;
+    return s_seed;
+}
+
+// Uniform in [-1, 1)
+static float RandomSample(void)
+{
+    return (float) ((int32_t) RandomBits() / 2147483648.0);
+}
+
+static int s_failures = 0;
+
+static void Expect(bool condition, const char *what, unsigned int rate, unsigned int lookaheadMS)
+{
+    if(!condition)
+    {
+        printf("FAILED: %s (%u Hz, %u ms)\n", what, rate, lookaheadMS);
+        s_failures++;
+    }
+}
+
+static double BesselI0(double x)
+{
+    double sum = 1, term = 1;
+    for(int k = 1; k < 50; k++)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+// True peak by 16x interpolation with a Kaiser windowed sinc 128 samples long, which is flat to about 0.96 of Nyquist.
+// The first and last 64 samples aren't measured.
+static double TruePeak(const std::vector<float> &samples)
+{
+    static const int k_Factor = 16;
+    static const int k_HalfTaps = 64;
+    static std::vector<double> coefs;
+    if(coefs.empty())
+    {
+        coefs.resize(k_Factor * 2 * k_HalfTaps);
+        for(int phase = 0; phase < k_Factor; phase++)
+        {
+            for(int k = -k_HalfTaps + 1; k <= k_HalfTaps; k++)
+            {
+                double x = (double) phase / k_Factor - k;
+                double sinc = x == 0 ? 1 : sin(k_Pi * x) / (k_Pi * x);
+                double edge = x / k_HalfTaps;
+                double window = edge * edge < 1 ? BesselI0(8 * sqrt(1 - edge * edge)) / BesselI0(8) : 0;
+                coefs[phase * 2 * k_HalfTaps + k + k_HalfTaps - 1] = sinc * window;
+            }
+        }
+    }
+
+    double peak = 0;
+    for(size_t n = k_HalfTaps; n + k_HalfTaps < samples.size(); n++)
+    {
+        const float *x = &samples[n - k_HalfTaps + 1];
+        for(int phase = 0; phase < k_Factor; phase++)
+        {
+            const double *c = &coefs[phase * 2 * k_HalfTaps];
+            double sum = 0;
+            for(int k = 0; k < 2 * k_HalfTaps; k++)
+                sum += x[k] * c[k];
+            if(fabs(sum) > peak)
+                peak = fabs(sum);
+        }
+    }
+    return peak;
+}
+
+static LookaheadLimiter *MakeLimiter(unsigned int rate, unsigned int lookaheadMS)
+{
+    LookaheadLimiter *limiter = new LookaheadLimiter;
+    if(!limiter->Init(rate, lookaheadMS, k_Ceiling, rate / 100))
+    {
+        delete limiter;
+        return nullptr;
+    }
+    return limiter;
+}
+
+// Processes a copy in 10 ms segments, like the float chain. The input is a whole number of them.
+static std::vector<float> Limit(LookaheadLimiter &limiter, const std::vector<float> &input, unsigned int rate)
+{
+    std::vector<float> output(input);
+    for(size_t pos = 0; pos < output.size(); pos += rate / 100)
+        limiter.Process(&output[pos], rate / 100);
+    return output;
+}
+
+// A quarter second of a tone at `nyquistFraction` of Nyquist, `boost` times the ceiling, faded in over 50 ms, at a
+// random phase
+static std::vector<float> MakeTone(unsigned int rate, double nyquistFraction, double boost)
+{
+    std::vector<float> tone(rate / 4);
+    double step = k_Pi * nyquistFraction;
+    double phase = (RandomBits() % 1000) / 1000.0 * 2 * k_Pi;
+    for(unsigned int i = 0; i < tone.size(); i++)
+    {
+        double fade = i < rate / 20 ? (double) i / (rate / 20) : 1.0;
+        tone[i] = (float) (k_Ceiling * boost * fade * sin(step * i + phase));
+    }
+    return tone;
+}
+
+// A quarter second of noise at about full scale, low-passed at 0.8 of Nyquist. The DMO doesn't let much more than that
+// through, and no filter as short as the detector's can find every peak of noise that reaches all the way to Nyquist.
+static std::vector<float> MakeNoise(unsigned int rate)
+{
+    static const int k_HalfTaps = 100;
+    static const double k_Band = 0.8;
+    std::vector<float> white(rate / 4 + 2 * k_HalfTaps);
+    for(size_t i = 0; i < white.size(); i++)
+        white[i] = RandomSample();
+
+    std::vector<float> noise(rate / 4);
+    for(size_t i = 0; i < noise.size(); i++)
+    {
+        double sum = 0;
+        for(int k = -k_HalfTaps; k <= k_HalfTaps; k++)
+        {
+            double t = k * k_Band;
+            double sinc = k == 0 ? 1 : sin(k_Pi * t) / (k_Pi * t);
+            double window = 0.5 + 0.5 * cos(k_Pi * k / (k_HalfTaps + 1));
+            sum += white[i + k_HalfTaps + k] * k_Band * sinc * window;
+        }
+        noise[i] = (float) (sum / sqrt(k_Band));
+    }
+    return noise;
+}
+
+static void CheckCeiling(unsigned int rate, unsigned int lookaheadMS, double *worstDB)
+{
+    static const double k_NyquistFractions[] = {0.5, 0.8, 0.9, 0.95};
+    static const double k_Boosts[] = {1.5, 4, 16};
+
+    std::vector<std::vector<float> > inputs;
+    for(size_t f = 0; f < sizeof(k_NyquistFractions) / sizeof(k_NyquistFractions[0]); f++)
+    {
+        for(size_t b = 0; b < sizeof(k_Boosts) / sizeof(k_Boosts[0]); b++)
+            inputs.push_back(MakeTone(rate, k_NyquistFractions[f], k_Boosts[b]));
+    }
+
+    // Noise boosted 8x, and bursts of it between quiet stretches so the gain has to recover and drop again
+    std::vector<float> noise = MakeNoise(rate), bursts = MakeNoise(rate);
+    for(unsigned int i = 0; i < noise.size(); i++)
+    {
+        noise[i] *= 8;
+        bursts[i] *= (i / (rate / 20)) % 2 ? 8.0f : 0.05f;
+    }
+    inputs.push_back(noise);
+    inputs.push_back(bursts);
+
+    for(size_t i = 0; i < inputs.size(); i++)
+    {
+        LookaheadLimiter *limiter = MakeLimiter(rate, lookaheadMS);
+        std::vector<float> output = Limit(*limiter, inputs[i], rate);
+        double overDB = 20 * log10(TruePeak(output) / k_Ceiling);
+        if(overDB > *worstDB)
+            *worstDB = overDB;
+        Expect(overDB <= k_PeakToleranceDB, "true peak over the ceiling", rate, lookaheadMS);
+        Expect(limiter->LowestGain() < 1, "boosted input didn't reduce the gain", rate, lookaheadMS);
+        delete limiter;
+    }
+}
+
+// Noise and a tone well under the ceiling, true peaks included
+static std::vector<float> MakeQuiet(unsigned int rate)
+{
+    std::vector<float> quiet(rate / 2);
+    for(size_t i = 0; i < quiet.size(); i++)
+        quiet[i] = (float) (0.2 * RandomSample() + 0.3 * sin(0.05 * i));
+    return quiet;
+}
+
+static void CheckDelay(unsigned int rate, unsigned int lookaheadMS)
+{
+    LookaheadLimiter *limiter = MakeLimiter(rate, lookaheadMS);
+    std::vector<float> input = MakeQuiet(rate);
+    std::vector<float> output = Limit(*limiter, input, rate);
+
+    unsigned int latency = limiter->Latency();
+    bool delayed = true;
+    for(size_t i = 0; i < output.size(); i++)
+    {
+        float expected = i < latency ? 0.0f : input[i - latency];
+        if(memcmp(&output[i], &expected, sizeof(float)) != 0)
+            delayed = false;
+    }
+    Expect(delayed, "audio under the ceiling isn't the input delayed by Latency()", rate, lookaheadMS);
+    Expect(limiter->LowestGain() == 1, "audio under the ceiling reduced the gain", rate, lookaheadMS);
+    delete limiter;
+}
+
+// Random block sizes, some longer than the limiter was set up for, against a single call for the whole buffer; then
+// the same after Reset() against a new limiter
+static void CheckBlocks(unsigned int rate, unsigned int lookaheadMS)
+{
+    std::vector<float> input = MakeTone(rate, 0.9, 4);
+    for(size_t i = 0; i < input.size(); i++)
+        input[i] += 2 * RandomSample();
+
+    LookaheadLimiter *whole = MakeLimiter(rate, lookaheadMS);
+    std::vector<float> expected(input);
+    whole->Process(&expected[0], (unsigned int) expected.size());
+
+    LookaheadLimiter *blocks = MakeLimiter(rate, lookaheadMS);
+    std::vector<float> output(input);
+    for(size_t pos = 0; pos < output.size(); )
+    {
+        unsigned int count = 1 + RandomBits() % (rate / 40);
+        if(count > output.size() - pos)
+            count = (unsigned int) (output.size() - pos);
+        blocks->Process(&output[pos], count);
+        pos += count;
+    }
+    Expect(output == expected, "processing in blocks differs from one call", rate, lookaheadMS);
+    Expect(blocks->LowestGain() == whole->LowestGain(), "processing in blocks gives another lowest gain", rate,
+        lookaheadMS);
+
+    // In the middle of limiting, with the delay line full of loud audio
+    blocks->Reset();
+    LookaheadLimiter *fresh = MakeLimiter(rate, lookaheadMS);
+    std::vector<float> afterReset = Limit(*blocks, input, rate);
+    std::vector<float> afterInit = Limit(*fresh, input, rate);
+    Expect(afterReset == afterInit, "Reset() doesn't give the state Init() does", rate, lookaheadMS);
+
+    delete whole;
+    delete blocks;
+    delete fresh;
+}
+
+// Nanoseconds to limit one 10 ms segment of boosted noise
+static double TimeSegment(unsigned int rate, unsigned int lookaheadMS)
+{
+    LookaheadLimiter *limiter = MakeLimiter(rate, lookaheadMS);
+    unsigned int count = rate / 100;
+    std::vector<float> input(count), buffer(count);
+    for(unsigned int i = 0; i < count; i++)
+        input[i] = 4 * RandomSample();
+
+    const int iterations = 20000;
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    for(int i = 0; i < iterations; i++)
+    {
+        memcpy(&buffer[0], &input[0], count * sizeof(float));
+        limiter->Process(&buffer[0], count);
+    }
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+    delete limiter;
+    return ns;
+}
+
+int main(int argc, char **argv)
+{
+    bool checkOnly = argc > 1 && strcmp(argv[1], "-c") == 0;
+
+    double worstDB = -100;
+    for(size_t r = 0; r < sizeof(k_Rates) / sizeof(k_Rates[0]); r++)
+    {
+        for(size_t l = 0; l < sizeof(k_LookaheadMS) / sizeof(k_LookaheadMS[0]); l++)
+        {
+            CheckCeiling(k_Rates[r], k_LookaheadMS[l], &worstDB);
+            CheckDelay(k_Rates[r], k_LookaheadMS[l]);
+            CheckBlocks(k_Rates[r], k_LookaheadMS[l]);
+        }
+    }
+    printf("Highest true peak %.3f dB from the ceiling\n", worstDB);
+    printf("LookaheadLimiter checks: %s\n", s_failures ? "FAILED" : "ok");
+
+    if(!checkOnly)
+    {
+        printf("\n10 ms segment of boosted noise, ns:\n   rate");
+        for(size_t l = 0; l < sizeof(k_LookaheadMS) / sizeof(k_LookaheadMS[0]); l++)
+            printf("%8u ms", k_LookaheadMS[l]);
+        printf("\n");
+        for(size_t r = 0; r < sizeof(k_Rates) / sizeof(k_Rates[0]); r++)
+        {
+            printf("%7u", k_Rates[r]);
+            for(size_t l = 0; l < sizeof(k_LookaheadMS) / sizeof(k_LookaheadMS[0]); l++)
+                printf("%11.0f", TimeSegment(k_Rates[r], k_LookaheadMS[l]));
+            printf("\n");
+            fflush(stdout);
+        }
+    }
+
+    return s_failures ? 1 : 0;
+}
@@ -0,0 +1,254 @@
+// Checks RingBuffer (OBS_mic_dsp/src/RingBuffer.h): reads that wrap through the mirrored window, Write(nullptr)
+// writing silence, and what Write(), Free() and Available() report when it's full. Run without arguments, it also times
+// it against the growing buffer the DMO source used before, which appended each read and moved the rest of the buffer
+// down after every segment. "testringbuffer -c" only does the checks.
+
+#include "../src/RingBuffer.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <deque>
+#include <vector>
+
+static uint32_t s_seed = 1;
+
+static uint32_t RandomBits(void)
+{
+    s_seed = s_seed * 1664525 + 1013904223;
+    return s_seed;
+}
+
+static int s_failures = 0;
+
+static void Expect(bool condition, const char *what)
+{
+    if(!condition)
+    {
+        printf("FAILED: %s\n", what);
+        s_failures++;
+    }
+}
+
+// Small capacity and window, so every read position wraps
+static void CheckWraparound(void)
+{
+    RingBuffer<int16_t> ring;
+    Expect(ring.Init(10, 4), "Init(10, 4)");
+
+    int16_t next = 1, expected = 1;
+    bool wrapped = false;
+    for(int round = 0; round < 50; round++)
+    {
+        int16_t data[3];
+        for(int i = 0; i < 3; i++)
+            data[i] = next++;
+        Expect(ring.Write(data, 3) == 3, "Write of 3 into a ring with room");
+
+        const int16_t *view = ring.Peek(4);
+        if(!view)
+            continue;
+
+        // The view is read as one array even where it crosses the end of the buffer
+        for(int i = 0; i < 4; i++)
+            Expect(view[i] == expected + i, "Peek(4) sees the samples in order across the wrap");
+        ring.Consume(4);
+        expected += 4;
+        wrapped |= expected > 20;
+    }
+    Expect(wrapped, "the reads went around the buffer");
+}
+
+static void CheckSilence(void)
+{
+    RingBuffer<float> ring;
+    Expect(ring.Init(8, 8), "Init(8, 8)");
+
+    float ones[6] = {1, 1, 1, 1, 1, 1};
+    ring.Write(ones, 6);
+    ring.Consume(6);
+
+    // Silence where the ones were, wrapping into the mirrored part
+    Expect(ring.Write(nullptr, 5) == 5, "Write(nullptr, 5)");
+    Expect(ring.Write(ones, 1) == 1, "Write of 1 after silence");
+    const float *view = ring.Peek(6);
+    Expect(view != nullptr, "Peek(6) after writing 6");
+    if(view)
+    {
+        for(int i = 0; i < 5; i++)
+            Expect(view[i] == 0.0f, "Write(nullptr) stores zeros");
+        Expect(view[5] == 1.0f, "the sample after the silence");
+    }
+}
+
+static void CheckOverflow(void)
+{
+    RingBuffer<int16_t> ring;
+    Expect(ring.Init(16, 8), "Init(16, 8)");
+    Expect(ring.Free() == 16 && ring.Available() == 0, "empty ring is all free");
+
+    int16_t data[20];
+    for(int i = 0; i < 20; i++)
+        data[i] = (int16_t) i;
+
+    Expect(ring.Write(data, 20) == 16, "Write past the capacity stores what fits");
+    Expect(ring.Free() == 0 && ring.Available() == 16, "full ring has nothing free");
+    Expect(ring.Write(data, 1) == 0, "Write into a full ring stores nothing");
+
+    Expect(ring.Peek(9) == nullptr, "Peek of more than the window fails");
+    ring.Consume(5);
+    Expect(ring.Free() == 5 && ring.Available() == 11, "Consume frees space");
+
+    // The samples that were dropped never show up
+    Expect(ring.Write(data + 16, 4) == 4, "Write after Consume");
+    const int16_t *view = ring.Peek(8);
+    Expect(view && view[0] == 5 && view[7] == 12, "oldest samples come out first");
+    ring.Consume(8);
+    view = ring.Peek(7);
+    Expect(view && view[2] == 15 && view[3] == 16 && view[6] == 19, "the samples written after the drop follow on");
+
+    ring.Consume(100);
+    Expect(ring.Available() == 0 && ring.Free() == 16, "Consume of more than is buffered empties it");
+    Expect(ring.Peek(1) == nullptr, "Peek on an empty ring fails");
+}
+
+// Random reads and writes against a plain queue
+static void CheckAgainstModel(void)
+{
+    RingBuffer<int16_t> ring;
+    Expect(ring.Init(1000, 320), "Init(1000, 320)");
+    std::deque<int16_t> model;
+    int16_t next = 0;
+    int mismatches = 0;
+
+    for(int step = 0; step < 20000; step++)
+    {
+        uint32_t bits = RandomBits();
+        if(bits & 0x100)
+        {
+            unsigned int count = (bits >> 16) % 400;
+            std::vector<int16_t> data(count);
+            for(unsigned int i = 0; i < count; i++)
+                data[i] = next++;
+            bool silence = (bits & 0x7000) == 0;
+            unsigned int stored = ring.Write(silence ? nullptr : data.data(), count);
+            if(stored != (count < 1000 - model.size() ? count : 1000 - model.size()))
+                mismatches++;
+            for(unsigned int i = 0; i < stored; i++)
+                model.push_back(silence ? 0 : data[i]);
+        }
+        else
+        {
+            unsigned int count = (bits >> 16) % 321;
+            const int16_t *view = ring.Peek(count);
+            if((view != nullptr) != (model.size() >= count))
+                mismatches++;
+            if(view)
+            {
+                for(unsigned int i = 0; i < count; i++)
+                {
+                    if(view[i] != model[i])
+                        mismatches++;
+                }
+                ring.Consume(count);
+                model.erase(model.begin(), model.begin() + count);
+            }
+        }
+        if(ring.Available() != model.size() || ring.Free() != 1000 - model.size())
+            mismatches++;
+    }
+    Expect(mismatches == 0, "random reads and writes match a queue");
+}
+
+// The DMO source's old buffer: append, then take a segment off the front and move the rest down
+class CompactingBuffer
+{
+public:
+    CompactingBuffer() : _numSamples(0) {}
+
+    void Write(const int16_t *data, unsigned int count)
+    {
+        if(_numSamples + count > _buf.size())
+            _buf.resize(_numSamples + count);
+        memcpy(&_buf[_numSamples], data, count * sizeof(int16_t));
+        _numSamples += count;
+    }
+
+    const int16_t *Peek(unsigned int count) const { return _numSamples >= count ? &_buf[0] : nullptr; }
+
+    void Consume(unsigned int count)
+    {
+        memmove(&_buf[0], &_buf[count], (_numSamples - count) * sizeof(int16_t));
+        _numSamples -= count;
+    }
+
+private:
+    std::vector<int16_t> _buf;
+    unsigned int _numSamples;
+};
+
+// ns per segment for DMO reads of uneven sizes that add up to 10 ms on average
+template<typename Buffer> static double TimeBuffer(Buffer &buffer, unsigned int segmentSize)
+{
+    std::vector<int16_t> read(segmentSize * 2);
+    volatile int16_t sink;
+    double best = 0;
+    for(int round = 0; round < 5; round++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::duration elapsed;
+        int segments = 0;
+        do
+        {
+            // Enough reads between clock checks that the clock doesn't count
+            for(int i = 0; i < 256; i++)
+            {
+                unsigned int count = segmentSize / 2 + RandomBits() % segmentSize;
+                buffer.Write(read.data(), count);
+                while(const int16_t *segment = buffer.Peek(segmentSize))
+                {
+                    sink = segment[segmentSize - 1];
+                    buffer.Consume(segmentSize);
+                    segments++;
+                }
+            }
+            elapsed = std::chrono::steady_clock::now() - start;
+        } while(elapsed < std::chrono::milliseconds(20));
+
+        double ns = std::chrono::duration<double, std::nano>(elapsed).count() / segments;
+        if(round == 0 || ns < best)
+            best = ns;
+    }
+    (void) sink;
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    bool checkOnly = argc > 1 && strcmp(argv[1], "-c") == 0;
+
+    CheckWraparound();
+    CheckSilence();
+    CheckOverflow();
+    CheckAgainstModel();
+    printf("RingBuffer checks: %s\n", s_failures ? "FAILED" : "ok");
+
+    if(!checkOnly)
+    {
+        static const unsigned int k_SegmentSizes[] = {160, 320, 480, 960};
+        printf("\nns per segment, reads of 0.5 to 1.5 segments:\nsegment  compacting        ring  speedup\n");
+        for(size_t i = 0; i < sizeof(k_SegmentSizes) / sizeof(k_SegmentSizes[0]); i++)
+        {
+            unsigned int segmentSize = k_SegmentSizes[i];
+            CompactingBuffer compacting;
+            RingBuffer<int16_t> ring;
+            ring.Init(segmentSize * 8, segmentSize);
+            double compactingNS = TimeBuffer(compacting, segmentSize);
+            double ringNS = TimeBuffer(ring, segmentSize);
+            printf("%7u%12.0f%12.0f%8.1fx\n", segmentSize, compactingNS, ringNS, compactingNS / ringNS);
+            fflush(stdout);
+        }
+    }
+
+    return s_failures ? 1 : 0;
+}
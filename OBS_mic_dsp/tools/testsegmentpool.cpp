@@ -0,0 +1,328 @@
+// Checks the pool AudioSource recycles its audio segments through (OBS/OBSApi/AudioSegmentPool.h): a filter shrinking,
+// clearing, swapping or replacing a pooled segment's buffer, and that once it's warmed up the pool doesn't allocate.
+// OBSApi's allocator and List are stood in for by ones that keep track of every block's size, so a copy past the end of
+// a recycled buffer is caught instead of corrupting the heap. There's nothing to time; "-c" is accepted like the other
+// tests take it.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <vector>
+
+typedef unsigned int UINT;
+typedef unsigned long long QWORD;
+
+// The blocks allocated and their sizes. ReAllocate shrinks in place, as the heap usually does.
+static std::map<char *, size_t> s_blocks;
+static unsigned int s_overruns = 0;
+
+static void *ReAllocate(void *p, size_t size)
+{
+    std::map<char *, size_t>::iterator it = s_blocks.find((char *) p);
+    if(it != s_blocks.end() && size <= it->second)
+    {
+        it->second = size;
+        return p;
+    }
+
+    char *block = (char *) malloc(size);
+    if(it != s_blocks.end())
+    {
+        memcpy(block, p, it->second);
+        free(p);
+        s_blocks.erase(it);
+    }
+    s_blocks[block] = size;
+    return block;
+}
+
+static void Free(void *p)
+{
+    s_blocks.erase((char *) p);
+    free(p);
+}
+
+// Copies only what fits in the destination's block, and counts it if that isn't everything
+static void mcpy(void *dst, const void *src, size_t size)
+{
+    std::map<char *, size_t>::iterator it = s_blocks.upper_bound((char *) dst);
+    if(it != s_blocks.begin())
+    {
+        --it;
+        size_t offset = (char *) dst - it->first;
+        if(offset <= it->second && size > it->second - offset)
+        {
+            s_overruns++;
+            size = it->second - offset;
+        }
+    }
+    memcpy(dst, src, size);
+}
+
+static void zero(void *p, size_t size)
+{
+    memset(p, 0, size);
+}
+
+// What OBS's List does for the calls the pool and filters make
+template<typename T> class List
+{
+    T *array;
+    unsigned int num;
+
+public:
+    List() : array(NULL), num(0) {}
+    ~List() { Clear(); }
+
+    T *Array() const { return array; }
+    unsigned int Num() const { return num; }
+
+    void SetSize(unsigned int n)
+    {
+        if(num == n)
+            return;
+        if(!n)
+        {
+            Clear();
+            return;
+        }
+        unsigned int oldNum = num;
+        num = n;
+        array = (T *) ReAllocate(array, sizeof(T) * num);
+        if(num > oldNum)
+            zero(&array[oldNum], sizeof(T) * (num - oldNum));
+    }
+
+    void CopyArray(const T *newArray, unsigned int n)
+    {
+        SetSize(n);
+        if(!num)
+        {
+            array = NULL;
+            return;
+        }
+        mcpy(array, newArray, sizeof(T) * num);
+    }
+
+    void TransferFrom(T *arrayIn, UINT numIn)
+    {
+        if(array)
+            Clear();
+        array = arrayIn;
+        num = numIn;
+    }
+
+    void TransferTo(T *&arrayOut, UINT &numOut)
+    {
+        arrayOut = array;
+        numOut = num;
+        array = NULL;
+        num = 0;
+    }
+
+    void Clear()
+    {
+        if(array)
+        {
+            Free(array);
+            array = NULL;
+            num = 0;
+        }
+    }
+};
+
+// As AudioSource.h declares it
+struct AudioSegment
+{
+    List<float> audioData;
+    QWORD timestamp;
+
+    AudioSegment(float *data, UINT numFloats, QWORD timestamp) : timestamp(timestamp)
+    {
+        audioData.CopyArray(data, numFloats);
+    }
+
+    void ClearData() { audioData.Clear(); }
+};
+
+#include "../../OBS/OBSApi/AudioSegmentPool.h"
+
+static const UINT k_PacketFloats = 480 * 2;
+
+static uint32_t s_seed = 1;
+
+static uint32_t RandomBits(void)
+{
+    s_seed = s_seed * 1664525 + 1013904223;
+    return s_seed;
+}
+
+static int s_failures = 0;
+
+static void Expect(bool condition, const char *what)
+{
+    if(!condition)
+    {
+        printf("FAILED: %s\n", what);
+        s_failures++;
+    }
+}
+
+static float s_packet[k_PacketFloats * 2];
+
+static void FillPacket(void)
+{
+    for(UINT i = 0; i < k_PacketFloats * 2; i++)
+        s_packet[i] = (float) (int) (RandomBits() >> 16);
+}
+
+static bool HoldsPacket(AudioSegment *segment, UINT numFloats)
+{
+    return segment->audioData.Num() == numFloats &&
+        memcmp(segment->audioData.Array(), s_packet, numFloats * sizeof(float)) == 0;
+}
+
+// The case that overran: a filter shrinks the buffer in place, and the next packet is full size again
+static void CheckShrink(void)
+{
+    AudioSegmentPool pool;
+    zero(&pool, sizeof(pool));
+
+    FillPacket();
+    AudioSegment *segment = pool.GetSegment(s_packet, k_PacketFloats, 0);
+    float *buffer = segment->audioData.Array();
+    segment->audioData.SetSize(k_PacketFloats / 2);
+    Expect(segment->audioData.Array() == buffer, "shrinking a segment keeps its buffer");
+    pool.RecycleSegment(segment);
+
+    UINT numAllocs = pool.numSegmentAllocs;
+    FillPacket();
+    segment = pool.GetSegment(s_packet, k_PacketFloats, 10);
+    Expect(s_overruns == 0, "a full packet in a recycled, shrunk segment stays inside its buffer");
+    Expect(HoldsPacket(segment, k_PacketFloats), "a full packet in a recycled, shrunk segment");
+    Expect(pool.numSegmentAllocs == numAllocs + 1, "a shrunk buffer is grown again");
+    pool.RecycleSegment(segment);
+
+    pool.FreeSegments();
+}
+
+// A filter clears the buffer, swaps in a bigger one of its own, or replaces the segment
+static void CheckFilters(void)
+{
+    AudioSegmentPool pool;
+    zero(&pool, sizeof(pool));
+
+    FillPacket();
+    AudioSegment *segment = pool.GetSegment(s_packet, k_PacketFloats, 0);
+    segment->ClearData();
+    pool.RecycleSegment(segment);
+    segment = pool.GetSegment(s_packet, k_PacketFloats, 10);
+    Expect(HoldsPacket(segment, k_PacketFloats), "a packet in a recycled, cleared segment");
+
+    float *own = (float *) ReAllocate(NULL, k_PacketFloats * 2 * sizeof(float));
+    segment->audioData.TransferFrom(own, k_PacketFloats * 2);
+    pool.RecycleSegment(segment);
+    UINT numAllocs = pool.numSegmentAllocs;
+    FillPacket();
+    segment = pool.GetSegment(s_packet, k_PacketFloats * 2, 20);
+    Expect(segment->audioData.Array() == own, "a filter's own buffer is kept");
+    Expect(pool.numSegmentAllocs == numAllocs, "a filter's own buffer big enough isn't grown");
+    Expect(HoldsPacket(segment, k_PacketFloats * 2), "a packet in a filter's own buffer");
+
+    // What AddAudioSegment does when a filter returns a different segment
+    AudioSegment *replacement = new AudioSegment(s_packet, k_PacketFloats, 20);
+    delete segment;
+    pool.ForgetSegment(segment);
+    pool.RecycleSegment(replacement);
+    segment = pool.GetSegment(s_packet, k_PacketFloats, 30);
+    Expect(HoldsPacket(segment, k_PacketFloats), "a packet after a segment was replaced");
+    pool.RecycleSegment(segment);
+
+    pool.FreeSegments();
+    Expect(s_overruns == 0, "filters changing segments don't lead to an overrun");
+}
+
+// Random queue depths, packet sizes and filter changes, then a steady stream of packets, which once the pool has
+// warmed up mustn't allocate
+static void CheckRandom(void)
+{
+    AudioSegmentPool pool;
+    zero(&pool, sizeof(pool));
+
+    std::vector<AudioSegment *> queue;
+    unsigned int wrongData = 0;
+    for(unsigned int run = 0; run < 20000; run++)
+    {
+        FillPacket();
+        UINT numFloats = 2 + RandomBits() % (k_PacketFloats * 2 - 1);
+        AudioSegment *segment = pool.GetSegment(s_packet, numFloats, run);
+        if(!HoldsPacket(segment, numFloats))
+            wrongData++;
+
+        switch(RandomBits() % 8)
+        {
+        case 0:
+            segment->audioData.SetSize(1 + RandomBits() % numFloats);
+            break;
+        case 1:
+            segment->audioData.SetSize(numFloats + 1 + RandomBits() % k_PacketFloats);
+            break;
+        case 2:
+            segment->ClearData();
+            break;
+        }
+        queue.push_back(segment);
+
+        while(!queue.empty() && (queue.size() > 40 || (RandomBits() & 1)))
+        {
+            pool.RecycleSegment(queue.front());
+            queue.erase(queue.begin());
+        }
+    }
+    for(size_t i = 0; i < queue.size(); i++)
+        pool.RecycleSegment(queue[i]);
+    queue.clear();
+
+    // A source's packets are all the same size, so once every slot has held one, queues of any depth up to the
+    // pool's size are served without allocating
+    FillPacket();
+    for(UINT j = 0; j < segmentPoolSize; j++)
+        queue.push_back(pool.GetSegment(s_packet, k_PacketFloats, j));
+    for(UINT j = 0; j < segmentPoolSize; j++)
+        pool.RecycleSegment(queue[j]);
+    queue.clear();
+    UINT numAllocs = pool.numSegmentAllocs;
+    for(unsigned int i = 0; i < 10000; i++)
+    {
+        queue.push_back(pool.GetSegment(s_packet, k_PacketFloats, i));
+        while(!queue.empty() && (queue.size() == segmentPoolSize || (RandomBits() & 1)))
+        {
+            pool.RecycleSegment(queue.front());
+            queue.erase(queue.begin());
+        }
+    }
+    for(size_t i = 0; i < queue.size(); i++)
+        pool.RecycleSegment(queue[i]);
+
+    pool.FreeSegments();
+    printf("20000 random packets: %u overruns, %u with the wrong data; %u allocations for 10000 packets after warming "
+        "up\n", s_overruns, wrongData, pool.numSegmentAllocs - numAllocs);
+    Expect(s_overruns == 0 && wrongData == 0, "random packets and filter changes");
+    Expect(pool.numSegmentAllocs == numAllocs, "no allocations after warming up");
+}
+
+int main(int argc, char **argv)
+{
+    (void) argc;
+    (void) argv;
+
+    CheckShrink();
+    CheckFilters();
+    CheckRandom();
+    Expect(s_blocks.empty(), "every buffer is freed");
+    printf("AudioSegmentPool checks: %s\n", s_failures ? "FAILED" : "ok");
+
+    return s_failures ? 1 : 0;
+}
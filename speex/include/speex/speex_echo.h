@@ -37,6 +37,7 @@
  *  This is the acoustic echo canceller module.
  *  @{
  */
+#include <stddef.h>
 #include "speex/speex_types.h"
 
 #ifdef __cplusplus
@@ -85,6 +86,25 @@ SpeexEchoState *speex_echo_state_init(int frame_size, int filter_length);
  */
 SpeexEchoState *speex_echo_state_init_mc(int frame_size, int filter_length, int nb_mic, int nb_speakers);
 
+/** Creates a new multi-channel echo canceller state with all its arrays in one block of memory, which the caller
+ * can provide. Everything is aligned to 64 bytes inside the block, whatever the block's own alignment. The FFT
+ * tables, which are shared between states, are allocated separately.
+ *
+ * If lenmem is NULL, the block is allocated, and freed by speex_echo_state_destroy().
+ * If lenmem is not NULL and mem is not NULL and *lenmem is large enough, the state is placed in mem and the size
+ * used is stored in *lenmem. mem must outlive the state, and speex_echo_state_destroy() must still be called.
+ * If lenmem is not NULL and (mem is NULL or *lenmem is not large enough), NULL is returned and the size needed is
+ * stored in *lenmem.
+ * @param frame_size Number of samples to process at one time (should correspond to 10-20 ms)
+ * @param filter_length Number of samples of echo to cancel (should generally correspond to 100-500 ms)
+ * @param nb_mic Number of microphone channels
+ * @param nb_speakers Number of speaker channels
+ * @param mem Memory for the state, or NULL
+ * @param lenmem In: size of mem in bytes. Out: size needed. NULL to allocate the block.
+ * @return Newly-created echo canceller state, or NULL
+ */
+SpeexEchoState *speex_echo_state_init_mem(int frame_size, int filter_length, int nb_mic, int nb_speakers, void *mem, size_t *lenmem);
+
 /** Destroys an echo canceller state 
  * @param st Echo canceller state
 */
@@ -100,6 +120,18 @@ void speex_echo_state_destroy(SpeexEchoState *st);
  */
 void speex_echo_cancellation(SpeexEchoState *st, const spx_int16_t *rec, const spx_int16_t *play, spx_int16_t *out);
 
+/** Performs echo cancellation on a frame of floating-point samples, like speex_echo_cancellation(). This avoids
+ * converting to and from 16-bit integers when the caller already works in float. In a floating-point build the
+ * output isn't clipped.
+ *
+ * @param st Echo canceller state
+ * @param rec Signal from the microphone (near end + far end echo), scaled like 16-bit samples (i.e. +/-32768
+ *            full scale)
+ * @param play Signal played to the speaker (received from far end), scaled the same way
+ * @param out Returns near-end signal with echo removed. May be the same buffer as rec.
+ */
+void speex_echo_cancellation_float(SpeexEchoState *st, const float *rec, const float *play, float *out);
+
 /** Performs echo cancellation a frame (deprecated) */
 void speex_echo_cancel(SpeexEchoState *st, const spx_int16_t *rec, const spx_int16_t *play, spx_int16_t *out, spx_int32_t *Yout);
 
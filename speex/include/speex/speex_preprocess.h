@@ -43,6 +43,7 @@
  *  @{
  */
 
+#include <stddef.h>
 #include "speex_types.h"
 
 #ifdef __cplusplus
@@ -64,6 +65,23 @@ typedef struct SpeexPreprocessState_ SpeexPreprocessState;
 */
 SpeexPreprocessState *speex_preprocess_state_init(int frame_size, int sampling_rate);
 
+/** Creates a new preprocessing state with all its arrays in one block of memory, which the caller can provide.
+ * Everything is aligned to 64 bytes inside the block, whatever the block's own alignment. The FFT tables, which
+ * are shared between states, are allocated separately.
+ *
+ * If lenmem is NULL, the block is allocated, and freed by speex_preprocess_state_destroy().
+ * If lenmem is not NULL and mem is not NULL and *lenmem is large enough, the state is placed in mem and the size
+ * used is stored in *lenmem. mem must outlive the state, and speex_preprocess_state_destroy() must still be called.
+ * If lenmem is not NULL and (mem is NULL or *lenmem is not large enough), NULL is returned and the size needed is
+ * stored in *lenmem.
+ * @param frame_size Number of samples to process at one time, as for speex_preprocess_state_init()
+ * @param sampling_rate Sampling rate used for the input.
+ * @param mem Memory for the state, or NULL
+ * @param lenmem In: size of mem in bytes. Out: size needed. NULL to allocate the block.
+ * @return Newly created preprocessor state, or NULL
+*/
+SpeexPreprocessState *speex_preprocess_state_init_mem(int frame_size, int sampling_rate, void *mem, size_t *lenmem);
+
 /** Destroys a preprocessor state 
  * @param st Preprocessor state to destroy
 */
@@ -76,6 +94,25 @@ void speex_preprocess_state_destroy(SpeexPreprocessState *st);
 */
 int speex_preprocess_run(SpeexPreprocessState *st, spx_int16_t *x);
 
+/** Preprocess a frame of floating-point samples in place. This avoids converting to and from 16-bit integers
+ * when the caller already works in float.
+ * @param st Preprocessor state
+ * @param x Audio sample vector (in and out), scaled like 16-bit samples (i.e. +/-32768 full scale).
+ *          Must be same size as specified in speex_preprocess_state_init().
+ * @return Bool value for voice activity (1 for speech, 0 for noise/silence), ONLY if VAD turned on.
+*/
+int speex_preprocess_run_float(SpeexPreprocessState *st, float *x);
+
+/** Preprocess a frame of floating-point samples in place, taking every stride-th sample, e.g. one channel of
+ * interleaved audio. The other samples are left alone.
+ * @param st Preprocessor state
+ * @param x Audio sample vector (in and out), scaled like 16-bit samples. Must hold stride times the frame size
+ *          specified in speex_preprocess_state_init().
+ * @param stride Distance between consecutive samples of the frame (1 for speex_preprocess_run_float())
+ * @return Bool value for voice activity (1 for speech, 0 for noise/silence), ONLY if VAD turned on.
+*/
+int speex_preprocess_run_float_stride(SpeexPreprocessState *st, float *x, int stride);
+
 /** Preprocess a frame (deprecated, use speex_preprocess_run() instead)*/
 int speex_preprocess(SpeexPreprocessState *st, spx_int16_t *x, spx_int32_t *echo);
 
@@ -85,6 +122,15 @@ int speex_preprocess(SpeexPreprocessState *st, spx_int16_t *x, spx_int32_t *echo
 */
 void speex_preprocess_estimate_update(SpeexPreprocessState *st, spx_int16_t *x);
 
+/** Update preprocessor state from a frame of floating-point samples, but do not compute the output
+ * @param st Preprocessor state
+ * @param x Audio sample vector (in only), scaled like 16-bit samples. Must be same size as specified in
+ *          speex_preprocess_state_init().
+ * @param out_gain What the caller scales this frame by when it outputs it instead (0 to 1), so the overlap and
+ *          a priori SNR the next processed frame starts from match it
+*/
+void speex_preprocess_estimate_update_float(SpeexPreprocessState *st, const float *x, float out_gain);
+
 /** Used like the ioctl function to control the preprocessor parameters 
  * @param st Preprocessor state
  * @param request ioctl-type request (one of the SPEEX_PREPROCESS_* macros)
@@ -93,6 +139,50 @@ void speex_preprocess_estimate_update(SpeexPreprocessState *st, spx_int16_t *x);
 */
 int speex_preprocess_ctl(SpeexPreprocessState *st, int request, void *ptr);
 
+/** Preprocessor states for several channels that are always run together. Should never be accessed directly. */
+struct SpeexPreprocessBatch_;
+
+/** Preprocessor states for several channels (e.g. one per mic) that are always run together, one frame of
+ * every channel per call. The per-bin noise estimation and gain computation is done for all channels at once,
+ * with the channels' spectra interleaved so that SIMD instructions work on several channels at a time.
+ */
+typedef struct SpeexPreprocessBatch_ SpeexPreprocessBatch;
+
+/** Creates preprocessor states for a batch of channels, all with the same frame size and sampling rate.
+ * @param channels Number of channels
+ * @param frame_size Number of samples to process at one time, as for speex_preprocess_state_init()
+ * @param sampling_rate Sampling rate used for the input
+ * @return Newly created batch
+*/
+SpeexPreprocessBatch *speex_preprocess_batch_init(int channels, int frame_size, int sampling_rate);
+
+/** Destroys a batch and the states of all its channels
+ * @param batch Batch to destroy
+*/
+void speex_preprocess_batch_destroy(SpeexPreprocessBatch *batch);
+
+/** The state of one channel of a batch, for speex_preprocess_ctl(). Settings can differ from channel to channel.
+ * The state must not be passed to any of the other speex_preprocess functions: part of it is kept by the batch.
+ * @param batch Batch
+ * @param channel Channel number, from 0
+ * @return State of the channel, or NULL if there is no such channel
+*/
+SpeexPreprocessState *speex_preprocess_batch_get_state(SpeexPreprocessBatch *batch, int channel);
+
+/** Preprocess one frame of every channel of a batch
+ * @param batch Batch
+ * @param x One audio sample vector (in and out) per channel, each the frame size given to speex_preprocess_batch_init()
+ * @param vad Receives the voice activity decision of each channel as speex_preprocess_run() returns it. May be NULL.
+*/
+void speex_preprocess_batch_run(SpeexPreprocessBatch *batch, spx_int16_t **x, int *vad);
+
+/** Preprocess one frame of floating-point samples of every channel of a batch, like speex_preprocess_run_float()
+ * @param batch Batch
+ * @param x One audio sample vector (in and out) per channel, scaled like 16-bit samples
+ * @param vad Receives the voice activity decision of each channel. May be NULL.
+*/
+void speex_preprocess_batch_run_float(SpeexPreprocessBatch *batch, float **x, int *vad);
+
 
 
 /** Set preprocessor denoiser state */
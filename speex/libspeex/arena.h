@@ -0,0 +1,75 @@
+/* File: arena.h
+   Laying out a state and its arrays in one block of memory
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   3. The name of the author may not be used to endorse or promote products
+   derived from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+   IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+   OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+   INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+   STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <string.h>
+
+/** Alignment of everything arena_alloc() hands out: a cache line, which also suits any
+    vector load */
+#define ARENA_ALIGN 64
+
+/** Hands out consecutive pieces of one block. A state's init function runs its layout
+    twice: first with base NULL, which hands out nothing and only adds up the size, then
+    with the real block. */
+typedef struct {
+   char *base;
+   size_t used;
+} SpeexArena;
+
+/** Bytes a block has to have for everything laid out in a sizing arena, whatever its
+    alignment */
+static inline size_t arena_size(const SpeexArena *a)
+{
+   return a->used + ARENA_ALIGN-1;
+}
+
+/** Starts laying out in mem, which must hold len >= arena_size() bytes. The block is
+    zeroed, like speex_alloc() memory. */
+static inline void arena_init(SpeexArena *a, void *mem, size_t len)
+{
+   size_t skip = (ARENA_ALIGN - (size_t)mem%ARENA_ALIGN)%ARENA_ALIGN;
+   a->base = (char *)mem + skip;
+   a->used = 0;
+   memset(a->base, 0, len-skip);
+}
+
+static inline void *arena_alloc(SpeexArena *a, size_t size)
+{
+   void *p;
+   a->used = (a->used + ARENA_ALIGN-1)/ARENA_ALIGN*ARENA_ALIGN;
+   p = a->base ? a->base + a->used : NULL;
+   a->used += size;
+   return p;
+}
+
+#endif
@@ -135,6 +135,33 @@ void spx_ifft(void *table, float *in, float *out)
    spx_drft_backward((struct drft_lookup *)table, out);
 }
 
+#elif defined(USE_REALFFT)
+
+#include "realfft.h"
+
+/* Plans are shared, so a preprocessor and an echo canceller working on the same frame size
+   only build the tables once */
+void *spx_fft_init(int size)
+{
+   return spx_rfft_alloc(size);
+}
+
+void spx_fft_destroy(void *table)
+{
+   spx_rfft_free(table);
+}
+
+/* Already scaled by 1/N, and fine in place */
+void spx_fft(void *table, float *in, float *out)
+{
+   spx_rfft_forward(table, in, out);
+}
+
+void spx_ifft(void *table, float *in, float *out)
+{
+   spx_rfft_backward(table, in, out);
+}
+
 #elif defined(USE_INTEL_MKL)
 #include <mkl.h>
 
@@ -51,10 +51,11 @@
        
 #define toMEL(n)    (2595.f*log10(1.f+(n)/700.f))
 
-FilterBank *filterbank_new(int banks, spx_word32_t sampling, int len, int type)
+/* Works out the filters of a bank whose arrays have been allocated */
+static void filterbank_fill(FilterBank *bank, spx_word32_t sampling)
 {
-#define CHECK_ALLOC(x) if (!(x)) { filterbank_destroy(bank); return NULL; }
-   FilterBank *bank;
+   int banks = bank->nb_banks;
+   int len = bank->len;
    spx_word32_t df;
    spx_word32_t max_mel, mel_interval;
    int i;
@@ -64,17 +65,6 @@ FilterBank *filterbank_new(int banks, spx_word32_t sampling, int len, int type)
    max_mel = toBARK(EXTRACT16(sampling/2));
    mel_interval = PDIV32(max_mel,banks-1);
    
-   CHECK_ALLOC(bank = speex_alloc(sizeof(FilterBank)));
-   bank->nb_banks = banks;
-   bank->len = len;
-   CHECK_ALLOC(bank->bank_left = speex_alloc(len*sizeof(int)));
-   CHECK_ALLOC(bank->bank_right = speex_alloc(len*sizeof(int)));
-   CHECK_ALLOC(bank->filter_left = speex_alloc(len*sizeof(spx_word16_t)));
-   CHECK_ALLOC(bank->filter_right = speex_alloc(len*sizeof(spx_word16_t)));
-   /* Think I can safely disable normalisation that for fixed-point (and probably float as well) */
-#ifndef FIXED_POINT
-   CHECK_ALLOC(bank->scaling = speex_alloc(banks*sizeof(float)));
-#endif
    for (i=0;i<len;i++)
    {
       spx_word16_t curr_freq;
@@ -117,6 +107,51 @@ FilterBank *filterbank_new(int banks, spx_word32_t sampling, int len, int type)
    for (i=0;i<bank->nb_banks;i++)
       bank->scaling[i] = Q15_ONE/(bank->scaling[i]);
 #endif
+}
+
+FilterBank *filterbank_new(int banks, spx_word32_t sampling, int len, int type)
+{
+#define CHECK_ALLOC(x) if (!(x)) { filterbank_destroy(bank); return NULL; }
+   FilterBank *bank;
+   
+   CHECK_ALLOC(bank = speex_alloc(sizeof(FilterBank)));
+   bank->nb_banks = banks;
+   bank->len = len;
+   CHECK_ALLOC(bank->bank_left = speex_alloc(len*sizeof(int)));
+   CHECK_ALLOC(bank->bank_right = speex_alloc(len*sizeof(int)));
+   CHECK_ALLOC(bank->filter_left = speex_alloc(len*sizeof(spx_word16_t)));
+   CHECK_ALLOC(bank->filter_right = speex_alloc(len*sizeof(spx_word16_t)));
+   /* Think I can safely disable normalisation that for fixed-point (and probably float as well) */
+#ifndef FIXED_POINT
+   CHECK_ALLOC(bank->scaling = speex_alloc(banks*sizeof(float)));
+#endif
+   filterbank_fill(bank, sampling);
+   return bank;
+#undef CHECK_ALLOC
+}
+
+FilterBank *filterbank_new_arena(SpeexArena *a, int banks, spx_word32_t sampling, int len, int type)
+{
+   FilterBank *bank = arena_alloc(a, sizeof(FilterBank));
+   int *bank_left = arena_alloc(a, len*sizeof(int));
+   int *bank_right = arena_alloc(a, len*sizeof(int));
+   spx_word16_t *filter_left = arena_alloc(a, len*sizeof(spx_word16_t));
+   spx_word16_t *filter_right = arena_alloc(a, len*sizeof(spx_word16_t));
+#ifndef FIXED_POINT
+   float *scaling = arena_alloc(a, banks*sizeof(float));
+#endif
+   if (!bank)
+      return NULL;
+   bank->nb_banks = banks;
+   bank->len = len;
+   bank->bank_left = bank_left;
+   bank->bank_right = bank_right;
+   bank->filter_left = filter_left;
+   bank->filter_right = filter_right;
+#ifndef FIXED_POINT
+   bank->scaling = scaling;
+#endif
+   filterbank_fill(bank, sampling);
    return bank;
 }
 
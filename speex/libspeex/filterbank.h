@@ -35,6 +35,7 @@
 #define FILTERBANK_H
 
 #include "arch.h"
+#include "arena.h"
 
 typedef struct {
    int *bank_left;
@@ -51,6 +52,10 @@ typedef struct {
 
 FilterBank *filterbank_new(int banks, spx_word32_t sampling, int len, int type);
 
+/** Lays a filter bank out in an arena instead. Returns NULL if the arena is only adding up
+    sizes. Such a bank is freed with the arena's block, not filterbank_destroy(). */
+FilterBank *filterbank_new_arena(SpeexArena *a, int banks, spx_word32_t sampling, int len, int type);
+
 void filterbank_destroy(FilterBank *bank);
 
 void filterbank_compute_bank32(FilterBank *bank, spx_word32_t *ps, spx_word32_t *mel);
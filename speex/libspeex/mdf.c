@@ -75,6 +75,10 @@
 #include "pseudofloat.h"
 #include "math_approx.h"
 #include "os_support.h"
+#include "arena.h"
+#ifndef FIXED_POINT
+#include "mdf_simd.h"
+#endif
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -137,6 +141,7 @@ struct SpeexEchoState_ {
    int adapted;
    int saturated;
    int screwed_up;
+   int clipped;              /* Whether the current frame's mic input reached +/-32000 */
    int C;                    /** Number of input channels (microphones) */
    int K;                    /** Number of output channels (loudspeakers) */
    spx_int32_t sampling_rate;
@@ -150,6 +155,7 @@ struct SpeexEchoState_ {
    spx_word16_t *x;      /* Far-end input buffer (2N) */
    spx_word16_t *X;      /* Far-end buffer (M+1 frames) in frequency domain */
    spx_word16_t *input;  /* scratch */
+   spx_word32_t *output; /* Current frame's output before it's converted to the caller's format */
    spx_word16_t *y;      /* scratch */
    spx_word16_t *last_y;
    spx_word16_t *Y;      /* scratch */
@@ -188,9 +194,11 @@ struct SpeexEchoState_ {
    spx_int16_t *play_buf;
    int play_buf_pos;
    int play_buf_started;
+
+   void *mem;            /* Block the state was allocated in, or NULL if the caller provided it */
 };
 
-static inline void filter_dc_notch16(const spx_int16_t *in, spx_word16_t radius, spx_word16_t *out, int len, spx_mem_t *mem, int stride)
+static inline void filter_dc_notch16(const spx_word16_t *in, spx_word16_t radius, spx_word16_t *out, int len, spx_mem_t *mem)
 {
    int i;
    spx_word16_t den2;
@@ -202,7 +210,7 @@ static inline void filter_dc_notch16(const spx_int16_t *in, spx_word16_t radius,
    /*printf ("%d %d %d %d %d %d\n", num[0], num[1], num[2], den[0], den[1], den[2]);*/
    for (i=0;i<len;i++)
    {
-      spx_word16_t vin = in[i*stride];
+      spx_word16_t vin = in[i];
       spx_word32_t vout = mem[0] + SHL32(EXTEND32(vin),15);
 #ifdef FIXED_POINT
       mem[0] = mem[1] + SHL32(SHL32(-EXTEND32(vin),15) + MULT16_32_Q15(radius,vout),1);
@@ -243,6 +251,7 @@ static inline void power_spectrum(const spx_word16_t *X, spx_word32_t *ps, int N
 }
 
 /** Compute power spectrum of a half-complex (packed) vector and accumulate */
+#ifdef FIXED_POINT
 static inline void power_spectrum_accum(const spx_word16_t *X, spx_word32_t *ps, int N)
 {
    int i, j;
@@ -253,6 +262,13 @@ static inline void power_spectrum_accum(const spx_word16_t *X, spx_word32_t *ps,
    }
    ps[j]+=MULT16_16(X[i],X[i]);
 }
+#else
+/* The float versions of this and the functions below are in mdf_simd.c, vectorized for the CPU */
+static inline void power_spectrum_accum(const spx_word16_t *X, spx_word32_t *ps, int N)
+{
+   mdf_simd_kernels()->power_spectrum_accum(X, ps, N);
+}
+#endif
 
 /** Compute cross-power spectrum of a half-complex (packed) vectors and add to acc */
 #ifdef FIXED_POINT
@@ -314,26 +330,13 @@ static inline void spectral_mul_accum16(const spx_word16_t *X, const spx_word16_
 #else
 static inline void spectral_mul_accum(const spx_word16_t *X, const spx_word32_t *Y, spx_word16_t *acc, int N, int M)
 {
-   int i,j;
-   for (i=0;i<N;i++)
-      acc[i] = 0;
-   for (j=0;j<M;j++)
-   {
-      acc[0] += X[0]*Y[0];
-      for (i=1;i<N-1;i+=2)
-      {
-         acc[i] += (X[i]*Y[i] - X[i+1]*Y[i+1]);
-         acc[i+1] += (X[i+1]*Y[i] + X[i]*Y[i+1]);
-      }
-      acc[i] += X[i]*Y[i];
-      X += N;
-      Y += N;
-   }
+   mdf_simd_kernels()->spectral_mul_accum(X, Y, acc, N, M);
 }
 #define spectral_mul_accum16 spectral_mul_accum
 #endif
 
 /** Compute weighted cross-power spectrum of a half-complex (packed) vector with conjugate */
+#ifdef FIXED_POINT
 static inline void weighted_spectral_mul_conj(const spx_float_t *w, const spx_float_t p, const spx_word16_t *X, const spx_word16_t *Y, spx_word32_t *prod, int N)
 {
    int i, j;
@@ -381,6 +384,17 @@ static inline void mdf_adjust_prop(const spx_word32_t *W, int N, int M, int P, s
    }
    /*printf ("\n");*/
 }
+#else
+static inline void weighted_spectral_mul_conj(const spx_float_t *w, const spx_float_t p, const spx_word16_t *X, const spx_word16_t *Y, spx_word32_t *prod, int N)
+{
+   mdf_simd_kernels()->weighted_spectral_mul_conj(w, p, X, Y, prod, N);
+}
+
+static inline void mdf_adjust_prop(const spx_word32_t *W, int N, int M, int P, spx_word16_t *prop)
+{
+   mdf_simd_kernels()->adjust_prop(W, N, M, P, prop);
+}
+#endif
 
 #ifdef DUMP_ECHO_CANCEL_DATA
 #include <stdio.h>
@@ -404,15 +418,87 @@ EXPORT SpeexEchoState *speex_echo_state_init(int frame_size, int filter_length)
    return speex_echo_state_init_mc(frame_size, filter_length, 1, 1);
 }
 
+/* Lays out the state's arrays one after the other, following the state itself. With a sizing arena it only adds
+   up their size, and st is scratch. */
+static void echo_layout(SpeexArena *a, SpeexEchoState *st, int frame_size, int filter_length, int nb_mic, int nb_speakers)
+{
+   int N, M, C, K;
+
+   st->frame_size = frame_size;
+   N = st->window_size = 2*frame_size;
+   M = st->M = (filter_length+frame_size-1)/frame_size;
+   C = st->C = nb_mic;
+   K = st->K = nb_speakers;
+
+   /* The filters and far-end spectra first, then the per-frame buffers and spectra in about the order they're
+      used */
+   st->W = arena_alloc(a, C*K*M*N*sizeof(spx_word32_t));
+#ifdef TWO_PATH
+   st->foreground = arena_alloc(a, M*N*C*K*sizeof(spx_word16_t));
+#endif
+   st->X = arena_alloc(a, K*(M+1)*N*sizeof(spx_word16_t));
+   st->x = arena_alloc(a, K*N*sizeof(spx_word16_t));
+   st->input = arena_alloc(a, C*frame_size*sizeof(spx_word16_t));
+   st->e = arena_alloc(a, C*N*sizeof(spx_word16_t));
+   st->y = arena_alloc(a, C*N*sizeof(spx_word16_t));
+   st->E = arena_alloc(a, C*N*sizeof(spx_word16_t));
+   st->Y = arena_alloc(a, C*N*sizeof(spx_word16_t));
+   st->PHI = arena_alloc(a, N*sizeof(spx_word32_t));
+   st->wtmp = arena_alloc(a, N*sizeof(spx_word16_t));
+#ifdef FIXED_POINT
+   st->wtmp2 = arena_alloc(a, N*sizeof(spx_word16_t));
+#endif
+   st->output = arena_alloc(a, C*frame_size*sizeof(spx_word32_t));
+   st->Xf = arena_alloc(a, (frame_size+1)*sizeof(spx_word32_t));
+   st->Rf = arena_alloc(a, (frame_size+1)*sizeof(spx_word32_t));
+   st->Yf = arena_alloc(a, (frame_size+1)*sizeof(spx_word32_t));
+   st->power = arena_alloc(a, (frame_size+1)*sizeof(spx_word32_t));
+   st->Eh = arena_alloc(a, (frame_size+1)*sizeof(spx_word32_t));
+   st->Yh = arena_alloc(a, (frame_size+1)*sizeof(spx_word32_t));
+   st->power_1 = arena_alloc(a, (frame_size+1)*sizeof(spx_float_t));
+   st->last_y = arena_alloc(a, C*N*sizeof(spx_word16_t));
+   st->window = arena_alloc(a, N*sizeof(spx_word16_t));
+   st->prop = arena_alloc(a, M*sizeof(spx_word16_t));
+   st->memX = arena_alloc(a, K*sizeof(spx_word16_t));
+   st->memD = arena_alloc(a, C*sizeof(spx_word16_t));
+   st->memE = arena_alloc(a, C*sizeof(spx_word16_t));
+   st->notch_mem = arena_alloc(a, 2*C*sizeof(spx_mem_t));
+   st->play_buf = arena_alloc(a, K*(PLAYBACK_DELAY+1)*frame_size*sizeof(spx_int16_t));
+}
+
 EXPORT SpeexEchoState *speex_echo_state_init_mc(int frame_size, int filter_length, int nb_mic, int nb_speakers)
+{
+   return speex_echo_state_init_mem(frame_size, filter_length, nb_mic, nb_speakers, NULL, NULL);
+}
+
+EXPORT SpeexEchoState *speex_echo_state_init_mem(int frame_size, int filter_length, int nb_mic, int nb_speakers, void *mem, size_t *lenmem)
 {
 #define CHECK_ALLOC(x) if (!(x)) { speex_echo_state_destroy(st); return NULL; }
    int i,N,M, C, K;
-   SpeexEchoState *st;
-   CHECK_ALLOC(st = speex_alloc(sizeof(SpeexEchoState)));
+   SpeexArena arena = {NULL, 0};
+   size_t memneeded;
+   SpeexEchoState *st, sizes;
+
+   arena_alloc(&arena, sizeof(SpeexEchoState));
+   echo_layout(&arena, &sizes, frame_size, filter_length, nb_mic, nb_speakers);
+   memneeded = arena_size(&arena);
+   if (lenmem == NULL)
+   {
+      if (!(mem = speex_alloc(memneeded)))
+         return NULL;
+   } else {
+      if (mem == NULL || *lenmem < memneeded)
+      {
+         *lenmem = memneeded;
+         return NULL;
+      }
+      *lenmem = memneeded;
+   }
+   arena_init(&arena, mem, memneeded);
+   st = arena_alloc(&arena, sizeof(SpeexEchoState));
+   echo_layout(&arena, st, frame_size, filter_length, nb_mic, nb_speakers);
+   st->mem = lenmem == NULL ? mem : NULL;
 
-   st->K = nb_speakers;
-   st->C = nb_mic;
    C=st->C;
    K=st->K;
 #ifdef DUMP_ECHO_CANCEL_DATA
@@ -423,10 +509,8 @@ EXPORT SpeexEchoState *speex_echo_state_init_mc(int frame_size, int filter_lengt
    oFile = fopen("aec_out.sw", "wb");
 #endif
    
-   st->frame_size = frame_size;
-   st->window_size = 2*frame_size;
    N = st->window_size;
-   M = st->M = (filter_length+st->frame_size-1)/frame_size;
+   M = st->M;
    st->cancel_count=0;
    st->sum_adapt = 0;
    st->saturated = 0;
@@ -444,33 +528,12 @@ EXPORT SpeexEchoState *speex_echo_state_init_mc(int frame_size, int filter_lengt
    st->leak_estimate = 0;
 
    CHECK_ALLOC(st->fft_table = spx_fft_init(N));
-   
-   CHECK_ALLOC(st->e = speex_alloc(C*N*sizeof(spx_word16_t)));
-   CHECK_ALLOC(st->x = speex_alloc(K*N*sizeof(spx_word16_t)));
-   CHECK_ALLOC(st->input = speex_alloc(C*st->frame_size*sizeof(spx_word16_t)));
-   CHECK_ALLOC(st->y = speex_alloc(C*N*sizeof(spx_word16_t)));
-   CHECK_ALLOC(st->last_y = speex_alloc(C*N*sizeof(spx_word16_t)));
-   CHECK_ALLOC(st->Yf = speex_alloc((st->frame_size+1)*sizeof(spx_word32_t)));
-   CHECK_ALLOC(st->Rf = speex_alloc((st->frame_size+1)*sizeof(spx_word32_t)));
-   CHECK_ALLOC(st->Xf = speex_alloc((st->frame_size+1)*sizeof(spx_word32_t)));
-   CHECK_ALLOC(st->Yh = speex_alloc((st->frame_size+1)*sizeof(spx_word32_t)));
-   CHECK_ALLOC(st->Eh = speex_alloc((st->frame_size+1)*sizeof(spx_word32_t)));
-
-   CHECK_ALLOC(st->X = speex_alloc(K*(M+1)*N*sizeof(spx_word16_t)));
-   CHECK_ALLOC(st->Y = speex_alloc(C*N*sizeof(spx_word16_t)));
-   CHECK_ALLOC(st->E = speex_alloc(C*N*sizeof(spx_word16_t)));
-   CHECK_ALLOC(st->W = speex_alloc(C*K*M*N*sizeof(spx_word32_t)));
-#ifdef TWO_PATH
-   CHECK_ALLOC(st->foreground = speex_alloc(M*N*C*K*sizeof(spx_word16_t)));
+#ifndef FIXED_POINT
+   /* Picks the vector kernels now rather than in the middle of the first frame */
+   mdf_simd_kernels();
 #endif
-   CHECK_ALLOC(st->PHI = speex_alloc(N*sizeof(spx_word32_t)));
-   CHECK_ALLOC(st->power = speex_alloc((frame_size+1)*sizeof(spx_word32_t)));
-   CHECK_ALLOC(st->power_1 = speex_alloc((frame_size+1)*sizeof(spx_float_t)));
-   CHECK_ALLOC(st->window = speex_alloc(N*sizeof(spx_word16_t)));
-   CHECK_ALLOC(st->prop = speex_alloc(M*sizeof(spx_word16_t)));
-   CHECK_ALLOC(st->wtmp = speex_alloc(N*sizeof(spx_word16_t)));
+   
 #ifdef FIXED_POINT
-   CHECK_ALLOC(st->wtmp2 = speex_alloc(N*sizeof(spx_word16_t)));
    for (i=0;i<N>>1;i++)
    {
       st->window[i] = (16383-SHL16(spx_cos(DIV32_16(MULT16_16(25736,i<<1),N)),1));
@@ -501,9 +564,6 @@ EXPORT SpeexEchoState *speex_echo_state_init_mc(int frame_size, int filter_lengt
       }
    }
    
-   CHECK_ALLOC(st->memX = speex_alloc(K*sizeof(spx_word16_t)));
-   CHECK_ALLOC(st->memD = speex_alloc(C*sizeof(spx_word16_t)));
-   CHECK_ALLOC(st->memE = speex_alloc(C*sizeof(spx_word16_t)));
    st->preemph = QCONST16(.9,15);
    if (st->sampling_rate<12000)
       st->notch_radius = QCONST16(.9, 15);
@@ -512,7 +572,6 @@ EXPORT SpeexEchoState *speex_echo_state_init_mc(int frame_size, int filter_lengt
    else
       st->notch_radius = QCONST16(.992, 15);
 
-   CHECK_ALLOC(st->notch_mem = speex_alloc(2*C*sizeof(spx_mem_t)));
    st->adapted = 0;
    st->Pey = st->Pyy = FLOAT_ONE;
    
@@ -521,7 +580,6 @@ EXPORT SpeexEchoState *speex_echo_state_init_mc(int frame_size, int filter_lengt
    st->Dvar1 = st->Dvar2 = FLOAT_ZERO;
 #endif
    
-   CHECK_ALLOC(st->play_buf = speex_alloc(K*(PLAYBACK_DELAY+1)*st->frame_size*sizeof(spx_int16_t)));
    st->play_buf_pos = PLAYBACK_DELAY*st->frame_size;
    st->play_buf_started = 0;
    
@@ -592,42 +650,10 @@ EXPORT void speex_echo_state_destroy(SpeexEchoState *st)
 {
    if (st)
    {
+      /* Everything else is in the state's block */
       spx_fft_destroy(st->fft_table);
-
-      speex_free(st->e);
-      speex_free(st->x);
-      speex_free(st->input);
-      speex_free(st->y);
-      speex_free(st->last_y);
-      speex_free(st->Yf);
-      speex_free(st->Rf);
-      speex_free(st->Xf);
-      speex_free(st->Yh);
-      speex_free(st->Eh);
-
-      speex_free(st->X);
-      speex_free(st->Y);
-      speex_free(st->E);
-      speex_free(st->W);
-#ifdef TWO_PATH
-      speex_free(st->foreground);
-#endif
-      speex_free(st->PHI);
-      speex_free(st->power);
-      speex_free(st->power_1);
-      speex_free(st->window);
-      speex_free(st->prop);
-      speex_free(st->wtmp);
-#ifdef FIXED_POINT
-      speex_free(st->wtmp2);
-#endif
-      speex_free(st->memX);
-      speex_free(st->memD);
-      speex_free(st->memE);
-      speex_free(st->notch_mem);
-
-      speex_free(st->play_buf);
-      speex_free(st);
+      if (st->mem)
+         speex_free(st->mem);
    }
    
 #ifdef DUMP_ECHO_CANCEL_DATA
@@ -693,8 +719,122 @@ EXPORT void speex_echo_cancel(SpeexEchoState *st, const spx_int16_t *in, const s
    speex_echo_cancellation(st, in, far_end, out);
 }
 
-/** Performs echo cancellation on a frame */
-EXPORT void speex_echo_cancellation(SpeexEchoState *st, const spx_int16_t *in, const spx_int16_t *far_end, spx_int16_t *out)
+/* Deinterleaves the mic input into st->input and appends the far end to st->x, both as they are. The DC notch
+   and pre-emphasis are applied by echo_process_frame(). */
+static void echo_load_input(SpeexEchoState *st, const spx_int16_t *in, const spx_int16_t *far_end)
+{
+   int i, chan, speak;
+   int N = st->window_size;
+   int C = st->C;
+   int K = st->K;
+
+   st->clipped = 0;
+   for (chan = 0; chan < C; chan++)
+   {
+      for (i=0;i<st->frame_size;i++)
+      {
+         st->input[chan*st->frame_size+i] = in[i*C+chan];
+         /* This is an arbitrary test for saturation in the microphone signal */
+         if (in[i*C+chan] <= -32000 || in[i*C+chan] >= 32000)
+            st->clipped = 1;
+      }
+   }
+   for (speak = 0; speak < K; speak++)
+   {
+      for (i=0;i<st->frame_size;i++)
+      {
+         st->x[speak*N+i] = st->x[speak*N+i+st->frame_size];
+         st->x[speak*N+i+st->frame_size] = far_end[i*K+speak];
+      }
+   }
+}
+
+#ifndef DISABLE_FLOAT_API
+static void echo_load_input_float(SpeexEchoState *st, const float *in, const float *far_end)
+{
+   int i, chan, speak;
+   int N = st->window_size;
+   int C = st->C;
+   int K = st->K;
+
+   st->clipped = 0;
+   for (chan = 0; chan < C; chan++)
+   {
+      for (i=0;i<st->frame_size;i++)
+      {
+#ifdef FIXED_POINT
+         st->input[chan*st->frame_size+i] = WORD2INT(in[i*C+chan]);
+#else
+         st->input[chan*st->frame_size+i] = in[i*C+chan];
+#endif
+         if (in[i*C+chan] <= -32000 || in[i*C+chan] >= 32000)
+            st->clipped = 1;
+      }
+   }
+   for (speak = 0; speak < K; speak++)
+   {
+      for (i=0;i<st->frame_size;i++)
+      {
+         st->x[speak*N+i] = st->x[speak*N+i+st->frame_size];
+#ifdef FIXED_POINT
+         st->x[speak*N+i+st->frame_size] = WORD2INT(far_end[i*K+speak]);
+#else
+         st->x[speak*N+i+st->frame_size] = far_end[i*K+speak];
+#endif
+      }
+   }
+}
+#endif
+
+/* Updates the estimated echo (st->last_y) the preprocessor's residual echo suppression uses, then writes the
+   output. Nothing is written to out before in has been read, so they may be the same buffer. "ok" is 0 if the
+   canceller was just reset, in which case only the (silent) output is written. */
+static void echo_store_output(SpeexEchoState *st, const spx_int16_t *in, spx_int16_t *out, int ok)
+{
+   int i;
+
+   if (ok)
+   {
+      /* FIXME: MC conversion required */ 
+      for (i=0;i<st->frame_size;i++)
+         st->last_y[i] = st->last_y[st->frame_size+i];
+      /* If the filter is adapted, take the filtered echo. If it isn't adapted yet, all we can do is take the far
+         end signal directly (moved earlier: for (i=0;i<N;i++) st->last_y[i] = st->x[i];) */
+      if (st->adapted)
+         for (i=0;i<st->frame_size;i++)
+            st->last_y[st->frame_size+i] = in[i]-WORD2INT(st->output[i]);
+   }
+   for (i=0;i<st->C*st->frame_size;i++)
+      out[i] = WORD2INT(st->output[i]);
+}
+
+#ifndef DISABLE_FLOAT_API
+#ifdef FIXED_POINT
+#define OUTPUT2FLOAT(x) WORD2INT(x)
+#else
+#define OUTPUT2FLOAT(x) (x)
+#endif
+
+static void echo_store_output_float(SpeexEchoState *st, const float *in, float *out, int ok)
+{
+   int i;
+
+   if (ok)
+   {
+      for (i=0;i<st->frame_size;i++)
+         st->last_y[i] = st->last_y[st->frame_size+i];
+      if (st->adapted)
+         for (i=0;i<st->frame_size;i++)
+            st->last_y[st->frame_size+i] = in[i]-OUTPUT2FLOAT(st->output[i]);
+   }
+   for (i=0;i<st->C*st->frame_size;i++)
+      out[i] = OUTPUT2FLOAT(st->output[i]);
+}
+#endif
+
+/* Cancels the echo in the frame echo_load_input() loaded, leaving the result in st->output. Returns 0 if the
+   canceller had to be reset. */
+static int echo_process_frame(SpeexEchoState *st)
 {
    int i,j, chan, speak;
    int N,M, C, K;
@@ -727,7 +867,7 @@ EXPORT void speex_echo_cancellation(SpeexEchoState *st, const spx_int16_t *in, c
    for (chan = 0; chan < C; chan++)
    {
       /* Apply a notch filter to make sure DC doesn't end up causing problems */
-      filter_dc_notch16(in+chan, st->notch_radius, st->input+chan*st->frame_size, st->frame_size, st->notch_mem+2*chan, C);
+      filter_dc_notch16(st->input+chan*st->frame_size, st->notch_radius, st->input+chan*st->frame_size, st->frame_size, st->notch_mem+2*chan);
       /* Copy input data to buffer and apply pre-emphasis */
       /* Copy input data to buffer */
       for (i=0;i<st->frame_size;i++)
@@ -759,8 +899,8 @@ EXPORT void speex_echo_cancellation(SpeexEchoState *st, const spx_int16_t *in, c
       for (i=0;i<st->frame_size;i++)
       {
          spx_word32_t tmp32;
-         st->x[speak*N+i] = st->x[speak*N+i+st->frame_size];
-         tmp32 = SUB32(EXTEND32(far_end[i*K+speak]), EXTEND32(MULT16_16_P15(st->preemph, st->memX[speak])));
+         spx_word16_t far_end = st->x[speak*N+i+st->frame_size];
+         tmp32 = SUB32(EXTEND32(far_end), EXTEND32(MULT16_16_P15(st->preemph, st->memX[speak])));
 #ifdef FIXED_POINT
          /*FIXME: If saturation occurs here, we need to freeze adaptation for M frames (not just one) */
          if (tmp32 > 32767)
@@ -775,7 +915,7 @@ EXPORT void speex_echo_cancellation(SpeexEchoState *st, const spx_int16_t *in, c
          }      
 #endif
          st->x[speak*N+i+st->frame_size] = EXTRACT16(tmp32);
-         st->memX[speak] = far_end[i*K+speak];
+         st->memX[speak] = far_end;
       }
    }   
    
@@ -967,6 +1107,10 @@ EXPORT void speex_echo_cancellation(SpeexEchoState *st, const spx_int16_t *in, c
    }
 #endif
 
+   /* Don't adapt on a frame where the mic input may have clipped */
+   if (st->clipped && st->saturated == 0)
+      st->saturated = 1;
+
    Sey = Syy = Sdd = 0;  
    for (chan = 0; chan < C; chan++)
    {    
@@ -980,19 +1124,9 @@ EXPORT void speex_echo_cancellation(SpeexEchoState *st, const spx_int16_t *in, c
          tmp_out = SUB32(EXTEND32(st->input[chan*st->frame_size+i]), EXTEND32(st->y[chan*N+i+st->frame_size]));
 #endif
          tmp_out = ADD32(tmp_out, EXTEND32(MULT16_16_P15(st->preemph, st->memE[chan])));
-      /* This is an arbitrary test for saturation in the microphone signal */
-         if (in[i*C+chan] <= -32000 || in[i*C+chan] >= 32000)
-         {
-         if (st->saturated == 0)
-            st->saturated = 1;
-         }
-         out[i*C+chan] = WORD2INT(tmp_out);
+         st->output[i*C+chan] = tmp_out;
          st->memE[chan] = tmp_out;
       }
-
-#ifdef DUMP_ECHO_CANCEL_DATA
-      dump_audio(in, far_end, out, st->frame_size);
-#endif
    
       /* Compute error signal (filter update version) */ 
       for (i=0;i<st->frame_size;i++)
@@ -1031,7 +1165,7 @@ EXPORT void speex_echo_cancellation(SpeexEchoState *st, const spx_int16_t *in, c
       /* Things have gone really bad */
       st->screwed_up += 50;
       for (i=0;i<st->frame_size*C;i++)
-         out[i] = 0;
+         st->output[i] = 0;
    } else if (SHR32(Sff, 2) > ADD32(Sdd, SHR32(MULT16_16(N, 10000),6)))
    {
       /* AEC seems to add lots of echo instead of removing it, let's see if it will improve */
@@ -1044,7 +1178,7 @@ EXPORT void speex_echo_cancellation(SpeexEchoState *st, const spx_int16_t *in, c
    {
       speex_warning("The echo canceller started acting funny and got slapped (reset). It swears it will behave now.");
       speex_echo_state_reset(st);
-      return;
+      return 0;
    }
 
    /* Add a small noise floor to make sure not to have problems when dividing */
@@ -1181,22 +1315,27 @@ EXPORT void speex_echo_cancellation(SpeexEchoState *st, const spx_int16_t *in, c
       st->sum_adapt = ADD32(st->sum_adapt,adapt_rate);
    }
 
-   /* FIXME: MC conversion required */ 
-      for (i=0;i<st->frame_size;i++)
-         st->last_y[i] = st->last_y[st->frame_size+i];
-   if (st->adapted)
-   {
-      /* If the filter is adapted, take the filtered echo */
-      for (i=0;i<st->frame_size;i++)
-         st->last_y[st->frame_size+i] = in[i]-out[i];
-   } else {
-      /* If filter isn't adapted yet, all we can do is take the far end signal directly */
-      /* moved earlier: for (i=0;i<N;i++)
-      st->last_y[i] = st->x[i];*/
-   }
+   return 1;
+}
 
+/** Performs echo cancellation on a frame */
+EXPORT void speex_echo_cancellation(SpeexEchoState *st, const spx_int16_t *in, const spx_int16_t *far_end, spx_int16_t *out)
+{
+   echo_load_input(st, in, far_end);
+   echo_store_output(st, in, out, echo_process_frame(st));
+#ifdef DUMP_ECHO_CANCEL_DATA
+   dump_audio(in, far_end, out, st->frame_size);
+#endif
 }
 
+#ifndef DISABLE_FLOAT_API
+EXPORT void speex_echo_cancellation_float(SpeexEchoState *st, const float *in, const float *far_end, float *out)
+{
+   echo_load_input_float(st, in, far_end);
+   echo_store_output_float(st, in, out, echo_process_frame(st));
+}
+#endif
+
 /* Compute spectrum of estimated echo for use in an echo post-filter */
 void speex_echo_get_residual(SpeexEchoState *st, spx_word32_t *residual_echo, int len)
 {
@@ -0,0 +1,629 @@
+/* File: mdf_simd.c
+   Vectorized inner loops of the floating-point MDF echo canceller
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   3. The name of the author may not be used to endorse or promote products
+   derived from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+   IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+   OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+   INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+   STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+   With a long tail, nearly all of the echo canceller's time goes into a few
+   loops over every bin of every filter block. This file has them in plain C
+   (the reference, and what mdf.c used to run) and for SSE2, AVX2 and NEON.
+   The best version for the CPU is picked the first time an echo canceller
+   is created.
+
+   The vector versions do the same arithmetic in the same order as the C
+   code wherever that's possible, so power_spectrum_accum(),
+   spectral_mul_accum() and weighted_spectral_mul_conj() give identical
+   results unless the compiler fuses multiplies and adds. Only the sum of
+   squares in adjust_prop() is reordered. The fixed-point build doesn't use
+   any of this.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include "mdf_simd.h"
+
+#ifndef FIXED_POINT
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MDF_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(_MSC_VER) || defined(__GNUC__)
+#define MDF_AVX2
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define MDF_TARGET_AVX2
+#else
+#define MDF_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+#endif
+
+/* NEON is part of every ARMv8 CPU, so there's nothing to detect at run time there. 32-bit
+   ARM builds only get it when the compiler is told the CPU has it. */
+#if defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#define MDF_NEON
+#include <arm_neon.h>
+#endif
+
+
+/* Scalar versions. The *_rest() functions finish the bins a vector loop didn't reach,
+   starting with bin i, and also do the DC and Nyquist bins. */
+
+static void power_spectrum_accum_rest(const float *X, float *ps, int N, int i)
+{
+   int j = (i+1)>>1;
+   ps[0] += X[0]*X[0];
+   for (;i<N-1;i+=2,j++)
+   {
+      ps[j] += X[i]*X[i] + X[i+1]*X[i+1];
+   }
+   ps[j] += X[i]*X[i];
+}
+
+static void power_spectrum_accum_c(const float *X, float *ps, int N)
+{
+   power_spectrum_accum_rest(X, ps, N, 1);
+}
+
+static void spectral_mul_accum_rest(const float *X, const float *Y, float *acc, int N, int M, int i)
+{
+   int j;
+   float re, im;
+   re = 0;
+   for (j=0;j<M;j++)
+      re += X[j*N]*Y[j*N];
+   acc[0] = re;
+   for (;i<N-1;i+=2)
+   {
+      re = im = 0;
+      for (j=0;j<M;j++)
+      {
+         re += (X[j*N+i]*Y[j*N+i] - X[j*N+i+1]*Y[j*N+i+1]);
+         im += (X[j*N+i+1]*Y[j*N+i] + X[j*N+i]*Y[j*N+i+1]);
+      }
+      acc[i] = re;
+      acc[i+1] = im;
+   }
+   re = 0;
+   for (j=0;j<M;j++)
+      re += X[j*N+i]*Y[j*N+i];
+   acc[i] = re;
+}
+
+/* The C version goes through the blocks one at a time, which streams through memory
+   better than summing each bin over all the blocks like the vector versions do */
+static void spectral_mul_accum_c(const float *X, const float *Y, float *acc, int N, int M)
+{
+   int i,j;
+   for (i=0;i<N;i++)
+      acc[i] = 0;
+   for (j=0;j<M;j++)
+   {
+      acc[0] += X[0]*Y[0];
+      for (i=1;i<N-1;i+=2)
+      {
+         acc[i] += (X[i]*Y[i] - X[i+1]*Y[i+1]);
+         acc[i+1] += (X[i+1]*Y[i] + X[i]*Y[i+1]);
+      }
+      acc[i] += X[i]*Y[i];
+      X += N;
+      Y += N;
+   }
+}
+
+static void weighted_spectral_mul_conj_rest(const float *w, float p, const float *X, const float *Y, float *prod, int N, int i)
+{
+   int j = (i+1)>>1;
+   float W;
+   W = p*w[0];
+   prod[0] = W*(X[0]*Y[0]);
+   for (;i<N-1;i+=2,j++)
+   {
+      W = p*w[j];
+      prod[i] = W*(X[i]*Y[i] + X[i+1]*Y[i+1]);
+      prod[i+1] = W*(-X[i+1]*Y[i] + X[i]*Y[i+1]);
+   }
+   W = p*w[j];
+   prod[i] = W*(X[i]*Y[i]);
+}
+
+static void weighted_spectral_mul_conj_c(const float *w, float p, const float *X, const float *Y, float *prod, int N)
+{
+   weighted_spectral_mul_conj_rest(w, p, X, Y, prod, N, 1);
+}
+
+/* prop[] holds the magnitude of each filter block on entry and its step size on return */
+static void adjust_prop_finish(float *prop, int M)
+{
+   int i;
+   float max_sum = 1;
+   float prop_sum = 1;
+   for (i=0;i<M;i++)
+   {
+      if (prop[i] > max_sum)
+         max_sum = prop[i];
+   }
+   for (i=0;i<M;i++)
+   {
+      prop[i] += .1f*max_sum;
+      prop_sum += prop[i];
+   }
+   for (i=0;i<M;i++)
+      prop[i] = .99f*prop[i]/prop_sum;
+}
+
+static void adjust_prop_c(const float *W, int N, int M, int P, float *prop)
+{
+   int i, j, p;
+   for (i=0;i<M;i++)
+   {
+      float tmp = 1;
+      for (p=0;p<P;p++)
+         for (j=0;j<N;j++)
+            tmp += W[p*N*M + i*N+j]*W[p*N*M + i*N+j];
+      prop[i] = sqrt(tmp);
+   }
+   adjust_prop_finish(prop, M);
+}
+
+static const MdfKernels mdf_kernels_c = {
+   "scalar",
+   power_spectrum_accum_c,
+   spectral_mul_accum_c,
+   weighted_spectral_mul_conj_c,
+   adjust_prop_c
+};
+
+
+#ifdef MDF_SSE2
+
+/* Two complex values at a time, interleaved as in the packed spectra. There's no
+   addsub before SSE3, so the signs are flipped with a mask instead. */
+static inline __m128 complex_mul_sse2(__m128 x, __m128 y, __m128 neg_re)
+{
+   __m128 yr = _mm_shuffle_ps(y, y, _MM_SHUFFLE(2,2,0,0));
+   __m128 yi = _mm_shuffle_ps(y, y, _MM_SHUFFLE(3,3,1,1));
+   __m128 xs = _mm_shuffle_ps(x, x, _MM_SHUFFLE(2,3,0,1));
+   return _mm_add_ps(_mm_mul_ps(x, yr), _mm_xor_ps(_mm_mul_ps(xs, yi), neg_re));
+}
+
+static inline __m128 complex_mul_conj_sse2(__m128 x, __m128 y, __m128 neg_im)
+{
+   __m128 xr = _mm_shuffle_ps(x, x, _MM_SHUFFLE(2,2,0,0));
+   __m128 xi = _mm_shuffle_ps(x, x, _MM_SHUFFLE(3,3,1,1));
+   __m128 ys = _mm_shuffle_ps(y, y, _MM_SHUFFLE(2,3,0,1));
+   return _mm_add_ps(_mm_mul_ps(xr, y), _mm_xor_ps(_mm_mul_ps(xi, ys), neg_im));
+}
+
+static void power_spectrum_accum_sse2(const float *X, float *ps, int N)
+{
+   int i, j;
+   for (i=1,j=1;i+8<N;i+=8,j+=4)
+   {
+      __m128 a = _mm_loadu_ps(X+i);
+      __m128 b = _mm_loadu_ps(X+i+4);
+      a = _mm_mul_ps(a, a);
+      b = _mm_mul_ps(b, b);
+      a = _mm_add_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2,0,2,0)), _mm_shuffle_ps(a, b, _MM_SHUFFLE(3,1,3,1)));
+      _mm_storeu_ps(ps+j, _mm_add_ps(_mm_loadu_ps(ps+j), a));
+   }
+   power_spectrum_accum_rest(X, ps, N, i);
+}
+
+static void spectral_mul_accum_sse2(const float *X, const float *Y, float *acc, int N, int M)
+{
+   int i, j;
+   const __m128 neg_re = _mm_set_ps(0.f, -0.f, 0.f, -0.f);
+   for (i=1;i+8<N;i+=8)
+   {
+      const float *x = X+i;
+      const float *y = Y+i;
+      __m128 acc0 = _mm_setzero_ps();
+      __m128 acc1 = _mm_setzero_ps();
+      for (j=0;j<M;j++,x+=N,y+=N)
+      {
+         acc0 = _mm_add_ps(acc0, complex_mul_sse2(_mm_loadu_ps(x), _mm_loadu_ps(y), neg_re));
+         acc1 = _mm_add_ps(acc1, complex_mul_sse2(_mm_loadu_ps(x+4), _mm_loadu_ps(y+4), neg_re));
+      }
+      _mm_storeu_ps(acc+i, acc0);
+      _mm_storeu_ps(acc+i+4, acc1);
+   }
+   spectral_mul_accum_rest(X, Y, acc, N, M, i);
+}
+
+static void weighted_spectral_mul_conj_sse2(const float *w, float p, const float *X, const float *Y, float *prod, int N)
+{
+   int i, j;
+   const __m128 neg_im = _mm_set_ps(-0.f, 0.f, -0.f, 0.f);
+   const __m128 pv = _mm_set1_ps(p);
+   for (i=1,j=1;i+8<N;i+=8,j+=4)
+   {
+      __m128 W = _mm_mul_ps(pv, _mm_loadu_ps(w+j));
+      __m128 p0 = complex_mul_conj_sse2(_mm_loadu_ps(X+i), _mm_loadu_ps(Y+i), neg_im);
+      __m128 p1 = complex_mul_conj_sse2(_mm_loadu_ps(X+i+4), _mm_loadu_ps(Y+i+4), neg_im);
+      _mm_storeu_ps(prod+i, _mm_mul_ps(_mm_unpacklo_ps(W, W), p0));
+      _mm_storeu_ps(prod+i+4, _mm_mul_ps(_mm_unpackhi_ps(W, W), p1));
+   }
+   weighted_spectral_mul_conj_rest(w, p, X, Y, prod, N, i);
+}
+
+static float sum_squares_sse2(const float *x, int len)
+{
+   int i;
+   float sum;
+   __m128 acc0 = _mm_setzero_ps();
+   __m128 acc1 = _mm_setzero_ps();
+   for (i=0;i+8<=len;i+=8)
+   {
+      __m128 a = _mm_loadu_ps(x+i);
+      __m128 b = _mm_loadu_ps(x+i+4);
+      acc0 = _mm_add_ps(acc0, _mm_mul_ps(a, a));
+      acc1 = _mm_add_ps(acc1, _mm_mul_ps(b, b));
+   }
+   acc0 = _mm_add_ps(acc0, acc1);
+   acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+   acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, _MM_SHUFFLE(1,1,1,1)));
+   sum = _mm_cvtss_f32(acc0);
+   for (;i<len;i++)
+      sum += x[i]*x[i];
+   return sum;
+}
+
+static void adjust_prop_sse2(const float *W, int N, int M, int P, float *prop)
+{
+   int i, p;
+   for (i=0;i<M;i++)
+   {
+      float tmp = 1;
+      for (p=0;p<P;p++)
+         tmp += sum_squares_sse2(W + p*N*M + i*N, N);
+      prop[i] = sqrt(tmp);
+   }
+   adjust_prop_finish(prop, M);
+}
+
+static const MdfKernels mdf_kernels_sse2 = {
+   "SSE2",
+   power_spectrum_accum_sse2,
+   spectral_mul_accum_sse2,
+   weighted_spectral_mul_conj_sse2,
+   adjust_prop_sse2
+};
+
+#endif /* MDF_SSE2 */
+
+
+#ifdef MDF_AVX2
+
+static int cpu_has_avx2(void)
+{
+#ifdef _MSC_VER
+   int regs[4];
+   __cpuid(regs, 0);
+   if (regs[0] < 7)
+      return 0;
+   /* The OS has to save the YMM registers too, not just the CPU supporting AVX */
+   __cpuid(regs, 1);
+   if (!(regs[2] & (1<<27)) || !(regs[2] & (1<<28)) || (_xgetbv(0) & 6) != 6)
+      return 0;
+   __cpuidex(regs, 7, 0);
+   return (regs[1] & (1<<5)) != 0;
+#else
+   __builtin_cpu_init();
+   return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+/* Four complex values at a time. The shuffles only work within each 128-bit half,
+   which is all these need. */
+MDF_TARGET_AVX2 static inline __m256 complex_mul_avx2(__m256 x, __m256 y)
+{
+   __m256 yr = _mm256_moveldup_ps(y);
+   __m256 yi = _mm256_movehdup_ps(y);
+   __m256 xs = _mm256_permute_ps(x, _MM_SHUFFLE(2,3,0,1));
+   return _mm256_addsub_ps(_mm256_mul_ps(x, yr), _mm256_mul_ps(xs, yi));
+}
+
+MDF_TARGET_AVX2 static inline __m256 complex_mul_conj_avx2(__m256 x, __m256 y, __m256 neg_im)
+{
+   __m256 xr = _mm256_moveldup_ps(x);
+   __m256 xi = _mm256_movehdup_ps(x);
+   __m256 ys = _mm256_permute_ps(y, _MM_SHUFFLE(2,3,0,1));
+   return _mm256_add_ps(_mm256_mul_ps(xr, y), _mm256_xor_ps(_mm256_mul_ps(xi, ys), neg_im));
+}
+
+MDF_TARGET_AVX2 static void power_spectrum_accum_avx2(const float *X, float *ps, int N)
+{
+   int i, j;
+   for (i=1,j=1;i+16<N;i+=16,j+=8)
+   {
+      __m256 a = _mm256_loadu_ps(X+i);
+      __m256 b = _mm256_loadu_ps(X+i+8);
+      a = _mm256_mul_ps(a, a);
+      b = _mm256_mul_ps(b, b);
+      a = _mm256_add_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2,0,2,0)), _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3,1,3,1)));
+      /* The in-lane shuffles leave the bins in the order 0 1 4 5 2 3 6 7 */
+      a = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(a), _MM_SHUFFLE(3,1,2,0)));
+      _mm256_storeu_ps(ps+j, _mm256_add_ps(_mm256_loadu_ps(ps+j), a));
+   }
+   power_spectrum_accum_rest(X, ps, N, i);
+}
+
+MDF_TARGET_AVX2 static void spectral_mul_accum_avx2(const float *X, const float *Y, float *acc, int N, int M)
+{
+   int i, j;
+   for (i=1;i+16<N;i+=16)
+   {
+      const float *x = X+i;
+      const float *y = Y+i;
+      __m256 acc0 = _mm256_setzero_ps();
+      __m256 acc1 = _mm256_setzero_ps();
+      for (j=0;j<M;j++,x+=N,y+=N)
+      {
+         acc0 = _mm256_add_ps(acc0, complex_mul_avx2(_mm256_loadu_ps(x), _mm256_loadu_ps(y)));
+         acc1 = _mm256_add_ps(acc1, complex_mul_avx2(_mm256_loadu_ps(x+8), _mm256_loadu_ps(y+8)));
+      }
+      _mm256_storeu_ps(acc+i, acc0);
+      _mm256_storeu_ps(acc+i+8, acc1);
+   }
+   spectral_mul_accum_rest(X, Y, acc, N, M, i);
+}
+
+MDF_TARGET_AVX2 static void weighted_spectral_mul_conj_avx2(const float *w, float p, const float *X, const float *Y, float *prod, int N)
+{
+   int i, j;
+   const __m256 neg_im = _mm256_set_ps(-0.f, 0.f, -0.f, 0.f, -0.f, 0.f, -0.f, 0.f);
+   const __m256 pv = _mm256_set1_ps(p);
+   for (i=1,j=1;i+16<N;i+=16,j+=8)
+   {
+      __m256 W = _mm256_mul_ps(pv, _mm256_loadu_ps(w+j));
+      __m256 lo = _mm256_unpacklo_ps(W, W);
+      __m256 hi = _mm256_unpackhi_ps(W, W);
+      __m256 p0 = complex_mul_conj_avx2(_mm256_loadu_ps(X+i), _mm256_loadu_ps(Y+i), neg_im);
+      __m256 p1 = complex_mul_conj_avx2(_mm256_loadu_ps(X+i+8), _mm256_loadu_ps(Y+i+8), neg_im);
+      _mm256_storeu_ps(prod+i, _mm256_mul_ps(_mm256_permute2f128_ps(lo, hi, 0x20), p0));
+      _mm256_storeu_ps(prod+i+8, _mm256_mul_ps(_mm256_permute2f128_ps(lo, hi, 0x31), p1));
+   }
+   weighted_spectral_mul_conj_rest(w, p, X, Y, prod, N, i);
+}
+
+MDF_TARGET_AVX2 static float sum_squares_avx2(const float *x, int len)
+{
+   int i;
+   float sum;
+   __m128 s;
+   __m256 acc0 = _mm256_setzero_ps();
+   __m256 acc1 = _mm256_setzero_ps();
+   for (i=0;i+16<=len;i+=16)
+   {
+      __m256 a = _mm256_loadu_ps(x+i);
+      __m256 b = _mm256_loadu_ps(x+i+8);
+      acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(a, a));
+      acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(b, b));
+   }
+   acc0 = _mm256_add_ps(acc0, acc1);
+   s = _mm_add_ps(_mm256_castps256_ps128(acc0), _mm256_extractf128_ps(acc0, 1));
+   s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+   s = _mm_add_ss(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1,1,1,1)));
+   sum = _mm_cvtss_f32(s);
+   for (;i<len;i++)
+      sum += x[i]*x[i];
+   return sum;
+}
+
+MDF_TARGET_AVX2 static void adjust_prop_avx2(const float *W, int N, int M, int P, float *prop)
+{
+   int i, p;
+   for (i=0;i<M;i++)
+   {
+      float tmp = 1;
+      for (p=0;p<P;p++)
+         tmp += sum_squares_avx2(W + p*N*M + i*N, N);
+      prop[i] = sqrt(tmp);
+   }
+   adjust_prop_finish(prop, M);
+}
+
+static const MdfKernels mdf_kernels_avx2 = {
+   "AVX2",
+   power_spectrum_accum_avx2,
+   spectral_mul_accum_avx2,
+   weighted_spectral_mul_conj_avx2,
+   adjust_prop_avx2
+};
+
+#endif /* MDF_AVX2 */
+
+
+#ifdef MDF_NEON
+
+/* vld2q/vst2q split the packed spectra into real and imaginary parts and back,
+   so no shuffling is needed */
+
+static void power_spectrum_accum_neon(const float *X, float *ps, int N)
+{
+   int i, j;
+   for (i=1,j=1;i+8<N;i+=8,j+=4)
+   {
+      float32x4x2_t x = vld2q_f32(X+i);
+      float32x4_t s = vaddq_f32(vmulq_f32(x.val[0], x.val[0]), vmulq_f32(x.val[1], x.val[1]));
+      vst1q_f32(ps+j, vaddq_f32(vld1q_f32(ps+j), s));
+   }
+   power_spectrum_accum_rest(X, ps, N, i);
+}
+
+static void spectral_mul_accum_neon(const float *X, const float *Y, float *acc, int N, int M)
+{
+   int i, j;
+   for (i=1;i+8<N;i+=8)
+   {
+      const float *xp = X+i;
+      const float *yp = Y+i;
+      float32x4x2_t out;
+      float32x4_t re = vdupq_n_f32(0);
+      float32x4_t im = vdupq_n_f32(0);
+      for (j=0;j<M;j++,xp+=N,yp+=N)
+      {
+         float32x4x2_t x = vld2q_f32(xp);
+         float32x4x2_t y = vld2q_f32(yp);
+         re = vaddq_f32(re, vsubq_f32(vmulq_f32(x.val[0], y.val[0]), vmulq_f32(x.val[1], y.val[1])));
+         im = vaddq_f32(im, vaddq_f32(vmulq_f32(x.val[1], y.val[0]), vmulq_f32(x.val[0], y.val[1])));
+      }
+      out.val[0] = re;
+      out.val[1] = im;
+      vst2q_f32(acc+i, out);
+   }
+   spectral_mul_accum_rest(X, Y, acc, N, M, i);
+}
+
+static void weighted_spectral_mul_conj_neon(const float *w, float p, const float *X, const float *Y, float *prod, int N)
+{
+   int i, j;
+   const float32x4_t pv = vdupq_n_f32(p);
+   for (i=1,j=1;i+8<N;i+=8,j+=4)
+   {
+      float32x4_t W = vmulq_f32(pv, vld1q_f32(w+j));
+      float32x4x2_t x = vld2q_f32(X+i);
+      float32x4x2_t y = vld2q_f32(Y+i);
+      float32x4x2_t out;
+      out.val[0] = vmulq_f32(W, vaddq_f32(vmulq_f32(x.val[0], y.val[0]), vmulq_f32(x.val[1], y.val[1])));
+      out.val[1] = vmulq_f32(W, vaddq_f32(vmulq_f32(vnegq_f32(x.val[1]), y.val[0]), vmulq_f32(x.val[0], y.val[1])));
+      vst2q_f32(prod+i, out);
+   }
+   weighted_spectral_mul_conj_rest(w, p, X, Y, prod, N, i);
+}
+
+static float sum_squares_neon(const float *x, int len)
+{
+   int i;
+   float sum;
+   float32x2_t s;
+   float32x4_t acc0 = vdupq_n_f32(0);
+   float32x4_t acc1 = vdupq_n_f32(0);
+   for (i=0;i+8<=len;i+=8)
+   {
+      float32x4_t a = vld1q_f32(x+i);
+      float32x4_t b = vld1q_f32(x+i+4);
+      acc0 = vaddq_f32(acc0, vmulq_f32(a, a));
+      acc1 = vaddq_f32(acc1, vmulq_f32(b, b));
+   }
+   acc0 = vaddq_f32(acc0, acc1);
+   s = vadd_f32(vget_low_f32(acc0), vget_high_f32(acc0));
+   sum = vget_lane_f32(vpadd_f32(s, s), 0);
+   for (;i<len;i++)
+      sum += x[i]*x[i];
+   return sum;
+}
+
+static void adjust_prop_neon(const float *W, int N, int M, int P, float *prop)
+{
+   int i, p;
+   for (i=0;i<M;i++)
+   {
+      float tmp = 1;
+      for (p=0;p<P;p++)
+         tmp += sum_squares_neon(W + p*N*M + i*N, N);
+      prop[i] = sqrt(tmp);
+   }
+   adjust_prop_finish(prop, M);
+}
+
+static const MdfKernels mdf_kernels_neon = {
+   "NEON",
+   power_spectrum_accum_neon,
+   spectral_mul_accum_neon,
+   weighted_spectral_mul_conj_neon,
+   adjust_prop_neon
+};
+
+#endif /* MDF_NEON */
+
+
+/* Picked by the first echo canceller that's created. If two threads race to do that,
+   they both store the same thing. */
+static const MdfKernels *mdf_kernels_current = NULL;
+
+const MdfKernels *mdf_simd_arch(int arch)
+{
+   switch (arch)
+   {
+   case MDF_SIMD_SCALAR:
+      return &mdf_kernels_c;
+#ifdef MDF_SSE2
+   case MDF_SIMD_SSE2:
+      return &mdf_kernels_sse2;
+#endif
+#ifdef MDF_AVX2
+   case MDF_SIMD_AVX2:
+      return cpu_has_avx2() ? &mdf_kernels_avx2 : NULL;
+#endif
+#ifdef MDF_NEON
+   case MDF_SIMD_NEON:
+      return &mdf_kernels_neon;
+#endif
+   default:
+      return NULL;
+   }
+}
+
+const MdfKernels *mdf_simd_kernels(void)
+{
+   if (!mdf_kernels_current)
+   {
+      /* Later entries are faster, and there's always the scalar one */
+      const MdfKernels *best = NULL;
+      int arch;
+      for (arch=MDF_SIMD_COUNT-1;!best;arch--)
+         best = mdf_simd_arch(arch);
+      mdf_kernels_current = best;
+   }
+   return mdf_kernels_current;
+}
+
+int mdf_simd_force(int arch)
+{
+   const MdfKernels *kernels;
+   if (arch < 0)
+   {
+      mdf_kernels_current = NULL;
+      return mdf_simd_kernels() != NULL;
+   }
+   kernels = mdf_simd_arch(arch);
+   if (!kernels)
+      return 0;
+   mdf_kernels_current = kernels;
+   return 1;
+}
+
+#endif /* !FIXED_POINT */
@@ -0,0 +1,68 @@
+/* File: mdf_simd.h
+   Vectorized inner loops of the floating-point MDF echo canceller
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   3. The name of the author may not be used to endorse or promote products
+   derived from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+   IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+   OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+   INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+   STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MDF_SIMD_H
+#define MDF_SIMD_H
+
+/** Available implementations of the kernels, for mdf_simd_arch() and mdf_simd_force() */
+#define MDF_SIMD_SCALAR 0
+#define MDF_SIMD_SSE2   1
+#define MDF_SIMD_AVX2   2
+#define MDF_SIMD_NEON   3
+#define MDF_SIMD_COUNT  4
+
+/** The loops over all N*M bins that the float echo canceller runs every frame. All spectra
+    are half-complex (packed) vectors of N values as produced by spx_fft(), and M blocks of
+    them are stored back to back. */
+typedef struct {
+   const char *name;
+   /** ps[k] += |X[k]|^2 */
+   void (*power_spectrum_accum)(const float *X, float *ps, int N);
+   /** acc = sum over the M blocks of X*Y */
+   void (*spectral_mul_accum)(const float *X, const float *Y, float *acc, int N, int M);
+   /** prod[k] = p*w[k] * conj(X[k])*Y[k] */
+   void (*weighted_spectral_mul_conj)(const float *w, float p, const float *X, const float *Y, float *prod, int N);
+   /** Proportionate step size of each of the M blocks of the P filters in W */
+   void (*adjust_prop)(const float *W, int N, int M, int P, float *prop);
+} MdfKernels;
+
+/** Kernels for the echo canceller to use: the fastest ones this CPU supports, unless
+    mdf_simd_force() picked others */
+const MdfKernels *mdf_simd_kernels(void);
+
+/** One particular implementation, or NULL if this build or CPU doesn't have it */
+const MdfKernels *mdf_simd_arch(int arch);
+
+/** Makes mdf_simd_kernels() return one particular implementation, or the fastest again if
+    arch is negative. For tests and benchmarks; it isn't thread safe. Returns 0 if the
+    implementation isn't available. */
+int mdf_simd_force(int arch);
+
+#endif
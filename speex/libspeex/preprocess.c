@@ -67,6 +67,8 @@
 #include "filterbank.h"
 #include "math_approx.h"
 #include "os_support.h"
+#include "arena.h"
+#include "preprocess_simd.h"
 
 #ifndef M_PI
 #define M_PI 3.14159263
@@ -92,6 +94,12 @@
 #define SQR16(x) (MULT16_16((x),(x)))
 #define SQR16_Q15(x) (MULT16_16_Q15((x),(x)))
 
+#ifdef FIXED_POINT
+#define WORD2INT(x) ((x) < -32767 ? -32768 : ((x) > 32766 ? 32767 : (x)))  
+#else
+#define WORD2INT(x) ((x) < -32767.5f ? -32768 : ((x) > 32766.5f ? 32767 : floor(.5+(x))))  
+#endif
+
 #ifdef FIXED_POINT
 static inline spx_word16_t DIV32_16_Q8(spx_word32_t a, spx_word32_t b)
 {
@@ -246,6 +254,7 @@ struct SpeexPreprocessState_ {
    int    was_speech;
    int    min_count;         /**< Number of frames processed so far */
    void  *fft_lookup;        /**< Lookup table for the FFT */
+   void  *mem;               /**< Block the state was allocated in, or NULL if the caller provided it */
 #ifdef FIXED_POINT
    int    frame_shift;
 #endif
@@ -392,14 +401,12 @@ static void compute_gain_floor(int noise_suppress, int effective_echo_suppress,
 }
 
 #endif
-EXPORT SpeexPreprocessState *speex_preprocess_state_init(int frame_size, int sampling_rate)
+/* Lays out the state's arrays one after the other, following the state itself. With a sizing arena it only adds
+   up their size, and st is scratch. */
+static void preprocess_layout(SpeexArena *a, SpeexPreprocessState *st, int frame_size, int sampling_rate)
 {
-#define CHECK_ALLOC(x) if (!(x)) { speex_preprocess_state_destroy(st); return NULL; }
-   int i;
-   int N, N3, N4, M;
+   int N, N3, M;
 
-   SpeexPreprocessState *st;
-   CHECK_ALLOC(st = speex_alloc(sizeof(SpeexPreprocessState)));
    st->frame_size = frame_size;
 
    /* Round ps_size down to the nearest power of two */
@@ -424,9 +431,78 @@ EXPORT SpeexPreprocessState *speex_preprocess_state_init(int frame_size, int sam
    st->ps_size = st->frame_size;
 #endif
 
+   N = st->ps_size;
+   N3 = 2*N - st->frame_size;
+   M = st->nbands = NB_BANDS;
+
+   /* The arrays used for every bin every frame come first, in about the order they're used */
+   st->frame = arena_alloc(a, 2*N*sizeof(spx_word16_t));
+   st->window = arena_alloc(a, 2*N*sizeof(spx_word16_t));
+   st->ft = arena_alloc(a, 2*N*sizeof(spx_word16_t));
+   
+   st->ps = arena_alloc(a, (N+M)*sizeof(spx_word32_t));
+   st->S = arena_alloc(a, N*sizeof(spx_word32_t));
+   st->Smin = arena_alloc(a, N*sizeof(spx_word32_t));
+   st->Stmp = arena_alloc(a, N*sizeof(spx_word32_t));
+   st->update_prob = arena_alloc(a, N*sizeof(int));
+   st->noise = arena_alloc(a, (N+M)*sizeof(spx_word32_t));
+   st->echo_noise = arena_alloc(a, (N+M)*sizeof(spx_word32_t));
+   st->residual_echo = arena_alloc(a, (N+M)*sizeof(spx_word32_t));
+   st->reverb_estimate = arena_alloc(a, (N+M)*sizeof(spx_word32_t));
+   st->old_ps = arena_alloc(a, (N+M)*sizeof(spx_word32_t));
+   st->prior = arena_alloc(a, (N+M)*sizeof(spx_word16_t));
+   st->post = arena_alloc(a, (N+M)*sizeof(spx_word16_t));
+   st->zeta = arena_alloc(a, (N+M)*sizeof(spx_word16_t));
+   st->gain = arena_alloc(a, (N+M)*sizeof(spx_word16_t));
+   st->gain2 = arena_alloc(a, (N+M)*sizeof(spx_word16_t));
+   st->gain_floor = arena_alloc(a, (N+M)*sizeof(spx_word16_t));
+#ifndef FIXED_POINT
+   st->loudness_weight = arena_alloc(a, N*sizeof(float));
+#endif
+   
+   st->inbuf = arena_alloc(a, N3*sizeof(spx_word16_t));
+   st->outbuf = arena_alloc(a, N3*sizeof(spx_word16_t));
+   st->bank = filterbank_new_arena(a, M, sampling_rate, N, 1);
+}
+
+EXPORT SpeexPreprocessState *speex_preprocess_state_init(int frame_size, int sampling_rate)
+{
+   return speex_preprocess_state_init_mem(frame_size, sampling_rate, NULL, NULL);
+}
+
+EXPORT SpeexPreprocessState *speex_preprocess_state_init_mem(int frame_size, int sampling_rate, void *mem, size_t *lenmem)
+{
+#define CHECK_ALLOC(x) if (!(x)) { speex_preprocess_state_destroy(st); return NULL; }
+   int i;
+   int N, N3, N4, M;
+   SpeexArena arena = {NULL, 0};
+   size_t memneeded;
+   SpeexPreprocessState *st, sizes;
+
+   arena_alloc(&arena, sizeof(SpeexPreprocessState));
+   preprocess_layout(&arena, &sizes, frame_size, sampling_rate);
+   memneeded = arena_size(&arena);
+   if (lenmem == NULL)
+   {
+      if (!(mem = speex_alloc(memneeded)))
+         return NULL;
+   } else {
+      if (mem == NULL || *lenmem < memneeded)
+      {
+         *lenmem = memneeded;
+         return NULL;
+      }
+      *lenmem = memneeded;
+   }
+   arena_init(&arena, mem, memneeded);
+   st = arena_alloc(&arena, sizeof(SpeexPreprocessState));
+   preprocess_layout(&arena, st, frame_size, sampling_rate);
+   st->mem = lenmem == NULL ? mem : NULL;
+
    N = st->ps_size;
    N3 = 2*N - st->frame_size;
    N4 = st->frame_size - N3;
+   M = st->nbands;
    
    st->sampling_rate = sampling_rate;
    st->denoise_enabled = 1;
@@ -442,35 +518,6 @@ EXPORT SpeexPreprocessState *speex_preprocess_state_init(int frame_size, int sam
    st->speech_prob_continue = SPEECH_PROB_CONTINUE_DEFAULT;
 
    st->echo_state = NULL;
-   
-   st->nbands = NB_BANDS;
-   M = st->nbands;
-   CHECK_ALLOC(st->bank = filterbank_new(M, sampling_rate, N, 1));
-   
-   CHECK_ALLOC(st->frame = speex_alloc(2*N*sizeof(spx_word16_t)));
-   CHECK_ALLOC(st->window = speex_alloc(2*N*sizeof(spx_word16_t)));
-   CHECK_ALLOC(st->ft = speex_alloc(2*N*sizeof(spx_word16_t)));
-   
-   CHECK_ALLOC(st->ps = speex_alloc((N+M)*sizeof(spx_word32_t)));
-   CHECK_ALLOC(st->noise = speex_alloc((N+M)*sizeof(spx_word32_t)));
-   CHECK_ALLOC(st->echo_noise = speex_alloc((N+M)*sizeof(spx_word32_t)));
-   CHECK_ALLOC(st->residual_echo = speex_alloc((N+M)*sizeof(spx_word32_t)));
-   CHECK_ALLOC(st->reverb_estimate = speex_alloc((N+M)*sizeof(spx_word32_t)));
-   CHECK_ALLOC(st->old_ps = speex_alloc((N+M)*sizeof(spx_word32_t)));
-   CHECK_ALLOC(st->prior = speex_alloc((N+M)*sizeof(spx_word16_t)));
-   CHECK_ALLOC(st->post = speex_alloc((N+M)*sizeof(spx_word16_t)));
-   CHECK_ALLOC(st->gain = speex_alloc((N+M)*sizeof(spx_word16_t)));
-   CHECK_ALLOC(st->gain2 = speex_alloc((N+M)*sizeof(spx_word16_t)));
-   CHECK_ALLOC(st->gain_floor = speex_alloc((N+M)*sizeof(spx_word16_t)));
-   CHECK_ALLOC(st->zeta = speex_alloc((N+M)*sizeof(spx_word16_t)));
-   
-   CHECK_ALLOC(st->S = speex_alloc(N*sizeof(spx_word32_t)));
-   CHECK_ALLOC(st->Smin = speex_alloc(N*sizeof(spx_word32_t)));
-   CHECK_ALLOC(st->Stmp = speex_alloc(N*sizeof(spx_word32_t)));
-   CHECK_ALLOC(st->update_prob = speex_alloc(N*sizeof(int)));
-   
-   CHECK_ALLOC(st->inbuf = speex_alloc(N3*sizeof(spx_word16_t)));
-   CHECK_ALLOC(st->outbuf = speex_alloc(N3*sizeof(spx_word16_t)));
 
    conj_window(st->window, 2*N3);
    for (i=2*N3;i<2*st->ps_size;i++)
@@ -504,7 +551,6 @@ EXPORT SpeexPreprocessState *speex_preprocess_state_init(int frame_size, int sam
 #ifndef FIXED_POINT
    st->agc_enabled = 0;
    st->agc_level = 8000;
-   CHECK_ALLOC(st->loudness_weight = speex_alloc(N*sizeof(float)));
    for (i=0;i<N;i++)
    {
       float ff=((float)i)*.5*sampling_rate/((float)N);
@@ -536,36 +582,10 @@ EXPORT void speex_preprocess_state_destroy(SpeexPreprocessState *st)
 {
    if (st)
    {
-      speex_free(st->frame);
-      speex_free(st->ft);
-      speex_free(st->ps);
-      speex_free(st->gain2);
-      speex_free(st->gain_floor);
-      speex_free(st->window);
-      speex_free(st->noise);
-      speex_free(st->reverb_estimate);
-      speex_free(st->old_ps);
-      speex_free(st->gain);
-      speex_free(st->prior);
-      speex_free(st->post);
-#ifndef FIXED_POINT
-      speex_free(st->loudness_weight);
-#endif
-      speex_free(st->echo_noise);
-      speex_free(st->residual_echo);
-
-      speex_free(st->S);
-      speex_free(st->Smin);
-      speex_free(st->Stmp);
-      speex_free(st->update_prob);
-      speex_free(st->zeta);
-
-      speex_free(st->inbuf);
-      speex_free(st->outbuf);
-
+      /* Everything else is in the state's block */
       spx_fft_destroy(st->fft_lookup);
-      filterbank_destroy(st->bank);
-      speex_free(st);
+      if (st->mem)
+         speex_free(st->mem);
    }
 }
 
@@ -620,15 +640,14 @@ static void speex_compute_agc(SpeexPreprocessState *st, spx_word16_t Pframe, spx
 }
 #endif
 
-static void preprocess_analysis(SpeexPreprocessState *st, spx_int16_t *x)
+/* 'Build' input frame from the new samples and the saved overlap */
+static void preprocess_load_input(SpeexPreprocessState *st, const spx_int16_t *x)
 {
    int i;
    int N = st->ps_size;
    int N3 = 2*N - st->frame_size;
    int N4 = st->frame_size - N3;
-   spx_word32_t *ps=st->ps;
 
-   /* 'Build' input frame */
    for (i=0;i<N3;i++)
       st->frame[i]=st->inbuf[i];
    for (i=0;i<st->frame_size;i++)
@@ -637,6 +656,38 @@ static void preprocess_analysis(SpeexPreprocessState *st, spx_int16_t *x)
    /* Update inbuf */
    for (i=0;i<N3;i++)
       st->inbuf[i]=x[N4+i];
+}
+
+#ifndef DISABLE_FLOAT_API
+static void preprocess_load_input_float(SpeexPreprocessState *st, const float *x, int stride)
+{
+   int i;
+   int N = st->ps_size;
+   int N3 = 2*N - st->frame_size;
+   int N4 = st->frame_size - N3;
+
+   for (i=0;i<N3;i++)
+      st->frame[i]=st->inbuf[i];
+#ifdef FIXED_POINT
+   for (i=0;i<st->frame_size;i++)
+      st->frame[N3+i]=WORD2INT(x[i*stride]);
+#else
+   for (i=0;i<st->frame_size;i++)
+      st->frame[N3+i]=x[i*stride];
+#endif
+
+   /* Update inbuf */
+   for (i=0;i<N3;i++)
+      st->inbuf[i]=st->frame[N3+N4+i];
+}
+#endif
+
+/* Expects the input frame to have been loaded already */
+static void preprocess_analysis(SpeexPreprocessState *st)
+{
+   int i;
+   int N = st->ps_size;
+   spx_word32_t *ps=st->ps;
 
    /* Windowing */
    for (i=0;i<2*N;i++)
@@ -728,26 +779,19 @@ EXPORT int speex_preprocess(SpeexPreprocessState *st, spx_int16_t *x, spx_int32_
    return speex_preprocess_run(st, x);
 }
 
-EXPORT int speex_preprocess_run(SpeexPreprocessState *st, spx_int16_t *x)
+/* The part of a frame that's done one channel at a time before the noise estimate is updated: frame
+   counters, residual echo and the analysis of the loaded input frame */
+static void preprocess_begin_frame(SpeexPreprocessState *st)
 {
    int i;
    int M;
    int N = st->ps_size;
-   int N3 = 2*N - st->frame_size;
-   int N4 = st->frame_size - N3;
-   spx_word32_t *ps=st->ps;
-   spx_word32_t Zframe;
-   spx_word16_t Pframe;
-   spx_word16_t beta, beta_1;
-   spx_word16_t effective_echo_suppress;
-   
+
    st->nb_adapt++;
    if (st->nb_adapt>20000)
       st->nb_adapt = 20000;
    st->min_count++;
    
-   beta = MAX16(QCONST16(.03,15),DIV32_16(Q15_ONE,st->nb_adapt));
-   beta_1 = Q15_ONE-beta;
    M = st->nbands;
    /* Deal with residual echo if provided */
    if (st->echo_state)
@@ -768,7 +812,17 @@ EXPORT int speex_preprocess_run(SpeexPreprocessState *st, spx_int16_t *x)
       for (i=0;i<N+M;i++)
          st->echo_noise[i] = 0;
    }
-   preprocess_analysis(st, x);
+   preprocess_analysis(st);
+}
+
+static void update_noise_estimate(SpeexPreprocessState *st)
+{
+   int i;
+   int N = st->ps_size;
+   spx_word16_t beta, beta_1;
+
+   beta = MAX16(QCONST16(.03,15),DIV32_16(Q15_ONE,st->nb_adapt));
+   beta_1 = Q15_ONE-beta;
 
    update_noise_prob(st);
 
@@ -787,14 +841,118 @@ EXPORT int speex_preprocess_run(SpeexPreprocessState *st, spx_int16_t *x)
          st->noise[i] = MAX32(EXTEND32(0),MULT16_32_Q15(beta_1,st->noise[i]) + MULT16_32_Q15(beta,SHL32(st->ps[i],NOISE_SHIFT)));
    }
    filterbank_compute_bank32(st->bank, st->noise, st->noise+N);
+}
+
+#ifndef FIXED_POINT
+static int preprocess_simd = 1;
 
+void preprocess_simd_enable(int enabled)
+{
+   preprocess_simd = enabled;
+}
+
+/* The loops of preprocess_compute_gain() that matter, four bins at a time. Each one returns the first bin it
+   left for the scalar loop to finish. */
+static int compute_snr_simd(SpeexPreprocessState *st)
+{
+   int i;
+   int len = st->ps_size + st->nbands;
+   v4sf zero = vset1(0.f);
+   v4sf one = vset1(1.f);
+   v4sf hundred = vset1(100.f);
+
+   for (i=0;i+4<=len;i+=4)
+   {
+      v4sf ps = vload(st->ps+i);
+      v4sf old_ps = vload(st->old_ps+i);
+      v4sf tot_noise = vadd(vadd(vadd(one, vload(st->noise+i)), vload(st->echo_noise+i)), vload(st->reverb_estimate+i));
+      v4sf post = vmin(vsub(vdiv(ps, tot_noise), one), hundred);
+      v4sf ratio = vdiv(old_ps, vadd(old_ps, tot_noise));
+      v4sf gamma = vadd(vset1(.1f), vmul(vset1(.89f), vmul(ratio, ratio)));
+      v4sf prior = vadd(vmul(gamma, vmax(zero, post)), vmul(vsub(one, gamma), vdiv(old_ps, tot_noise)));
+      vstore(st->post+i, post);
+      vstore(st->prior+i, vmin(prior, hundred));
+   }
+   return i;
+}
+
+static int compute_bark_gain_simd(SpeexPreprocessState *st, float Pframe)
+{
+   int i;
+   int len = st->ps_size + st->nbands;
+   v4sf zero = vset1(0.f);
+   v4sf one = vset1(1.f);
+
+   for (i=st->ps_size;i+4<=len;i+=4)
+   {
+      v4sf prior = vload(st->prior+i);
+      v4sf prior_ratio = vdiv(prior, vadd(prior, one));
+      v4sf theta = vmul(prior_ratio, vadd(one, vload(st->post+i)));
+      v4sf gain = vmin(one, vmul(prior_ratio, hypergeom_gain_v4(theta)));
+      v4sf P1 = vadd(vset1(.199f), vmul(vset1(.8f), qcurve_v4(vload(st->zeta+i))));
+      v4sf q = vsub(one, vmul(vset1(Pframe), P1));
+
+      vstore(st->gain+i, gain);
+      vstore(st->old_ps+i, vadd(vmul(vset1(.2f), vload(st->old_ps+i)), vmul(vmul(vset1(.8f), vmul(gain, gain)), vload(st->ps+i))));
+      vstore(st->gain2+i, vdiv(one, vadd(one, vmul(vmul(vdiv(q, vsub(one, q)), vadd(one, prior)), vexp(vsub(zero, theta))))));
+   }
+   return i;
+}
+
+static int compute_linear_gain_simd(SpeexPreprocessState *st)
+{
+   int i;
+   int N = st->ps_size;
+   v4sf one = vset1(1.f);
+
+   for (i=0;i+4<=N;i+=4)
+   {
+      v4sf prior = vload(st->prior+i);
+      v4sf prior_ratio = vdiv(prior, vadd(prior, one));
+      v4sf theta = vmul(prior_ratio, vadd(one, vload(st->post+i)));
+      v4sf g = vmin(one, vmul(prior_ratio, hypergeom_gain_v4(theta)));
+      v4sf band_gain = vload(st->gain+i);
+      v4sf floor_gain = vload(st->gain_floor+i);
+      v4sf p = vload(st->gain2+i);
+      v4sf tmp;
+
+      /* Constrain the gain to be close to the Bark scale gain */
+      g = vselect_gt(vmul(vset1(.333f), g), band_gain, vmul(vset1(3.f), band_gain), g);
+      vstore(st->old_ps+i, vadd(vmul(vset1(.2f), vload(st->old_ps+i)), vmul(vmul(vset1(.8f), vmul(g, g)), vload(st->ps+i))));
+      g = vmax(g, floor_gain);
+      vstore(st->gain+i, g);
+      tmp = vadd(vmul(p, vsqrt(g)), vmul(vsub(one, p), vsqrt(floor_gain)));
+      vstore(st->gain2+i, vmul(tmp, tmp));
+   }
+   return i;
+}
+#endif
+
+/* Computes the gain to apply to each bin in st->gain2 from the updated noise estimate. Returns the speech
+   probability of the frame. */
+static spx_word16_t preprocess_compute_gain(SpeexPreprocessState *st)
+{
+   int i;
+   int M;
+   int N = st->ps_size;
+   spx_word32_t *ps=st->ps;
+   spx_word32_t Zframe;
+   spx_word16_t Pframe;
+   spx_word16_t effective_echo_suppress;
+
+   M = st->nbands;
    /* Special case for first frame */
    if (st->nb_adapt==1)
       for (i=0;i<N+M;i++)
          st->old_ps[i] = ps[i];
 
    /* Compute a posteriori SNR */
-   for (i=0;i<N+M;i++)
+   i = 0;
+#ifndef FIXED_POINT
+   if (preprocess_simd)
+      i = compute_snr_simd(st);
+#endif
+   for (;i<N+M;i++)
    {
       spx_word16_t gamma;
       
@@ -836,7 +994,12 @@ EXPORT int speex_preprocess_run(SpeexPreprocessState *st, spx_int16_t *x)
    /* Compute Ephraim & Malah gain speech probability of presence for each critical band (Bark scale) 
       Technically this is actually wrong because the EM gaim assumes a slightly different probability 
       distribution */
-   for (i=N;i<N+M;i++)
+   i = N;
+#ifndef FIXED_POINT
+   if (preprocess_simd)
+      i = compute_bark_gain_simd(st, Pframe);
+#endif
+   for (;i<N+M;i++)
    {
       /* See EM and Cohen papers*/
       spx_word32_t theta;
@@ -883,7 +1046,12 @@ EXPORT int speex_preprocess_run(SpeexPreprocessState *st, spx_int16_t *x)
       filterbank_compute_psd16(st->bank,st->gain_floor+N, st->gain_floor);
    
       /* Compute gain according to the Ephraim-Malah algorithm -- linear frequency */
-      for (i=0;i<N;i++)
+      i = 0;
+#ifndef FIXED_POINT
+      if (preprocess_simd)
+         i = compute_linear_gain_simd(st);
+#endif
+      for (;i<N;i++)
       {
          spx_word32_t MM;
          spx_word32_t theta;
@@ -945,6 +1113,16 @@ EXPORT int speex_preprocess_run(SpeexPreprocessState *st, spx_int16_t *x)
          st->gain2[i]=Q15_ONE;
    }
       
+   return Pframe;
+}
+
+/* Applies st->gain2 (and the AGC) to the spectrum and leaves the windowed output in st->frame for the
+   caller to overlap-add. Returns the VAD decision. */
+static int preprocess_synthesis(SpeexPreprocessState *st, spx_word16_t Pframe)
+{
+   int i;
+   int N = st->ps_size;
+
    /* Apply computed gain */
    for (i=1;i<N;i++)
    {
@@ -987,16 +1165,6 @@ EXPORT int speex_preprocess_run(SpeexPreprocessState *st, spx_int16_t *x)
    for (i=0;i<2*N;i++)
       st->frame[i] = MULT16_16_Q15(st->frame[i], st->window[i]);
 
-   /* Perform overlap and add */
-   for (i=0;i<N3;i++)
-      x[i] = st->outbuf[i] + st->frame[i];
-   for (i=0;i<N4;i++)
-      x[N3+i] = st->frame[N3+i];
-   
-   /* Update outbuf */
-   for (i=0;i<N3;i++)
-      st->outbuf[i] = st->frame[st->frame_size+i];
-
    /* FIXME: This VAD is a kludge */
    st->speech_prob = Pframe;
    if (st->vad_enabled)
@@ -1015,18 +1183,108 @@ EXPORT int speex_preprocess_run(SpeexPreprocessState *st, spx_int16_t *x)
    }
 }
 
-EXPORT void speex_preprocess_estimate_update(SpeexPreprocessState *st, spx_int16_t *x)
+/* Runs the analysis, gain computation and synthesis on the loaded input frame, leaving the windowed output
+   in st->frame for the caller to overlap-add. Returns the VAD decision. */
+static int preprocess_process_frame(SpeexPreprocessState *st)
+{
+   int i;
+   int skip_gain = !st->denoise_enabled && !st->vad_enabled;
+
+   preprocess_begin_frame(st);
+   update_noise_estimate(st);
+#ifndef FIXED_POINT
+   skip_gain = skip_gain && !st->agc_enabled;
+#endif
+   /* Without denoising the gain is 1, so unless the VAD or AGC needs the speech probability, there's no
+      point working out the band and bin gains. The noise estimate is still kept up to date. */
+   if (skip_gain)
+   {
+      for (i=0;i<st->ps_size;i++)
+         st->gain2[i] = Q15_ONE;
+      return preprocess_synthesis(st, st->speech_prob);
+   }
+   return preprocess_synthesis(st, preprocess_compute_gain(st));
+}
+
+/* Overlap-adds st->frame into the output */
+static void preprocess_store_output(SpeexPreprocessState *st, spx_int16_t *x)
+{
+   int i;
+   int N3 = 2*st->ps_size - st->frame_size;
+   int N4 = st->frame_size - N3;
+
+   /* Perform overlap and add */
+   for (i=0;i<N3;i++)
+      x[i] = st->outbuf[i] + st->frame[i];
+   for (i=0;i<N4;i++)
+      x[N3+i] = st->frame[N3+i];
+   
+   /* Update outbuf */
+   for (i=0;i<N3;i++)
+      st->outbuf[i] = st->frame[st->frame_size+i];
+}
+
+#ifndef DISABLE_FLOAT_API
+static void preprocess_store_output_float(SpeexPreprocessState *st, float *x, int stride)
+{
+   int i;
+   int N3 = 2*st->ps_size - st->frame_size;
+   int N4 = st->frame_size - N3;
+
+   /* Perform overlap and add */
+   for (i=0;i<N3;i++)
+      x[i*stride] = ADD32(EXTEND32(st->outbuf[i]), EXTEND32(st->frame[i]));
+   for (i=0;i<N4;i++)
+      x[(N3+i)*stride] = st->frame[N3+i];
+
+   /* Update outbuf */
+   for (i=0;i<N3;i++)
+      st->outbuf[i] = st->frame[st->frame_size+i];
+}
+#endif
+
+EXPORT int speex_preprocess_run(SpeexPreprocessState *st, spx_int16_t *x)
+{
+   int vad;
+
+   preprocess_load_input(st, x);
+   vad = preprocess_process_frame(st);
+   preprocess_store_output(st, x);
+   return vad;
+}
+
+#ifndef DISABLE_FLOAT_API
+EXPORT int speex_preprocess_run_float(SpeexPreprocessState *st, float *x)
+{
+   return speex_preprocess_run_float_stride(st, x, 1);
+}
+
+EXPORT int speex_preprocess_run_float_stride(SpeexPreprocessState *st, float *x, int stride)
+{
+   int vad;
+
+   preprocess_load_input_float(st, x, stride);
+   vad = preprocess_process_frame(st);
+   preprocess_store_output_float(st, x, stride);
+   return vad;
+}
+#endif /* #ifndef DISABLE_FLOAT_API */
+
+/* Expects the input frame to have been loaded already. Leaves old_ps to the caller */
+static void preprocess_estimate_frame(SpeexPreprocessState *st)
 {
    int i;
    int N = st->ps_size;
    int N3 = 2*N - st->frame_size;
-   int M;
-   spx_word32_t *ps=st->ps;
 
-   M = st->nbands;
    st->min_count++;
-   
-   preprocess_analysis(st, x);
+
+   /* The caller outputs the frame unprocessed, so that's what the next frame overlaps with.
+      frame[N3+i] is still input sample i here, analysis windows it in place */
+   for (i=0;i<N3;i++)
+      st->outbuf[i] = MULT16_16_Q15(st->frame[st->frame_size+i],st->window[st->frame_size+i]);
+
+   preprocess_analysis(st);
 
    update_noise_prob(st);
    
@@ -1038,16 +1296,46 @@ EXPORT void speex_preprocess_estimate_update(SpeexPreprocessState *st, spx_int16
       }
    }
 
-   for (i=0;i<N3;i++)
-      st->outbuf[i] = MULT16_16_Q15(x[st->frame_size-N3+i],st->window[st->frame_size+i]);
+   for (i=0;i<N;i++)
+      st->reverb_estimate[i] = MULT16_32_Q15(st->reverb_decay, st->reverb_estimate[i]);
+}
+
+EXPORT void speex_preprocess_estimate_update(SpeexPreprocessState *st, spx_int16_t *x)
+{
+   int i;
+   int N = st->ps_size;
+   int M = st->nbands;
+
+   preprocess_load_input(st, x);
+   preprocess_estimate_frame(st);
 
    /* Save old power spectrum */
    for (i=0;i<N+M;i++)
-      st->old_ps[i] = ps[i];
+      st->old_ps[i] = st->ps[i];
+}
 
-   for (i=0;i<N;i++)
-      st->reverb_estimate[i] = MULT16_32_Q15(st->reverb_decay, st->reverb_estimate[i]);
+#ifndef DISABLE_FLOAT_API
+EXPORT void speex_preprocess_estimate_update_float(SpeexPreprocessState *st, const float *x, float out_gain)
+{
+   int i;
+   int N = st->ps_size;
+   int N3 = 2*N - st->frame_size;
+   int M = st->nbands;
+
+   preprocess_load_input_float(st, x, 1);
+   preprocess_estimate_frame(st);
+
+   if (out_gain > 1.f)
+      out_gain = 1.f;
+   for (i=0;i<N3;i++)
+      st->outbuf[i] = (spx_word16_t)(st->outbuf[i]*out_gain);
+
+   /* Decision-directed like a processed frame, with the gain the caller applied standing in for the filter's. With
+      the raw spectrum the next frame's a priori SNR starts out as if the noise were speech */
+   for (i=0;i<N+M;i++)
+      st->old_ps[i] = (spx_word32_t)(.2f*st->old_ps[i] + .8f*out_gain*out_gain*st->ps[i]);
 }
+#endif /* #ifndef DISABLE_FLOAT_API */
 
 
 EXPORT int speex_preprocess_ctl(SpeexPreprocessState *state, int request, void *ptr)
@@ -1218,6 +1506,450 @@ EXPORT int speex_preprocess_ctl(SpeexPreprocessState *state, int request, void *
    return 0;
 }
 
+/* Batches
+
+   A batch keeps the state of each of its channels in an ordinary
+   SpeexPreprocessState, which does the channel's FFTs, residual echo, AGC
+   and overlap-add. The rest of the frame, from the noise estimate to the
+   gain of each bin, runs on interleaved copies of all the channels'
+   spectra: bin i of channel c is at i*stride+c, where stride is the
+   number of channels rounded up to a multiple of 4. Every per-bin loop of
+   update_noise_estimate() and preprocess_compute_gain() then works on 4
+   channels at a time, and the neighbouring bins that the smoothing of S
+   and zeta looks at are simply a row up or down. Padding channels
+   process a copy of channel 0's input.
+
+   The noise estimate, S, Smin, Stmp, old_ps and zeta only live in the
+   interleaved arrays. The noise estimate is copied back to each channel's
+   state for SPEEX_PREPROCESS_GET_NOISE_PSD.
+*/
+struct SpeexPreprocessBatch_ {
+   int    channels;
+   SpeexPreprocessState **st;   /**< State of each channel */
+#ifndef FIXED_POINT
+   int    stride;               /**< Values per bin in the interleaved arrays */
+   float *ps;                   /**< Power spectra (N+M bins) */
+   float *echo_noise;           /**< Residual echo estimates (N+M bins) */
+   float *noise;                /**< Noise estimates (N+M bins) */
+   float *S;                    /**< Smoothed power spectra (N bins) */
+   float *Smin;
+   float *Stmp;
+   float *old_ps;               /**< Power spectra of the last frame (N+M bins) */
+   float *zeta;                 /**< Smoothed a priori SNRs (N+M bins) */
+   float *post;                 /**< A posteriori SNRs (N+M bins) */
+   float *prior;                /**< A priori SNRs (N+M bins) */
+   float *gain;                 /**< Ephraim Malah gains (N+M bins) */
+   float *gain2;                /**< Adjusted gains (N+M bins) */
+   float *gain_floor;           /**< Minimum gains (N+M bins) */
+   float *Pframe;               /**< Speech probability of each channel's frame */
+   float *noise_floor;          /**< Noise and echo gain floors of each channel */
+   float *echo_floor;
+#endif
+};
+
+#ifndef FIXED_POINT
+
+/* Copies one channel's N+M bins into an interleaved array */
+static void batch_interleave(float *dst, const float *src, int stride, int len)
+{
+   int i;
+   for (i=0;i<len;i++)
+      dst[i*stride] = src[i];
+}
+
+static void batch_deinterleave(float *dst, const float *src, int stride, int len)
+{
+   int i;
+   for (i=0;i<len;i++)
+      dst[i] = src[i*stride];
+}
+
+/* filterbank_compute_bank32() for interleaved spectra: adds up bins 0..N-1 of x into the bands that
+   follow them */
+static void batch_compute_bank(FilterBank *bank, float *x, int stride)
+{
+   int i, c;
+   float *mel = x + bank->len*stride;
+   for (i=0;i<bank->nb_banks*stride;i++)
+      mel[i] = 0;
+   for (i=0;i<bank->len;i++)
+   {
+      v4sf left = vset1(bank->filter_left[i]);
+      v4sf right = vset1(bank->filter_right[i]);
+      float *ml = mel + bank->bank_left[i]*stride;
+      float *mr = mel + bank->bank_right[i]*stride;
+      for (c=0;c<stride;c+=4)
+      {
+         v4sf ps = vload(x+i*stride+c);
+         vstore(ml+c, vadd(vload(ml+c), vmul(left, ps)));
+         vstore(mr+c, vadd(vload(mr+c), vmul(right, ps)));
+      }
+   }
+}
+
+/* filterbank_compute_psd16() for interleaved spectra: spreads the bands after bin N-1 back over the bins */
+static void batch_compute_psd(FilterBank *bank, float *x, int stride)
+{
+   int i, c;
+   const float *mel = x + bank->len*stride;
+   for (i=0;i<bank->len;i++)
+   {
+      v4sf left = vset1(bank->filter_left[i]);
+      v4sf right = vset1(bank->filter_right[i]);
+      const float *ml = mel + bank->bank_left[i]*stride;
+      const float *mr = mel + bank->bank_right[i]*stride;
+      for (c=0;c<stride;c+=4)
+         vstore(x+i*stride+c, vadd(vmul(vload(ml+c), left), vmul(vload(mr+c), right)));
+   }
+}
+
+/* update_noise_estimate() for all channels */
+static void batch_update_noise(SpeexPreprocessBatch *b)
+{
+   int c, k;
+   int min_range;
+   SpeexPreprocessState *st = b->st[0];
+   int N = st->ps_size;
+   int C = b->stride;
+   float beta = MAX16(QCONST16(.03,15),DIV32_16(Q15_ONE,st->nb_adapt));
+   v4sf vbeta = vset1(beta);
+   v4sf vbeta_1 = vset1(1.f-beta);
+   v4sf zero = vset1(0.f);
+
+   /* Smoothed power spectrum */
+   for (c=0;c<C;c+=4)
+   {
+      vstore(b->S+c, vadd(vmul(vset1(.8f), vload(b->S+c)), vmul(vset1(.2f), vload(b->ps+c))));
+      k = (N-1)*C+c;
+      vstore(b->S+k, vadd(vmul(vset1(.8f), vload(b->S+k)), vmul(vset1(.2f), vload(b->ps+k))));
+   }
+   for (k=C;k<(N-1)*C;k+=4)
+   {
+      v4sf S = vadd(vmul(vset1(.8f), vload(b->S+k)), vmul(vset1(.05f), vload(b->ps+k-C)));
+      S = vadd(S, vmul(vset1(.1f), vload(b->ps+k)));
+      vstore(b->S+k, vadd(S, vmul(vset1(.05f), vload(b->ps+k+C))));
+   }
+
+   /* All channels of a batch have seen the same number of frames */
+   if (st->nb_adapt==1)
+   {
+      for (k=0;k<N*C;k++)
+         b->Smin[k] = b->Stmp[k] = 0;
+   }
+   if (st->nb_adapt < 100)
+      min_range = 15;
+   else if (st->nb_adapt < 1000)
+      min_range = 50;
+   else if (st->nb_adapt < 10000)
+      min_range = 150;
+   else
+      min_range = 300;
+   if (st->min_count > min_range)
+   {
+      for (c=0;c<b->channels;c++)
+         b->st[c]->min_count = 0;
+      for (k=0;k<N*C;k+=4)
+      {
+         vstore(b->Smin+k, vmin(vload(b->Stmp+k), vload(b->S+k)));
+         vstore(b->Stmp+k, vload(b->S+k));
+      }
+   } else {
+      for (k=0;k<N*C;k+=4)
+      {
+         v4sf S = vload(b->S+k);
+         vstore(b->Smin+k, vmin(vload(b->Smin+k), S));
+         vstore(b->Stmp+k, vmin(vload(b->Stmp+k), S));
+      }
+   }
+
+   /* Update the noise estimate where there's no speech (S isn't well above Smin), or where the power is below
+      the noise estimate */
+   for (k=0;k<N*C;k+=4)
+   {
+      v4sf ps = vload(b->ps+k);
+      v4sf noise = vload(b->noise+k);
+      v4sf updated = vmax(zero, vadd(vmul(vbeta_1, noise), vmul(vbeta, ps)));
+      v4sf speech = vselect_gt(noise, ps, updated, noise);
+      vstore(b->noise+k, vselect_gt(vmul(vset1(.4f), vload(b->S+k)), vload(b->Smin+k), speech, updated));
+   }
+   batch_compute_bank(st->bank, b->noise, C);
+}
+
+/* preprocess_compute_gain() for all channels, leaving the gains in b->gain2 and each channel's speech
+   probability in b->Pframe */
+static void batch_compute_gain(SpeexPreprocessBatch *b)
+{
+   int i, c, k;
+   SpeexPreprocessState *st = b->st[0];
+   int N = st->ps_size;
+   int M = st->nbands;
+   int C = b->stride;
+   v4sf zero = vset1(0.f);
+   v4sf one = vset1(1.f);
+   v4sf hundred = vset1(100.f);
+
+   /* Special case for first frame */
+   if (st->nb_adapt==1)
+      for (k=0;k<(N+M)*C;k++)
+         b->old_ps[k] = b->ps[k];
+
+   /* A posteriori SNR and a priori SNR update */
+   for (k=0;k<(N+M)*C;k+=4)
+   {
+      v4sf ps = vload(b->ps+k);
+      v4sf old_ps = vload(b->old_ps+k);
+      v4sf tot_noise = vadd(vadd(one, vload(b->noise+k)), vload(b->echo_noise+k));
+      v4sf post = vmin(vsub(vdiv(ps, tot_noise), one), hundred);
+      v4sf ratio = vdiv(old_ps, vadd(old_ps, tot_noise));
+      v4sf gamma = vadd(vset1(.1f), vmul(vset1(.89f), vmul(ratio, ratio)));
+      v4sf prior = vadd(vmul(gamma, vmax(zero, post)), vmul(vsub(one, gamma), vdiv(old_ps, tot_noise)));
+      vstore(b->post+k, post);
+      vstore(b->prior+k, vmin(prior, hundred));
+   }
+
+   /* Recursive average of the a priori SNR, a bit smoothed for the psd components */
+   for (k=0;k<(N+M)*C;k+=4)
+   {
+      v4sf zeta = vmul(vset1(.7f), vload(b->zeta+k));
+      if (k < C || k >= (N-1)*C)
+      {
+         zeta = vadd(zeta, vmul(vset1(.3f), vload(b->prior+k)));
+      } else {
+         zeta = vadd(zeta, vmul(vset1(.15f), vload(b->prior+k)));
+         zeta = vadd(zeta, vmul(vset1(.075f), vload(b->prior+k-C)));
+         zeta = vadd(zeta, vmul(vset1(.075f), vload(b->prior+k+C)));
+      }
+      vstore(b->zeta+k, zeta);
+   }
+
+   /* Speech probability of each frame, from the average a priori SNR of its bands */
+   for (c=0;c<C;c+=4)
+   {
+      v4sf Zframe = zero;
+      for (i=N;i<N+M;i++)
+         Zframe = vadd(Zframe, vload(b->zeta+i*C+c));
+      vstore(b->Pframe+c, vadd(vset1(.1f), vmul(vset1(.899f), qcurve_v4(vdiv(Zframe, vset1(M))))));
+   }
+   for (c=0;c<C;c++)
+   {
+      SpeexPreprocessState *ch = b->st[c < b->channels ? c : 0];
+      float effective_echo_suppress = (1-b->Pframe[c])*ch->echo_suppress + b->Pframe[c]*ch->echo_suppress_active;
+      b->noise_floor[c] = exp(.2302585f*ch->noise_suppress);
+      b->echo_floor[c] = exp(.2302585f*effective_echo_suppress);
+   }
+
+   /* Gain floor, Ephraim & Malah gain and speech probability of presence for each band */
+   for (i=N;i<N+M;i++)
+   {
+      for (c=0;c<C;c+=4)
+      {
+         v4sf MM, P1, q, gain, theta, prior_ratio;
+         v4sf noise, echo, ps, prior, post;
+
+         k = i*C+c;
+         noise = vload(b->noise+k);
+         echo = vload(b->echo_noise+k);
+         vstore(b->gain_floor+k, vdiv(vsqrt(vadd(vmul(vload(b->noise_floor+c), noise), vmul(vload(b->echo_floor+c), echo))),
+                                     vsqrt(vadd(vadd(one, noise), echo))));
+
+         ps = vload(b->ps+k);
+         prior = vload(b->prior+k);
+         post = vload(b->post+k);
+         prior_ratio = vdiv(prior, vadd(prior, one));
+         theta = vmul(prior_ratio, vadd(one, post));
+         MM = hypergeom_gain_v4(theta);
+         gain = vmin(one, vmul(prior_ratio, MM));
+         vstore(b->gain+k, gain);
+         vstore(b->old_ps+k, vadd(vmul(vset1(.2f), vload(b->old_ps+k)), vmul(vmul(vset1(.8f), vmul(gain, gain)), ps)));
+
+         P1 = vadd(vset1(.199f), vmul(vset1(.8f), qcurve_v4(vload(b->zeta+k))));
+         q = vsub(one, vmul(vload(b->Pframe+c), P1));
+         vstore(b->gain2+k, vdiv(one, vadd(one, vmul(vmul(vdiv(q, vsub(one, q)), vadd(one, prior)), vexp(vsub(zero, theta))))));
+      }
+   }
+   /* Convert the EM gains and speech prob to linear frequency */
+   batch_compute_psd(st->bank, b->gain2, C);
+   batch_compute_psd(st->bank, b->gain, C);
+   batch_compute_psd(st->bank, b->gain_floor, C);
+
+   /* Ephraim-Malah gain of each bin, kept close to the band gain, then weighted with the speech probability */
+   for (k=0;k<N*C;k+=4)
+   {
+      v4sf prior = vload(b->prior+k);
+      v4sf prior_ratio = vdiv(prior, vadd(prior, one));
+      v4sf theta = vmul(prior_ratio, vadd(one, vload(b->post+k)));
+      v4sf g = vmin(one, vmul(prior_ratio, hypergeom_gain_v4(theta)));
+      v4sf band_gain = vload(b->gain+k);
+      v4sf floor_gain = vload(b->gain_floor+k);
+      v4sf p = vload(b->gain2+k);
+      v4sf tmp;
+
+      g = vselect_gt(vmul(vset1(.333f), g), band_gain, vmul(vset1(3.f), band_gain), g);
+      vstore(b->old_ps+k, vadd(vmul(vset1(.2f), vload(b->old_ps+k)), vmul(vmul(vset1(.8f), vmul(g, g)), vload(b->ps+k))));
+      g = vmax(g, floor_gain);
+      tmp = vadd(vmul(p, vsqrt(g)), vmul(vsub(one, p), vsqrt(floor_gain)));
+      vstore(b->gain2+k, vmul(tmp, tmp));
+   }
+}
+
+#endif /* !FIXED_POINT */
+
+/* Everything between loading the input of every channel and overlap-adding the output */
+static void batch_process_frame(SpeexPreprocessBatch *b, int *vad)
+{
+   int c, v;
+#ifndef FIXED_POINT
+   int i;
+   int N = b->st[0]->ps_size;
+   int M = b->st[0]->nbands;
+   int C = b->stride;
+
+   for (c=0;c<b->channels;c++)
+   {
+      preprocess_begin_frame(b->st[c]);
+      batch_interleave(b->ps+c, b->st[c]->ps, C, N+M);
+      batch_interleave(b->echo_noise+c, b->st[c]->echo_noise, C, N+M);
+   }
+   for (c=b->channels;c<C;c++)
+   {
+      batch_interleave(b->ps+c, b->st[0]->ps, C, N+M);
+      batch_interleave(b->echo_noise+c, b->st[0]->echo_noise, C, N+M);
+   }
+
+   batch_update_noise(b);
+   batch_compute_gain(b);
+
+   for (c=0;c<b->channels;c++)
+   {
+      SpeexPreprocessState *st = b->st[c];
+      batch_deinterleave(st->noise, b->noise+c, C, N);
+      if (st->denoise_enabled)
+         batch_deinterleave(st->gain2, b->gain2+c, C, N);
+      else
+         for (i=0;i<N;i++)
+            st->gain2[i] = Q15_ONE;
+      v = preprocess_synthesis(st, b->Pframe[c]);
+      if (vad)
+         vad[c] = v;
+   }
+#else
+   for (c=0;c<b->channels;c++)
+   {
+      v = preprocess_process_frame(b->st[c]);
+      if (vad)
+         vad[c] = v;
+   }
+#endif
+}
+
+EXPORT SpeexPreprocessBatch *speex_preprocess_batch_init(int channels, int frame_size, int sampling_rate)
+{
+#undef CHECK_ALLOC
+#define CHECK_ALLOC(x) if (!(x)) { speex_preprocess_batch_destroy(b); return NULL; }
+   int c;
+   SpeexPreprocessBatch *b;
+#ifndef FIXED_POINT
+   int k, C, len;
+#endif
+
+   if (channels < 1)
+      return NULL;
+   CHECK_ALLOC(b = speex_alloc(sizeof(SpeexPreprocessBatch)));
+   CHECK_ALLOC(b->st = speex_alloc(channels*sizeof(SpeexPreprocessState *)));
+   b->channels = channels;
+   for (c=0;c<channels;c++)
+      CHECK_ALLOC(b->st[c] = speex_preprocess_state_init(frame_size, sampling_rate));
+
+#ifndef FIXED_POINT
+   C = b->stride = (channels+3)&~3;
+   len = (b->st[0]->ps_size + b->st[0]->nbands)*C;
+   CHECK_ALLOC(b->ps = speex_alloc(len*sizeof(float)));
+   CHECK_ALLOC(b->echo_noise = speex_alloc(len*sizeof(float)));
+   CHECK_ALLOC(b->noise = speex_alloc(len*sizeof(float)));
+   CHECK_ALLOC(b->S = speex_alloc(len*sizeof(float)));
+   CHECK_ALLOC(b->Smin = speex_alloc(len*sizeof(float)));
+   CHECK_ALLOC(b->Stmp = speex_alloc(len*sizeof(float)));
+   CHECK_ALLOC(b->old_ps = speex_alloc(len*sizeof(float)));
+   CHECK_ALLOC(b->zeta = speex_alloc(len*sizeof(float)));
+   CHECK_ALLOC(b->post = speex_alloc(len*sizeof(float)));
+   CHECK_ALLOC(b->prior = speex_alloc(len*sizeof(float)));
+   CHECK_ALLOC(b->gain = speex_alloc(len*sizeof(float)));
+   CHECK_ALLOC(b->gain2 = speex_alloc(len*sizeof(float)));
+   CHECK_ALLOC(b->gain_floor = speex_alloc(len*sizeof(float)));
+   CHECK_ALLOC(b->Pframe = speex_alloc(C*sizeof(float)));
+   CHECK_ALLOC(b->noise_floor = speex_alloc(C*sizeof(float)));
+   CHECK_ALLOC(b->echo_floor = speex_alloc(C*sizeof(float)));
+   /* The same starting point as speex_preprocess_state_init() */
+   for (k=0;k<len;k++)
+   {
+      b->noise[k] = 1;
+      b->old_ps[k] = 1;
+   }
+#endif
+   return b;
+#undef CHECK_ALLOC
+}
+
+EXPORT void speex_preprocess_batch_destroy(SpeexPreprocessBatch *b)
+{
+   int c;
+   if (b)
+   {
+      if (b->st)
+         for (c=0;c<b->channels;c++)
+            speex_preprocess_state_destroy(b->st[c]);
+      speex_free(b->st);
+#ifndef FIXED_POINT
+      speex_free(b->ps);
+      speex_free(b->echo_noise);
+      speex_free(b->noise);
+      speex_free(b->S);
+      speex_free(b->Smin);
+      speex_free(b->Stmp);
+      speex_free(b->old_ps);
+      speex_free(b->zeta);
+      speex_free(b->post);
+      speex_free(b->prior);
+      speex_free(b->gain);
+      speex_free(b->gain2);
+      speex_free(b->gain_floor);
+      speex_free(b->Pframe);
+      speex_free(b->noise_floor);
+      speex_free(b->echo_floor);
+#endif
+      speex_free(b);
+   }
+}
+
+EXPORT SpeexPreprocessState *speex_preprocess_batch_get_state(SpeexPreprocessBatch *b, int channel)
+{
+   if (channel < 0 || channel >= b->channels)
+      return NULL;
+   return b->st[channel];
+}
+
+EXPORT void speex_preprocess_batch_run(SpeexPreprocessBatch *b, spx_int16_t **x, int *vad)
+{
+   int c;
+   for (c=0;c<b->channels;c++)
+      preprocess_load_input(b->st[c], x[c]);
+   batch_process_frame(b, vad);
+   for (c=0;c<b->channels;c++)
+      preprocess_store_output(b->st[c], x[c]);
+}
+
+#ifndef DISABLE_FLOAT_API
+EXPORT void speex_preprocess_batch_run_float(SpeexPreprocessBatch *b, float **x, int *vad)
+{
+   int c;
+   for (c=0;c<b->channels;c++)
+      preprocess_load_input_float(b->st[c], x[c], 1);
+   batch_process_frame(b, vad);
+   for (c=0;c<b->channels;c++)
+      preprocess_store_output_float(b->st[c], x[c], 1);
+}
+#endif
+
 #ifdef FIXED_DEBUG
 long long spx_mips=0;
 #endif
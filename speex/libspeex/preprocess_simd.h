@@ -0,0 +1,277 @@
+/* File: preprocess_simd.h
+   Vector arithmetic for the floating-point preprocessor
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   3. The name of the author may not be used to endorse or promote products
+   derived from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+   IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+   OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+   INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+   STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef PREPROCESS_SIMD_H
+#define PREPROCESS_SIMD_H
+
+/* The preprocessor's per-bin gain computation works on four values at a
+   time: four neighbouring bins of one channel, or in a batch the same bin
+   of four channels. The operations below are SSE2 on x86 and plain C
+   elsewhere, and only exist in floating point.
+
+   vexp() is within 2e-7 (relative) of exp() for arguments between
+   EXP_MIN and EXP_MAX, and clamps the others. hypergeom_gain_v4() is
+   hypergeom_gain() in single precision. testpreprocess checks both. */
+
+#ifndef FIXED_POINT
+
+#include <math.h>
+#include "arch.h"
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PREPROCESS_SSE2
+#include <emmintrin.h>
+#endif
+
+/* Range vexp() is accurate in. e^EXP_MIN is the smallest normal float. */
+#define EXP_MIN -87.33f
+#define EXP_MAX 88.37f
+
+/* ln(2) split in two, so n*EXP_LN2_HI is exact, and the polynomial for e^r - 1 - r */
+#define EXP_LN2_HI .693359375f
+#define EXP_LN2_LO -2.12194440e-4f
+#define EXP_P0 1.9875691500e-4f
+#define EXP_P1 1.3981999507e-3f
+#define EXP_P2 8.3334519073e-3f
+#define EXP_P3 4.1665795894e-2f
+#define EXP_P4 1.6666665459e-1f
+#define EXP_P5 5.0000001201e-1f
+
+/* hypergeom_gain() at 0, .5, 1, ..., 10 */
+static const float hypergeom_table[21] = {
+   0.82157f, 1.02017f, 1.20461f, 1.37534f, 1.53363f, 1.68092f, 1.81865f,
+   1.94811f, 2.07038f, 2.18638f, 2.29688f, 2.40255f, 2.50391f, 2.60144f,
+   2.69551f, 2.78647f, 2.87458f, 2.96015f, 3.04333f, 3.12431f, 3.20326f};
+
+#ifdef PREPROCESS_SSE2
+
+typedef __m128 v4sf;
+
+static inline v4sf vadd(v4sf a, v4sf b) { return _mm_add_ps(a, b); }
+static inline v4sf vsub(v4sf a, v4sf b) { return _mm_sub_ps(a, b); }
+static inline v4sf vmul(v4sf a, v4sf b) { return _mm_mul_ps(a, b); }
+static inline v4sf vdiv(v4sf a, v4sf b) { return _mm_div_ps(a, b); }
+static inline v4sf vmin(v4sf a, v4sf b) { return _mm_min_ps(a, b); }
+static inline v4sf vmax(v4sf a, v4sf b) { return _mm_max_ps(a, b); }
+static inline v4sf vsqrt(v4sf a) { return _mm_sqrt_ps(a); }
+static inline v4sf vset1(float x) { return _mm_set1_ps(x); }
+static inline v4sf vload(const float *p) { return _mm_loadu_ps(p); }
+static inline void vstore(float *p, v4sf v) { _mm_storeu_ps(p, v); }
+
+/* a>b ? x : y, for each channel */
+static inline v4sf vselect_gt(v4sf a, v4sf b, v4sf x, v4sf y)
+{
+   v4sf mask = _mm_cmpgt_ps(a, b);
+   return _mm_or_ps(_mm_and_ps(mask, x), _mm_andnot_ps(mask, y));
+}
+
+/* e^x. x is written as n*ln(2) + r with |r| <= ln(2)/2, e^r comes from Cephes' expf() polynomial and 2^n
+   goes straight into the exponent bits. */
+static inline v4sf vexp(v4sf x)
+{
+   v4sf fx, t, r, y;
+   __m128i n;
+   x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(EXP_MIN)), _mm_set1_ps(EXP_MAX));
+   fx = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(1.44269504f)), _mm_set1_ps(.5f));
+   /* floor(fx): truncate, then take one off where that rounded a negative value up */
+   t = _mm_cvtepi32_ps(_mm_cvttps_epi32(fx));
+   t = _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, fx), _mm_set1_ps(1.f)));
+   n = _mm_cvttps_epi32(t);
+   r = _mm_sub_ps(_mm_sub_ps(x, _mm_mul_ps(t, _mm_set1_ps(EXP_LN2_HI))), _mm_mul_ps(t, _mm_set1_ps(EXP_LN2_LO)));
+   y = _mm_set1_ps(EXP_P0);
+   y = _mm_add_ps(_mm_mul_ps(y, r), _mm_set1_ps(EXP_P1));
+   y = _mm_add_ps(_mm_mul_ps(y, r), _mm_set1_ps(EXP_P2));
+   y = _mm_add_ps(_mm_mul_ps(y, r), _mm_set1_ps(EXP_P3));
+   y = _mm_add_ps(_mm_mul_ps(y, r), _mm_set1_ps(EXP_P4));
+   y = _mm_add_ps(_mm_mul_ps(y, r), _mm_set1_ps(EXP_P5));
+   y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(y, r), r), r), _mm_set1_ps(1.f));
+   return _mm_mul_ps(y, _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23)));
+}
+
+/* hypergeom_gain() of each value */
+static inline v4sf hypergeom_gain_v4(v4sf x)
+{
+   int ind[4];
+   v4sf one = _mm_set1_ps(1.f);
+   v4sf x2 = _mm_add_ps(x, x);
+   /* Clamped so that out of range values still give valid indices */
+   __m128i integer = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(x2, _mm_setzero_ps()), _mm_set1_ps(19.f)));
+   v4sf frac = _mm_sub_ps(x2, _mm_cvtepi32_ps(integer));
+   v4sf lo, hi, interp, large;
+
+   _mm_storeu_si128((__m128i *)ind, integer);
+   lo = _mm_setr_ps(hypergeom_table[ind[0]], hypergeom_table[ind[1]], hypergeom_table[ind[2]], hypergeom_table[ind[3]]);
+   hi = _mm_setr_ps(hypergeom_table[ind[0]+1], hypergeom_table[ind[1]+1], hypergeom_table[ind[2]+1], hypergeom_table[ind[3]+1]);
+   interp = _mm_div_ps(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(one, frac), lo), _mm_mul_ps(frac, hi)),
+                       _mm_sqrt_ps(_mm_add_ps(x, _mm_set1_ps(.0001f))));
+   large = _mm_add_ps(one, _mm_div_ps(_mm_set1_ps(.1296f), x));
+   return vselect_gt(_mm_setzero_ps(), x2, one, vselect_gt(_mm_set1_ps(20.f), x2, interp, large));
+}
+
+#else
+
+typedef struct { float f[4]; } v4sf;
+
+static inline v4sf vadd(v4sf a, v4sf b)
+{
+   int i;
+   for (i=0;i<4;i++)
+      a.f[i] += b.f[i];
+   return a;
+}
+
+static inline v4sf vsub(v4sf a, v4sf b)
+{
+   int i;
+   for (i=0;i<4;i++)
+      a.f[i] -= b.f[i];
+   return a;
+}
+
+static inline v4sf vmul(v4sf a, v4sf b)
+{
+   int i;
+   for (i=0;i<4;i++)
+      a.f[i] *= b.f[i];
+   return a;
+}
+
+static inline v4sf vdiv(v4sf a, v4sf b)
+{
+   int i;
+   for (i=0;i<4;i++)
+      a.f[i] /= b.f[i];
+   return a;
+}
+
+static inline v4sf vmin(v4sf a, v4sf b)
+{
+   int i;
+   for (i=0;i<4;i++)
+      a.f[i] = MIN32(a.f[i], b.f[i]);
+   return a;
+}
+
+static inline v4sf vmax(v4sf a, v4sf b)
+{
+   int i;
+   for (i=0;i<4;i++)
+      a.f[i] = MAX32(a.f[i], b.f[i]);
+   return a;
+}
+
+static inline v4sf vsqrt(v4sf a)
+{
+   int i;
+   for (i=0;i<4;i++)
+      a.f[i] = sqrt(a.f[i]);
+   return a;
+}
+
+static inline v4sf vset1(float x)
+{
+   v4sf v;
+   v.f[0] = v.f[1] = v.f[2] = v.f[3] = x;
+   return v;
+}
+
+static inline v4sf vload(const float *p)
+{
+   v4sf v;
+   v.f[0] = p[0]; v.f[1] = p[1]; v.f[2] = p[2]; v.f[3] = p[3];
+   return v;
+}
+
+static inline void vstore(float *p, v4sf v)
+{
+   p[0] = v.f[0]; p[1] = v.f[1]; p[2] = v.f[2]; p[3] = v.f[3];
+}
+
+static inline v4sf vselect_gt(v4sf a, v4sf b, v4sf x, v4sf y)
+{
+   int i;
+   for (i=0;i<4;i++)
+      x.f[i] = a.f[i] > b.f[i] ? x.f[i] : y.f[i];
+   return x;
+}
+
+static inline v4sf vexp(v4sf x)
+{
+   int i;
+   for (i=0;i<4;i++)
+   {
+      float xi = MIN32(MAX32(x.f[i], EXP_MIN), EXP_MAX);
+      float t = floor(xi*1.44269504f + .5f);
+      float r = xi - t*EXP_LN2_HI - t*EXP_LN2_LO;
+      float y = EXP_P0;
+      y = y*r + EXP_P1;
+      y = y*r + EXP_P2;
+      y = y*r + EXP_P3;
+      y = y*r + EXP_P4;
+      y = y*r + EXP_P5;
+      x.f[i] = ldexp(y*r*r + r + 1.f, (int)t);
+   }
+   return x;
+}
+
+static inline v4sf hypergeom_gain_v4(v4sf x)
+{
+   int i;
+   for (i=0;i<4;i++)
+   {
+      float x2 = x.f[i] + x.f[i];
+      int ind = (int)MIN32(MAX32(x2, 0.f), 19.f);
+      float frac = x2 - ind;
+      if (!(x2 < 20.f))
+         x.f[i] = 1.f + .1296f/x.f[i];
+      else if (x2 < 0.f)
+         x.f[i] = 1.f;
+      else
+         x.f[i] = ((1.f-frac)*hypergeom_table[ind] + frac*hypergeom_table[ind+1])/(float)sqrt(x.f[i] + .0001f);
+   }
+   return x;
+}
+
+#endif
+
+/* qcurve() of each value */
+static inline v4sf qcurve_v4(v4sf x)
+{
+   v4sf one = vset1(1.f);
+   return vdiv(one, vadd(one, vdiv(vset1(.15f), x)));
+}
+
+/** Makes the preprocessor compute its gains with the scalar code (0) or with the vector operations above
+    (1, the default). For tests and benchmarks; it isn't thread safe. */
+void preprocess_simd_enable(int enabled);
+
+#endif /* !FIXED_POINT */
+
+#endif
@@ -0,0 +1,764 @@
+/* File: realfft.c
+   Mixed-radix real FFT with SSE butterflies
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   3. The name of the author may not be used to endorse or promote products
+   derived from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+   IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+   OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+   INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+   STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+   A real transform of N values is done as a complex one of N/2 values
+   (the even samples as real parts, the odd ones as imaginary parts)
+   followed by a pass that splits the result into the real spectrum, or
+   the other way around for the inverse.
+
+   The complex FFT is a Stockham autosort one: every pass reads one buffer
+   and writes the other, so there's no bit reversal and the output comes
+   out in order. The preprocessor and echo canceller use 2*frame_size
+   points, which is rarely a power of two (960 for 10 ms at 48 kHz), so
+   there are radix 2, 3, 4 and 5 passes, and a slower generic one for other
+   small primes. Sizes with a prime factor above RFFT_MAX_RADIX are handed
+   to smallft.
+
+   Every pass works on two complex values at once, written against the
+   few v4sf operations below, which are SSE2 on x86 and plain C elsewhere.
+   Which two depends on the pass: neighbouring columns when the stride is
+   even, so loads and stores are contiguous, or neighbouring butterflies
+   when it isn't.
+
+   The forward transform's 1/N scaling is part of the split pass's
+   twiddles, so unlike smallft there is no separate scaling pass, and
+   in-place transforms need no copy either. Plans never change once made
+   and are shared by everyone asking for the same size.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include "realfft.h"
+#include "smallft.h"
+#include "os_support.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RFFT_SSE2
+#include <emmintrin.h>
+#endif
+
+/* Number of passes a plan can have. log2 of any size that fits in memory. */
+#define RFFT_MAX_STAGES 32
+/* Largest prime factor the generic pass handles */
+#define RFFT_MAX_RADIX 31
+/* Transforms up to this many values keep their scratch buffer on the stack */
+#define RFFT_STACK_SIZE 4096
+
+
+/* Two complex values, interleaved */
+#ifdef RFFT_SSE2
+
+typedef __m128 v4sf;
+
+static inline v4sf vadd(v4sf a, v4sf b) { return _mm_add_ps(a, b); }
+static inline v4sf vsub(v4sf a, v4sf b) { return _mm_sub_ps(a, b); }
+static inline v4sf vmul(v4sf a, v4sf b) { return _mm_mul_ps(a, b); }
+static inline v4sf vset1(float x) { return _mm_set1_ps(x); }
+static inline v4sf vload(const float *p) { return _mm_loadu_ps(p); }
+static inline void vstore(float *p, v4sf v) { _mm_storeu_ps(p, v); }
+
+/* One complex value from each address. In most passes they're next to each other. */
+static inline v4sf vload2(const float *lo, const float *hi)
+{
+   if (hi == lo+2)
+      return _mm_loadu_ps(lo);
+   return _mm_castpd_ps(_mm_loadh_pd(_mm_load_sd((const double *)lo), (const double *)hi));
+}
+
+static inline void vstore2(float *lo, float *hi, v4sf v)
+{
+   if (hi == lo+2)
+   {
+      _mm_storeu_ps(lo, v);
+      return;
+   }
+   _mm_storel_pi((__m64 *)lo, v);
+   _mm_storeh_pi((__m64 *)hi, v);
+}
+
+/* -i times each value */
+static inline v4sf vmul_mi(v4sf a)
+{
+   return _mm_xor_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2,3,0,1)), _mm_set_ps(-0.f, 0.f, -0.f, 0.f));
+}
+
+static inline v4sf vconj(v4sf a)
+{
+   return _mm_xor_ps(a, _mm_set_ps(-0.f, 0.f, -0.f, 0.f));
+}
+
+/* The two values the other way round */
+static inline v4sf vswap(v4sf a)
+{
+   return _mm_shuffle_ps(a, a, _MM_SHUFFLE(1,0,3,2));
+}
+
+static inline v4sf vcmul(v4sf a, v4sf w)
+{
+   v4sf wr = _mm_shuffle_ps(w, w, _MM_SHUFFLE(2,2,0,0));
+   v4sf wi = _mm_shuffle_ps(w, w, _MM_SHUFFLE(3,3,1,1));
+   v4sf as = _mm_shuffle_ps(a, a, _MM_SHUFFLE(2,3,0,1));
+   return _mm_add_ps(_mm_mul_ps(a, wr), _mm_xor_ps(_mm_mul_ps(as, wi), _mm_set_ps(0.f, -0.f, 0.f, -0.f)));
+}
+
+#else
+
+typedef struct { float f[4]; } v4sf;
+
+static inline v4sf vadd(v4sf a, v4sf b)
+{
+   int i;
+   for (i=0;i<4;i++)
+      a.f[i] += b.f[i];
+   return a;
+}
+
+static inline v4sf vsub(v4sf a, v4sf b)
+{
+   int i;
+   for (i=0;i<4;i++)
+      a.f[i] -= b.f[i];
+   return a;
+}
+
+static inline v4sf vmul(v4sf a, v4sf b)
+{
+   int i;
+   for (i=0;i<4;i++)
+      a.f[i] *= b.f[i];
+   return a;
+}
+
+static inline v4sf vset1(float x)
+{
+   v4sf v;
+   v.f[0] = v.f[1] = v.f[2] = v.f[3] = x;
+   return v;
+}
+
+static inline v4sf vload(const float *p)
+{
+   v4sf v;
+   v.f[0] = p[0]; v.f[1] = p[1]; v.f[2] = p[2]; v.f[3] = p[3];
+   return v;
+}
+
+static inline void vstore(float *p, v4sf v)
+{
+   p[0] = v.f[0]; p[1] = v.f[1]; p[2] = v.f[2]; p[3] = v.f[3];
+}
+
+static inline v4sf vload2(const float *lo, const float *hi)
+{
+   v4sf v;
+   v.f[0] = lo[0]; v.f[1] = lo[1]; v.f[2] = hi[0]; v.f[3] = hi[1];
+   return v;
+}
+
+static inline void vstore2(float *lo, float *hi, v4sf v)
+{
+   lo[0] = v.f[0]; lo[1] = v.f[1]; hi[0] = v.f[2]; hi[1] = v.f[3];
+}
+
+static inline v4sf vmul_mi(v4sf a)
+{
+   v4sf v;
+   v.f[0] = a.f[1]; v.f[1] = -a.f[0]; v.f[2] = a.f[3]; v.f[3] = -a.f[2];
+   return v;
+}
+
+static inline v4sf vconj(v4sf a)
+{
+   a.f[1] = -a.f[1];
+   a.f[3] = -a.f[3];
+   return a;
+}
+
+static inline v4sf vswap(v4sf a)
+{
+   v4sf v;
+   v.f[0] = a.f[2]; v.f[1] = a.f[3]; v.f[2] = a.f[0]; v.f[3] = a.f[1];
+   return v;
+}
+
+static inline v4sf vcmul(v4sf a, v4sf w)
+{
+   v4sf v;
+   v.f[0] = a.f[0]*w.f[0] - a.f[1]*w.f[1];
+   v.f[1] = a.f[1]*w.f[0] + a.f[0]*w.f[1];
+   v.f[2] = a.f[2]*w.f[2] - a.f[3]*w.f[3];
+   v.f[3] = a.f[3]*w.f[2] + a.f[2]*w.f[3];
+   return v;
+}
+
+#endif
+
+
+/* One pass of the complex FFT: n = p*m*s values are read as s interleaved sequences of
+   length p*m. For each butterfly j < m and column q < s, the p values
+   x[q + s*(j + r*m)] go through a length p DFT, and output k is multiplied by w^(j*k)
+   (w the (p*m)-th root of unity) and written to y[q + s*(p*j + k)]. */
+typedef struct {
+   int p;
+   int m;
+   int s;
+   /* w^(j*k) at [(k-1)*m + j], forward then inverse */
+   float *tw[2];
+   /* Generic passes only: cos and sin tables, see bfly_generic() */
+   float *rot[2];
+} rfft_stage;
+
+struct spx_rfft_plan {
+   int N;
+   /* Length of the complex FFT, N/2 */
+   int n;
+   int nstages;
+   rfft_stage stages[RFFT_MAX_STAGES];
+   /* Split pass twiddles for 0 < k < n: forward A and B (with the 1/N scaling), then inverse C and D */
+   float *split[4];
+   float *mem;
+   /* Sizes this doesn't handle */
+   struct drft_lookup *fallback;
+   int refs;
+   spx_rfft_plan *next;
+};
+
+/* The butterflies: each takes the p values of one column in a[] and leaves the DFT of them
+   there, before the twiddles. They share rfft_pass()'s signature, though only the generic
+   one needs the stage. */
+static inline void bfly2(v4sf *a, const rfft_stage *st, int inv)
+{
+   v4sf a0 = a[0];
+   (void)st;
+   (void)inv;
+   a[0] = vadd(a0, a[1]);
+   a[1] = vsub(a0, a[1]);
+}
+
+static inline void bfly3(v4sf *a, const rfft_stage *st, int inv)
+{
+   const v4sf half = vset1(-.5f);
+   const v4sf sin60 = vset1(inv ? -.86602540378443865f : .86602540378443865f);
+   v4sf s12 = vadd(a[1], a[2]);
+   v4sf c = vadd(a[0], vmul(s12, half));
+   v4sf d = vmul_mi(vmul(vsub(a[1], a[2]), sin60));
+   (void)st;
+   a[0] = vadd(a[0], s12);
+   a[1] = vadd(c, d);
+   a[2] = vsub(c, d);
+}
+
+static inline void bfly4(v4sf *a, const rfft_stage *st, int inv)
+{
+   const v4sf dir = vset1(inv ? -1.f : 1.f);
+   v4sf s02 = vadd(a[0], a[2]);
+   v4sf d02 = vsub(a[0], a[2]);
+   v4sf s13 = vadd(a[1], a[3]);
+   v4sf d13 = vmul_mi(vmul(vsub(a[1], a[3]), dir));
+   (void)st;
+   a[0] = vadd(s02, s13);
+   a[1] = vadd(d02, d13);
+   a[2] = vsub(s02, s13);
+   a[3] = vsub(d02, d13);
+}
+
+static inline void bfly5(v4sf *a, const rfft_stage *st, int inv)
+{
+   const float sgn = inv ? -1.f : 1.f;
+   const v4sf c1 = vset1(.30901699437494742f), c2 = vset1(-.80901699437494742f);
+   const v4sf s1 = vset1(sgn*.95105651629515357f), s2 = vset1(sgn*.58778525229247313f);
+   v4sf s14 = vadd(a[1], a[4]);
+   v4sf d14 = vsub(a[1], a[4]);
+   v4sf s23 = vadd(a[2], a[3]);
+   v4sf d23 = vsub(a[2], a[3]);
+   v4sf e1 = vadd(a[0], vadd(vmul(s14, c1), vmul(s23, c2)));
+   v4sf e2 = vadd(a[0], vadd(vmul(s14, c2), vmul(s23, c1)));
+   v4sf f1 = vmul_mi(vadd(vmul(d14, s1), vmul(d23, s2)));
+   v4sf f2 = vmul_mi(vsub(vmul(d14, s2), vmul(d23, s1)));
+   (void)st;
+   a[0] = vadd(a[0], vadd(s14, s23));
+   a[1] = vadd(e1, f1);
+   a[2] = vadd(e2, f2);
+   a[3] = vsub(e2, f2);
+   a[4] = vsub(e1, f1);
+}
+
+/* Any other odd prime, pairing up inputs r and p-r like bfly3() and bfly5() do. rot[0]
+   and rot[1] hold cos and sin of 2*pi*r*k/p at [(k-1)*h + r-1], for r, k <= h. */
+static inline void bfly_generic(v4sf *a, const rfft_stage *st, int inv)
+{
+   const int p = st->p, h = (p-1)/2;
+   const float *c = st->rot[0], *sn = st->rot[1];
+   const v4sf dir = vset1(inv ? -1.f : 1.f);
+   v4sf sum[RFFT_MAX_RADIX/2], dif[RFFT_MAX_RADIX/2];
+   v4sf a0 = a[0];
+   int r, k;
+   for (r=1;r<=h;r++)
+   {
+      sum[r-1] = vadd(a[r], a[p-r]);
+      dif[r-1] = vmul(vsub(a[r], a[p-r]), dir);
+      a[0] = vadd(a[0], sum[r-1]);
+   }
+   for (k=1;k<=h;k++)
+   {
+      v4sf e = a0, f = vset1(0);
+      for (r=0;r<h;r++)
+      {
+         e = vadd(e, vmul(sum[r], vset1(c[(k-1)*h+r])));
+         f = vadd(f, vmul(dif[r], vset1(sn[(k-1)*h+r])));
+      }
+      f = vmul_mi(f);
+      a[k] = vadd(e, f);
+      a[p-k] = vsub(e, f);
+   }
+}
+
+/* Runs one pass with the given butterfly. When the stride is even, each vector holds two
+   neighbouring columns of one butterfly, so loads and stores are contiguous and both share
+   the twiddles. Otherwise it holds the same column of two neighbouring butterflies, the
+   last one twice if m is odd. */
+static inline void rfft_pass(const rfft_stage *st, const float *x, float *y, int inv, int p,
+                             void (*bfly)(v4sf *, const rfft_stage *, int))
+{
+   const float *tw = st->tw[inv];
+   const int m = st->m, s = st->s, m2 = 2*m, rs = 2*s*m, ks = 2*s;
+   v4sf a[RFFT_MAX_RADIX], w[RFFT_MAX_RADIX];
+   int j, q, r;
+   if (!(s & 1))
+   {
+      for (j=0;j<m;j++)
+      {
+         const float *xj = x + 2*s*j;
+         float *yj = y + 2*s*p*j;
+         for (r=1;r<p;r++)
+            w[r] = vload2(tw+2*j+(r-1)*m2, tw+2*j+(r-1)*m2);
+         for (q=0;q<2*s;q+=4)
+         {
+            for (r=0;r<p;r++)
+               a[r] = vload(xj+q+r*rs);
+            bfly(a, st, inv);
+            vstore(yj+q, a[0]);
+            for (r=1;r<p;r++)
+               vstore(yj+q+r*ks, vcmul(a[r], w[r]));
+         }
+      }
+   } else {
+      for (q=0;q<s;q++)
+      {
+         for (j=0;j<m;j+=2)
+         {
+            const int j1 = j+1 < m ? j+1 : j;
+            const float *x0 = x + 2*(q + s*j), *x1 = x + 2*(q + s*j1);
+            float *y0 = y + 2*(q + s*p*j), *y1 = y + 2*(q + s*p*j1);
+            for (r=0;r<p;r++)
+               a[r] = vload2(x0+r*rs, x1+r*rs);
+            bfly(a, st, inv);
+            vstore2(y0, y1, a[0]);
+            for (r=1;r<p;r++)
+               vstore2(y0+r*ks, y1+r*ks, vcmul(a[r], vload2(tw+2*j+(r-1)*m2, tw+2*j1+(r-1)*m2)));
+         }
+      }
+   }
+}
+
+/* With the radix known at compile time, so the butterflies get inlined and unrolled */
+static void pass2(const rfft_stage *st, const float *x, float *y, int inv) { rfft_pass(st, x, y, inv, 2, bfly2); }
+static void pass3(const rfft_stage *st, const float *x, float *y, int inv) { rfft_pass(st, x, y, inv, 3, bfly3); }
+static void pass4(const rfft_stage *st, const float *x, float *y, int inv) { rfft_pass(st, x, y, inv, 4, bfly4); }
+static void pass5(const rfft_stage *st, const float *x, float *y, int inv) { rfft_pass(st, x, y, inv, 5, bfly5); }
+static void pass_generic(const rfft_stage *st, const float *x, float *y, int inv)
+{
+   rfft_pass(st, x, y, inv, st->p, bfly_generic);
+}
+
+/* Runs all the passes, alternating between a and b. Returns the one holding the result. */
+static const float *rfft_complex(const spx_rfft_plan *plan, const float *in, float *a, float *b, int inv)
+{
+   int i;
+   for (i=0;i<plan->nstages;i++)
+   {
+      const rfft_stage *st = &plan->stages[i];
+      float *out = i&1 ? b : a;
+      switch (st->p)
+      {
+         case 2: pass2(st, in, out, inv); break;
+         case 3: pass3(st, in, out, inv); break;
+         case 4: pass4(st, in, out, inv); break;
+         case 5: pass5(st, in, out, inv); break;
+         default: pass_generic(st, in, out, inv); break;
+      }
+      in = out;
+   }
+   return in;
+}
+
+/* Complex spectrum Z of the even/odd samples to the real spectrum X:
+   X[k] = A[k]*Z[k] + B[k]*conj(Z[n-k]). z and out can't be the same buffer. */
+static void rfft_split(const spx_rfft_plan *plan, const float *z, float *out)
+{
+   const int n = plan->n;
+   const float *A = plan->split[0], *B = plan->split[1];
+   const float scale = 1.f/plan->N;
+   int k;
+   for (k=1;k+1<n;k+=2)
+   {
+      v4sf zk = vload(z+2*k);
+      v4sf zn = vconj(vswap(vload(z+2*(n-k-1))));
+      vstore(out+2*k-1, vadd(vcmul(zk, vload(A+2*k)), vcmul(zn, vload(B+2*k))));
+   }
+   if (k < n)
+   {
+      v4sf zk = vload2(z+2*k, z+2*k);
+      v4sf zn = vconj(vload2(z+2*(n-k), z+2*(n-k)));
+      v4sf X = vadd(vcmul(zk, vload2(A+2*k, A+2*k)), vcmul(zn, vload2(B+2*k, B+2*k)));
+      vstore2(out+2*k-1, out+2*k-1, X);
+   }
+   out[0] = (z[0] + z[1])*scale;
+   out[2*n-1] = (z[0] - z[1])*scale;
+}
+
+/* The reverse: Z[k] = C[k]*X[k] + D[k]*conj(X[n-k]), which is twice the spectrum of the
+   even/odd samples. in and z can't be the same buffer. */
+static void rfft_merge(const spx_rfft_plan *plan, const float *in, float *z)
+{
+   const int n = plan->n;
+   const float *C = plan->split[2], *D = plan->split[3];
+   int k;
+   for (k=1;k+1<n;k+=2)
+   {
+      v4sf xk = vload(in+2*k-1);
+      v4sf xn = vconj(vswap(vload(in+2*(n-k-1)-1)));
+      vstore(z+2*k, vadd(vcmul(xk, vload(C+2*k)), vcmul(xn, vload(D+2*k))));
+   }
+   if (k < n)
+   {
+      v4sf xk = vload2(in+2*k-1, in+2*k-1);
+      v4sf xn = vconj(vload2(in+2*(n-k)-1, in+2*(n-k)-1));
+      v4sf Z = vadd(vcmul(xk, vload2(C+2*k, C+2*k)), vcmul(xn, vload2(D+2*k, D+2*k)));
+      vstore2(z+2*k, z+2*k, Z);
+   }
+   z[0] = in[0] + in[2*n-1];
+   z[1] = in[0] - in[2*n-1];
+}
+
+void spx_rfft_forward(const spx_rfft_plan *plan, const float *in, float *out)
+{
+   float stack_tmp[RFFT_STACK_SIZE];
+   float *tmp, *a, *b;
+   const float *z;
+
+   if (plan->fallback)
+   {
+      int i;
+      float scale = 1.f/plan->N;
+      for (i=0;i<plan->N;i++)
+         out[i] = scale*in[i];
+      spx_drft_forward(plan->fallback, out);
+      return;
+   }
+
+   tmp = plan->N <= RFFT_STACK_SIZE ? stack_tmp : speex_alloc(plan->N*sizeof(float));
+   /* The passes alternate between out and tmp, starting with whichever has the last one
+      writing to tmp so the split can go straight to out. When in and out are the same
+      that isn't always possible, and the result gets copied. */
+   if ((plan->nstages & 1) || in == out)
+   {
+      a = tmp;
+      b = out;
+   } else {
+      a = out;
+      b = tmp;
+   }
+   z = rfft_complex(plan, in, a, b, 0);
+   if (z == out)
+   {
+      rfft_split(plan, z, tmp);
+      SPEEX_COPY(out, tmp, plan->N);
+   } else {
+      rfft_split(plan, z, out);
+   }
+   if (tmp != stack_tmp)
+      speex_free(tmp);
+}
+
+void spx_rfft_backward(const spx_rfft_plan *plan, const float *in, float *out)
+{
+   float stack_tmp[RFFT_STACK_SIZE];
+   float *tmp, *z;
+   const float *x;
+
+   if (plan->fallback)
+   {
+      if (in != out)
+         SPEEX_COPY(out, in, plan->N);
+      spx_drft_backward(plan->fallback, out);
+      return;
+   }
+
+   tmp = plan->N <= RFFT_STACK_SIZE ? stack_tmp : speex_alloc(plan->N*sizeof(float));
+   /* Merge into whichever buffer has the last pass writing to out */
+   if ((plan->nstages & 1) || in == out)
+      z = tmp;
+   else
+      z = out;
+   rfft_merge(plan, in, z);
+   x = rfft_complex(plan, z, z == tmp ? out : tmp, z, 1);
+   if (x != out)
+      SPEEX_COPY(out, x, plan->N);
+   if (tmp != stack_tmp)
+      speex_free(tmp);
+}
+
+
+/* Finds the passes for a complex FFT of n values. Fours first, so every pass after the
+   first has an even stride. Returns 0 for a factor bigger than RFFT_MAX_RADIX. */
+static int rfft_factor(int n, int *radix, int *count)
+{
+   int p = 4;
+   *count = 0;
+   while (n > 1)
+   {
+      while (n % p)
+      {
+         if (p == 4)
+            p = 2;
+         else if (p == 2)
+            p = 3;
+         else
+            p += 2;
+         if (p > RFFT_MAX_RADIX)
+            return 0;
+      }
+      radix[(*count)++] = p;
+      n /= p;
+   }
+   return 1;
+}
+
+static spx_rfft_plan *rfft_make_plan(int N)
+{
+   int radix[RFFT_MAX_STAGES];
+   int i, j, k, L, s, size;
+   spx_rfft_plan *plan;
+   float *mem;
+
+   plan = speex_alloc(sizeof(spx_rfft_plan));
+   if (!plan)
+      return NULL;
+   plan->N = N;
+   plan->n = N/2;
+   plan->refs = 1;
+
+   if (!rfft_factor(plan->n, radix, &plan->nstages))
+   {
+      plan->nstages = 0;
+      plan->fallback = speex_alloc(sizeof(struct drft_lookup));
+      if (!plan->fallback)
+      {
+         speex_free(plan);
+         return NULL;
+      }
+      spx_drft_init(plan->fallback, N);
+      if (!(plan->fallback->trigcache && plan->fallback->splitcache))
+      {
+         spx_drft_clear(plan->fallback);
+         speex_free(plan->fallback);
+         speex_free(plan);
+         return NULL;
+      }
+      return plan;
+   }
+
+   /* Each pass has (p-1)*m twiddles each way, generic ones their cos and sin tables, and
+      the split has four tables of n */
+   size = 8*plan->n;
+   L = plan->n;
+   for (i=0;i<plan->nstages;i++)
+   {
+      size += 4*(radix[i]-1)*(L/radix[i]) + radix[i]*radix[i];
+      L /= radix[i];
+   }
+   mem = plan->mem = speex_alloc(size*sizeof(float));
+   if (!mem)
+   {
+      speex_free(plan);
+      return NULL;
+   }
+
+   L = plan->n;
+   s = 1;
+   for (i=0;i<plan->nstages;i++)
+   {
+      rfft_stage *st = &plan->stages[i];
+      st->p = radix[i];
+      st->m = L/st->p;
+      st->s = s;
+      st->tw[0] = mem;
+      st->tw[1] = mem + 2*(st->p-1)*st->m;
+      mem += 4*(st->p-1)*st->m;
+      for (k=1;k<st->p;k++)
+      {
+         for (j=0;j<st->m;j++)
+         {
+            double phase = -2*M_PI*j*k/L;
+            int t = 2*((k-1)*st->m + j);
+            st->tw[0][t] = st->tw[1][t] = (float)cos(phase);
+            st->tw[0][t+1] = (float)sin(phase);
+            st->tw[1][t+1] = -st->tw[0][t+1];
+         }
+      }
+      if (st->p > 5)
+      {
+         int h = (st->p-1)/2, r;
+         st->rot[0] = mem;
+         st->rot[1] = mem + h*h;
+         mem += 2*h*h;
+         for (k=1;k<=h;k++)
+         {
+            for (r=1;r<=h;r++)
+            {
+               double phase = 2*M_PI*r*k/st->p;
+               st->rot[0][(k-1)*h + r-1] = (float)cos(phase);
+               st->rot[1][(k-1)*h + r-1] = (float)sin(phase);
+            }
+         }
+      }
+      s *= st->p;
+      L = st->m;
+   }
+
+   for (i=0;i<4;i++)
+   {
+      plan->split[i] = mem;
+      mem += 2*plan->n;
+   }
+   for (k=0;k<plan->n;k++)
+   {
+      double phase = 2*M_PI*k/N;
+      float c = (float)cos(phase), sn = (float)sin(phase), scale = .5f/N;
+      plan->split[0][2*k] = (1 - sn)*scale;
+      plan->split[0][2*k+1] = -c*scale;
+      plan->split[1][2*k] = (1 + sn)*scale;
+      plan->split[1][2*k+1] = c*scale;
+      plan->split[2][2*k] = 1 - sn;
+      plan->split[2][2*k+1] = c;
+      plan->split[3][2*k] = 1 + sn;
+      plan->split[3][2*k+1] = -c;
+   }
+   return plan;
+}
+
+static void rfft_destroy_plan(spx_rfft_plan *plan)
+{
+   if (plan->fallback)
+   {
+      spx_drft_clear(plan->fallback);
+      speex_free(plan->fallback);
+   }
+   speex_free(plan->mem);
+   speex_free(plan);
+}
+
+
+/* Plans in use. They're only looked up when a preprocessor or echo canceller is created or
+   destroyed, so a spin lock is plenty. Compilers without atomics just don't share. */
+#if defined(_MSC_VER)
+#include <intrin.h>
+static volatile long rfft_lock;
+#define RFFT_LOCK() while (_InterlockedExchange(&rfft_lock, 1)) {}
+#define RFFT_UNLOCK() _InterlockedExchange(&rfft_lock, 0)
+#define RFFT_SHARE_PLANS
+#elif defined(__GNUC__)
+static volatile int rfft_lock;
+#define RFFT_LOCK() while (__sync_lock_test_and_set(&rfft_lock, 1)) {}
+#define RFFT_UNLOCK() __sync_lock_release(&rfft_lock)
+#define RFFT_SHARE_PLANS
+#endif
+
+#ifdef RFFT_SHARE_PLANS
+static spx_rfft_plan *rfft_plans;
+#endif
+
+spx_rfft_plan *spx_rfft_alloc(int N)
+{
+   spx_rfft_plan *plan;
+   if (N <= 0 || N & 1)
+      return NULL;
+#ifdef RFFT_SHARE_PLANS
+   RFFT_LOCK();
+   for (plan=rfft_plans;plan;plan=plan->next)
+   {
+      if (plan->N == N)
+      {
+         plan->refs++;
+         break;
+      }
+   }
+   if (!plan)
+   {
+      plan = rfft_make_plan(N);
+      if (plan)
+      {
+         plan->next = rfft_plans;
+         rfft_plans = plan;
+      }
+   }
+   RFFT_UNLOCK();
+#else
+   plan = rfft_make_plan(N);
+#endif
+   return plan;
+}
+
+void spx_rfft_free(spx_rfft_plan *plan)
+{
+#ifdef RFFT_SHARE_PLANS
+   spx_rfft_plan **link;
+   RFFT_LOCK();
+   if (--plan->refs > 0)
+   {
+      RFFT_UNLOCK();
+      return;
+   }
+   for (link=&rfft_plans;*link!=plan;link=&(*link)->next)
+      ;
+   *link = plan->next;
+   RFFT_UNLOCK();
+#endif
+   rfft_destroy_plan(plan);
+}
@@ -0,0 +1,52 @@
+/* File: realfft.h
+   Mixed-radix real FFT with SSE butterflies
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are
+   met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+   this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   3. The name of the author may not be used to endorse or promote products
+   derived from this software without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+   IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+   OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+   DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+   INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+   (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+   SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+   HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+   STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+   ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef REALFFT_H
+#define REALFFT_H
+
+/** Precomputed tables for one transform size. Plans never change once made, so one plan
+    serves any number of users, on any thread. */
+typedef struct spx_rfft_plan spx_rfft_plan;
+
+/** Plan for real transforms of N (even) values. Asking for a size that already has a plan
+    returns that plan instead of making another. Returns NULL if N is odd or memory runs out. */
+spx_rfft_plan *spx_rfft_alloc(int N);
+
+/** Drops one reference to a plan, freeing it when the last user is done with it */
+void spx_rfft_free(spx_rfft_plan *plan);
+
+/** Forward transform of N real values into the half-complex layout smallft uses
+    (r0, r1, i1, r2, i2, ..., r(N/2)), scaled by 1/N. in and out may be the same buffer. */
+void spx_rfft_forward(const spx_rfft_plan *plan, const float *in, float *out);
+
+/** Inverse of spx_rfft_forward(), unscaled. in and out may be the same buffer. */
+void spx_rfft_backward(const spx_rfft_plan *plan, const float *in, float *out);
+
+#endif
@@ -106,8 +106,24 @@ static void speex_free (void *ptr) {free(ptr);}
 #define FIXED_STACK_ALLOC 1024
 #endif
 
+/* Direct sinc tables up to this many coefficients are used even when the interpolated
+   table would be smaller, so common rational ratios like 44.1 kHz to 48 kHz (147/160) get
+   an exact filter for each phase */
+#define MAX_DIRECT_TABLE 16384
+
 typedef int (*resampler_basic_func)(SpeexResamplerState *, spx_uint32_t , const spx_word16_t *, spx_uint32_t *, spx_word16_t *, spx_uint32_t *);
 
+#ifndef FIXED_POINT
+typedef void (*inner_product_stereo_func)(const float *, const float *, const float *, unsigned int, float *, float *);
+
+/* Where the interleaved path goes from each phase of a direct sinc table: the next phase,
+   and how many input samples it moves on */
+struct PhaseStep {
+   spx_uint32_t next;
+   spx_uint32_t advance;
+};
+#endif
+
 struct SpeexResamplerState_ {
    spx_uint32_t in_rate;
    spx_uint32_t out_rate;
@@ -135,6 +151,10 @@ struct SpeexResamplerState_ {
    spx_word16_t *sinc_table;
    spx_uint32_t sinc_table_length;
    resampler_basic_func resampler_ptr;
+#ifndef FIXED_POINT
+   struct PhaseStep *phase_step;
+   inner_product_stereo_func inner_product_stereo;
+#endif
          
    int    in_stride;
    int    out_stride;
@@ -547,6 +567,79 @@ static int resampler_basic_interpolate_double(SpeexResamplerState *st, spx_uint3
 }
 #endif
 
+#ifndef FIXED_POINT
+#ifndef OVERRIDE_INNER_PRODUCT_STEREO
+/* Sums in the same order as resampler_basic_direct_single() */
+static void inner_product_stereo_c(const float *a, const float *b0, const float *b1, unsigned int len, float *sum0, float *sum1)
+{
+   float accum0[4] = {0,0,0,0};
+   float accum1[4] = {0,0,0,0};
+   unsigned int j, k;
+   for (j=0;j<len;j+=4)
+   {
+      for (k=0;k<4;k++)
+      {
+         accum0[k] += a[j+k]*b0[j+k];
+         accum1[k] += a[j+k]*b1[j+k];
+      }
+   }
+   *sum0 = accum0[0] + accum0[1] + accum0[2] + accum0[3];
+   *sum1 = accum1[0] + accum1[1] + accum1[2] + accum1[3];
+}
+#endif
+
+static inner_product_stereo_func pick_inner_product_stereo(void)
+{
+#ifdef OVERRIDE_INNER_PRODUCT_STEREO
+#ifdef RESAMPLE_FMA
+   if (cpu_has_fma())
+      return inner_product_stereo_fma;
+#endif
+   return inner_product_stereo_sse;
+#else
+   return inner_product_stereo_c;
+#endif
+}
+
+/* The direct-table resampler for all channels at once. Every channel is at the same
+   position, so each output frame looks up its phase once and runs the filter over the
+   channels' memories two at a time. Output is interleaved. */
+static int resampler_direct_interleaved(SpeexResamplerState *st, spx_uint32_t in_len, float *out, spx_uint32_t out_len)
+{
+   const int N = st->filt_len;
+   const int C = st->nb_channels;
+   const spx_uint32_t mem_size = st->mem_alloc_size;
+   const struct PhaseStep *phase_step = st->phase_step;
+   const spx_word16_t *sinc_table = st->sinc_table;
+   spx_int32_t last_sample = st->last_sample[0];
+   spx_uint32_t samp_frac_num = st->samp_frac_num[0];
+   spx_uint32_t out_sample = 0;
+   float unused;
+   int c;
+
+   while (last_sample < (spx_int32_t)in_len && out_sample < out_len)
+   {
+      const spx_word16_t *sinc = &sinc_table[samp_frac_num*N];
+      const spx_word16_t *x = st->mem + last_sample;
+      for (c=0;c+1<C;c+=2,x+=2*mem_size)
+         st->inner_product_stereo(sinc, x, x+mem_size, N, &out[c], &out[c+1]);
+      if (c<C)
+         st->inner_product_stereo(sinc, x, x, N, &out[c], &unused);
+      out += C;
+      out_sample++;
+      last_sample += phase_step[samp_frac_num].advance;
+      samp_frac_num = phase_step[samp_frac_num].next;
+   }
+
+   for (c=0;c<C;c++)
+   {
+      st->last_sample[c] = last_sample;
+      st->samp_frac_num[c] = samp_frac_num;
+   }
+   return out_sample;
+}
+#endif
+
 static void update_filter(SpeexResamplerState *st)
 {
    spx_uint32_t old_length;
@@ -561,8 +654,8 @@ static void update_filter(SpeexResamplerState *st)
       st->cutoff = quality_map[st->quality].downsample_bandwidth * st->den_rate / st->num_rate;
       /* FIXME: divide the numerator and denominator by a certain amount if they're too large */
       st->filt_len = st->filt_len*st->num_rate / st->den_rate;
-      /* Round down to make sure we have a multiple of 4 */
-      st->filt_len &= (~0x3);
+      /* Round up to make sure we have a multiple of 8, which the SSE inner products assume */
+      st->filt_len = ((st->filt_len-1)&(~0x7))+8;
       if (2*st->den_rate < st->num_rate)
          st->oversample >>= 1;
       if (4*st->den_rate < st->num_rate)
@@ -578,8 +671,9 @@ static void update_filter(SpeexResamplerState *st)
       st->cutoff = quality_map[st->quality].upsample_bandwidth;
    }
    
-   /* Choose the resampling type that requires the least amount of memory */
-   if (st->den_rate <= st->oversample)
+   /* Choose the resampling type that requires the least amount of memory, unless the direct
+      table is small anyway */
+   if (st->den_rate <= st->oversample || st->filt_len*st->den_rate <= MAX_DIRECT_TABLE)
    {
       spx_uint32_t i;
       if (!st->sinc_table)
@@ -604,6 +698,13 @@ static void update_filter(SpeexResamplerState *st)
          st->resampler_ptr = resampler_basic_direct_double;
       else
          st->resampler_ptr = resampler_basic_direct_single;
+      st->phase_step = (struct PhaseStep *)speex_realloc(st->phase_step, st->den_rate*sizeof(struct PhaseStep));
+      for (i=0;i<st->den_rate;i++)
+      {
+         spx_uint32_t next = i + st->num_rate%st->den_rate;
+         st->phase_step[i].advance = st->num_rate/st->den_rate + (next >= st->den_rate);
+         st->phase_step[i].next = next >= st->den_rate ? next - st->den_rate : next;
+      }
 #endif
       /*fprintf (stderr, "resampler uses direct sinc table and normalised cutoff %f\n", cutoff);*/
    } else {
@@ -743,6 +844,10 @@ EXPORT SpeexResamplerState *speex_resampler_init_frac(spx_uint32_t nb_channels,
    st->filt_len = 0;
    st->mem = 0;
    st->resampler_ptr = 0;
+#ifndef FIXED_POINT
+   st->phase_step = NULL;
+   st->inner_product_stereo = pick_inner_product_stereo();
+#endif
          
    st->cutoff = 1.f;
    st->nb_channels = nb_channels;
@@ -786,6 +891,9 @@ EXPORT void speex_resampler_destroy(SpeexResamplerState *st)
    speex_free(st->last_sample);
    speex_free(st->magic_samples);
    speex_free(st->samp_frac_num);
+#ifndef FIXED_POINT
+   speex_free(st->phase_step);
+#endif
    speex_free(st);
 }
 
@@ -950,11 +1058,82 @@ EXPORT int speex_resampler_process_int(SpeexResamplerState *st, spx_uint32_t cha
    return RESAMPLER_ERR_SUCCESS;
 }
 
+#ifndef FIXED_POINT
+/* Whether all channels can go through resampler_direct_interleaved() together: the state
+   uses a single-precision direct table, and no channel is out of step with the others or
+   has samples left over from a filter length change */
+static int interleaved_in_step(SpeexResamplerState *st)
+{
+   spx_uint32_t i;
+   if (st->resampler_ptr != resampler_basic_direct_single)
+      return 0;
+   for (i=0;i<st->nb_channels;i++)
+   {
+      if (st->magic_samples[i] || st->last_sample[i] != st->last_sample[0] || st->samp_frac_num[i] != st->samp_frac_num[0])
+         return 0;
+   }
+   return 1;
+}
+
+/* Same as running speex_resampler_process_float() on each channel, but with one pass over
+   the input, the phase tracked once, and the filter run on two channels at a time */
+static void process_interleaved_direct(SpeexResamplerState *st, const float *in, spx_uint32_t *in_len, float *out, spx_uint32_t *out_len)
+{
+   const int C = st->nb_channels;
+   const int filt_offs = st->filt_len - 1;
+   const spx_uint32_t xlen = st->mem_alloc_size - filt_offs;
+   spx_uint32_t ilen = *in_len;
+   spx_uint32_t olen = *out_len;
+   spx_uint32_t j;
+   int c;
+
+   st->started = 1;
+   while (ilen && olen)
+   {
+      spx_uint32_t ichunk = (ilen > xlen) ? xlen : ilen;
+      spx_uint32_t ochunk;
+
+      for (c=0;c<C;c++)
+      {
+         spx_word16_t *x = st->mem + c*st->mem_alloc_size + filt_offs;
+         for (j=0;j<ichunk;j++)
+            x[j] = in[j*C+c];
+      }
+      ochunk = resampler_direct_interleaved(st, ichunk, out, olen);
+
+      /* As in speex_resampler_process_native(), keep the input the filter still needs */
+      if (st->last_sample[0] < (spx_int32_t)ichunk)
+         ichunk = st->last_sample[0];
+      for (c=0;c<C;c++)
+      {
+         spx_word16_t *x = st->mem + c*st->mem_alloc_size;
+         st->last_sample[c] -= ichunk;
+         for (j=0;j<filt_offs;j++)
+            x[j] = x[j+ichunk];
+      }
+
+      ilen -= ichunk;
+      olen -= ochunk;
+      in += ichunk*C;
+      out += ochunk*C;
+   }
+   *in_len -= ilen;
+   *out_len -= olen;
+}
+#endif
+
 EXPORT int speex_resampler_process_interleaved_float(SpeexResamplerState *st, const float *in, spx_uint32_t *in_len, float *out, spx_uint32_t *out_len)
 {
    spx_uint32_t i;
    int istride_save, ostride_save;
    spx_uint32_t bak_len = *out_len;
+#ifndef FIXED_POINT
+   if (in != NULL && st->nb_channels > 1 && interleaved_in_step(st))
+   {
+      process_interleaved_direct(st, in, in_len, out, out_len);
+      return RESAMPLER_ERR_SUCCESS;
+   }
+#endif
    istride_save = st->in_stride;
    ostride_save = st->out_stride;
    st->in_stride = st->out_stride = st->nb_channels;
@@ -126,3 +126,79 @@ static inline double interpolate_product_double(const float *a, const float *b,
 }
 
 #endif
+
+/* Two channels against the same filter phase, for the interleaved fixed-ratio path. Each
+   sum is added up in the same order as inner_product_single(), so a stereo stream comes
+   out exactly like two mono ones. */
+#define OVERRIDE_INNER_PRODUCT_STEREO
+static void inner_product_stereo_sse(const float *a, const float *b0, const float *b1, unsigned int len, float *sum0, float *sum1)
+{
+   int i;
+   __m128 s0 = _mm_setzero_ps();
+   __m128 s1 = _mm_setzero_ps();
+   for (i=0;i<len;i+=8)
+   {
+      __m128 a0 = _mm_loadu_ps(a+i);
+      __m128 a1 = _mm_loadu_ps(a+i+4);
+      s0 = _mm_add_ps(s0, _mm_mul_ps(a0, _mm_loadu_ps(b0+i)));
+      s1 = _mm_add_ps(s1, _mm_mul_ps(a0, _mm_loadu_ps(b1+i)));
+      s0 = _mm_add_ps(s0, _mm_mul_ps(a1, _mm_loadu_ps(b0+i+4)));
+      s1 = _mm_add_ps(s1, _mm_mul_ps(a1, _mm_loadu_ps(b1+i+4)));
+   }
+   s0 = _mm_add_ps(s0, _mm_movehl_ps(s0, s0));
+   s0 = _mm_add_ss(s0, _mm_shuffle_ps(s0, s0, 0x55));
+   _mm_store_ss(sum0, s0);
+   s1 = _mm_add_ps(s1, _mm_movehl_ps(s1, s1));
+   s1 = _mm_add_ss(s1, _mm_shuffle_ps(s1, s1, 0x55));
+   _mm_store_ss(sum1, s1);
+}
+
+/* The same with 8-wide fused multiply-adds, for CPUs that have them. It rounds differently
+   from the SSE version, so it's picked at run time rather than used everywhere. */
+#if (defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)) && (defined(_MSC_VER) || defined(__GNUC__))
+#define RESAMPLE_FMA
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define RESAMPLE_TARGET_FMA
+#else
+#define RESAMPLE_TARGET_FMA __attribute__((target("avx,fma")))
+#endif
+
+static int cpu_has_fma(void)
+{
+#ifdef _MSC_VER
+   int regs[4];
+   __cpuid(regs, 1);
+   /* The OS has to save the YMM registers too, not just the CPU supporting AVX */
+   if (!(regs[2] & (1<<27)) || !(regs[2] & (1<<28)) || (_xgetbv(0) & 6) != 6)
+      return 0;
+   return (regs[2] & (1<<12)) != 0;
+#else
+   __builtin_cpu_init();
+   return __builtin_cpu_supports("avx") && __builtin_cpu_supports("fma");
+#endif
+}
+
+RESAMPLE_TARGET_FMA static void inner_product_stereo_fma(const float *a, const float *b0, const float *b1, unsigned int len, float *sum0, float *sum1)
+{
+   int i;
+   __m128 t0, t1;
+   __m256 s0 = _mm256_setzero_ps();
+   __m256 s1 = _mm256_setzero_ps();
+   for (i=0;i<len;i+=8)
+   {
+      __m256 a0 = _mm256_loadu_ps(a+i);
+      s0 = _mm256_fmadd_ps(a0, _mm256_loadu_ps(b0+i), s0);
+      s1 = _mm256_fmadd_ps(a0, _mm256_loadu_ps(b1+i), s1);
+   }
+   t0 = _mm_add_ps(_mm256_castps256_ps128(s0), _mm256_extractf128_ps(s0, 1));
+   t1 = _mm_add_ps(_mm256_castps256_ps128(s1), _mm256_extractf128_ps(s1, 1));
+   t0 = _mm_add_ps(t0, _mm_movehl_ps(t0, t0));
+   t0 = _mm_add_ss(t0, _mm_shuffle_ps(t0, t0, 0x55));
+   _mm_store_ss(sum0, t0);
+   t1 = _mm_add_ps(t1, _mm_movehl_ps(t1, t1));
+   t1 = _mm_add_ss(t1, _mm_shuffle_ps(t1, t1, 0x55));
+   _mm_store_ss(sum1, t1);
+}
+#endif
@@ -0,0 +1,233 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "realfft.h"
+#include "smallft.h"
+#include "os_support.h"
+#ifndef FIXED_POINT
+#include "kiss_fftr.h"
+#endif
+
+/* Checks realfft against smallft, forwards, backwards and in place, then times both of
+   them and kiss_fft at the sizes the preprocessor and echo canceller use: twice the frame
+   size, for 10 and 20 ms frames. "testfft -c" only does the checks. */
+
+#define TOLERANCE 1e-5f
+
+static const int sizes[] = {160, 256, 320, 512, 640, 882, 960, 1024, 1280, 1764, 1920, 2048};
+
+static unsigned int seed = 1;
+
+/* Uniform in [-1, 1), the same sequence everywhere */
+static float rand_float(void)
+{
+   seed = seed*1664525 + 1013904223;
+   return (int)(seed>>8) / 8388608.f - 1.f;
+}
+
+/* Relative to the biggest value in the reference */
+static float max_error(const float *x, const float *ref, int len)
+{
+   int i;
+   float err = 0, peak = 0;
+   for (i=0;i<len;i++)
+   {
+      if (fabs(x[i]-ref[i]) > err)
+         err = fabs(x[i]-ref[i]);
+      if (fabs(ref[i]) > peak)
+         peak = fabs(ref[i]);
+   }
+   return peak > 0 ? err/peak : err;
+}
+
+/* smallft the way fftwrap.c calls it */
+static void smallft_forward(struct drft_lookup *t, const float *in, float *out)
+{
+   int i;
+   float scale = 1.f/t->n;
+   for (i=0;i<t->n;i++)
+      out[i] = scale*in[i];
+   spx_drft_forward(t, out);
+}
+
+static void smallft_backward(struct drft_lookup *t, const float *in, float *out)
+{
+   memcpy(out, in, t->n*sizeof(float));
+   spx_drft_backward(t, out);
+}
+
+static int check_size(int N)
+{
+   struct drft_lookup t;
+   spx_rfft_plan *plan, *shared;
+   float *x = malloc(N*sizeof(float));
+   float *X_ref = malloc(N*sizeof(float));
+   float *x_ref = malloc(N*sizeof(float));
+   float *out = malloc(N*sizeof(float));
+   float err[4];
+   int i, failed;
+
+   spx_drft_init(&t, N);
+   plan = spx_rfft_alloc(N);
+   shared = spx_rfft_alloc(N);
+   if (!plan)
+   {
+      printf("%5d  no plan: FAILED\n", N);
+      return 1;
+   }
+   for (i=0;i<N;i++)
+      x[i] = 30000*rand_float();
+   smallft_forward(&t, x, X_ref);
+   smallft_backward(&t, X_ref, x_ref);
+
+   spx_rfft_forward(plan, x, out);
+   err[0] = max_error(out, X_ref, N);
+   memcpy(out, x, N*sizeof(float));
+   spx_rfft_forward(plan, out, out);
+   err[1] = max_error(out, X_ref, N);
+   spx_rfft_backward(plan, X_ref, out);
+   err[2] = max_error(out, x_ref, N);
+   memcpy(out, X_ref, N*sizeof(float));
+   spx_rfft_backward(plan, out, out);
+   err[3] = max_error(out, x_ref, N);
+
+   failed = shared != plan;
+   for (i=0;i<4;i++)
+      failed |= !(err[i] <= TOLERANCE);
+   printf("%5d  forward %.2g, in place %.2g, backward %.2g, in place %.2g%s: %s\n", N, err[0], err[1],
+          err[2], err[3], shared == plan ? "" : ", plan not shared", failed ? "FAILED" : "ok");
+
+   spx_rfft_free(shared);
+   spx_rfft_free(plan);
+   spx_drft_clear(&t);
+   free(x);
+   free(X_ref);
+   free(x_ref);
+   free(out);
+   return failed;
+}
+
+/* Nanoseconds for one forward and one backward transform, the best of a few runs of about
+   20 ms each */
+#define FFT_SMALLFT 0
+#define FFT_KISS    1
+#define FFT_REALFFT 2
+
+static double time_size(int fft, int N)
+{
+   struct drft_lookup t;
+#ifndef FIXED_POINT
+   kiss_fftr_cfg kf = NULL, kb = NULL;
+#endif
+   spx_rfft_plan *plan = NULL;
+   float *x = malloc(N*sizeof(float));
+   float *X = malloc(N*sizeof(float));
+   double best = 0;
+   int i, iter, round;
+
+   for (i=0;i<N;i++)
+      x[i] = rand_float();
+   if (fft == FFT_SMALLFT)
+      spx_drft_init(&t, N);
+#ifndef FIXED_POINT
+   else if (fft == FFT_KISS)
+   {
+      kf = kiss_fftr_alloc(N, 0, NULL, NULL);
+      kb = kiss_fftr_alloc(N, 1, NULL, NULL);
+   }
+#endif
+   else
+      plan = spx_rfft_alloc(N);
+
+   for (round=0;round<5;round++)
+   {
+      clock_t start = clock(), elapsed;
+      int runs = 0;
+      double ns;
+      do {
+         for (iter=0;iter<100;iter++)
+         {
+            if (fft == FFT_SMALLFT)
+            {
+               smallft_forward(&t, x, X);
+               smallft_backward(&t, X, x);
+            }
+#ifndef FIXED_POINT
+            else if (fft == FFT_KISS)
+            {
+               float scale = 1.f/N;
+               kiss_fftr2(kf, x, X);
+               for (i=0;i<N;i++)
+                  X[i] *= scale;
+               kiss_fftri2(kb, X, x);
+            }
+#endif
+            else
+            {
+               spx_rfft_forward(plan, x, X);
+               spx_rfft_backward(plan, X, x);
+            }
+         }
+         runs += iter;
+         elapsed = clock()-start;
+      } while (elapsed < CLOCKS_PER_SEC/50);
+      ns = 1e9*elapsed/CLOCKS_PER_SEC/runs;
+      if (round == 0 || ns < best)
+         best = ns;
+   }
+
+   if (fft == FFT_SMALLFT)
+      spx_drft_clear(&t);
+#ifndef FIXED_POINT
+   else if (fft == FFT_KISS)
+   {
+      kiss_fftr_free(kf);
+      kiss_fftr_free(kb);
+   }
+#endif
+   else
+      spx_rfft_free(plan);
+   free(x);
+   free(X);
+   return best;
+}
+
+int main(int argc, char **argv)
+{
+   int s, failed = 0;
+   int check_only = argc > 1 && strcmp(argv[1], "-c") == 0;
+
+   printf("realfft compared to smallft, largest relative error:\n");
+   for (s=0;s<(int)(sizeof(sizes)/sizeof(sizes[0]));s++)
+      failed |= check_size(sizes[s]);
+   /* Tiny sizes, the generic pass, and prime factors too big for it */
+   failed |= check_size(2);
+   failed |= check_size(14);
+   failed |= check_size(2*3*7*11);
+   failed |= check_size(2*37);
+   failed |= check_size(4*4*41);
+
+   if (!check_only)
+   {
+      printf("\nForward + backward transform, ns:\n");
+      printf("    N   smallft      kiss   realfft\n");
+      for (s=0;s<(int)(sizeof(sizes)/sizeof(sizes[0]));s++)
+      {
+         printf("%5d%10.0f", sizes[s], time_size(FFT_SMALLFT, sizes[s]));
+#ifndef FIXED_POINT
+         printf("%10.0f", time_size(FFT_KISS, sizes[s]));
+#else
+         printf("%10s", "-");
+#endif
+         printf("%10.0f\n", time_size(FFT_REALFFT, sizes[s]));
+         fflush(stdout);
+      }
+   }
+   return failed;
+}
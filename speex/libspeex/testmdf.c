@@ -0,0 +1,314 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "speex/speex_echo.h"
+#include "mdf_simd.h"
+
+/* Checks each vectorized MDF kernel against the scalar one and the float API against the
+   int16 one, then times the whole echo canceller with each kernel for a few tail lengths.
+   "testmdf -c" only does the checks. */
+
+#ifndef FIXED_POINT
+
+#define RATE 48000
+#define FRAME 480
+#define TOLERANCE 1e-5f
+
+static unsigned int seed = 1;
+
+/* Uniform in [-1, 1), the same sequence everywhere */
+static float rand_float(void)
+{
+   seed = seed*1664525 + 1013904223;
+   return (int)(seed>>8) / 8388608.f - 1.f;
+}
+
+static void fill(float *x, int len, float scale)
+{
+   int i;
+   for (i=0;i<len;i++)
+      x[i] = scale*rand_float();
+}
+
+/* Relative to the biggest value in the reference, so bins that nearly cancel don't count */
+static float max_error(const float *x, const float *ref, int len)
+{
+   int i;
+   float err = 0, peak = 0;
+   for (i=0;i<len;i++)
+   {
+      if (fabs(x[i]-ref[i]) > err)
+         err = fabs(x[i]-ref[i]);
+      if (fabs(ref[i]) > peak)
+         peak = fabs(ref[i]);
+   }
+   return peak > 0 ? err/peak : err;
+}
+
+static int check_kernels(const MdfKernels *k, const MdfKernels *ref)
+{
+   static const int frames[] = {1, 2, 7, 64, 80, 128, 160, 441, 480, 960};
+   static const int blocks[] = {1, 3, 20};
+   float worst[4] = {0, 0, 0, 0};
+   int f, b, failed;
+
+   for (f=0;f<(int)(sizeof(frames)/sizeof(frames[0]));f++)
+   {
+      for (b=0;b<(int)(sizeof(blocks)/sizeof(blocks[0]));b++)
+      {
+         int N = 2*frames[f], M = blocks[b], P = 2;
+         float *X = malloc(M*N*sizeof(float));
+         float *Y = malloc(M*N*sizeof(float));
+         float *W = malloc(P*M*N*sizeof(float));
+         float *w = malloc((N/2+1)*sizeof(float));
+         float *out = malloc((N+M)*sizeof(float));
+         float *out_ref = malloc((N+M)*sizeof(float));
+         float p, err;
+
+         fill(X, M*N, 30000);
+         fill(Y, M*N, 30000);
+         fill(W, P*M*N, 10);
+         fill(w, N/2+1, 1e-6f);
+         p = rand_float();
+
+         fill(out_ref, N/2+1, 1e9f);
+         memcpy(out, out_ref, (N/2+1)*sizeof(float));
+         ref->power_spectrum_accum(X, out_ref, N);
+         k->power_spectrum_accum(X, out, N);
+         err = max_error(out, out_ref, N/2+1);
+         if (err > worst[0])
+            worst[0] = err;
+
+         /* The outputs start out different, to catch anything left unwritten */
+         fill(out, N, 1);
+         fill(out_ref, N, 1);
+         ref->spectral_mul_accum(X, Y, out_ref, N, M);
+         k->spectral_mul_accum(X, Y, out, N, M);
+         err = max_error(out, out_ref, N);
+         if (err > worst[1])
+            worst[1] = err;
+
+         fill(out, N, 1);
+         fill(out_ref, N, 1);
+         ref->weighted_spectral_mul_conj(w, p, X, Y, out_ref, N);
+         k->weighted_spectral_mul_conj(w, p, X, Y, out, N);
+         err = max_error(out, out_ref, N);
+         if (err > worst[2])
+            worst[2] = err;
+
+         ref->adjust_prop(W, N, M, P, out_ref);
+         k->adjust_prop(W, N, M, P, out);
+         err = max_error(out, out_ref, M);
+         if (err > worst[3])
+            worst[3] = err;
+
+         free(X);
+         free(Y);
+         free(W);
+         free(w);
+         free(out);
+         free(out_ref);
+      }
+   }
+
+   failed = worst[0] > TOLERANCE || worst[1] > TOLERANCE || worst[2] > TOLERANCE || worst[3] > TOLERANCE;
+   printf("%-6s power %.2g, cross %.2g, weighted %.2g, prop %.2g: %s\n", k->name, worst[0], worst[1],
+          worst[2], worst[3], failed ? "FAILED" : "ok");
+   return failed;
+}
+
+/* One second of far-end noise, and the mic picking it up 5 ms later with some noise of its own */
+static spx_int16_t far_end[RATE], near_end[RATE];
+
+static void make_signals(void)
+{
+   int i, delay = RATE/200;
+   seed = 1;
+   for (i=0;i<RATE;i++)
+      far_end[i] = (spx_int16_t)(8000*rand_float());
+   for (i=0;i<RATE;i++)
+      near_end[i] = (spx_int16_t)(.5f*far_end[(i+RATE-delay)%RATE] + 100*rand_float());
+}
+
+/* Runs the echo canceller for a number of frames, returning frames per second and the output */
+static double run_echo(int tail_ms, int frames, spx_int16_t *out)
+{
+   SpeexEchoState *st;
+   int rate = RATE, i, pos;
+   clock_t start;
+   double seconds;
+
+   st = speex_echo_state_init(FRAME, tail_ms*RATE/1000);
+   speex_echo_ctl(st, SPEEX_ECHO_SET_SAMPLING_RATE, &rate);
+   start = clock();
+   for (i=0;i<frames;i++)
+   {
+      pos = (i*FRAME)%RATE;
+      speex_echo_cancellation(st, near_end+pos, far_end+pos, out+i*FRAME);
+   }
+   seconds = (double)(clock()-start)/CLOCKS_PER_SEC;
+   speex_echo_state_destroy(st);
+   return seconds > 0 ? frames/seconds : 0;
+}
+
+/* A canceller placed in caller memory, deliberately misaligned, has to run exactly like an allocated one. Asking for
+   the size, or offering too little memory, must not create a state. */
+static int check_mem(int frames)
+{
+   SpeexEchoState *st = speex_echo_state_init(FRAME, 200*RATE/1000);
+   SpeexEchoState *placed;
+   size_t size = 0, small;
+   char *mem;
+   int rate = RATE, f, i, mismatches = 0, failed;
+
+   placed = speex_echo_state_init_mem(FRAME, 200*RATE/1000, 1, 1, NULL, &size);
+   failed = placed != NULL || size == 0;
+   mem = malloc(size+3);
+   small = size-1;
+   failed |= speex_echo_state_init_mem(FRAME, 200*RATE/1000, 1, 1, mem+3, &small) != NULL;
+   placed = speex_echo_state_init_mem(FRAME, 200*RATE/1000, 1, 1, mem+3, &size);
+   failed |= placed == NULL;
+   if (placed)
+   {
+      speex_echo_ctl(st, SPEEX_ECHO_SET_SAMPLING_RATE, &rate);
+      speex_echo_ctl(placed, SPEEX_ECHO_SET_SAMPLING_RATE, &rate);
+      for (f=0;f<frames;f++)
+      {
+         int pos = (f*FRAME)%RATE;
+         spx_int16_t out[FRAME], out_placed[FRAME];
+         speex_echo_cancellation(st, near_end+pos, far_end+pos, out);
+         speex_echo_cancellation(placed, near_end+pos, far_end+pos, out_placed);
+         for (i=0;i<FRAME;i++)
+            mismatches += out[i] != out_placed[i];
+      }
+      speex_echo_state_destroy(placed);
+   }
+   failed |= mismatches > 0;
+   printf("Placed state (%lu bytes): %d samples differ: %s\n", (unsigned long)size, mismatches,
+          failed ? "FAILED" : "ok");
+   speex_echo_state_destroy(st);
+   free(mem);
+   return failed;
+}
+
+/* The float API, working in place, against the int16 one. They run the same canceller on the same samples, so
+   the float output rounds to the int16 output. */
+static int check_float_api(int frames)
+{
+   SpeexEchoState *st16 = speex_echo_state_init(FRAME, 200*RATE/1000);
+   SpeexEchoState *stf = speex_echo_state_init(FRAME, 200*RATE/1000);
+   int rate = RATE, f, i, failed;
+   float err = 0;
+
+   speex_echo_ctl(st16, SPEEX_ECHO_SET_SAMPLING_RATE, &rate);
+   speex_echo_ctl(stf, SPEEX_ECHO_SET_SAMPLING_RATE, &rate);
+   for (f=0;f<frames;f++)
+   {
+      int pos = (f*FRAME)%RATE;
+      spx_int16_t out[FRAME];
+      float x[FRAME], play[FRAME];
+      for (i=0;i<FRAME;i++)
+      {
+         x[i] = near_end[pos+i];
+         play[i] = far_end[pos+i];
+      }
+      speex_echo_cancellation(st16, near_end+pos, far_end+pos, out);
+      speex_echo_cancellation_float(stf, x, play, x);
+      for (i=0;i<FRAME;i++)
+      {
+         if (fabs(x[i]-out[i]) > err)
+            err = fabs(x[i]-out[i]);
+      }
+   }
+   failed = !(err <= .5f);
+   printf("Float API output differs by up to %.3g: %s\n", err, failed ? "FAILED" : "ok");
+   speex_echo_state_destroy(st16);
+   speex_echo_state_destroy(stf);
+   return failed;
+}
+
+int main(int argc, char **argv)
+{
+   static const int tails[] = {50, 100, 200, 400};
+   const int check_frames = 300, bench_frames = 1000;
+   const MdfKernels *ref = mdf_simd_arch(MDF_SIMD_SCALAR);
+   spx_int16_t *out = malloc(bench_frames*FRAME*sizeof(spx_int16_t));
+   spx_int16_t *out_ref = malloc(bench_frames*FRAME*sizeof(spx_int16_t));
+   int arch, t, i, failed = 0;
+   int check_only = argc > 1 && strcmp(argv[1], "-c") == 0;
+
+   make_signals();
+
+   /* Each kernel on its own, then the whole canceller, whose output mustn't drift far from
+      what the scalar kernels give */
+   printf("Kernels compared to scalar, largest relative error:\n");
+   mdf_simd_force(MDF_SIMD_SCALAR);
+   run_echo(200, check_frames, out_ref);
+   for (arch=0;arch<MDF_SIMD_COUNT;arch++)
+   {
+      const MdfKernels *k = mdf_simd_arch(arch);
+      int diff = 0;
+      if (!k || arch == MDF_SIMD_SCALAR)
+         continue;
+      failed |= check_kernels(k, ref);
+
+      mdf_simd_force(arch);
+      run_echo(200, check_frames, out);
+      for (i=0;i<check_frames*FRAME;i++)
+      {
+         if (abs(out[i]-out_ref[i]) > diff)
+            diff = abs(out[i]-out_ref[i]);
+      }
+      printf("%-6s echo canceller output differs by up to %d: %s\n", k->name, diff, diff > 2 ? "FAILED" : "ok");
+      failed |= diff > 2;
+      mdf_simd_force(MDF_SIMD_SCALAR);
+   }
+   mdf_simd_force(-1);
+   failed |= check_mem(check_frames);
+   failed |= check_float_api(check_frames);
+
+   if (!check_only)
+   {
+      printf("\nEcho canceller frames/sec, %d Hz in %d-sample frames:\n", RATE, FRAME);
+      printf("  tail");
+      for (arch=0;arch<MDF_SIMD_COUNT;arch++)
+      {
+         if (mdf_simd_arch(arch))
+            printf("%10s", mdf_simd_arch(arch)->name);
+      }
+      printf("\n");
+      for (t=0;t<(int)(sizeof(tails)/sizeof(tails[0]));t++)
+      {
+         printf("%3d ms", tails[t]);
+         for (arch=0;arch<MDF_SIMD_COUNT;arch++)
+         {
+            if (!mdf_simd_force(arch))
+               continue;
+            printf("%10.0f", run_echo(tails[t], bench_frames, out));
+            fflush(stdout);
+         }
+         printf("\n");
+      }
+   }
+
+   mdf_simd_force(-1);
+   free(out);
+   free(out_ref);
+   return failed;
+}
+
+#else
+
+/* The fixed-point echo canceller has no vectorized kernels */
+int main(void)
+{
+   return 0;
+}
+
+#endif
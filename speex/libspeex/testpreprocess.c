@@ -0,0 +1,541 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "speex/speex_preprocess.h"
+#include "preprocess_simd.h"
+
+/* Checks the vectorized gain computation against the scalar one, the strided float API against the plain one and
+   a batch of channels against separate preprocessor states, then times them. "testpreprocess -c" only does the
+   checks. */
+
+#define RATE 48000
+#define FRAME_SIZE 480
+#define FRAMES 1000
+
+/* Largest difference allowed between a batch's output and a separate state's, in 16-bit sample units. The
+   batch does in single precision some things the separate state does in double precision. */
+#define TOLERANCE 2.f
+
+/* Largest relative error allowed in the vector exp and hypergeometric gain, and largest difference between the
+   vectorized gain computation's float output and the scalar one's, in 16-bit sample units */
+#define EXP_TOLERANCE 2e-7
+#define HYPERGEOM_TOLERANCE 5e-7
+#define SIMD_TOLERANCE .01f
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+static unsigned int seed = 1;
+
+/* Uniform in [-1, 1), the same sequence everywhere */
+static float rand_float(void)
+{
+   seed = seed*1664525 + 1013904223;
+   return (int)(seed>>8) / 8388608.f - 1.f;
+}
+
+/* Background noise with bursts of a vowel-like tone, a bit different for each channel */
+static void make_signal(float *x, int len, int channel)
+{
+   int i;
+   float f0 = 110.f + 35.f*channel;
+   float noise = 300.f + 150.f*channel;
+   for (i=0;i<len;i++)
+   {
+      float t = (float)i/RATE;
+      float env = sin(2*M_PI*(.7f+.1f*channel)*t);
+      float voice = 0;
+      int h;
+      if (env > .2f)
+         for (h=1;h<=8;h++)
+            voice += 4000.f/h*env*sin(2*M_PI*f0*h*t);
+      x[i] = voice + noise*rand_float();
+   }
+}
+
+/* Different settings on each channel, so the batch can't get away with using channel 0's */
+static void configure(SpeexPreprocessState *st, int channel)
+{
+   int on = 1, off = 0;
+   int suppress = -15 - 5*(channel%4);
+   speex_preprocess_ctl(st, SPEEX_PREPROCESS_SET_NOISE_SUPPRESS, &suppress);
+   if (channel == 1)
+      speex_preprocess_ctl(st, SPEEX_PREPROCESS_SET_VAD, &on);
+   if (channel%5 == 2)
+      speex_preprocess_ctl(st, SPEEX_PREPROCESS_SET_AGC, &on);
+   if (channel == 6)
+      speex_preprocess_ctl(st, SPEEX_PREPROCESS_SET_DENOISE, &off);
+}
+
+#ifndef FIXED_POINT
+/* hypergeom_gain() from preprocess.c, in double precision */
+static double hypergeom_ref(double x)
+{
+   static const double table[21] = {
+      0.82157, 1.02017, 1.20461, 1.37534, 1.53363, 1.68092, 1.81865,
+      1.94811, 2.07038, 2.18638, 2.29688, 2.40255, 2.50391, 2.60144,
+      2.69551, 2.78647, 2.87458, 2.96015, 3.04333, 3.12431, 3.20326};
+   int ind = (int)floor(2*x);
+   double frac = 2*x-ind;
+   if (ind<0)
+      return 1;
+   if (ind>19)
+      return 1+.1296/x;
+   return ((1-frac)*table[ind] + frac*table[ind+1])/sqrt(x+.0001);
+}
+
+/* Largest relative error of f over [lo, hi) */
+static double max_error_v4(v4sf (*f)(v4sf), double (*ref)(double), double lo, double hi, double step)
+{
+   double err = 0;
+   double x;
+   for (x=lo;x+3*step<hi;x+=4*step)
+   {
+      float in[4], out[4];
+      int i;
+      for (i=0;i<4;i++)
+         in[i] = x+i*step;
+      vstore(out, f(vload(in)));
+      for (i=0;i<4;i++)
+      {
+         double r = ref(in[i]);
+         if (fabs(out[i]-r) > err*fabs(r))
+            err = fabs(out[i]-r)/fabs(r);
+      }
+   }
+   return err;
+}
+
+static int check_vector_ops(void)
+{
+   double exp_err = max_error_v4(vexp, exp, EXP_MIN, EXP_MAX, 1e-3);
+   double hypergeom_err = max_error_v4(hypergeom_gain_v4, hypergeom_ref, 0, 100, 1e-4);
+   float clamped[4];
+   int failed;
+
+   vstore(clamped, vexp(vset1(-1000.f)));
+   failed = !(exp_err <= EXP_TOLERANCE) || !(hypergeom_err <= HYPERGEOM_TOLERANCE) || !(clamped[0] >= 0);
+   printf("vexp: largest error %.3g, hypergeom_gain_v4: largest error %.3g: %s\n", exp_err, hypergeom_err,
+          failed ? "FAILED" : "ok");
+   return failed;
+}
+
+/* Runs the same input through a state with the vectorized gain computation and one with the scalar one */
+static int check_simd(int rate, int frame_size, int use_float)
+{
+   SpeexPreprocessState *st[2];
+   float *input = malloc(FRAMES*frame_size*sizeof(float));
+   float *fbuf[2];
+   spx_int16_t *ibuf[2];
+   float err = 0;
+   int vad_mismatches = 0;
+   int f, i, k, failed;
+
+   make_signal(input, FRAMES*frame_size, 0);
+   for (k=0;k<2;k++)
+   {
+      st[k] = speex_preprocess_state_init(frame_size, rate);
+      configure(st[k], 1);
+      fbuf[k] = malloc(frame_size*sizeof(float));
+      ibuf[k] = malloc(frame_size*sizeof(spx_int16_t));
+   }
+   for (f=0;f<FRAMES;f++)
+   {
+      int vad[2];
+      for (k=0;k<2;k++)
+      {
+         preprocess_simd_enable(k == 0);
+         for (i=0;i<frame_size;i++)
+         {
+            fbuf[k][i] = input[f*frame_size+i];
+            ibuf[k][i] = (spx_int16_t)floor(.5f+input[f*frame_size+i]);
+         }
+         if (use_float)
+         {
+            vad[k] = speex_preprocess_run_float(st[k], fbuf[k]);
+         } else {
+            vad[k] = speex_preprocess_run(st[k], ibuf[k]);
+            for (i=0;i<frame_size;i++)
+               fbuf[k][i] = ibuf[k][i];
+         }
+      }
+      for (i=0;i<frame_size;i++)
+         if (fabs(fbuf[0][i]-fbuf[1][i]) > err)
+            err = fabs(fbuf[0][i]-fbuf[1][i]);
+      vad_mismatches += vad[0] != vad[1];
+   }
+   preprocess_simd_enable(1);
+
+   failed = !(err <= (use_float ? SIMD_TOLERANCE : 1.f)) || vad_mismatches > 0;
+   printf("%5d Hz, %s: largest difference %.3g, %d VAD mismatches: %s\n", rate, use_float ? "float" : "int16",
+          err, vad_mismatches, failed ? "FAILED" : "ok");
+   for (k=0;k<2;k++)
+   {
+      speex_preprocess_state_destroy(st[k]);
+      free(fbuf[k]);
+      free(ibuf[k]);
+   }
+   free(input);
+   return failed;
+}
+#endif
+
+/* Without denoising, VAD or AGC the preprocessor skips its gain computation. The output has to be the same as
+   when the VAD makes it do the computation and then not use it. */
+static int check_skip(void)
+{
+   SpeexPreprocessState *st[2];
+   spx_int16_t *buf[2];
+   float *input = malloc(FRAMES*FRAME_SIZE*sizeof(float));
+   int off = 0, on = 1;
+   int f, i, k, mismatches = 0;
+
+   make_signal(input, FRAMES*FRAME_SIZE, 0);
+   for (k=0;k<2;k++)
+   {
+      st[k] = speex_preprocess_state_init(FRAME_SIZE, RATE);
+      speex_preprocess_ctl(st[k], SPEEX_PREPROCESS_SET_DENOISE, &off);
+      buf[k] = malloc(FRAME_SIZE*sizeof(spx_int16_t));
+   }
+   speex_preprocess_ctl(st[1], SPEEX_PREPROCESS_SET_VAD, &on);
+   for (f=0;f<FRAMES;f++)
+   {
+      for (k=0;k<2;k++)
+      {
+         for (i=0;i<FRAME_SIZE;i++)
+            buf[k][i] = (spx_int16_t)floor(.5f+input[f*FRAME_SIZE+i]);
+         speex_preprocess_run(st[k], buf[k]);
+      }
+      for (i=0;i<FRAME_SIZE;i++)
+         mismatches += buf[0][i] != buf[1][i];
+   }
+   printf("Skipped gain computation: %d samples differ: %s\n", mismatches, mismatches ? "FAILED" : "ok");
+   for (k=0;k<2;k++)
+   {
+      speex_preprocess_state_destroy(st[k]);
+      free(buf[k]);
+   }
+   free(input);
+   return mismatches > 0;
+}
+
+/* A preprocessor placed in caller memory, deliberately misaligned, has to run exactly like an allocated one. Asking
+   for the size, or offering too little memory, must not create a state. */
+static int check_mem(void)
+{
+   SpeexPreprocessState *st = speex_preprocess_state_init(FRAME_SIZE, RATE);
+   SpeexPreprocessState *placed;
+   float *input = malloc(FRAMES*FRAME_SIZE*sizeof(float));
+   spx_int16_t buf[FRAME_SIZE], buf_placed[FRAME_SIZE];
+   size_t size = 0, small;
+   char *mem;
+   int f, i, mismatches = 0, failed;
+
+   placed = speex_preprocess_state_init_mem(FRAME_SIZE, RATE, NULL, &size);
+   failed = placed != NULL || size == 0;
+   mem = malloc(size+3);
+   small = size-1;
+   failed |= speex_preprocess_state_init_mem(FRAME_SIZE, RATE, mem+3, &small) != NULL;
+   placed = speex_preprocess_state_init_mem(FRAME_SIZE, RATE, mem+3, &size);
+   failed |= placed == NULL;
+   if (placed)
+   {
+      make_signal(input, FRAMES*FRAME_SIZE, 0);
+      configure(st, 2);
+      configure(placed, 2);
+      for (f=0;f<FRAMES;f++)
+      {
+         for (i=0;i<FRAME_SIZE;i++)
+            buf[i] = buf_placed[i] = (spx_int16_t)floor(.5f+input[f*FRAME_SIZE+i]);
+         speex_preprocess_run(st, buf);
+         speex_preprocess_run(placed, buf_placed);
+         for (i=0;i<FRAME_SIZE;i++)
+            mismatches += buf[i] != buf_placed[i];
+      }
+      speex_preprocess_state_destroy(placed);
+   }
+   failed |= mismatches > 0;
+   printf("Placed state (%lu bytes): %d samples differ: %s\n", (unsigned long)size, mismatches,
+          failed ? "FAILED" : "ok");
+   speex_preprocess_state_destroy(st);
+   free(mem);
+   free(input);
+   return failed;
+}
+
+#ifndef DISABLE_FLOAT_API
+/* One channel of interleaved stereo processed in place with a stride has to come out exactly like the same samples
+   processed on their own, and the other channel has to be left alone */
+static int check_stride(void)
+{
+   SpeexPreprocessState *mono = speex_preprocess_state_init(FRAME_SIZE, RATE);
+   SpeexPreprocessState *strided = speex_preprocess_state_init(FRAME_SIZE, RATE);
+   float *input = malloc(FRAMES*FRAME_SIZE*sizeof(float));
+   float buf[FRAME_SIZE], stereo[2*FRAME_SIZE];
+   int f, i, mismatches = 0;
+
+   make_signal(input, FRAMES*FRAME_SIZE, 0);
+   configure(mono, 2);
+   configure(strided, 2);
+   for (f=0;f<FRAMES;f++)
+   {
+      for (i=0;i<FRAME_SIZE;i++)
+      {
+         buf[i] = stereo[2*i+1] = input[f*FRAME_SIZE+i];
+         stereo[2*i] = i;
+      }
+      speex_preprocess_run_float(mono, buf);
+      speex_preprocess_run_float_stride(strided, stereo+1, 2);
+      for (i=0;i<FRAME_SIZE;i++)
+         mismatches += stereo[2*i+1] != buf[i] || stereo[2*i] != i;
+   }
+   printf("Strided float API: %d samples differ: %s\n", mismatches, mismatches ? "FAILED" : "ok");
+   speex_preprocess_state_destroy(mono);
+   speex_preprocess_state_destroy(strided);
+   free(input);
+   return mismatches > 0;
+}
+#endif
+
+/* Runs every channel through a batch and through separate states. Returns 1 if they don't match. */
+static int check_channels(int channels, int use_float)
+{
+   SpeexPreprocessBatch *batch = speex_preprocess_batch_init(channels, FRAME_SIZE, RATE);
+   SpeexPreprocessState **st = malloc(channels*sizeof(SpeexPreprocessState *));
+   float **input = malloc(channels*sizeof(float *));
+   float **fbuf = malloc(channels*sizeof(float *));
+   spx_int16_t **ibuf = malloc(channels*sizeof(spx_int16_t *));
+   int *vad = malloc(channels*sizeof(int));
+   float err = 0;
+   int vad_mismatches = 0;
+   int c, f, i, failed;
+
+   for (c=0;c<channels;c++)
+   {
+      st[c] = speex_preprocess_state_init(FRAME_SIZE, RATE);
+      configure(st[c], c);
+      configure(speex_preprocess_batch_get_state(batch, c), c);
+      input[c] = malloc(FRAMES*FRAME_SIZE*sizeof(float));
+      fbuf[c] = malloc(FRAME_SIZE*sizeof(float));
+      ibuf[c] = malloc(FRAME_SIZE*sizeof(spx_int16_t));
+      make_signal(input[c], FRAMES*FRAME_SIZE, c);
+   }
+
+   for (f=0;f<FRAMES;f++)
+   {
+      for (c=0;c<channels;c++)
+         for (i=0;i<FRAME_SIZE;i++)
+         {
+            fbuf[c][i] = input[c][f*FRAME_SIZE+i];
+            ibuf[c][i] = (spx_int16_t)floor(.5f+input[c][f*FRAME_SIZE+i]);
+         }
+      if (use_float)
+         speex_preprocess_batch_run_float(batch, fbuf, vad);
+      else
+         speex_preprocess_batch_run(batch, ibuf, vad);
+
+      for (c=0;c<channels;c++)
+      {
+         float ref[FRAME_SIZE];
+         spx_int16_t iref[FRAME_SIZE];
+         int ref_vad;
+         if (use_float)
+         {
+            memcpy(ref, input[c]+f*FRAME_SIZE, sizeof(ref));
+            ref_vad = speex_preprocess_run_float(st[c], ref);
+         } else {
+            for (i=0;i<FRAME_SIZE;i++)
+               iref[i] = (spx_int16_t)floor(.5f+input[c][f*FRAME_SIZE+i]);
+            ref_vad = speex_preprocess_run(st[c], iref);
+            for (i=0;i<FRAME_SIZE;i++)
+            {
+               ref[i] = iref[i];
+               fbuf[c][i] = ibuf[c][i];
+            }
+         }
+         for (i=0;i<FRAME_SIZE;i++)
+            if (fabs(fbuf[c][i]-ref[i]) > err)
+               err = fabs(fbuf[c][i]-ref[i]);
+         vad_mismatches += vad[c] != ref_vad;
+      }
+   }
+
+   failed = !(err <= TOLERANCE) || vad_mismatches > 0;
+   printf("%d channel%s, %s: largest difference %.3g, %d VAD mismatches: %s\n", channels, channels > 1 ? "s" : "",
+          use_float ? "float" : "int16", err, vad_mismatches, failed ? "FAILED" : "ok");
+
+   for (c=0;c<channels;c++)
+   {
+      speex_preprocess_state_destroy(st[c]);
+      free(input[c]);
+      free(fbuf[c]);
+      free(ibuf[c]);
+   }
+   speex_preprocess_batch_destroy(batch);
+   free(st);
+   free(input);
+   free(fbuf);
+   free(ibuf);
+   free(vad);
+   return failed;
+}
+
+#ifndef FIXED_POINT
+/* Microseconds to process one frame of one channel with or without the vectorized gain computation, the best of
+   a few runs of about 50 ms each */
+static double time_simd(int rate, int frame_size, int simd)
+{
+   SpeexPreprocessState *st = speex_preprocess_state_init(frame_size, rate);
+   float *input = malloc(FRAMES*frame_size*sizeof(float));
+   float *buf = malloc(frame_size*sizeof(float));
+   double best = 0;
+   int f = 0, round;
+
+   make_signal(input, FRAMES*frame_size, 0);
+   preprocess_simd_enable(simd);
+   for (round=0;round<5;round++)
+   {
+      clock_t start = clock(), elapsed;
+      int runs = 0;
+      double us;
+      do {
+         memcpy(buf, input+f*frame_size, frame_size*sizeof(float));
+         speex_preprocess_run_float(st, buf);
+         f = (f+1)%FRAMES;
+         runs++;
+         elapsed = clock()-start;
+      } while (elapsed < CLOCKS_PER_SEC/20);
+      us = 1e6*elapsed/CLOCKS_PER_SEC/runs;
+      if (round == 0 || us < best)
+         best = us;
+   }
+   preprocess_simd_enable(1);
+
+   speex_preprocess_state_destroy(st);
+   free(input);
+   free(buf);
+   return best;
+}
+#endif
+
+/* Microseconds to process one frame of every channel, the best of a few runs of about 50 ms each */
+static double time_channels(int channels, int use_batch)
+{
+   SpeexPreprocessBatch *batch = NULL;
+   SpeexPreprocessState **st = malloc(channels*sizeof(SpeexPreprocessState *));
+   float **input = malloc(channels*sizeof(float *));
+   float **buf = malloc(channels*sizeof(float *));
+   double best = 0;
+   int c, f = 0, round;
+
+   if (use_batch)
+      batch = speex_preprocess_batch_init(channels, FRAME_SIZE, RATE);
+   for (c=0;c<channels;c++)
+   {
+      if (!use_batch)
+         st[c] = speex_preprocess_state_init(FRAME_SIZE, RATE);
+      input[c] = malloc(FRAMES*FRAME_SIZE*sizeof(float));
+      buf[c] = malloc(FRAME_SIZE*sizeof(float));
+      make_signal(input[c], FRAMES*FRAME_SIZE, c);
+   }
+
+   for (round=0;round<5;round++)
+   {
+      clock_t start = clock(), elapsed;
+      int runs = 0;
+      double us;
+      do {
+         for (c=0;c<channels;c++)
+            memcpy(buf[c], input[c]+f*FRAME_SIZE, FRAME_SIZE*sizeof(float));
+         if (use_batch)
+            speex_preprocess_batch_run_float(batch, buf, NULL);
+         else
+            for (c=0;c<channels;c++)
+               speex_preprocess_run_float(st[c], buf[c]);
+         f = (f+1)%FRAMES;
+         runs++;
+         elapsed = clock()-start;
+      } while (elapsed < CLOCKS_PER_SEC/20);
+      us = 1e6*elapsed/CLOCKS_PER_SEC/runs;
+      if (round == 0 || us < best)
+         best = us;
+   }
+
+   for (c=0;c<channels;c++)
+   {
+      if (!use_batch)
+         speex_preprocess_state_destroy(st[c]);
+      free(input[c]);
+      free(buf[c]);
+   }
+   speex_preprocess_batch_destroy(batch);
+   free(st);
+   free(input);
+   free(buf);
+   return best;
+}
+
+int main(int argc, char **argv)
+{
+   static const int counts[] = {1, 2, 3, 4, 5, 8};
+   static const int rates[] = {8000, 16000, 32000, 44100, 48000};
+   int n, failed = 0;
+   int check_only = argc > 1 && strcmp(argv[1], "-c") == 0;
+
+#ifndef FIXED_POINT
+   failed |= check_vector_ops();
+   printf("\nVectorized gain computation compared to the scalar one:\n");
+   for (n=0;n<(int)(sizeof(rates)/sizeof(rates[0]));n++)
+   {
+      failed |= check_simd(rates[n], rates[n]/100, 0);
+      failed |= check_simd(rates[n], rates[n]/100, 1);
+   }
+   printf("\n");
+#endif
+   failed |= check_skip();
+   failed |= check_mem();
+#ifndef DISABLE_FLOAT_API
+   failed |= check_stride();
+#endif
+
+   printf("\nBatch compared to separate states:\n");
+   for (n=0;n<(int)(sizeof(counts)/sizeof(counts[0]));n++)
+   {
+      failed |= check_channels(counts[n], 0);
+#ifndef DISABLE_FLOAT_API
+      failed |= check_channels(counts[n], 1);
+#endif
+   }
+
+#ifndef DISABLE_FLOAT_API
+   if (!check_only)
+   {
+#ifndef FIXED_POINT
+      printf("\nOne 10 ms frame of one channel, us:\n");
+      printf("  rate    scalar    vector\n");
+      for (n=0;n<(int)(sizeof(rates)/sizeof(rates[0]));n++)
+      {
+         double scalar = time_simd(rates[n], rates[n]/100, 0);
+         printf("%6d%10.1f%10.1f\n", rates[n], scalar, time_simd(rates[n], rates[n]/100, 1));
+      }
+#endif
+      printf("\nOne 10 ms frame of every channel at 48 kHz, us:\n");
+      printf("channels  separate     batch  per channel\n");
+      for (n=1;n<=8;n++)
+      {
+         double separate = time_channels(n, 0);
+         double batch = time_channels(n, 1);
+         printf("%8d%10.1f%10.1f%13.1f\n", n, separate, batch, batch/n);
+         fflush(stdout);
+      }
+   }
+#endif
+   return failed;
+}
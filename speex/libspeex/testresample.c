@@ -0,0 +1,244 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "speex/speex_resampler.h"
+#ifdef HAVE_LIBSAMPLERATE
+#include "samplerate.h"
+#endif
+
+/* Checks the interleaved fixed-ratio path against resampling each channel with its own
+   state, then times both, and libsamplerate's SRC_SINC_FASTEST if it's built in, on stereo
+   audio the way OBS's AudioSource resamples it. "testresample -c" only does the checks. */
+
+/* Input per call, like the 10 ms packets AudioSource gets */
+#define CHUNK_MS 10
+#define SECONDS 2
+
+/* Largest difference allowed between the interleaved path's output and a separate state's,
+   for a full-scale signal of +/-1. The FMA version rounds differently. */
+#define TOLERANCE 1e-5f
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+static unsigned int seed = 1;
+
+/* Uniform in [-1, 1), the same sequence everywhere */
+static float rand_float(void)
+{
+   seed = seed*1664525 + 1013904223;
+   return (int)(seed>>8) / 8388608.f - 1.f;
+}
+
+/* A different tone and some noise in each channel */
+static void make_signal(float *x, int frames, int channels, int rate)
+{
+   int i, c;
+   for (i=0;i<frames;i++)
+   {
+      for (c=0;c<channels;c++)
+         x[i*channels+c] = .7f*sin(2*M_PI*(440.f+110.f*c)*i/rate) + .1f*rand_float();
+   }
+}
+
+/* Resamples all of in, CHUNK_MS at a time. Returns the number of output frames. */
+static int run_interleaved(SpeexResamplerState *st, const float *in, int frames, int channels, int rate, float *out)
+{
+   int chunk = rate*CHUNK_MS/1000;
+   int done = 0, produced = 0;
+   while (done + chunk <= frames)
+   {
+      spx_uint32_t in_len = chunk, out_len = 4*chunk;
+      speex_resampler_process_interleaved_float(st, in+done*channels, &in_len, out+produced*channels, &out_len);
+      done += in_len;
+      produced += out_len;
+   }
+   return produced;
+}
+
+static int run_channel(SpeexResamplerState *st, const float *in, int frames, int channels, int channel, int rate, float *out)
+{
+   int chunk = rate*CHUNK_MS/1000;
+   int done = 0, produced = 0;
+   speex_resampler_set_input_stride(st, channels);
+   speex_resampler_set_output_stride(st, channels);
+   while (done + chunk <= frames)
+   {
+      spx_uint32_t in_len = chunk, out_len = 4*chunk;
+      speex_resampler_process_float(st, 0, in+done*channels+channel, &in_len, out+produced*channels+channel, &out_len);
+      done += in_len;
+      produced += out_len;
+   }
+   return produced;
+}
+
+static int check_ratio(int in_rate, int out_rate, int quality, int channels)
+{
+   int frames = SECONDS*in_rate;
+   float *in = malloc(frames*channels*sizeof(float));
+   float *out = malloc(4*frames*channels*sizeof(float));
+   float *ref = malloc(4*frames*channels*sizeof(float));
+   SpeexResamplerState *st = speex_resampler_init(channels, in_rate, out_rate, quality, NULL);
+   float err = 0;
+   int n, ref_len = 0, c, i, failed;
+
+   make_signal(in, frames, channels, in_rate);
+   n = run_interleaved(st, in, frames, channels, in_rate, out);
+   speex_resampler_destroy(st);
+   for (c=0;c<channels;c++)
+   {
+      st = speex_resampler_init(1, in_rate, out_rate, quality, NULL);
+      ref_len = run_channel(st, in, frames, channels, c, in_rate, ref);
+      speex_resampler_destroy(st);
+   }
+   for (i=0;i<n*channels && i<ref_len*channels;i++)
+   {
+      if (fabs(out[i]-ref[i]) > err)
+         err = fabs(out[i]-ref[i]);
+   }
+   failed = n != ref_len || !(err <= TOLERANCE);
+   printf("%5d -> %5d Hz, quality %2d, %d channels: %d frames, differs by up to %.3g: %s\n", in_rate, out_rate,
+          quality, channels, n, err, failed ? "FAILED" : "ok");
+   free(in);
+   free(out);
+   free(ref);
+   return failed;
+}
+
+#define TIME_SPEEX_CHANNELS 0
+#define TIME_SPEEX_INTERLEAVED 1
+#define TIME_LIBSAMPLERATE 2
+
+/* Best time over a few rounds to resample CHUNK_MS of stereo input, in us */
+static double time_stereo(int in_rate, int out_rate, int quality, int method)
+{
+   int chunk = in_rate*CHUNK_MS/1000;
+   int frames = SECONDS*in_rate/chunk*chunk;
+   float *in = malloc(2*frames*sizeof(float));
+   float *out = malloc(2*4*chunk*sizeof(float));
+   SpeexResamplerState *st = NULL;
+#ifdef HAVE_LIBSAMPLERATE
+   SRC_STATE *src = NULL;
+   int err;
+#endif
+   double best = 0;
+   int pos = 0, round;
+
+   make_signal(in, frames, 2, in_rate);
+   if (method == TIME_SPEEX_CHANNELS)
+   {
+      /* What speex_resampler_process_interleaved_float() did before: one channel after the
+         other, each in a strided pass over the input */
+      st = speex_resampler_init(2, in_rate, out_rate, quality, NULL);
+      speex_resampler_set_input_stride(st, 2);
+      speex_resampler_set_output_stride(st, 2);
+   } else if (method == TIME_SPEEX_INTERLEAVED)
+   {
+      st = speex_resampler_init(2, in_rate, out_rate, quality, NULL);
+   }
+#ifdef HAVE_LIBSAMPLERATE
+   else
+      src = src_new(SRC_SINC_FASTEST, 2, &err);
+#endif
+
+   for (round=0;round<5;round++)
+   {
+      clock_t start = clock(), elapsed;
+      int runs = 0;
+      double us;
+      do {
+         spx_uint32_t in_len = chunk, out_len = 4*chunk;
+         if (method == TIME_SPEEX_CHANNELS)
+         {
+            speex_resampler_process_float(st, 0, in+2*pos, &in_len, out, &out_len);
+            in_len = chunk;
+            out_len = 4*chunk;
+            speex_resampler_process_float(st, 1, in+2*pos+1, &in_len, out+1, &out_len);
+         } else if (method == TIME_SPEEX_INTERLEAVED)
+         {
+            speex_resampler_process_interleaved_float(st, in+2*pos, &in_len, out, &out_len);
+         }
+#ifdef HAVE_LIBSAMPLERATE
+         else
+         {
+            /* As AudioSource::InitAudioData() sets it up */
+            SRC_DATA data;
+            data.src_ratio = (double)out_rate/in_rate;
+            data.data_in = in+2*pos;
+            data.input_frames = chunk;
+            data.data_out = out;
+            data.output_frames = 4*chunk;
+            data.end_of_input = 0;
+            src_process(src, &data);
+         }
+#endif
+         pos = (pos+chunk)%frames;
+         runs++;
+         elapsed = clock()-start;
+      } while (elapsed < CLOCKS_PER_SEC/20);
+      us = 1e6*elapsed/CLOCKS_PER_SEC/runs;
+      if (round == 0 || us < best)
+         best = us;
+   }
+
+   if (st)
+      speex_resampler_destroy(st);
+#ifdef HAVE_LIBSAMPLERATE
+   if (src)
+      src_delete(src);
+#endif
+   free(in);
+   free(out);
+   return best;
+}
+
+int main(int argc, char **argv)
+{
+   static const int ratios[][2] = {{16000, 48000}, {44100, 48000}, {48000, 44100}, {48000, 16000}};
+   static const int qualities[] = {0, 3, 5, 8};
+   int n, q, failed = 0;
+   int check_only = argc > 1 && strcmp(argv[1], "-c") == 0;
+
+   printf("Interleaved resampling compared to one state per channel:\n");
+   for (n=0;n<(int)(sizeof(ratios)/sizeof(ratios[0]));n++)
+   {
+      for (q=0;q<(int)(sizeof(qualities)/sizeof(qualities[0]));q++)
+      {
+         failed |= check_ratio(ratios[n][0], ratios[n][1], qualities[q], 2);
+         failed |= check_ratio(ratios[n][0], ratios[n][1], qualities[q], 3);
+      }
+   }
+
+   if (!check_only)
+   {
+      printf("\n%d ms of stereo input, us:\n", CHUNK_MS);
+      printf("        rates  quality  per channel  interleaved");
+#ifdef HAVE_LIBSAMPLERATE
+      printf("  SRC_SINC_FASTEST");
+#endif
+      printf("\n");
+      for (n=0;n<(int)(sizeof(ratios)/sizeof(ratios[0]));n++)
+      {
+         for (q=1;q<(int)(sizeof(qualities)/sizeof(qualities[0]));q++)
+         {
+            printf("%5d->%5d%9d%13.2f%13.2f", ratios[n][0], ratios[n][1], qualities[q],
+                   time_stereo(ratios[n][0], ratios[n][1], qualities[q], TIME_SPEEX_CHANNELS),
+                   time_stereo(ratios[n][0], ratios[n][1], qualities[q], TIME_SPEEX_INTERLEAVED));
+#ifdef HAVE_LIBSAMPLERATE
+            if (q == 1)
+               printf("%18.2f", time_stereo(ratios[n][0], ratios[n][1], 0, TIME_LIBSAMPLERATE));
+#endif
+            printf("\n");
+            fflush(stdout);
+         }
+      }
+   }
+   return failed;
+}
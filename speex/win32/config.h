@@ -11,7 +11,7 @@
 /* Default to floating point */
 #ifndef FIXED_POINT
 #  define FLOATING_POINT
-#  define USE_SMALLFT
+#  define USE_REALFFT
 #else
 #  define USE_KISS_FFT
 #endif